@@ -36,8 +36,14 @@ NOTE:   String length must be evenly divisible by 16byte (str_len % 16 == 0)
 /* Includes:                                                                 */
 /*****************************************************************************/
 #include <string.h> // CBC mode, for memset
+#include <pthread.h>
 #include "aes.h"
 
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define AES_X86_KERNELS 1
+#include <immintrin.h>
+#endif
+
 /*****************************************************************************/
 /* Defines:                                                                  */
 /*****************************************************************************/
@@ -216,14 +222,21 @@ static void KeyExpansion(uint8_t* RoundKey, const uint8_t* Key)
   }
 }
 
+#if defined(CBC) && (CBC == 1)
+static void InvKeyExpansion(uint8_t* DecRoundKey, const uint8_t* RoundKey);
+#else
+#define InvKeyExpansion(DecRoundKey, RoundKey)
+#endif
+
 void AES_init_ctx(struct AES_ctx* ctx, const uint8_t* key)
 {
   KeyExpansion(ctx->RoundKey, key);
+  InvKeyExpansion(ctx->DecRoundKey, ctx->RoundKey);
 }
 #if (defined(CBC) && (CBC == 1)) || (defined(CTR) && (CTR == 1))
 void AES_init_ctx_iv(struct AES_ctx* ctx, const uint8_t* key, const uint8_t* iv)
 {
-  KeyExpansion(ctx->RoundKey, key);
+  AES_init_ctx(ctx, key);
   memcpy (ctx->Iv, iv, AES_BLOCKLEN);
 }
 void AES_ctx_set_iv(struct AES_ctx* ctx, const uint8_t* iv)
@@ -461,6 +474,24 @@ static void InvCipher(state_t* state, const uint8_t* RoundKey)
 }
 #endif // #if (defined(CBC) && CBC == 1) || (defined(ECB) && ECB == 1)
 
+#if defined(CBC) && (CBC == 1)
+// The round keys for the equivalent inverse cipher (FIPS-197 5.3.5), which
+// the T-table and AES-NI decryption use: the encryption keys in reverse
+// order, with InvMixColumns applied to all but the first and last.
+static void InvKeyExpansion(uint8_t* DecRoundKey, const uint8_t* RoundKey)
+{
+  uint8_t round;
+
+  memcpy(DecRoundKey, RoundKey + Nr * AES_BLOCKLEN, AES_BLOCKLEN);
+  for (round = 1; round < Nr; ++round)
+  {
+    memcpy(DecRoundKey + round * AES_BLOCKLEN, RoundKey + (Nr - round) * AES_BLOCKLEN, AES_BLOCKLEN);
+    InvMixColumns((state_t*)(DecRoundKey + round * AES_BLOCKLEN));
+  }
+  memcpy(DecRoundKey + Nr * AES_BLOCKLEN, RoundKey, AES_BLOCKLEN);
+}
+#endif
+
 /*****************************************************************************/
 /* Public functions:                                                         */
 /*****************************************************************************/
@@ -498,34 +529,371 @@ static void XorWithIv(uint8_t* buf, const uint8_t* Iv)
   }
 }
 
-void AES_CBC_encrypt_buffer(struct AES_ctx *ctx, uint8_t* buf, size_t length)
+/*****************************************************************************/
+/* CBC kernels:                                                              */
+/*****************************************************************************/
+// Three implementations of CBC sit behind the public functions: the byte
+// oriented code above, 32 bit T-tables, and AES-NI. Each takes whole blocks,
+// lets out == in, and leaves the last ciphertext block in ctx->Iv so calls
+// can be chained over a stream.
+
+typedef void (*cbc_fn)(struct AES_ctx* ctx, uint8_t* out, const uint8_t* in, size_t nblocks);
+
+static void cbc_encrypt_byte(struct AES_ctx* ctx, uint8_t* out, const uint8_t* in, size_t nblocks)
 {
-  size_t i;
-  uint8_t *Iv = ctx->Iv;
-  for (i = 0; i < length; i += AES_BLOCKLEN)
+  const uint8_t* Iv = ctx->Iv;
+  for (; nblocks; --nblocks)
   {
-    XorWithIv(buf, Iv);
-    Cipher((state_t*)buf, ctx->RoundKey);
-    Iv = buf;
-    buf += AES_BLOCKLEN;
+    memmove(out, in, AES_BLOCKLEN);
+    XorWithIv(out, Iv);
+    Cipher((state_t*)out, ctx->RoundKey);
+    Iv = out;
+    in += AES_BLOCKLEN;
+    out += AES_BLOCKLEN;
   }
-  /* store Iv in ctx for next call */
-  memcpy(ctx->Iv, Iv, AES_BLOCKLEN);
+  memmove(ctx->Iv, Iv, AES_BLOCKLEN);
 }
 
-void AES_CBC_decrypt_buffer(struct AES_ctx* ctx, uint8_t* buf, size_t length)
+static void cbc_decrypt_byte(struct AES_ctx* ctx, uint8_t* out, const uint8_t* in, size_t nblocks)
 {
-  size_t i;
   uint8_t storeNextIv[AES_BLOCKLEN];
-  for (i = 0; i < length; i += AES_BLOCKLEN)
+  for (; nblocks; --nblocks)
   {
-    memcpy(storeNextIv, buf, AES_BLOCKLEN);
-    InvCipher((state_t*)buf, ctx->RoundKey);
-    XorWithIv(buf, ctx->Iv);
+    memcpy(storeNextIv, in, AES_BLOCKLEN);
+    memmove(out, in, AES_BLOCKLEN);
+    InvCipher((state_t*)out, ctx->RoundKey);
+    XorWithIv(out, ctx->Iv);
     memcpy(ctx->Iv, storeNextIv, AES_BLOCKLEN);
-    buf += AES_BLOCKLEN;
+    in += AES_BLOCKLEN;
+    out += AES_BLOCKLEN;
+  }
+}
+
+// The T-tables fold SubBytes, ShiftRows and MixColumns into four lookups
+// per column. They are built from the S-boxes on first use. Table lookups
+// leak their indices through the cache, so this is only the fallback for
+// cpus without AES-NI.
+static uint32_t Te[4][256], Td[4][256];
+static pthread_once_t ttables_once = PTHREAD_ONCE_INIT;
+
+#define GETU32(p) ((uint32_t)(p)[0] << 24 | (uint32_t)(p)[1] << 16 | (uint32_t)(p)[2] << 8 | (uint32_t)(p)[3])
+#define PUTU32(p, v) ((p)[0] = (uint8_t)((v) >> 24), (p)[1] = (uint8_t)((v) >> 16), \
+                      (p)[2] = (uint8_t)((v) >> 8), (p)[3] = (uint8_t)(v))
+#define ROR8(x) ((x) >> 8 | (x) << 24)
+
+static void build_ttables(void)
+{
+  uint32_t e, d;
+  int i, t;
+  for (i = 0; i < 256; ++i)
+  {
+    uint8_t s = sbox[i], si = rsbox[i];
+    e = (uint32_t)xtime(s) << 24 | (uint32_t)s << 16 | (uint32_t)s << 8 | (uint32_t)(xtime(s) ^ s);
+    d = (uint32_t)Multiply(si, 0x0e) << 24 | (uint32_t)Multiply(si, 0x09) << 16 |
+        (uint32_t)Multiply(si, 0x0d) << 8 | (uint32_t)Multiply(si, 0x0b);
+    for (t = 0; t < 4; ++t)
+    {
+      Te[t][i] = e;
+      Td[t][i] = d;
+      e = ROR8(e);
+      d = ROR8(d);
+    }
+  }
+}
+
+static void load_round_keys(uint32_t rk[4 * (Nr + 1)], const uint8_t* RoundKey)
+{
+  int i;
+  for (i = 0; i < 4 * (Nr + 1); ++i)
+    rk[i] = GETU32(RoundKey + 4 * i);
+}
+
+static void cbc_encrypt_ttable(struct AES_ctx* ctx, uint8_t* out, const uint8_t* in, size_t nblocks)
+{
+  uint32_t rk[4 * (Nr + 1)];
+  uint32_t s0, s1, s2, s3, t0, t1, t2, t3;
+  uint32_t v0 = GETU32(ctx->Iv), v1 = GETU32(ctx->Iv + 4), v2 = GETU32(ctx->Iv + 8), v3 = GETU32(ctx->Iv + 12);
+  const uint32_t* k;
+  int r;
+
+  pthread_once(&ttables_once, build_ttables);
+  load_round_keys(rk, ctx->RoundKey);
+
+  for (; nblocks; --nblocks)
+  {
+    s0 = GETU32(in) ^ v0 ^ rk[0];
+    s1 = GETU32(in + 4) ^ v1 ^ rk[1];
+    s2 = GETU32(in + 8) ^ v2 ^ rk[2];
+    s3 = GETU32(in + 12) ^ v3 ^ rk[3];
+
+    for (r = 1, k = rk + 4; r < Nr; ++r, k += 4)
+    {
+      t0 = Te[0][s0 >> 24] ^ Te[1][(s1 >> 16) & 0xff] ^ Te[2][(s2 >> 8) & 0xff] ^ Te[3][s3 & 0xff] ^ k[0];
+      t1 = Te[0][s1 >> 24] ^ Te[1][(s2 >> 16) & 0xff] ^ Te[2][(s3 >> 8) & 0xff] ^ Te[3][s0 & 0xff] ^ k[1];
+      t2 = Te[0][s2 >> 24] ^ Te[1][(s3 >> 16) & 0xff] ^ Te[2][(s0 >> 8) & 0xff] ^ Te[3][s1 & 0xff] ^ k[2];
+      t3 = Te[0][s3 >> 24] ^ Te[1][(s0 >> 16) & 0xff] ^ Te[2][(s1 >> 8) & 0xff] ^ Te[3][s2 & 0xff] ^ k[3];
+      s0 = t0; s1 = t1; s2 = t2; s3 = t3;
+    }
+
+    // the last round has no MixColumns, so go through the plain S-box
+    v0 = ((uint32_t)sbox[s0 >> 24] << 24 | (uint32_t)sbox[(s1 >> 16) & 0xff] << 16 |
+          (uint32_t)sbox[(s2 >> 8) & 0xff] << 8 | sbox[s3 & 0xff]) ^ k[0];
+    v1 = ((uint32_t)sbox[s1 >> 24] << 24 | (uint32_t)sbox[(s2 >> 16) & 0xff] << 16 |
+          (uint32_t)sbox[(s3 >> 8) & 0xff] << 8 | sbox[s0 & 0xff]) ^ k[1];
+    v2 = ((uint32_t)sbox[s2 >> 24] << 24 | (uint32_t)sbox[(s3 >> 16) & 0xff] << 16 |
+          (uint32_t)sbox[(s0 >> 8) & 0xff] << 8 | sbox[s1 & 0xff]) ^ k[2];
+    v3 = ((uint32_t)sbox[s3 >> 24] << 24 | (uint32_t)sbox[(s0 >> 16) & 0xff] << 16 |
+          (uint32_t)sbox[(s1 >> 8) & 0xff] << 8 | sbox[s2 & 0xff]) ^ k[3];
+
+    PUTU32(out, v0); PUTU32(out + 4, v1); PUTU32(out + 8, v2); PUTU32(out + 12, v3);
+    in += AES_BLOCKLEN;
+    out += AES_BLOCKLEN;
   }
 
+  PUTU32(ctx->Iv, v0); PUTU32(ctx->Iv + 4, v1); PUTU32(ctx->Iv + 8, v2); PUTU32(ctx->Iv + 12, v3);
+}
+
+static void cbc_decrypt_ttable(struct AES_ctx* ctx, uint8_t* out, const uint8_t* in, size_t nblocks)
+{
+  uint32_t rk[4 * (Nr + 1)];
+  uint32_t s0, s1, s2, s3, t0, t1, t2, t3, c0, c1, c2, c3;
+  uint32_t v0 = GETU32(ctx->Iv), v1 = GETU32(ctx->Iv + 4), v2 = GETU32(ctx->Iv + 8), v3 = GETU32(ctx->Iv + 12);
+  const uint32_t* k;
+  int r;
+
+  pthread_once(&ttables_once, build_ttables);
+  load_round_keys(rk, ctx->DecRoundKey);
+
+  for (; nblocks; --nblocks)
+  {
+    c0 = GETU32(in); c1 = GETU32(in + 4); c2 = GETU32(in + 8); c3 = GETU32(in + 12);
+    s0 = c0 ^ rk[0];
+    s1 = c1 ^ rk[1];
+    s2 = c2 ^ rk[2];
+    s3 = c3 ^ rk[3];
+
+    for (r = 1, k = rk + 4; r < Nr; ++r, k += 4)
+    {
+      t0 = Td[0][s0 >> 24] ^ Td[1][(s3 >> 16) & 0xff] ^ Td[2][(s2 >> 8) & 0xff] ^ Td[3][s1 & 0xff] ^ k[0];
+      t1 = Td[0][s1 >> 24] ^ Td[1][(s0 >> 16) & 0xff] ^ Td[2][(s3 >> 8) & 0xff] ^ Td[3][s2 & 0xff] ^ k[1];
+      t2 = Td[0][s2 >> 24] ^ Td[1][(s1 >> 16) & 0xff] ^ Td[2][(s0 >> 8) & 0xff] ^ Td[3][s3 & 0xff] ^ k[2];
+      t3 = Td[0][s3 >> 24] ^ Td[1][(s2 >> 16) & 0xff] ^ Td[2][(s1 >> 8) & 0xff] ^ Td[3][s0 & 0xff] ^ k[3];
+      s0 = t0; s1 = t1; s2 = t2; s3 = t3;
+    }
+
+    t0 = ((uint32_t)rsbox[s0 >> 24] << 24 | (uint32_t)rsbox[(s3 >> 16) & 0xff] << 16 |
+          (uint32_t)rsbox[(s2 >> 8) & 0xff] << 8 | rsbox[s1 & 0xff]) ^ k[0] ^ v0;
+    t1 = ((uint32_t)rsbox[s1 >> 24] << 24 | (uint32_t)rsbox[(s0 >> 16) & 0xff] << 16 |
+          (uint32_t)rsbox[(s3 >> 8) & 0xff] << 8 | rsbox[s2 & 0xff]) ^ k[1] ^ v1;
+    t2 = ((uint32_t)rsbox[s2 >> 24] << 24 | (uint32_t)rsbox[(s1 >> 16) & 0xff] << 16 |
+          (uint32_t)rsbox[(s0 >> 8) & 0xff] << 8 | rsbox[s3 & 0xff]) ^ k[2] ^ v2;
+    t3 = ((uint32_t)rsbox[s3 >> 24] << 24 | (uint32_t)rsbox[(s2 >> 16) & 0xff] << 16 |
+          (uint32_t)rsbox[(s1 >> 8) & 0xff] << 8 | rsbox[s0 & 0xff]) ^ k[3] ^ v3;
+
+    PUTU32(out, t0); PUTU32(out + 4, t1); PUTU32(out + 8, t2); PUTU32(out + 12, t3);
+    v0 = c0; v1 = c1; v2 = c2; v3 = c3;
+    in += AES_BLOCKLEN;
+    out += AES_BLOCKLEN;
+  }
+
+  PUTU32(ctx->Iv, v0); PUTU32(ctx->Iv + 4, v1); PUTU32(ctx->Iv + 8, v2); PUTU32(ctx->Iv + 12, v3);
+}
+
+#ifdef AES_X86_KERNELS
+// CBC encryption chains every block on the previous one, so AES-NI can only
+// go one block at a time. Decryption has no such chain and keeps four blocks
+// in flight to cover the latency of aesdec.
+__attribute__((target("aes,sse2")))
+static void cbc_encrypt_aesni(struct AES_ctx* ctx, uint8_t* out, const uint8_t* in, size_t nblocks)
+{
+  __m128i rk[Nr + 1], b = _mm_loadu_si128((const __m128i*)ctx->Iv);
+  int r;
+
+  for (r = 0; r <= Nr; ++r)
+    rk[r] = _mm_loadu_si128((const __m128i*)(ctx->RoundKey + 16 * r));
+
+  for (; nblocks; --nblocks)
+  {
+    b = _mm_xor_si128(b, _mm_loadu_si128((const __m128i*)in));
+    b = _mm_xor_si128(b, rk[0]);
+    for (r = 1; r < Nr; ++r)
+      b = _mm_aesenc_si128(b, rk[r]);
+    b = _mm_aesenclast_si128(b, rk[Nr]);
+    _mm_storeu_si128((__m128i*)out, b);
+    in += AES_BLOCKLEN;
+    out += AES_BLOCKLEN;
+  }
+
+  _mm_storeu_si128((__m128i*)ctx->Iv, b);
+}
+
+__attribute__((target("aes,sse2")))
+static void cbc_decrypt_aesni(struct AES_ctx* ctx, uint8_t* out, const uint8_t* in, size_t nblocks)
+{
+  __m128i rk[Nr + 1], iv = _mm_loadu_si128((const __m128i*)ctx->Iv);
+  __m128i c0, c1, c2, c3, b0, b1, b2, b3;
+  int r;
+
+  for (r = 0; r <= Nr; ++r)
+    rk[r] = _mm_loadu_si128((const __m128i*)(ctx->DecRoundKey + 16 * r));
+
+  for (; nblocks >= 4; nblocks -= 4)
+  {
+    c0 = _mm_loadu_si128((const __m128i*)in);
+    c1 = _mm_loadu_si128((const __m128i*)(in + 16));
+    c2 = _mm_loadu_si128((const __m128i*)(in + 32));
+    c3 = _mm_loadu_si128((const __m128i*)(in + 48));
+    b0 = _mm_xor_si128(c0, rk[0]);
+    b1 = _mm_xor_si128(c1, rk[0]);
+    b2 = _mm_xor_si128(c2, rk[0]);
+    b3 = _mm_xor_si128(c3, rk[0]);
+    for (r = 1; r < Nr; ++r)
+    {
+      b0 = _mm_aesdec_si128(b0, rk[r]);
+      b1 = _mm_aesdec_si128(b1, rk[r]);
+      b2 = _mm_aesdec_si128(b2, rk[r]);
+      b3 = _mm_aesdec_si128(b3, rk[r]);
+    }
+    b0 = _mm_xor_si128(_mm_aesdeclast_si128(b0, rk[Nr]), iv);
+    b1 = _mm_xor_si128(_mm_aesdeclast_si128(b1, rk[Nr]), c0);
+    b2 = _mm_xor_si128(_mm_aesdeclast_si128(b2, rk[Nr]), c1);
+    b3 = _mm_xor_si128(_mm_aesdeclast_si128(b3, rk[Nr]), c2);
+    _mm_storeu_si128((__m128i*)out, b0);
+    _mm_storeu_si128((__m128i*)(out + 16), b1);
+    _mm_storeu_si128((__m128i*)(out + 32), b2);
+    _mm_storeu_si128((__m128i*)(out + 48), b3);
+    iv = c3;
+    in += 4 * AES_BLOCKLEN;
+    out += 4 * AES_BLOCKLEN;
+  }
+
+  for (; nblocks; --nblocks)
+  {
+    c0 = _mm_loadu_si128((const __m128i*)in);
+    b0 = _mm_xor_si128(c0, rk[0]);
+    for (r = 1; r < Nr; ++r)
+      b0 = _mm_aesdec_si128(b0, rk[r]);
+    b0 = _mm_xor_si128(_mm_aesdeclast_si128(b0, rk[Nr]), iv);
+    _mm_storeu_si128((__m128i*)out, b0);
+    iv = c0;
+    in += AES_BLOCKLEN;
+    out += AES_BLOCKLEN;
+  }
+
+  _mm_storeu_si128((__m128i*)ctx->Iv, iv);
+}
+#endif // AES_X86_KERNELS
+
+static int kernel_supported(enum aes_kernel kernel)
+{
+  switch (kernel) {
+  case AES_KERNEL_AUTO:
+  case AES_KERNEL_BYTE:
+  case AES_KERNEL_TTABLE:
+    return 1;
+#ifdef AES_X86_KERNELS
+  case AES_KERNEL_AESNI:
+    return __builtin_cpu_supports("aes");
+#endif
+  default:
+    return 0;
+  }
+}
+
+static enum aes_kernel best_kernel(void)
+{
+  return kernel_supported(AES_KERNEL_AESNI) ? AES_KERNEL_AESNI : AES_KERNEL_TTABLE;
+}
+
+// 0 means not selected yet; selection is idempotent, so racing threads
+// just agree on the same answer
+static enum aes_kernel selected_kernel;
+
+static enum aes_kernel current_kernel(void)
+{
+  if (selected_kernel == AES_KERNEL_AUTO)
+    selected_kernel = best_kernel();
+  return selected_kernel;
+}
+
+int aes_kernel_supported(enum aes_kernel kernel)
+{
+  return kernel_supported(kernel);
+}
+
+const char *aes_kernel_name(enum aes_kernel kernel)
+{
+  switch (kernel == AES_KERNEL_AUTO ? current_kernel() : kernel) {
+  case AES_KERNEL_BYTE: return "byte";
+  case AES_KERNEL_TTABLE: return "ttable";
+  case AES_KERNEL_AESNI: return "aesni";
+  default: return "unknown";
+  }
+}
+
+int aes_set_kernel(enum aes_kernel kernel)
+{
+  if (!kernel_supported(kernel))
+    return 0;
+  selected_kernel = kernel == AES_KERNEL_AUTO ? best_kernel() : kernel;
+  return 1;
+}
+
+static cbc_fn cbc_encrypt_kernel(void)
+{
+  switch (current_kernel()) {
+#ifdef AES_X86_KERNELS
+  case AES_KERNEL_AESNI: return cbc_encrypt_aesni;
+#endif
+  case AES_KERNEL_TTABLE: return cbc_encrypt_ttable;
+  default: return cbc_encrypt_byte;
+  }
+}
+
+static cbc_fn cbc_decrypt_kernel(void)
+{
+  switch (current_kernel()) {
+#ifdef AES_X86_KERNELS
+  case AES_KERNEL_AESNI: return cbc_decrypt_aesni;
+#endif
+  case AES_KERNEL_TTABLE: return cbc_decrypt_ttable;
+  default: return cbc_decrypt_byte;
+  }
+}
+
+void AES_CBC_encrypt(struct AES_ctx* ctx, uint8_t* out, const uint8_t* in, size_t length)
+{
+  cbc_encrypt_kernel()(ctx, out, in, length / AES_BLOCKLEN);
+}
+
+void AES_CBC_decrypt(struct AES_ctx* ctx, uint8_t* out, const uint8_t* in, size_t length)
+{
+  cbc_decrypt_kernel()(ctx, out, in, length / AES_BLOCKLEN);
+}
+
+size_t AES_CBC_encrypt_final(struct AES_ctx* ctx, uint8_t* out, const uint8_t* in, size_t length)
+{
+  uint8_t last[AES_BLOCKLEN];
+  size_t full = length - length % AES_BLOCKLEN;
+  uint8_t padding = AES_BLOCKLEN - length % AES_BLOCKLEN;
+
+  // copy the tail out before the full blocks are written, in case out == in
+  memcpy(last, in + full, length - full);
+  memset(last + (length - full), padding, padding);
+
+  AES_CBC_encrypt(ctx, out, in, full);
+  AES_CBC_encrypt(ctx, out + full, last, AES_BLOCKLEN);
+  return full + AES_BLOCKLEN;
+}
+
+void AES_CBC_encrypt_buffer(struct AES_ctx *ctx, uint8_t* buf, size_t length)
+{
+  AES_CBC_encrypt(ctx, buf, buf, length);
+}
+
+void AES_CBC_decrypt_buffer(struct AES_ctx* ctx, uint8_t* buf, size_t length)
+{
+  AES_CBC_decrypt(ctx, buf, buf, length);
 }
 
 #endif // #if defined(CBC) && (CBC == 1)
@@ -44,6 +44,9 @@
 struct AES_ctx
 {
   uint8_t RoundKey[AES_keyExpSize];
+#if defined(CBC) && (CBC == 1)
+  uint8_t DecRoundKey[AES_keyExpSize];
+#endif
 #if (defined(CBC) && (CBC == 1)) || (defined(CTR) && (CTR == 1))
   uint8_t Iv[AES_BLOCKLEN];
 #endif
@@ -73,6 +76,32 @@ void AES_ECB_decrypt(const struct AES_ctx* ctx, uint8_t* buf);
 void AES_CBC_encrypt_buffer(struct AES_ctx* ctx, uint8_t* buf, size_t length);
 void AES_CBC_decrypt_buffer(struct AES_ctx* ctx, uint8_t* buf, size_t length);
 
+// Streaming CBC from `in` to `out`, which may be the same buffer but must not
+// otherwise overlap. length is a multiple of AES_BLOCKLEN; ctx->Iv carries
+// the chain over to the next call, so a message can be fed in pieces.
+void AES_CBC_encrypt(struct AES_ctx* ctx, uint8_t* out, const uint8_t* in, size_t length);
+void AES_CBC_decrypt(struct AES_ctx* ctx, uint8_t* out, const uint8_t* in, size_t length);
+
+// Encrypt the rest of a message, any length, and its PKCS#7 padding.
+// Writes and returns length rounded up to the next whole block, which is
+// always at least one byte more than length.
+size_t AES_CBC_encrypt_final(struct AES_ctx* ctx, uint8_t* out, const uint8_t* in, size_t length);
+
+// CBC is done with AES-NI when the cpu has it and with T-tables otherwise.
+// The byte oriented reference code stays selectable for tests and
+// benchmarks. aes_set_kernel() isn't thread safe.
+enum aes_kernel {
+  AES_KERNEL_AUTO,
+  AES_KERNEL_BYTE,
+  AES_KERNEL_TTABLE,
+  AES_KERNEL_AESNI,
+  AES_KERNEL_COUNT
+};
+
+int aes_kernel_supported(enum aes_kernel kernel);
+const char *aes_kernel_name(enum aes_kernel kernel);
+int aes_set_kernel(enum aes_kernel kernel);
+
 #endif // #if defined(CBC) && (CBC == 1)
 
 
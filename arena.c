@@ -0,0 +1,86 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "arena.h"
+
+#define ARENA_ALIGN 16
+#define ARENA_MIN_BLOCK 4096
+
+struct arena_block {
+	struct arena_block *next;
+	size_t size, used;
+	/* pads the header to four words so data stays aligned */
+	size_t pad;
+	unsigned char data[];
+};
+
+void arena_init(struct arena *a)
+{
+	a->head = NULL;
+}
+
+void *arena_alloc(struct arena *a, size_t size)
+{
+	struct arena_block *b = a->head;
+	size_t bsize;
+	void *p;
+
+	size = (size + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+
+	if (!b || b->size - b->used < size) {
+		bsize = b ? b->size * 2 : ARENA_MIN_BLOCK;
+		while (bsize < size)
+			bsize *= 2;
+
+		if (!(b = malloc(sizeof(*b) + bsize)))
+			return NULL;
+
+		b->size = bsize;
+		b->used = 0;
+		b->next = a->head;
+		a->head = b;
+	}
+
+	p = b->data + b->used;
+	b->used += size;
+	return p;
+}
+
+char *arena_strdup(struct arena *a, const char *str)
+{
+	size_t len = strlen(str) + 1;
+	char *p;
+
+	if ((p = arena_alloc(a, len)))
+		memcpy(p, str, len);
+	return p;
+}
+
+void arena_reset(struct arena *a)
+{
+	struct arena_block *b, *next;
+
+	if (!a->head)
+		return;
+
+	/* the head is always the largest block */
+	for (b = a->head->next; b; b = next) {
+		next = b->next;
+		free(b);
+	}
+
+	a->head->next = NULL;
+	a->head->used = 0;
+}
+
+void arena_free(struct arena *a)
+{
+	struct arena_block *b, *next;
+
+	for (b = a->head; b; b = next) {
+		next = b->next;
+		free(b);
+	}
+
+	a->head = NULL;
+}
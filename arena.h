@@ -0,0 +1,28 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+
+/* A bump allocator for everything that lives as long as one event: tags,
+ * tag elements and serialization buffers. Memory comes from a chain of
+ * blocks that double in size, so pointers stay valid as it grows, and it
+ * is all released by one arena_free(). arena_reset() keeps the largest
+ * block around, so reusing an arena for event after event stops calling
+ * malloc once it has grown to fit. */
+struct arena_block;
+
+struct arena {
+	struct arena_block *head;
+};
+
+void arena_init(struct arena *a);
+
+/* 16 byte aligned, NULL when out of memory */
+void *arena_alloc(struct arena *a, size_t size);
+
+char *arena_strdup(struct arena *a, const char *str);
+
+void arena_reset(struct arena *a);
+void arena_free(struct arena *a);
+
+#endif
@@ -1,5 +1,6 @@
 /* Licensed under BSD-MIT - see LICENSE file for details */
 #include "base64.h"
+#include "codec.h"
 
 #include <errno.h>
 #include <string.h>
@@ -97,6 +98,11 @@ ssize_t base64_encode_using_maps(const base64_maps_t *maps,
 		return -1;
 	}
 
+	if (maps == &base64_maps_rfc4648) {
+		src_offset = codec_base64_encode_blocks((const unsigned char *)src, srclen, dest);
+		dest_offset = src_offset / 3 * 4;
+	}
+
 	while (srclen - src_offset >= 3) {
 		base64_encode_triplet_using_maps(maps, &dest[dest_offset], &src[src_offset]);
 		src_offset += 3;
@@ -185,7 +191,15 @@ ssize_t base64_decode_using_maps(const base64_maps_t *maps,
 		return -1;
 	}
 
-	for(i=0; srclen - i > 4; i+=4) {
+	/* the vector kernels stop early on a bad block, the scalar loop
+	 * below then finds the error */
+	i = 0;
+	if (maps == &base64_maps_rfc4648) {
+		i = codec_base64_decode_blocks(src, srclen, (unsigned char *)dest);
+		dest_offset = i / 4 * 3;
+	}
+
+	for(; srclen - i > 4; i+=4) {
 		if (base64_decode_quartet_using_maps(maps, &dest[dest_offset], &src[i]) == -1) {
 			return -1;
 		}
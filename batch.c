@@ -0,0 +1,1110 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <time.h>
+#include <errno.h>
+#include <unistd.h>
+#include <limits.h>
+#include <sys/uio.h>
+
+#include "secp256k1.h"
+#include "secp256k1_extrakeys.h"
+#include "secp256k1_schnorrsig.h"
+
+#include "cursor.h"
+#include "hex.h"
+#include "random.h"
+#include "event.h"
+#include "json.h"
+#include "mine.h"
+#include "workq.h"
+#include "cache.h"
+#include "dm.h"
+#include "base64.h"
+#include "gen.h"
+#include "patch.h"
+#include "batch.h"
+
+/* limits.h only has it with _XOPEN_SOURCE, POSIX guarantees 16 */
+#ifndef IOV_MAX
+#define IOV_MAX 16
+#endif
+
+/* output pieces at least this big, event content mostly, are handed to
+ * writev where they are rather than copied into the output buffer */
+#define SPLICE_MIN 1024
+
+struct splice {
+	/* the piece goes after this many bytes of out */
+	size_t at;
+	const void *p;
+	size_t len;
+};
+
+/* a batch is closed after this many lines or bytes, whichever comes first */
+#define BATCH_LINES 256
+#define BATCH_BYTES (1 << 20)
+
+/* batches in flight per worker */
+#define BATCH_DEPTH 2
+
+struct batch {
+	char *in;
+	size_t in_len, in_cap;
+	int nlines;
+	uint64_t first_line;
+
+	unsigned char *out;
+	size_t out_len, out_cap;
+	int nok, nbad;
+
+	/* big pieces of output that stay in the arena, see batch_splice */
+	struct splice *splices;
+	int nsplices, splices_cap;
+
+	/* events of this batch, reset when the next one starts so spliced
+	 * pieces live until the output is written */
+	struct arena arena;
+
+	/* events made by the reader rather than parsed from in, see
+	 * read_patches */
+	struct nostr_event *events;
+};
+
+struct sign_state {
+	const secp256k1_context *ctx;
+	struct key *key;
+	struct batch_opts *opts;
+};
+
+struct verify_state {
+	const secp256k1_context *ctx;
+};
+
+struct dm_state {
+	const secp256k1_context *ctx;
+	struct key *key;
+	struct nostr_event *tmpl;
+	struct batch_opts *opts;
+};
+
+struct decrypt_state {
+	const secp256k1_context *ctx;
+	struct key *key;
+	struct cache *secrets;
+};
+
+static void batch_free(struct batch *b)
+{
+	if (!b)
+		return;
+	free(b->in);
+	free(b->out);
+	free(b->splices);
+	arena_free(&b->arena);
+	free(b);
+}
+
+static int batch_reserve(struct batch *b, size_t n)
+{
+	unsigned char *out;
+	size_t cap;
+
+	if (b->out_cap - b->out_len >= n)
+		return 1;
+
+	for (cap = b->out_cap ? b->out_cap : 4096; cap - b->out_len < n; cap *= 2)
+		;
+
+	if (!(out = realloc(b->out, cap)))
+		return 0;
+
+	b->out = out;
+	b->out_cap = cap;
+	return 1;
+}
+
+static void batch_start_out(struct batch *b)
+{
+	b->out_len = 0;
+	b->nsplices = 0;
+	b->nok = b->nbad = 0;
+}
+
+static void batch_start(struct batch *b)
+{
+	batch_start_out(b);
+	arena_reset(&b->arena);
+}
+
+/* aux randomness for line n: the batch's random draw with n mixed in, so
+ * every event gets its own without a draw per line */
+static void line_aux(unsigned char aux[32], const unsigned char base[32], uint64_t n)
+{
+	int i;
+
+	memcpy(aux, base, 32);
+	for (i = 0; i < 8; i++)
+		aux[i] ^= n >> (i * 8);
+}
+
+/* append a piece of output, copied if it's small */
+static int batch_splice(struct batch *b, const void *p, size_t len)
+{
+	struct splice *sp;
+	int cap;
+
+	if (len < SPLICE_MIN) {
+		if (!batch_reserve(b, len))
+			return 0;
+		memcpy(b->out + b->out_len, p, len);
+		b->out_len += len;
+		return 1;
+	}
+
+	if (b->nsplices == b->splices_cap) {
+		cap = b->splices_cap ? b->splices_cap * 2 : 16;
+		if (!(sp = realloc(b->splices, cap * sizeof(*sp))))
+			return 0;
+		b->splices = sp;
+		b->splices_cap = cap;
+	}
+
+	sp = &b->splices[b->nsplices++];
+	sp->at = b->out_len;
+	sp->p = p;
+	sp->len = len;
+	return 1;
+}
+
+/* append the event as a json line, or nothing at all on failure */
+static int batch_push_event(struct batch *b, struct nostr_event *ev, int envelope)
+{
+	struct iovec iov[EVENT_IOV];
+	size_t out_len = b->out_len;
+	int i, nsplices = b->nsplices;
+
+	if (!event_json_iov(ev, envelope, iov))
+		return 0;
+
+	for (i = 0; i < EVENT_IOV; i++) {
+		if (!batch_splice(b, iov[i].iov_base, iov[i].iov_len))
+			break;
+	}
+
+	if (i == EVENT_IOV && batch_splice(b, "\n", 1))
+		return 1;
+
+	b->out_len = out_len;
+	b->nsplices = nsplices;
+	return 0;
+}
+
+/* fill b with the next batch of input, returns 0 at end of input and -1
+ * on an error, after reporting it */
+typedef int batch_read_fn(void *src, struct batch *b);
+
+struct line_src {
+	FILE *in;
+	char *line;
+	size_t linecap;
+};
+
+/* read up to BATCH_LINES lines into b, returns 0 at end of input and -1
+ * if reading failed */
+static int read_batch(FILE *in, struct batch *b, char **line, size_t *linecap)
+{
+	ssize_t len;
+	char *buf;
+	size_t cap;
+
+	b->in_len = 0;
+	b->nlines = 0;
+
+	while (b->nlines < BATCH_LINES && b->in_len < BATCH_BYTES) {
+		if ((len = getline(line, linecap, in)) == -1) {
+			if (feof(in))
+				return 0;
+			fprintf(stderr, "error reading input: %s\n", strerror(errno));
+			return -1;
+		}
+
+		if ((*line)[len-1] == '\n')
+			len--;
+
+		if (b->in_cap - b->in_len < (size_t)len + 1) {
+			for (cap = b->in_cap ? b->in_cap : 4096; cap - b->in_len < (size_t)len + 1; cap *= 2)
+				;
+			if (!(buf = realloc(b->in, cap))) {
+				fprintf(stderr, "out of memory\n");
+				return -1;
+			}
+			b->in = buf;
+			b->in_cap = cap;
+		}
+
+		memcpy(b->in + b->in_len, *line, len);
+		b->in_len += len;
+		b->in[b->in_len++] = '\n';
+		b->nlines++;
+	}
+
+	return 1;
+}
+
+static int sign_line(struct sign_state *st, struct batch *b, char *line,
+		     int len, unsigned char aux[32])
+{
+	struct nostr_event ev;
+	int fields;
+
+	event_init(&ev, &b->arena);
+
+	if (!parse_event(line, len, &ev, &fields))
+		return 0;
+
+	if (!(fields & EVENT_HAS_CONTENT))
+		ev.content = "";
+	if (!(fields & EVENT_HAS_CREATED_AT))
+		ev.created_at = st->opts->created_at ? st->opts->created_at : (uint64_t)time(NULL);
+	if (!(fields & EVENT_HAS_KIND))
+		ev.kind = st->opts->kind;
+	memcpy(ev.pubkey, st->key->pubkey, 32);
+
+	if (!event_id(&ev) ||
+	    !secp256k1_schnorrsig_sign32(st->ctx, ev.sig, ev.id, &st->key->pair, aux))
+		return 0;
+
+	return batch_push_event(b, &ev, st->opts->envelope);
+}
+
+static void sign_batch(void *job, void *data)
+{
+	struct sign_state *st = data;
+	struct batch *b = job;
+	unsigned char base[32], aux[32];
+	char *line, *nl, *end;
+	int i, len, n;
+
+	batch_start(b);
+
+	/* aux randomness only hardens the nonce against side channels, so one
+	 * draw per batch is enough as long as each event gets its own */
+	if (!fill_random(base, sizeof(base)))
+		memset(base, 0, sizeof(base));
+
+	line = b->in;
+	end = b->in + b->in_len;
+
+	for (i = 0; line < end; i++, line = nl + 1) {
+		nl = memchr(line, '\n', end - line);
+		len = nl - line;
+		if (len && line[len-1] == '\r')
+			len--;
+		if (!len)
+			continue;
+
+		line_aux(aux, base, b->first_line + i);
+
+		if (sign_line(st, b, line, len, aux)) {
+			b->nok++;
+			continue;
+		}
+
+		b->nbad++;
+		if (!st->opts->error_lines) {
+			fprintf(stderr, "line %" PRIu64 ": could not sign event\n",
+				b->first_line + i);
+		} else if (batch_reserve(b, 64)) {
+			n = snprintf((char *)b->out + b->out_len, b->out_cap - b->out_len,
+				     "{\"error\":\"could not sign event\"}\n");
+			b->out_len += n;
+		}
+	}
+}
+
+static int dm_line(struct dm_state *st, struct batch *b, char *line, int len,
+		   unsigned char aux[32])
+{
+	struct nostr_event ev, *tmpl = st->tmpl;
+	unsigned char recipient[32];
+	int i;
+
+	if (len != 64 || !hex_decode(line, len, recipient, 32))
+		return 0;
+
+	event_init(&ev, &b->arena);
+
+	/* the template's strings are shared read only by every worker */
+	ev.content = tmpl->content;
+	ev.created_at = tmpl->created_at;
+	ev.explicit_tags = tmpl->explicit_tags;
+	for (i = 0; i < tmpl->num_tags; i++) {
+		if (!nostr_add_tag_n(&ev, tmpl->tags[i].strs, tmpl->tags[i].num_elems))
+			return 0;
+	}
+	memcpy(ev.pubkey, st->key->pubkey, 32);
+
+	if (!make_encrypted_dm(st->ctx, st->key, &ev, recipient, st->opts->kind))
+		return 0;
+
+	if (!event_id(&ev) ||
+	    !secp256k1_schnorrsig_sign32(st->ctx, ev.sig, ev.id, &st->key->pair, aux))
+		return 0;
+
+	return batch_push_event(b, &ev, st->opts->envelope);
+}
+
+/* one DM per recipient line, ECDH and signing both happen here on the
+ * worker, with aux drawn once per batch as in sign_batch */
+static void dm_batch(void *job, void *data)
+{
+	struct dm_state *st = data;
+	struct batch *b = job;
+	unsigned char base[32], aux[32];
+	char *line, *nl, *end;
+	int i, len;
+
+	batch_start(b);
+
+	if (!fill_random(base, sizeof(base)))
+		memset(base, 0, sizeof(base));
+
+	line = b->in;
+	end = b->in + b->in_len;
+
+	for (i = 0; line < end; i++, line = nl + 1) {
+		nl = memchr(line, '\n', end - line);
+		len = nl - line;
+		while (len && (line[len-1] == '\r' || line[len-1] == ' '))
+			len--;
+		if (!len || line[0] == '#')
+			continue;
+
+		line_aux(aux, base, b->first_line + i);
+
+		if (dm_line(st, b, line, len, aux)) {
+			b->nok++;
+			continue;
+		}
+
+		b->nbad++;
+		fprintf(stderr, "line %" PRIu64 ": could not make a dm for '%.*s'\n",
+			b->first_line + i, len, line);
+	}
+}
+
+/* a signature waiting for the batch check */
+struct pending_sig {
+	unsigned char id[32];
+	unsigned char sig[64];
+	secp256k1_xonly_pubkey pubkey;
+	int line;
+};
+
+/* Check everything but the signature. On success the signature is queued
+ * in *p for verify_batch. */
+static const char *check_line(const secp256k1_context *ctx, struct batch *b,
+			      char *line, int len, struct pending_sig *p)
+{
+	struct nostr_event ev;
+	int fields;
+
+	event_init(&ev, &b->arena);
+
+	if (!parse_event(line, len, &ev, &fields))
+		return "could not parse event";
+
+	if ((fields & EVENT_HAS_ALL) != EVENT_HAS_ALL)
+		return "missing fields";
+
+	memcpy(p->id, ev.id, 32);
+	memcpy(p->sig, ev.sig, 64);
+
+	if (!event_id(&ev))
+		return "could not serialize event";
+
+	if (memcmp(p->id, ev.id, 32))
+		return "id mismatch";
+
+	if (!secp256k1_xonly_pubkey_parse(ctx, &p->pubkey, ev.pubkey))
+		return "invalid pubkey";
+
+	return NULL;
+}
+
+static void verify_batch(void *job, void *data)
+{
+	struct verify_state *st = data;
+	struct batch *b = job;
+	struct pending_sig pending[BATCH_LINES];
+	const unsigned char *sigs[BATCH_LINES], *ids[BATCH_LINES];
+	const secp256k1_xonly_pubkey *pubkeys[BATCH_LINES];
+	const char *errs[BATCH_LINES] = {0};
+	char *line, *nl, *end;
+	int i, k, len, n, npending = 0;
+
+	batch_start(b);
+
+	line = b->in;
+	end = b->in + b->in_len;
+
+	for (i = 0; line < end; i++, line = nl + 1) {
+		nl = memchr(line, '\n', end - line);
+		len = nl - line;
+		if (len && line[len-1] == '\r')
+			len--;
+		if (!len)
+			continue;
+
+		if ((errs[i] = check_line(st->ctx, b, line, len, &pending[npending])))
+			continue;
+
+		k = npending++;
+		pending[k].line = i;
+		sigs[k] = pending[k].sig;
+		ids[k] = pending[k].id;
+		pubkeys[k] = &pending[k].pubkey;
+	}
+
+	/* one multi-scalar multiplication for the whole batch, only when it
+	 * fails do we go back and find the bad signatures one by one */
+	b->nok = npending;
+	if (!secp256k1_schnorrsig_verify_batch(st->ctx, sigs, ids, pubkeys, npending)) {
+		for (k = 0; k < npending; k++) {
+			if (!secp256k1_schnorrsig_verify(st->ctx, sigs[k], ids[k], 32, pubkeys[k])) {
+				errs[pending[k].line] = "invalid signature";
+				b->nok--;
+			}
+		}
+	}
+
+	for (i = 0; i < b->nlines; i++) {
+		if (!errs[i])
+			continue;
+
+		b->nbad++;
+		if (!batch_reserve(b, 64))
+			continue;
+		n = snprintf((char *)b->out + b->out_len, b->out_cap - b->out_len,
+			     "line %" PRIu64 ": %s\n", b->first_line + i, errs[i]);
+		b->out_len += n;
+	}
+}
+
+/* The other side of a DM is its author, unless we wrote it, then it's the
+ * first p tag. */
+static int dm_peer(struct decrypt_state *st, struct nostr_event *ev,
+		   unsigned char peer[32])
+{
+	int i;
+
+	if (memcmp(ev->pubkey, st->key->pubkey, 32)) {
+		memcpy(peer, ev->pubkey, 32);
+		return 1;
+	}
+
+	for (i = 0; i < ev->num_tags; i++) {
+		struct nostr_tag *tag = &ev->tags[i];
+		if (tag->num_elems >= 2 && !strcmp(tag->strs[0], "p"))
+			return hex_decode(tag->strs[1], strlen(tag->strs[1]), peer, 32);
+	}
+
+	return 0;
+}
+
+static const char *decrypt_line(struct decrypt_state *st, struct batch *b,
+				char *line, int len)
+{
+	unsigned char peer[32], shared[32];
+	struct nostr_event ev;
+	size_t clen, ptlen;
+	char *plaintext;
+	int fields;
+
+	event_init(&ev, &b->arena);
+
+	if (!parse_event(line, len, &ev, &fields))
+		return "could not parse event";
+
+	if (!(fields & EVENT_HAS_PUBKEY) || !(fields & EVENT_HAS_CONTENT))
+		return "missing fields";
+
+	if (!dm_peer(st, &ev, peer))
+		return "no p tag on our own dm";
+
+	/* ECDH is the expensive part, and archives are mostly a few peers */
+	if (!cache_get(st->secrets, peer, shared)) {
+		if (!dm_shared_secret(st->ctx, st->key->secret, peer, shared))
+			return "invalid pubkey";
+		cache_put(st->secrets, peer, shared);
+	}
+
+	clen = strlen(ev.content);
+	ptlen = base64_decoded_length(clen);
+	if (!(plaintext = arena_alloc(&b->arena, ptlen)))
+		return "out of memory";
+
+	if (decrypt_dm(shared, ev.content, clen, plaintext, ptlen) < 0)
+		return "could not decrypt content";
+	ev.content = plaintext;
+
+	if (!batch_push_event(b, &ev, 0))
+		return "could not serialize event";
+
+	return NULL;
+}
+
+static void decrypt_batch(void *job, void *data)
+{
+	struct decrypt_state *st = data;
+	struct batch *b = job;
+	char *line, *nl, *end;
+	const char *err;
+	int i, len;
+
+	batch_start(b);
+
+	line = b->in;
+	end = b->in + b->in_len;
+
+	for (i = 0; line < end; i++, line = nl + 1) {
+		nl = memchr(line, '\n', end - line);
+		len = nl - line;
+		if (len && line[len-1] == '\r')
+			len--;
+		if (!len)
+			continue;
+
+		if (!(err = decrypt_line(st, b, line, len))) {
+			b->nok++;
+			continue;
+		}
+
+		b->nbad++;
+		fprintf(stderr, "line %" PRIu64 ": %s\n", b->first_line + i, err);
+	}
+}
+
+struct gen_state {
+	const secp256k1_context *ctx;
+	const struct key *keys;
+	const struct gen_opts *opts;
+	int envelope;
+};
+
+struct gen_src {
+	uint64_t next, count;
+};
+
+/* nothing to read, a batch is just the next BATCH_LINES event numbers */
+static int read_gen(void *src, struct batch *b)
+{
+	struct gen_src *gs = src;
+	uint64_t left = gs->count - gs->next;
+
+	b->nlines = left < BATCH_LINES ? left : BATCH_LINES;
+	gs->next += b->nlines;
+	return gs->next < gs->count;
+}
+
+static void gen_batch(void *job, void *data)
+{
+	struct gen_state *st = data;
+	struct batch *b = job;
+	struct nostr_event ev;
+	unsigned char aux[32];
+	uint64_t n;
+	int i, author;
+
+	batch_start(b);
+
+	for (i = 0; i < b->nlines; i++) {
+		n = b->first_line - 1 + i;
+		event_init(&ev, &b->arena);
+
+		if (gen_event(st->opts, st->keys, n, &ev, aux, &author) &&
+		    event_id(&ev) &&
+		    secp256k1_schnorrsig_sign32(st->ctx, ev.sig, ev.id, &st->keys[author].pair, aux) &&
+		    batch_push_event(b, &ev, st->envelope)) {
+			b->nok++;
+			continue;
+		}
+
+		b->nbad++;
+		fprintf(stderr, "event %" PRIu64 ": could not make event\n", n);
+	}
+}
+
+struct patch_src {
+	struct patch_reader r;
+	const struct patch_opts *opts;
+	const unsigned char *pubkey;
+	uint64_t created_at;
+	unsigned char prev[32];
+	int have_prev;
+	int error;
+};
+
+/* Every patch replies to the id of the one before, so patch events are
+ * made and hashed here, in order, and only signed by the workers. They
+ * live in the batch arena until the batch is written. */
+static int read_patches(void *src, struct batch *b)
+{
+	struct patch_src *ps = src;
+	struct nostr_event *ev;
+	const char *patch;
+	size_t len, bytes = 0;
+
+	arena_reset(&b->arena);
+	b->nlines = 0;
+
+	if (!(b->events = arena_alloc(&b->arena, BATCH_LINES * sizeof(*b->events)))) {
+		ps->error = 1;
+		return 0;
+	}
+
+	while (b->nlines < BATCH_LINES && bytes < BATCH_BYTES) {
+		if (!(patch = patch_next(&ps->r, &b->arena, &len)))
+			return 0;
+
+		ev = &b->events[b->nlines];
+		event_init(ev, &b->arena);
+		ev->created_at = ps->created_at;
+		memcpy(ev->pubkey, ps->pubkey, 32);
+
+		if (!patch_event(ps->opts, patch, ps->have_prev ? ps->prev : NULL, ev) ||
+		    !event_id(ev)) {
+			fprintf(stderr, "patch %" PRIu64 ": could not make event\n",
+				b->first_line + b->nlines);
+			ps->error = 1;
+			return 0;
+		}
+
+		memcpy(ps->prev, ev->id, 32);
+		ps->have_prev = 1;
+		b->nlines++;
+		bytes += len;
+	}
+
+	return 1;
+}
+
+static void patch_batch(void *job, void *data)
+{
+	struct sign_state *st = data;
+	struct batch *b = job;
+	struct nostr_event *ev;
+	unsigned char base[32], aux[32];
+	int i;
+
+	/* the arena holds the events, read_patches resets it */
+	batch_start_out(b);
+
+	if (!fill_random(base, sizeof(base)))
+		memset(base, 0, sizeof(base));
+
+	for (i = 0; i < b->nlines; i++) {
+		ev = &b->events[i];
+		line_aux(aux, base, b->first_line + i);
+
+		if (secp256k1_schnorrsig_sign32(st->ctx, ev->sig, ev->id, &st->key->pair, aux) &&
+		    batch_push_event(b, ev, st->opts->envelope)) {
+			b->nok++;
+			continue;
+		}
+
+		b->nbad++;
+		fprintf(stderr, "patch %" PRIu64 ": could not sign event\n", b->first_line + i);
+	}
+}
+
+int write_iov(int fd, struct iovec *iov, int iovcnt)
+{
+	ssize_t n;
+
+	while (iovcnt) {
+		if ((n = writev(fd, iov, iovcnt < IOV_MAX ? iovcnt : IOV_MAX)) < 0) {
+			if (errno == EINTR)
+				continue;
+			return 0;
+		}
+
+		for (; iovcnt && (size_t)n >= iov->iov_len; iov++, iovcnt--)
+			n -= iov->iov_len;
+		if (iovcnt) {
+			iov->iov_base = (char *)iov->iov_base + n;
+			iov->iov_len -= n;
+		}
+	}
+
+	return 1;
+}
+
+/* out with the splices put back in their places */
+static int write_out(int fd, struct batch *b)
+{
+	struct iovec iov[IOV_MAX];
+	size_t at = 0;
+	int i, n = 0;
+
+	for (i = 0; i <= b->nsplices; i++) {
+		if (n + 2 > (int)(sizeof(iov) / sizeof(iov[0]))) {
+			if (!write_iov(fd, iov, n))
+				return 0;
+			n = 0;
+		}
+
+		iov[n].iov_base = b->out + at;
+		iov[n].iov_len = (i < b->nsplices ? b->splices[i].at : b->out_len) - at;
+		n += iov[n].iov_len > 0;
+
+		if (i == b->nsplices)
+			break;
+
+		iov[n].iov_base = (void *)b->splices[i].p;
+		iov[n++].iov_len = b->splices[i].len;
+		at = b->splices[i].at;
+	}
+
+	return write_iov(fd, iov, n);
+}
+
+static int write_batch(FILE *out, struct batch *b, uint64_t *nok, uint64_t *nbad)
+{
+	*nok += b->nok;
+	*nbad += b->nbad;
+
+	if (!b->nsplices)
+		return fwrite(b->out, 1, b->out_len, out) == b->out_len;
+
+	/* the spliced pieces bypass stdio, so empty its buffer first */
+	return !fflush(out) && write_out(fileno(out), b);
+}
+
+static int read_lines(void *src, struct batch *b)
+{
+	struct line_src *ls = src;
+
+	return read_batch(ls->in, b, &ls->line, &ls->linecap);
+}
+
+/* Feed the batches `fill` makes from src through `run` and write the
+ * results to `out` in input order. Returns the duration in ms, or -1 on
+ * error. */
+static int64_t run_batches(batch_read_fn *fill, void *src, FILE *out,
+			   int threads, workq_fn run, void *data,
+			   uint64_t *nok, uint64_t *nbad)
+{
+	struct batch *b, *spare = NULL;
+	struct timespec t1, t2;
+	struct workq *q;
+	uint64_t lineno = 1;
+	int more = 1, ok = 1;
+
+	*nok = *nbad = 0;
+
+	if (!(q = workq_new(threads, threads * BATCH_DEPTH, run, data))) {
+		fprintf(stderr, "could not start workers\n");
+		return -1;
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+
+	while (ok && more) {
+		if (spare) {
+			b = spare;
+			spare = NULL;
+		} else if (!(b = calloc(1, sizeof(*b)))) {
+			fprintf(stderr, "out of memory\n");
+			ok = 0;
+			break;
+		}
+
+		if ((more = fill(src, b)) < 0) {
+			spare = b;
+			break;
+		}
+		b->first_line = lineno;
+		lineno += b->nlines;
+
+		if (b->nlines == 0) {
+			spare = b;
+			break;
+		}
+
+		if (workq_full(q)) {
+			spare = workq_pop(q);
+			ok = write_batch(out, spare, nok, nbad);
+		}
+
+		workq_push(q, b);
+	}
+
+	while ((b = workq_pop(q))) {
+		ok = ok && write_batch(out, b, nok, nbad);
+		batch_free(b);
+	}
+
+	workq_free(q);
+	batch_free(spare);
+
+	if (fflush(out) || !ok) {
+		fprintf(stderr, "error writing output\n");
+		return -1;
+	}
+
+	if (more < 0)
+		return -1;
+
+	clock_gettime(CLOCK_MONOTONIC, &t2);
+	return ((t2.tv_sec - t1.tv_sec) * 1000000000LL + (t2.tv_nsec - t1.tv_nsec)) / 1000000LL;
+}
+
+/* run_batches over the lines of `in` */
+static int64_t run_lines(FILE *in, FILE *out, int threads, workq_fn run,
+			 void *data, uint64_t *nok, uint64_t *nbad)
+{
+	struct line_src src = { in, NULL, 0 };
+	int64_t duration;
+
+	duration = run_batches(read_lines, &src, out, threads, run, data, nok, nbad);
+	free(src.line);
+
+	return duration;
+}
+
+int batch_sign(const secp256k1_context *ctx, struct key *key,
+	       FILE *in, FILE *out, struct batch_opts *opts)
+{
+	struct sign_state st = { ctx, key, opts };
+	uint64_t nok, nbad;
+	int64_t duration;
+	int threads;
+
+	threads = opts->threads < 1 ? online_cpus() : opts->threads;
+
+	if ((duration = run_lines(in, out, threads, sign_batch, &st, &nok, &nbad)) < 0)
+		return 0;
+
+	fprintf(stderr, "signed %" PRIu64 " events in %" PRId64 " ms, %.0f events per second on %d threads\n",
+		nok, duration, duration ? nok * 1000.0 / duration : 0.0, threads);
+
+	return nbad == 0;
+}
+
+int batch_verify(const secp256k1_context *ctx, FILE *in, FILE *out,
+		 int threads, uint64_t *nbad)
+{
+	struct verify_state st = { ctx };
+	uint64_t nok;
+	int64_t duration;
+
+	threads = threads < 1 ? online_cpus() : threads;
+
+	if ((duration = run_lines(in, out, threads, verify_batch, &st, &nok, nbad)) < 0)
+		return 0;
+
+	fprintf(out, "verified %" PRIu64 " events: %" PRIu64 " ok, %" PRIu64 " failed\n",
+		nok + *nbad, nok, *nbad);
+	fprintf(stderr, "%" PRId64 " ms, %.0f events per second on %d threads\n",
+		duration, duration ? (nok + *nbad) * 1000.0 / duration : 0.0, threads);
+
+	return 1;
+}
+
+int batch_dm(const secp256k1_context *ctx, struct key *key,
+	     struct nostr_event *tmpl, FILE *recipients, FILE *out,
+	     struct batch_opts *opts)
+{
+	struct dm_state st = { ctx, key, tmpl, opts };
+	uint64_t nok, nbad;
+	int64_t duration;
+	int threads;
+
+	threads = opts->threads < 1 ? online_cpus() : opts->threads;
+
+	if ((duration = run_lines(recipients, out, threads, dm_batch, &st, &nok, &nbad)) < 0)
+		return 0;
+
+	fprintf(stderr, "made %" PRIu64 " dms in %" PRId64 " ms, %.0f per second on %d threads\n",
+		nok, duration, duration ? nok * 1000.0 / duration : 0.0, threads);
+
+	return nbad == 0;
+}
+
+int batch_decrypt(const secp256k1_context *ctx, struct key *key, FILE *in,
+		  FILE *out, int threads, int cache_size, uint64_t *nbad)
+{
+	struct decrypt_state st = { ctx, key, NULL };
+	uint64_t nok, hits, misses;
+	int64_t duration;
+
+	threads = threads < 1 ? online_cpus() : threads;
+
+	if (!(st.secrets = cache_new(cache_size))) {
+		fprintf(stderr, "out of memory\n");
+		return 0;
+	}
+
+	duration = run_lines(in, out, threads, decrypt_batch, &st, &nok, nbad);
+	cache_stats(st.secrets, &hits, &misses);
+	cache_free(st.secrets);
+
+	if (duration < 0)
+		return 0;
+
+	fprintf(stderr, "decrypted %" PRIu64 " of %" PRIu64 " events in %" PRId64 " ms, %.0f events per second on %d threads, %" PRIu64 " ecdh for %" PRIu64 " cache hits\n",
+		nok, nok + *nbad, duration,
+		duration ? (nok + *nbad) * 1000.0 / duration : 0.0, threads,
+		misses, hits);
+
+	return 1;
+}
+
+/* the longest line a serve client may send, anything longer is not an
+ * event and would only grow the buffer */
+#define SIGN_FD_LINE_MAX BATCH_BYTES
+
+int batch_sign_fd(const secp256k1_context *ctx, struct key *key, int fd,
+		  struct batch_opts *opts)
+{
+	static const char too_long[] = "{\"error\":\"line too long\"}\n";
+	struct sign_state st = { ctx, key, opts };
+	struct batch b;
+	size_t len = 0, cap = 1 << 16, done;
+	char *buf, *tmp, *nl;
+	ssize_t n;
+	int ok = 1, eof = 0;
+
+	memset(&b, 0, sizeof(b));
+	b.first_line = 1;
+
+	if (!(buf = malloc(cap)))
+		return 0;
+
+	while (!eof) {
+		/* only a partial line is left in a full buffer */
+		if (len == cap) {
+			if (cap >= SIGN_FD_LINE_MAX) {
+				/* the connection is dropped either way */
+				if (write(fd, too_long, sizeof(too_long) - 1) < 0)
+					perror("serve: write");
+				ok = 0;
+				break;
+			}
+			if (!(tmp = realloc(buf, cap *= 2))) {
+				ok = 0;
+				break;
+			}
+			buf = tmp;
+		}
+
+		if ((n = read(fd, buf + len, cap - len)) < 0) {
+			if (errno == EINTR)
+				continue;
+			ok = 0;
+			break;
+		}
+
+		/* a last request without a newline is still answered, there
+		 * is room for one since the buffer grows before it is full */
+		if (n == 0) {
+			if (!len)
+				break;
+			buf[len++] = '\n';
+			eof = 1;
+		}
+
+		/* sign every complete line that has arrived and answer them
+		 * with one write, the partial line waits for the next read */
+		len += n;
+		for (nl = buf + len; nl > buf && nl[-1] != '\n'; nl--)
+			;
+		if (nl == buf)
+			continue;
+		done = nl - buf;
+
+		b.in = buf;
+		b.in_len = done;
+		sign_batch(&b, &st);
+		for (tmp = buf; tmp < nl; tmp++)
+			b.first_line += *tmp == '\n';
+
+		if (!write_out(fd, &b)) {
+			ok = 0;
+			break;
+		}
+
+		memmove(buf, buf + done, len - done);
+		len -= done;
+	}
+
+	free(buf);
+	free(b.out);
+	free(b.splices);
+	arena_free(&b.arena);
+	return ok;
+}
+
+int batch_gen(const secp256k1_context *ctx, const struct key *keys,
+	      const struct gen_opts *gen, FILE *out, struct batch_opts *opts)
+{
+	struct gen_state st = { ctx, keys, gen, opts->envelope };
+	struct gen_src src = { 0, gen->count };
+	uint64_t nok, nbad;
+	int64_t duration;
+	int threads;
+
+	threads = opts->threads < 1 ? online_cpus() : opts->threads;
+
+	if ((duration = run_batches(read_gen, &src, out, threads, gen_batch, &st, &nok, &nbad)) < 0)
+		return 0;
+
+	fprintf(stderr, "generated %" PRIu64 " events in %" PRId64 " ms, %.0f events per second on %d threads\n",
+		nok, duration, duration ? nok * 1000.0 / duration : 0.0, threads);
+
+	return nbad == 0;
+}
+
+int batch_patches(const secp256k1_context *ctx, struct key *key, FILE *in,
+		  FILE *out, const struct patch_opts *patch, struct batch_opts *opts)
+{
+	struct sign_state st = { ctx, key, opts };
+	struct patch_src src;
+	uint64_t nok, nbad;
+	int64_t duration;
+	int threads;
+
+	threads = opts->threads < 1 ? online_cpus() : opts->threads;
+
+	memset(&src, 0, sizeof(src));
+	patch_reader_init(&src.r, in);
+	src.opts = patch;
+	src.pubkey = key->pubkey;
+	src.created_at = opts->created_at ? opts->created_at : (uint64_t)time(NULL);
+
+	duration = run_batches(read_patches, &src, out, threads, patch_batch, &st, &nok, &nbad);
+	patch_reader_free(&src.r);
+
+	if (duration < 0)
+		return 0;
+
+	if (src.r.error) {
+		fprintf(stderr, "error reading patches\n");
+		return 0;
+	}
+
+	if (src.error)
+		return 0;
+
+	if (!nok) {
+		fprintf(stderr, "no patches found, expected git format-patch output\n");
+		return 0;
+	}
+
+	fprintf(stderr, "made %" PRIu64 " patch events in %" PRId64 " ms\n", nok, duration);
+
+	return nbad == 0;
+}
@@ -0,0 +1,90 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+#include <stdio.h>
+#include <sys/uio.h>
+
+#include "secp256k1.h"
+#include "struct_key.h"
+
+struct nostr_event;
+struct gen_opts;
+struct patch_opts;
+
+struct batch_opts {
+	int threads;
+	int envelope;
+
+	/* used for templates without created_at or kind, a created_at of 0
+	 * means the time of signing */
+	uint64_t created_at;
+	int kind;
+
+	/* answer lines that can't be signed with {"error":...} instead of
+	 * skipping them, so every request gets a reply */
+	int error_lines;
+};
+
+/* Read unsigned event templates from `in`, one json object per line, and
+ * write the signed events to `out` in input order. Lines are signed in
+ * batches by a pool of workers sharing `ctx`, with a bounded number of
+ * batches in flight. Lines that can't be parsed are reported on stderr and
+ * skipped. Returns 0 on a read or write error, or if any line was
+ * skipped. */
+int batch_sign(const secp256k1_context *ctx, struct key *key,
+	       FILE *in, FILE *out, struct batch_opts *opts);
+
+/* Sign event templates read from fd as they arrive and write the signed
+ * events back to the same fd, for one connection of nostril serve. Clients
+ * may pipeline requests: all complete lines from one read are signed and
+ * answered with a single write. A last line without a newline is signed
+ * at EOF. A line over 1MB is answered with an error and ends the
+ * connection. Returns 0 on a read or write error or a line too long. */
+int batch_sign_fd(const secp256k1_context *ctx, struct key *key, int fd,
+		  struct batch_opts *opts);
+
+/* Check the id and signature of every event read from `in`, one json
+ * object per line. Failures are written to `out` as "line N: reason" in
+ * input order, followed by a summary. *nbad is set to the number of lines
+ * that failed. Returns 0 on a read or write error. */
+int batch_verify(const secp256k1_context *ctx, FILE *in, FILE *out,
+		 int threads, uint64_t *nbad);
+
+/* Send the template event as a NIP-04 DM to every hex pubkey read from
+ * `recipients`, one per line, with blank lines and # comments skipped.
+ * Workers do the ECDH, encryption and signing, sharing ctx and key, and
+ * the events are written to `out` in recipient order with opts->kind.
+ * Returns 0 on a read or write error, or if any recipient was skipped. */
+int batch_dm(const secp256k1_context *ctx, struct key *key,
+	     struct nostr_event *tmpl, FILE *recipients, FILE *out,
+	     struct batch_opts *opts);
+
+/* Decrypt the NIP-04 DMs read from `in`, one json object per line, to or
+ * from `key`. Each is written to `out` in input order with its content in
+ * the clear; id and sig still refer to the encrypted event. Shared secrets
+ * are kept in an LRU of `cache_size` peers shared by the workers. Lines
+ * that fail are reported on stderr and counted in *nbad. Returns 0 on a
+ * read or write error. */
+int batch_decrypt(const secp256k1_context *ctx, struct key *key, FILE *in,
+		  FILE *out, int threads, int cache_size, uint64_t *nbad);
+
+/* Write gen->count synthetic events to `out`, see gen.h, signed by the
+ * pool of `keys` across opts->threads workers. The output only depends on
+ * the gen options, not on the number of threads. Returns 0 on a write
+ * error or if any event could not be made. */
+int batch_gen(const secp256k1_context *ctx, const struct key *keys,
+	      const struct gen_opts *gen, FILE *out, struct batch_opts *opts);
+
+/* Turn the `git format-patch --stdout` mbox read from `in` into a chain of
+ * NIP-34 patch events signed by key, see patch.h, written to `out` in
+ * series order. All patches get opts->created_at, or the current time if
+ * it is 0. Returns 0 on a read or write error or if there were no
+ * patches. */
+int batch_patches(const secp256k1_context *ctx, struct key *key, FILE *in,
+		  FILE *out, const struct patch_opts *patch, struct batch_opts *opts);
+
+/* writev all of iov to fd, retrying short writes, returns 0 on error.
+ * iov is used up in the process. */
+int write_iov(int fd, struct iovec *iov, int iovcnt);
+
+#endif
@@ -0,0 +1,78 @@
+#include <string.h>
+#include <stdint.h>
+
+#include "bech32.h"
+
+int bech32_value(char c)
+{
+	const char *p;
+
+	if (c >= 'A' && c <= 'Z')
+		c += 'a' - 'A';
+	if (!c || !(p = strchr(BECH32_CHARSET, c)))
+		return -1;
+	return p - BECH32_CHARSET;
+}
+
+static uint32_t polymod_step(uint32_t chk, int v)
+{
+	static const uint32_t gen[5] = {
+		0x3b6a57b2, 0x26508e6d, 0x1ea119fa, 0x3d4233dd, 0x2a1462b3
+	};
+	uint32_t top = chk >> 25;
+	int i;
+
+	chk = (chk & 0x1ffffff) << 5 ^ v;
+	for (i = 0; i < 5; i++) {
+		if ((top >> i) & 1)
+			chk ^= gen[i];
+	}
+	return chk;
+}
+
+int bech32_encode(char *out, size_t outsize, const char *hrp,
+		  const unsigned char *data, size_t len)
+{
+	size_t hrplen = strlen(hrp), ngroups = (len * 8 + 4) / 5, i, n = 0;
+	uint32_t chk = 1, acc = 0;
+	int bits = 0, v;
+
+	if (outsize < hrplen + 1 + ngroups + 6 + 1)
+		return 0;
+
+	for (i = 0; i < hrplen; i++)
+		chk = polymod_step(chk, hrp[i] >> 5);
+	chk = polymod_step(chk, 0);
+	for (i = 0; i < hrplen; i++)
+		chk = polymod_step(chk, hrp[i] & 31);
+
+	memcpy(out, hrp, hrplen);
+	n = hrplen;
+	out[n++] = '1';
+
+	/* 8 bit bytes to 5 bit groups, the last one padded with zeros */
+	for (i = 0; i < len; i++) {
+		acc = acc << 8 | data[i];
+		bits += 8;
+		while (bits >= 5) {
+			bits -= 5;
+			v = (acc >> bits) & 31;
+			chk = polymod_step(chk, v);
+			out[n++] = BECH32_CHARSET[v];
+		}
+	}
+	if (bits) {
+		v = (acc << (5 - bits)) & 31;
+		chk = polymod_step(chk, v);
+		out[n++] = BECH32_CHARSET[v];
+	}
+
+	for (i = 0; i < 6; i++)
+		chk = polymod_step(chk, 0);
+	chk ^= 1;
+	for (i = 0; i < 6; i++)
+		out[n++] = BECH32_CHARSET[(chk >> (5 * (5 - i))) & 31];
+
+	out[n] = 0;
+	return 1;
+}
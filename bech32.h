@@ -0,0 +1,21 @@
+#ifndef BECH32_H
+#define BECH32_H
+
+#include <stddef.h>
+
+/* The bech32 (BIP-173) encoding of NIP-19 keys, npub and nsec. */
+
+#define BECH32_CHARSET "qpzry9x8gf2tvdw0s3jn54khce6mua7l"
+
+/* characters of the data part of a 32 byte key */
+#define BECH32_KEY_CHARS 52
+
+/* the 5 bit value of a bech32 character in either case, -1 if it isn't one */
+int bech32_value(char c);
+
+/* hrp, "1", the data in 5 bit groups and the checksum, NUL terminated.
+ * Returns 0 if it doesn't fit in outsize. */
+int bech32_encode(char *out, size_t outsize, const char *hrp,
+		  const unsigned char *data, size_t len);
+
+#endif
@@ -0,0 +1,288 @@
+/* Throughput and equivalence checks for the hex, base64 and json string
+ * kernels.
+ *
+ * usage: bench_codec [seconds per run]
+ *        bench_codec --fuzz [iterations]
+ *
+ * The benchmark reports MB/s of input for every kernel the cpu supports.
+ * --fuzz feeds random buffers, valid and corrupted encodings and text with
+ * bytes that need json escaping through each kernel and compares the
+ * results with the scalar code, exiting 1 on the first mismatch.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "hex.h"
+#include "base64.h"
+
+#define MAXLEN 1024
+
+static double now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+enum op { HEX_ENCODE, HEX_DECODE, BASE64_ENCODE, BASE64_DECODE, JSON_PLAIN, OP_COUNT };
+
+static const char *op_names[] = {
+	"hex_encode", "hex_decode", "base64_encode", "base64_decode", "json_plain"
+};
+
+static void run(enum op op, const unsigned char *raw, const char *hex,
+		const char *b64, const char *text, size_t len, char *out)
+{
+	size_t i, run;
+
+	switch (op) {
+	case HEX_ENCODE:
+		hex_encode(raw, len, out, 2 * len + 1);
+		break;
+	case HEX_DECODE:
+		hex_decode(hex, 2 * len, out, len);
+		break;
+	case BASE64_ENCODE:
+		base64_encode(out, base64_encoded_length(len) + 1, (const char *)raw, len);
+		break;
+	case BASE64_DECODE:
+		base64_decode(out, len + 3, b64, base64_encoded_length(len));
+		break;
+	case JSON_PLAIN:
+		/* walk the runs the way cursor_push_jsonstr does */
+		for (i = 0; i < len; i += run + 1)
+			run = codec_json_plain(text + i, len - i);
+		break;
+	default:
+		break;
+	}
+}
+
+static void bench(enum codec_kernel kernel, enum op op, size_t len, double seconds)
+{
+	static unsigned char raw[MAXLEN];
+	static char hex[2 * MAXLEN + 1], b64[MAXLEN * 2], out[MAXLEN * 2 + 1];
+	static char text[MAXLEN];
+	unsigned long long runs = 0;
+	double start, elapsed;
+	size_t i;
+
+	/* text is prose with a newline to escape every 80 bytes */
+	for (i = 0; i < len; i++) {
+		raw[i] = (unsigned char)(i * 131);
+		text[i] = i % 80 == 79 ? '\n' : 'a' + i % 26;
+	}
+
+	codec_set_kernel(CODEC_KERNEL_SCALAR);
+	hex_encode(raw, len, hex, sizeof(hex));
+	base64_encode(b64, sizeof(b64), (const char *)raw, len);
+
+	codec_set_kernel(kernel);
+
+	start = now();
+	do {
+		for (i = 0; i < 256; i++)
+			run(op, raw, hex, b64, text, len, out);
+		runs += 256;
+		elapsed = now() - start;
+	} while (elapsed < seconds);
+
+	printf("%-14s %-7s %6zu %10.1f\n", op_names[op], codec_kernel_name(kernel),
+	       len, runs * len / elapsed / 1e6);
+}
+
+/* the byte at a time loops these kernels replaced, as a reference for
+ * hex; base64 is checked against the scalar kernel, which leaves all of
+ * the work to the original ccan code */
+static int ref_hex_decode(const char *str, size_t slen, unsigned char *p, size_t bufsize)
+{
+	unsigned char v1, v2;
+
+	while (slen > 1) {
+		if (!char_to_hex(&v1, str[0]) || !char_to_hex(&v2, str[1]))
+			return 0;
+		if (!bufsize)
+			return 0;
+		*(p++) = (v1 << 4) | v2;
+		str += 2;
+		slen -= 2;
+		bufsize--;
+	}
+	return slen == 0 && bufsize == 0;
+}
+
+static void ref_hex_encode(const unsigned char *buf, size_t n, char *dest)
+{
+	size_t i;
+
+	for (i = 0; i < n; i++) {
+		*(dest++) = hexchar(buf[i] >> 4);
+		*(dest++) = hexchar(buf[i] & 0xF);
+	}
+	*dest = '\0';
+}
+
+static size_t ref_json_plain(const char *s, size_t n)
+{
+	size_t i;
+
+	for (i = 0; i < n; i++) {
+		if (strchr("\"\\\b\f\n\r\t", s[i]) && s[i])
+			break;
+	}
+	return i;
+}
+
+static const char junk[] = "=-_ .\n\0g:@[`{~\x80\xff";
+
+/* flip some encodings so both the block kernels and the tails see
+ * uppercase, padding in the wrong place and characters outside the
+ * alphabet */
+static void corrupt(char *s, size_t len, int uppercase)
+{
+	size_t i;
+
+	if (!len)
+		return;
+
+	switch (rand() % 4) {
+	case 0:
+		return;
+	case 1:
+		s[rand() % len] = junk[rand() % (sizeof(junk) - 1)];
+		return;
+	case 2:
+		if (uppercase) {
+			for (i = 0; i < len; i++) {
+				if (s[i] >= 'a' && s[i] <= 'f' && rand() % 2)
+					s[i] -= 'a' - 'A';
+			}
+		} else {
+			s[rand() % len] = rand();
+		}
+		return;
+	default:
+		s[len - 1 - rand() % (len < 8 ? len : 8)] = '=';
+		return;
+	}
+}
+
+static int fail(enum codec_kernel kernel, const char *what, size_t len)
+{
+	fprintf(stderr, "%s: %s mismatch at length %zu\n",
+		codec_kernel_name(kernel), what, len);
+	return 0;
+}
+
+static int fuzz_one(enum codec_kernel kernel)
+{
+	static unsigned char raw[MAXLEN], want[MAXLEN + 3], got[MAXLEN + 3];
+	static char hex[2 * MAXLEN + 1], b64[MAXLEN * 2], want_s[MAXLEN * 2], got_s[MAXLEN * 2];
+	size_t i, len = rand() % (rand() % 8 ? 128 : MAXLEN);
+	size_t hexlen, b64len;
+	ssize_t want_n, got_n;
+	int want_ok, got_ok;
+
+	for (i = 0; i < len; i++)
+		raw[i] = rand();
+
+	/* encoders */
+	ref_hex_encode(raw, len, want_s);
+	codec_set_kernel(kernel);
+	hex_encode(raw, len, got_s, sizeof(got_s));
+	if (strcmp(want_s, got_s))
+		return fail(kernel, "hex_encode", len);
+
+	codec_set_kernel(CODEC_KERNEL_SCALAR);
+	want_n = base64_encode(want_s, sizeof(want_s), (const char *)raw, len);
+	codec_set_kernel(kernel);
+	got_n = base64_encode(got_s, sizeof(got_s), (const char *)raw, len);
+	if (want_n != got_n || memcmp(want_s, got_s, want_n + 1))
+		return fail(kernel, "base64_encode", len);
+
+	/* decoders, on possibly broken input */
+	hexlen = 2 * len;
+	ref_hex_encode(raw, len, hex);
+	corrupt(hex, hexlen, 1);
+	if (rand() % 16 == 0 && hexlen)
+		hexlen--;
+
+	want_ok = ref_hex_decode(hex, hexlen, want, len);
+	codec_set_kernel(kernel);
+	got_ok = hex_decode(hex, hexlen, got, len);
+	if (want_ok != got_ok || (want_ok && memcmp(want, got, len)))
+		return fail(kernel, "hex_decode", len);
+
+	memcpy(b64, want_s, want_n + 1);
+	b64len = want_n;
+	corrupt(b64, b64len, 0);
+	if (rand() % 16 == 0 && b64len)
+		b64len -= 1 + rand() % (b64len < 3 ? b64len : 3);
+
+	codec_set_kernel(CODEC_KERNEL_SCALAR);
+	want_n = base64_decode((char *)want, sizeof(want), b64, b64len);
+	codec_set_kernel(kernel);
+	got_n = base64_decode((char *)got, sizeof(got), b64, b64len);
+	if (want_n != got_n || (want_n > 0 && memcmp(want, got, want_n)))
+		return fail(kernel, "base64_decode", len);
+
+	/* json runs, on text with the odd byte that needs escaping */
+	for (i = 0; i < len; i++)
+		got_s[i] = rand() % 64 ? ' ' + rand() % 95 : junk[rand() % (sizeof(junk) - 1)];
+	for (i = 0; i < len; i += want_n + 1) {
+		want_n = ref_json_plain(got_s + i, len - i);
+		if ((size_t)want_n != codec_json_plain(got_s + i, len - i))
+			return fail(kernel, "json_plain", len);
+	}
+
+	return 1;
+}
+
+static int fuzz(unsigned long iterations)
+{
+	unsigned long i;
+	int k;
+
+	srand(time(NULL));
+
+	for (k = CODEC_KERNEL_SCALAR; k < CODEC_KERNEL_COUNT; k++) {
+		if (!codec_kernel_supported(k))
+			continue;
+		for (i = 0; i < iterations; i++) {
+			if (!fuzz_one(k))
+				return 0;
+		}
+		printf("%-7s %lu ok\n", codec_kernel_name(k), iterations);
+	}
+
+	return 1;
+}
+
+int main(int argc, char *argv[])
+{
+	static const size_t lens[] = { 32, 64, 256, 1024 };
+	double seconds = 0.5;
+	size_t l;
+	int k, op;
+
+	if (argc > 1 && !strcmp(argv[1], "--fuzz"))
+		return fuzz(argc > 2 ? strtoul(argv[2], NULL, 10) : 100000) ? 0 : 1;
+	if (argc > 1)
+		seconds = atof(argv[1]);
+
+	printf("selected kernel: %s\n", codec_kernel_name(CODEC_KERNEL_AUTO));
+	printf("%-14s %-7s %6s %10s\n", "op", "kernel", "bytes", "MB/s");
+
+	for (op = 0; op < OP_COUNT; op++) {
+		for (l = 0; l < sizeof(lens) / sizeof(lens[0]); l++) {
+			for (k = CODEC_KERNEL_SCALAR; k < CODEC_KERNEL_COUNT; k++) {
+				if (codec_kernel_supported(k))
+					bench(k, op, lens[l], seconds);
+			}
+		}
+	}
+
+	return 0;
+}
@@ -0,0 +1,161 @@
+/* Benchmark for parse_event() over a json lines corpus.
+ *
+ * usage: bench_json [file.jsonl] [runs]
+ *
+ * Without a file, a synthetic corpus of 200000 signed-looking events with a
+ * mix of tags, escapes and content lengths is generated in memory. Every
+ * run parses a fresh copy of the corpus, since parsing unescapes in place;
+ * the copy is not timed. Reports the best run in GB/s and events/s.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "event.h"
+#include "json.h"
+
+#define SYNTHETIC_EVENTS 200000
+
+static double now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static char *read_file(const char *path, size_t *len)
+{
+	size_t cap = 1 << 20, n;
+	char *buf = malloc(cap), *tmp;
+	FILE *f;
+
+	if (!buf || !(f = fopen(path, "rb"))) {
+		free(buf);
+		return NULL;
+	}
+
+	*len = 0;
+	while ((n = fread(buf + *len, 1, cap - *len, f)) > 0) {
+		*len += n;
+		if (*len == cap) {
+			if (!(tmp = realloc(buf, cap *= 2)))
+				break;
+			buf = tmp;
+		}
+	}
+
+	fclose(f);
+	return buf;
+}
+
+static void hex(char *out, unsigned int seed, int bytes)
+{
+	static const char digits[] = "0123456789abcdef";
+	int i;
+
+	for (i = 0; i < bytes * 2; i++) {
+		seed = seed * 1103515245 + 12345;
+		out[i] = digits[(seed >> 16) & 15];
+	}
+	out[i] = 0;
+}
+
+static char *synthetic_corpus(int nevents, size_t *len)
+{
+	static const char *words[] = {
+		"gm", "nostr", "zap", "relay", "\\\"quoted\\\"", "line\\nbreak",
+		"\\u00e9t\\u00e9", "emoji \\ud83d\\ude00", "https://example.com/a/b",
+	};
+	size_t cap = (size_t)nevents * 2048, n = 0;
+	char *buf = malloc(cap);
+	char id[65], pk[65], sig[129], e[65];
+	int i, w, nwords;
+
+	if (!buf)
+		return NULL;
+
+	for (i = 0; i < nevents; i++) {
+		hex(id, i, 32);
+		hex(pk, i % 1000, 32);
+		hex(sig, i * 7, 64);
+		hex(e, i * 13, 32);
+
+		n += sprintf(buf + n,
+			"{\"id\":\"%s\",\"pubkey\":\"%s\",\"created_at\":%d,\"kind\":%d,"
+			"\"tags\":[[\"e\",\"%s\",\"wss://relay.example.com\",\"reply\"],"
+			"[\"p\",\"%s\"],[\"t\",\"nostr\"]],\"content\":\"",
+			id, pk, 1700000000 + i, i % 3 ? 1 : 7, e, pk);
+
+		nwords = 4 + (i * 31) % 60;
+		for (w = 0; w < nwords; w++)
+			n += sprintf(buf + n, "%s%s", w ? " " : "", words[(i + w * 5) % 9]);
+
+		n += sprintf(buf + n, "\",\"sig\":\"%s\"}\n", sig);
+	}
+
+	*len = n;
+	return buf;
+}
+
+int main(int argc, char *argv[])
+{
+	struct nostr_event ev;
+	struct arena arena;
+	char *corpus, *work, *line, *nl, *end;
+	size_t len;
+	double start, elapsed, best = 0;
+	long events = 0, bad = 0;
+	int run, runs, fields;
+
+	runs = argc > 2 ? atoi(argv[2]) : 5;
+	if (runs < 1) {
+		fprintf(stderr, "usage: bench_json [file.jsonl] [runs], runs must be at least 1\n");
+		return 1;
+	}
+
+	if (argc > 1)
+		corpus = read_file(argv[1], &len);
+	else
+		corpus = synthetic_corpus(SYNTHETIC_EVENTS, &len);
+
+	if (!corpus || !(work = malloc(len))) {
+		fprintf(stderr, "could not load corpus\n");
+		return 1;
+	}
+
+	arena_init(&arena);
+
+	for (run = 0; run < runs; run++) {
+		memcpy(work, corpus, len);
+		events = bad = 0;
+		end = work + len;
+
+		start = now();
+		for (line = work; line < end; line = nl + 1) {
+			if (!(nl = memchr(line, '\n', end - line)))
+				nl = end;
+			if (nl == line)
+				continue;
+			arena_reset(&arena);
+			event_init(&ev, &arena);
+			if (parse_event(line, nl - line, &ev, &fields))
+				events++;
+			else
+				bad++;
+		}
+		elapsed = now() - start;
+
+		if (!best || elapsed < best)
+			best = elapsed;
+	}
+
+	printf("%zu bytes, %ld events, %ld unparsed\n", len, events, bad);
+	if (best > 0)
+		printf("%.3f GB/s, %.0f events/s\n", len / best / 1e9, events / best);
+
+	arena_free(&arena);
+	free(work);
+	free(corpus);
+	return 0;
+}
@@ -0,0 +1,516 @@
+/* Benchmark for nostril's own hot paths, one json object per result.
+ *
+ * usage: bench_nostril [--seconds S] [--content N,N,...] [--tags N,N,...]
+ *                      [--difficulty N] [--key-difficulty N] [--threads N]
+ *                      [--only NAME]
+ *
+ * Events are built from a fixed key, created_at and content pattern, so
+ * runs are comparable across builds. Every size dependent bench runs once
+ * per --content x --tags pair; make_encrypted_dm only depends on the
+ * content, and make_sig and generate_key on neither. Mining defaults to
+ * one thread, so the nonces found, and so the attempt counts, repeat from
+ * run to run.
+ *
+ * Each line looks like
+ *
+ *   {"bench":"sha256","content":256,"tags":4,"ops":..,"seconds":..,
+ *    "ops_per_sec":..,"ns_per_op":..,"bytes_per_sec":..}
+ *
+ * where ops are calls, except for mine_event and generate_key_pow where
+ * they are hash or key attempts. AES-CBC is run with every kernel the cpu
+ * supports, as aes_cbc_encrypt/<kernel> and aes_cbc_decrypt/<kernel>.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <time.h>
+
+#include "secp256k1.h"
+
+#include "hex.h"
+#include "aes.h"
+#include "sha256.h"
+#include "event.h"
+#include "mine.h"
+#include "key.h"
+#include "dm.h"
+
+#define MAX_SIZES 16
+
+/* cheap calls are timed in rounds so reading the clock doesn't dominate */
+#define ROUND 32
+
+#define CREATED_AT 1700000000
+
+struct bench_opts {
+	double seconds;
+	int content[MAX_SIZES], ncontent;
+	int tags[MAX_SIZES], ntags;
+	int difficulty;
+	int key_difficulty;
+	int threads;
+	const char *only;
+};
+
+struct bench_env {
+	secp256k1_context *ctx;
+	struct key key;
+	unsigned char recipient[32];
+	struct arena arena;
+	char *content;
+	int content_len;
+	int ntags;
+};
+
+static double now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void report(const char *name, int content, int tags, uint64_t ops,
+		   double elapsed, double bytes)
+{
+	printf("{\"bench\":\"%s\",\"content\":%d,\"tags\":%d,\"ops\":%" PRIu64
+	       ",\"seconds\":%.6f,\"ops_per_sec\":%.1f,\"ns_per_op\":%.1f",
+	       name, content, tags, ops, elapsed, ops / elapsed,
+	       ops ? elapsed * 1e9 / ops : 0.0);
+	if (bytes)
+		printf(",\"bytes_per_sec\":%.0f", bytes / elapsed);
+	printf("}\n");
+	fflush(stdout);
+}
+
+/* printable text with a quote, backslash and newline every so often, so
+ * serialization takes its escaping paths */
+static char *make_content(int len)
+{
+	static const char pattern[] =
+		"the quick brown fox jumps over the lazy dog \"gm\" \\o/\n";
+	char *s = malloc(len + 1);
+	int i;
+
+	if (!s)
+		return NULL;
+	for (i = 0; i < len; i++)
+		s[i] = pattern[i % (sizeof(pattern) - 1)];
+	s[len] = 0;
+	return s;
+}
+
+/* alternate e tags with relay hints and short t tags */
+static int build_event(struct bench_env *env, struct nostr_event *ev,
+		       uint64_t created_at)
+{
+	static const char eid[] =
+		"5c83da77af1dec6d7289834998ad7aafbd9e2191396d75ec3cc27f5a77226f36";
+	const char *e[] = { "e", eid, "wss://relay.example.com" };
+	char *t;
+	int i;
+
+	arena_reset(&env->arena);
+	event_init(ev, &env->arena);
+	memcpy(ev->pubkey, env->key.pubkey, 32);
+	ev->created_at = created_at;
+	ev->kind = 1;
+	ev->content = env->content;
+
+	for (i = 0; i < env->ntags; i++) {
+		if (i % 2 == 0) {
+			if (!nostr_add_tag_n(ev, e, 3))
+				return 0;
+			continue;
+		}
+		if (!(t = arena_alloc(&env->arena, 16)))
+			return 0;
+		snprintf(t, 16, "topic%d", i);
+		if (!nostr_add_tag(ev, "t", t))
+			return 0;
+	}
+
+	return 1;
+}
+
+static int bench_commitment(struct bench_env *env, struct bench_opts *opts)
+{
+	struct nostr_event ev;
+	unsigned char *buf;
+	double start, elapsed;
+	uint64_t ops = 0, bytes = 0;
+	size_t size;
+	int i, len;
+
+	if (!build_event(env, &ev, CREATED_AT))
+		return 0;
+	size = event_size(&ev);
+	if (!(buf = arena_alloc(&env->arena, size)))
+		return 0;
+
+	start = now();
+	do {
+		for (i = 0; i < ROUND; i++) {
+			if (!(len = event_commitment(&ev, buf, size)))
+				return 0;
+			bytes += len;
+		}
+		ops += ROUND;
+		elapsed = now() - start;
+	} while (elapsed < opts->seconds);
+
+	report("event_commitment", env->content_len, env->ntags, ops,
+	       elapsed, bytes);
+	return 1;
+}
+
+/* everything a signing path does besides signing: build the event, hash
+ * the id and write the json, from a fresh arena every time */
+static int bench_serialize(struct bench_env *env, struct bench_opts *opts)
+{
+	struct nostr_event ev;
+	struct cursor cur;
+	unsigned char *buf = NULL;
+	double start, elapsed;
+	uint64_t ops = 0, bytes = 0;
+	size_t size = 0;
+	int i;
+
+	start = now();
+	do {
+		for (i = 0; i < ROUND; i++) {
+			if (!build_event(env, &ev, CREATED_AT) || !event_id(&ev))
+				return 0;
+			if (event_size(&ev) > size) {
+				size = event_size(&ev);
+				free(buf);
+				if (!(buf = malloc(size)))
+					return 0;
+			}
+			make_cursor(buf, buf + size, &cur);
+			if (!event_json(&cur, &ev, 0))
+				return 0;
+			bytes += cursor_len(&cur);
+		}
+		ops += ROUND;
+		elapsed = now() - start;
+	} while (elapsed < opts->seconds);
+
+	free(buf);
+	report("event_serialize", env->content_len, env->ntags, ops,
+	       elapsed, bytes);
+	return 1;
+}
+
+static int bench_sha256(struct bench_env *env, struct bench_opts *opts)
+{
+	struct nostr_event ev;
+	struct sha256 id;
+	unsigned char *buf;
+	double start, elapsed;
+	uint64_t ops = 0;
+	size_t size;
+	int i, len;
+
+	if (!build_event(env, &ev, CREATED_AT))
+		return 0;
+	size = event_size(&ev);
+	if (!(buf = arena_alloc(&env->arena, size)) ||
+	    !(len = event_commitment(&ev, buf, size)))
+		return 0;
+
+	start = now();
+	do {
+		for (i = 0; i < ROUND; i++)
+			sha256(&id, buf, len);
+		ops += ROUND;
+		elapsed = now() - start;
+	} while (elapsed < opts->seconds);
+
+	report("sha256", env->content_len, env->ntags, ops, elapsed,
+	       (double)ops * len);
+	return 1;
+}
+
+static int bench_make_sig(struct bench_env *env, struct bench_opts *opts)
+{
+	unsigned char id[32], sig[64];
+	double start, elapsed;
+	uint64_t ops = 0;
+
+	memset(id, 0x42, sizeof(id));
+
+	start = now();
+	do {
+		if (!make_sig(env->ctx, &env->key, id, sig))
+			return 0;
+		id[ops++ % 32]++;
+		elapsed = now() - start;
+	} while (elapsed < opts->seconds);
+
+	report("make_sig", 0, 0, ops, elapsed, 0);
+	return 1;
+}
+
+static int bench_encrypted_dm(struct bench_env *env, struct bench_opts *opts)
+{
+	struct nostr_event ev;
+	double start, elapsed;
+	uint64_t ops = 0;
+
+	start = now();
+	do {
+		if (!build_event(env, &ev, CREATED_AT) ||
+		    !make_encrypted_dm(env->ctx, &env->key, &ev, env->recipient, 4))
+			return 0;
+		ops++;
+		elapsed = now() - start;
+	} while (elapsed < opts->seconds);
+
+	report("make_encrypted_dm", env->content_len, 0, ops, elapsed,
+	       (double)ops * env->content_len);
+	return 1;
+}
+
+static int bench_aes(struct bench_env *env, struct bench_opts *opts)
+{
+	unsigned char key[32], iv[16], *buf;
+	char name[64];
+	struct AES_ctx ctx;
+	double start, elapsed;
+	uint64_t ops;
+	size_t len = env->content_len + 16 - env->content_len % 16;
+	int k, enc;
+
+	memset(key, 0x11, sizeof(key));
+	memset(iv, 0x22, sizeof(iv));
+	if (!(buf = arena_alloc(&env->arena, len)))
+		return 0;
+	memset(buf, 'x', len);
+
+	for (k = AES_KERNEL_BYTE; k < AES_KERNEL_COUNT; k++) {
+		if (!aes_set_kernel(k))
+			continue;
+
+		for (enc = 1; enc >= 0; enc--) {
+			AES_init_ctx_iv(&ctx, key, iv);
+			ops = 0;
+			start = now();
+			do {
+				if (enc)
+					AES_CBC_encrypt(&ctx, buf, buf, len);
+				else
+					AES_CBC_decrypt(&ctx, buf, buf, len);
+				ops++;
+				elapsed = now() - start;
+			} while (elapsed < opts->seconds);
+
+			snprintf(name, sizeof(name), "aes_cbc_%s/%s",
+				 enc ? "encrypt" : "decrypt", aes_kernel_name(k));
+			report(name, env->content_len, 0, ops, elapsed,
+			       (double)ops * len);
+		}
+	}
+
+	aes_set_kernel(AES_KERNEL_AUTO);
+	return 1;
+}
+
+/* with one thread the winning nonce is the number of ids hashed, give or
+ * take the last partial batch */
+static int bench_mine_event(struct bench_env *env, struct bench_opts *opts)
+{
+	struct nostr_event ev;
+	double start, elapsed;
+	uint64_t attempts = 0, events = 0;
+	int i;
+
+	start = now();
+	do {
+		if (!build_event(env, &ev, CREATED_AT + events) ||
+		    !mine_event(&ev, opts->difficulty, opts->threads))
+			return 0;
+
+		for (i = 0; i < ev.num_tags; i++) {
+			if (!strcmp(ev.tags[i].strs[0], "nonce"))
+				attempts += strtoull(ev.tags[i].strs[1], NULL, 10) + 1;
+		}
+		events++;
+		elapsed = now() - start;
+	} while (elapsed < opts->seconds);
+
+	report("mine_event", env->content_len, env->ntags, attempts,
+	       elapsed, 0);
+	return 1;
+}
+
+static int bench_generate_key(struct bench_env *env, struct bench_opts *opts)
+{
+	struct key key;
+	double start, elapsed;
+	uint64_t ops = 0, attempts = 0, n;
+
+	start = now();
+	do {
+		if (!generate_key(env->ctx, &key, NULL, 1))
+			return 0;
+		ops++;
+		elapsed = now() - start;
+	} while (elapsed < opts->seconds);
+
+	report("generate_key", 0, 0, ops, elapsed, 0);
+
+	if (!opts->key_difficulty)
+		return 1;
+
+	start = now();
+	do {
+		if (!mine_pubkey(env->ctx, key.secret, opts->key_difficulty,
+				 opts->threads, &n))
+			return 0;
+		attempts += n;
+		elapsed = now() - start;
+	} while (elapsed < opts->seconds);
+
+	report("generate_key_pow", 0, 0, attempts, elapsed, 0);
+	return 1;
+}
+
+static int selected(struct bench_opts *opts, const char *name)
+{
+	return !opts->only || strstr(name, opts->only);
+}
+
+static int parse_sizes(const char *arg, int *sizes, int *n)
+{
+	char *end;
+
+	for (*n = 0; *n < MAX_SIZES; arg = end + 1) {
+		sizes[(*n)++] = strtol(arg, &end, 10);
+		if (end == arg || sizes[*n - 1] < 0)
+			return 0;
+		if (!*end)
+			return 1;
+		if (*end != ',')
+			return 0;
+	}
+
+	return 0;
+}
+
+static int parse_opts(int argc, char *argv[], struct bench_opts *opts)
+{
+	const char *arg, *val;
+	int i;
+
+	opts->seconds = 0.5;
+	opts->content[0] = 0;
+	opts->content[1] = 256;
+	opts->content[2] = 4096;
+	opts->ncontent = 3;
+	opts->tags[0] = 0;
+	opts->tags[1] = 4;
+	opts->tags[2] = 32;
+	opts->ntags = 3;
+	opts->difficulty = 16;
+	opts->key_difficulty = 16;
+	opts->threads = 1;
+	opts->only = NULL;
+
+	for (i = 1; i < argc; i++) {
+		arg = argv[i];
+		if (i + 1 >= argc) {
+			fprintf(stderr, "missing value for '%s'\n", arg);
+			return 0;
+		}
+		val = argv[++i];
+
+		if (!strcmp(arg, "--seconds")) {
+			opts->seconds = atof(val);
+		} else if (!strcmp(arg, "--content")) {
+			if (!parse_sizes(val, opts->content, &opts->ncontent))
+				goto bad;
+		} else if (!strcmp(arg, "--tags")) {
+			if (!parse_sizes(val, opts->tags, &opts->ntags))
+				goto bad;
+		} else if (!strcmp(arg, "--difficulty")) {
+			opts->difficulty = atoi(val);
+		} else if (!strcmp(arg, "--key-difficulty")) {
+			opts->key_difficulty = atoi(val);
+		} else if (!strcmp(arg, "--threads")) {
+			opts->threads = atoi(val);
+		} else if (!strcmp(arg, "--only")) {
+			opts->only = val;
+		} else {
+			fprintf(stderr, "unexpected argument '%s'\n", arg);
+			return 0;
+		}
+	}
+
+	return 1;
+bad:
+	fprintf(stderr, "bad size list '%s', expected N,N,...\n", val);
+	return 0;
+}
+
+int main(int argc, char *argv[])
+{
+	static const char recipient[] =
+		"32e1827635450ebb3c5a7d12c1f8e7b2b514439ac10a67eef3d9fd9c5c68e245";
+	struct bench_opts opts;
+	struct bench_env env;
+	int c, t, ok = 1;
+
+	if (!parse_opts(argc, argv, &opts))
+		return 2;
+
+	memset(&env, 0, sizeof(env));
+	memset(env.key.secret, 0, 32);
+	env.key.secret[31] = 1;
+
+	if (!init_secp_context(&env.ctx) || !create_key(env.ctx, &env.key) ||
+	    !hex_decode(recipient, 64, env.recipient, 32)) {
+		fprintf(stderr, "could not set up the key\n");
+		return 2;
+	}
+
+	arena_init(&env.arena);
+
+	if (selected(&opts, "make_sig"))
+		ok &= bench_make_sig(&env, &opts);
+	if (selected(&opts, "generate_key"))
+		ok &= bench_generate_key(&env, &opts);
+
+	for (c = 0; ok && c < opts.ncontent; c++) {
+		free(env.content);
+		if (!(env.content = make_content(opts.content[c])))
+			return 2;
+		env.content_len = opts.content[c];
+
+		env.ntags = 0;
+		if (selected(&opts, "make_encrypted_dm"))
+			ok &= bench_encrypted_dm(&env, &opts);
+		if (selected(&opts, "aes_cbc"))
+			ok &= bench_aes(&env, &opts);
+
+		for (t = 0; ok && t < opts.ntags; t++) {
+			env.ntags = opts.tags[t];
+			if (selected(&opts, "event_commitment"))
+				ok &= bench_commitment(&env, &opts);
+			if (selected(&opts, "event_serialize"))
+				ok &= bench_serialize(&env, &opts);
+			if (selected(&opts, "sha256"))
+				ok &= bench_sha256(&env, &opts);
+			if (selected(&opts, "mine_event"))
+				ok &= bench_mine_event(&env, &opts);
+		}
+	}
+
+	if (!ok)
+		fprintf(stderr, "benchmark failed\n");
+
+	free(env.content);
+	arena_free(&env.arena);
+	secp256k1_context_destroy(env.ctx);
+	return !ok;
+}
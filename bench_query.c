@@ -0,0 +1,382 @@
+/* Benchmark for the store's filter queries over a synthetic corpus, one
+ * json object per result.
+ *
+ * usage: bench_query [--events N] [--dir DIR] [--queries N] [--check N]
+ *
+ * The corpus is --events events (default 10M) from 100k authors, a few
+ * of them much busier than the rest, mostly kind 1 notes with some
+ * reactions, reposts and contact lists, with e, p and t tags and
+ * created_at a little out of the order they were added in. It is made
+ * from a fixed seed, so runs are comparable, and kept in DIR (default
+ * bench-query-store) to be reused by the next run with the same --events.
+ * Ids and signatures are made up, the store doesn't check them.
+ *
+ * Each kind of filter runs --queries times (default 1000) with values
+ * picked at random from the corpus:
+ *
+ *   {"bench":"query/author_limit","events":..,"queries":..,
+ *    "seconds":..,"us_per_query":..,"results_per_query":..}
+ *
+ * --check N compares the first N queries of each kind with a scan of the
+ * whole store and exits 1 on a difference; the scans are slow on the full
+ * corpus, so use fewer --events with it.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <time.h>
+
+#include "hex.h"
+#include "arena.h"
+#include "json.h"
+#include "store.h"
+#include "query.h"
+
+#define AUTHORS 100000
+#define BUSY_AUTHORS 1000
+#define TOPICS 1000
+#define START_TIME 1600000000
+
+static double now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static uint64_t mix(uint64_t h)
+{
+	h ^= h >> 33;
+	h *= 0xff51afd7ed558ccdULL;
+	h ^= h >> 33;
+	h *= 0xc4ceb9fe1a85ec53ULL;
+	h ^= h >> 33;
+	return h;
+}
+
+static uint64_t rng = 0x6e6f737472696cULL;
+
+static uint64_t rnd(void)
+{
+	rng ^= rng >> 12;
+	rng ^= rng << 25;
+	rng ^= rng >> 27;
+	return rng * 0x2545f4914f6cdd1dULL;
+}
+
+/* ids and pubkeys are a function of the event and author numbers, so the
+ * queries can name them without keeping the corpus around */
+static void fake_hex(uint64_t seed, char hex[65])
+{
+	unsigned char bytes[32];
+	uint64_t w;
+	int i;
+
+	for (i = 0; i < 4; i++) {
+		w = mix(seed * 4 + i + 1);
+		memcpy(bytes + 8 * i, &w, 8);
+	}
+	hex_encode(bytes, 32, hex, 65);
+}
+
+static void event_id_hex(uint64_t i, char hex[65])
+{
+	fake_hex(i << 1, hex);
+}
+
+static void author_hex(uint64_t a, char hex[65])
+{
+	fake_hex((a << 1) | 1, hex);
+}
+
+static uint64_t pick_author(void)
+{
+	return rnd() % 5 ? rnd() % AUTHORS : rnd() % BUSY_AUTHORS;
+}
+
+/* a few topics are everywhere, most are rare */
+static uint64_t pick_topic(void)
+{
+	return rnd() % (1 + rnd() % TOPICS);
+}
+
+static int make_event(uint64_t i, char *buf, size_t size)
+{
+	char id[65], pubkey[65], hex[65], tags[1024];
+	uint64_t r = rnd() % 100, created_at, j;
+	int kind, n = 0, k;
+
+	created_at = START_TIME + i * 3 + rnd() % 600;
+	kind = r < 70 ? 1 : r < 85 ? 7 : r < 95 ? 6 : r < 98 ? 3 : 0;
+
+	event_id_hex(i, id);
+	author_hex(pick_author(), pubkey);
+
+	tags[0] = 0;
+	if (i && (kind == 6 || kind == 7 || (kind == 1 && rnd() % 10 < 4))) {
+		event_id_hex(rnd() % i, hex);
+		n += snprintf(tags + n, sizeof(tags) - n, "%s[\"e\",\"%s\"]", n ? "," : "", hex);
+	}
+	if (kind == 6 || kind == 7 || (kind == 1 && rnd() % 2)) {
+		author_hex(pick_author(), hex);
+		n += snprintf(tags + n, sizeof(tags) - n, "%s[\"p\",\"%s\"]", n ? "," : "", hex);
+	}
+	if (kind == 3) {
+		for (k = 0; k < 8; k++) {
+			author_hex(pick_author(), hex);
+			n += snprintf(tags + n, sizeof(tags) - n, "%s[\"p\",\"%s\"]", n ? "," : "", hex);
+		}
+	}
+	if (kind == 1 && rnd() % 10 < 3) {
+		j = pick_topic();
+		n += snprintf(tags + n, sizeof(tags) - n, "%s[\"t\",\"topic%" PRIu64 "\"]", n ? "," : "", j);
+	}
+
+	return snprintf(buf, size,
+		"{\"id\": \"%s\",\"pubkey\": \"%s\",\"created_at\": %" PRIu64 ",\"kind\": %d,"
+		"\"tags\": [%s],\"content\": \"note %" PRIu64 " about nothing much, just filling the corpus\","
+		"\"sig\": \"%s%s\"}",
+		id, pubkey, created_at, kind, tags, i, id, id);
+}
+
+static int make_corpus(struct store *s, uint64_t events)
+{
+	char buf[2048];
+	uint64_t i;
+	double start = now(), elapsed;
+	int len;
+
+	for (i = 0; i < events; i++) {
+		len = make_event(i, buf, sizeof(buf));
+		if (store_add(s, buf, len) != STORE_ADDED) {
+			fprintf(stderr, "could not add event %" PRIu64 "\n", i);
+			return 0;
+		}
+	}
+
+	elapsed = now() - start;
+	printf("{\"bench\":\"store_add\",\"events\":%" PRIu64 ",\"seconds\":%.3f,\"events_per_sec\":%.0f}\n",
+	       events, elapsed, events / elapsed);
+	return 1;
+}
+
+enum query_kind {
+	Q_AUTHOR_LIMIT,
+	Q_AUTHORS_LIMIT,
+	Q_KIND_LIMIT,
+	Q_TOPIC_LIMIT,
+	Q_MENTIONS_LIMIT,
+	Q_REPLIES,
+	Q_AUTHOR_KIND_LIMIT,
+	Q_KIND_TOPIC_LIMIT,
+	Q_IDS,
+	Q_LATEST,
+	Q_COUNT
+};
+
+static const char *query_names[] = {
+	"author_limit", "authors10_limit", "kind_limit", "topic_limit",
+	"mentions_limit", "replies", "author_kind_limit", "kind_topic_limit",
+	"ids", "latest"
+};
+
+/* the filter as nostril-query would make it */
+static int make_filter(enum query_kind kind, uint64_t events, char *buf, size_t size)
+{
+	char hex[65];
+	int n = 0, i;
+
+	switch (kind) {
+	case Q_AUTHOR_LIMIT:
+		author_hex(pick_author(), hex);
+		return snprintf(buf, size, "{\"authors\":[\"%s\"],\"limit\":20}", hex);
+	case Q_AUTHORS_LIMIT:
+		n = snprintf(buf, size, "{\"authors\":[");
+		for (i = 0; i < 10; i++) {
+			author_hex(pick_author(), hex);
+			n += snprintf(buf + n, size - n, "%s\"%s\"", i ? "," : "", hex);
+		}
+		return n + snprintf(buf + n, size - n, "],\"limit\":100}");
+	case Q_KIND_LIMIT:
+		return snprintf(buf, size, "{\"kinds\":[%d],\"limit\":50}", rnd() % 2 ? 7 : 3);
+	case Q_TOPIC_LIMIT:
+		return snprintf(buf, size, "{\"#t\":[\"topic%" PRIu64 "\"],\"limit\":50}", pick_topic());
+	case Q_MENTIONS_LIMIT:
+		author_hex(pick_author(), hex);
+		return snprintf(buf, size, "{\"#p\":[\"%s\"],\"limit\":20}", hex);
+	case Q_REPLIES:
+		event_id_hex(rnd() % events, hex);
+		return snprintf(buf, size, "{\"#e\":[\"%s\"]}", hex);
+	case Q_AUTHOR_KIND_LIMIT:
+		author_hex(pick_author(), hex);
+		return snprintf(buf, size, "{\"authors\":[\"%s\"],\"kinds\":[1],\"limit\":20}", hex);
+	case Q_KIND_TOPIC_LIMIT:
+		return snprintf(buf, size, "{\"kinds\":[1],\"#t\":[\"topic%" PRIu64 "\",\"topic%" PRIu64 "\"],\"limit\":10}",
+				pick_topic(), pick_topic());
+	case Q_IDS:
+		n = snprintf(buf, size, "{\"ids\":[");
+		for (i = 0; i < 5; i++) {
+			event_id_hex(rnd() % events, hex);
+			n += snprintf(buf + n, size - n, "%s\"%s\"", i ? "," : "", hex);
+		}
+		return n + snprintf(buf + n, size - n, "]}");
+	default:
+		return snprintf(buf, size, "{\"limit\":100}");
+	}
+}
+
+struct results {
+	uint64_t *locs;
+	size_t num, cap;
+};
+
+static int collect(const struct store_rec *rec, uint64_t loc, void *data)
+{
+	struct results *r = data;
+	uint64_t *locs;
+
+	(void)rec;
+	if (r->num == r->cap) {
+		r->cap = r->cap ? r->cap * 2 : 256;
+		if (!(locs = realloc(r->locs, r->cap * sizeof(*locs))))
+			return 0;
+		r->locs = locs;
+	}
+	r->locs[r->num++] = loc;
+	return 1;
+}
+
+static int run_queries(struct query *q, enum query_kind kind, uint64_t events,
+		       int queries, int check)
+{
+	struct results got = { 0 }, want = { 0 };
+	struct nostr_filter *filter;
+	struct arena arena;
+	const char *subid;
+	char buf[2048];
+	double elapsed = 0, scan = 0, start;
+	uint64_t results = 0;
+	int i, num, ok = 1;
+
+	arena_init(&arena);
+
+	for (i = 0; ok && i < queries; i++) {
+		make_filter(kind, events, buf, sizeof(buf));
+		arena_reset(&arena);
+		if (!parse_req(buf, strlen(buf), &arena, &subid, &filter, &num)) {
+			ok = 0;
+			break;
+		}
+
+		got.num = 0;
+		start = now();
+		ok = query_run(q, filter, collect, &got);
+		elapsed += now() - start;
+		results += got.num;
+
+		if (!ok || i >= check)
+			continue;
+
+		want.num = 0;
+		start = now();
+		ok = query_scan(q, filter, collect, &want);
+		scan += now() - start;
+
+		if (ok && (got.num != want.num ||
+			   memcmp(got.locs, want.locs, got.num * sizeof(*got.locs)))) {
+			fprintf(stderr, "%s: %zu results from the index, %zu from a scan for %s\n",
+				query_names[kind], got.num, want.num, buf);
+			ok = 0;
+		}
+	}
+
+	if (ok) {
+		printf("{\"bench\":\"query/%s\",\"events\":%" PRIu64 ",\"queries\":%d,\"seconds\":%.3f,"
+		       "\"us_per_query\":%.1f,\"results_per_query\":%.1f",
+		       query_names[kind], events, queries, elapsed,
+		       elapsed / queries * 1e6, (double)results / queries);
+		if (check)
+			printf(",\"checked\":%d,\"us_per_scan\":%.0f",
+			       check < queries ? check : queries,
+			       scan / (check < queries ? check : queries) * 1e6);
+		printf("}\n");
+	}
+
+	free(got.locs);
+	free(want.locs);
+	arena_free(&arena);
+	return ok;
+}
+
+int main(int argc, char *argv[])
+{
+	const char *dir = "bench-query-store";
+	uint64_t events = 10000000;
+	struct store_stats stats;
+	struct store *s;
+	struct query *q;
+	double start;
+	int i, k, queries = 1000, check = 0, ok = 1;
+
+	for (i = 1; i < argc; i++) {
+		if (i + 1 < argc && !strcmp(argv[i], "--events")) {
+			events = strtoull(argv[++i], NULL, 10);
+		} else if (i + 1 < argc && !strcmp(argv[i], "--dir")) {
+			dir = argv[++i];
+		} else if (i + 1 < argc && !strcmp(argv[i], "--queries")) {
+			queries = atoi(argv[++i]);
+		} else if (i + 1 < argc && !strcmp(argv[i], "--check")) {
+			check = atoi(argv[++i]);
+		} else {
+			fprintf(stderr, "usage: bench_query [--events N] [--dir DIR] [--queries N] [--check N]\n");
+			return 10;
+		}
+	}
+
+	if (!events || queries < 1) {
+		fprintf(stderr, "need at least one event and one query\n");
+		return 10;
+	}
+
+	if (!(s = store_open(dir)))
+		return 2;
+	/* the corpus ids are made up so queries can name them */
+	store_set_checks(s, 0, NULL, NULL);
+
+	store_stats(s, &stats);
+	if (stats.events != events) {
+		if (stats.events) {
+			fprintf(stderr, "'%s' has %" PRIu64 " events, not %" PRIu64 ", remove it first\n",
+				dir, stats.events, events);
+			store_close(s);
+			return 2;
+		}
+		if (!make_corpus(s, events)) {
+			store_close(s);
+			return 2;
+		}
+	}
+
+	start = now();
+	if (!(q = query_open(s, 0))) {
+		store_close(s);
+		return 2;
+	}
+	printf("{\"bench\":\"query_open\",\"events\":%" PRIu64 ",\"seconds\":%.3f}\n",
+	       events, now() - start);
+
+	for (k = 0; ok && k < Q_COUNT; k++)
+		ok = run_queries(q, k, events, queries, check);
+
+	query_close(q);
+	if (!store_close(s))
+		ok = 0;
+
+	if (!ok) {
+		fprintf(stderr, "benchmark failed\n");
+		return 1;
+	}
+
+	return 0;
+}
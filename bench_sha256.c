@@ -0,0 +1,74 @@
+/* Microbenchmark for the sha256_many() kernels.
+ *
+ * usage: bench_sha256 [seconds per run]
+ *
+ * For every kernel the cpu supports, hash batches of equal-length messages
+ * and report hashes/s and MB/s next to the scalar sha256_update() path.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "sha256.h"
+
+#define BATCH 64
+
+static double now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void bench(enum sha256_kernel kernel, size_t len, double seconds)
+{
+	static struct sha256 res[BATCH];
+	const unsigned char *msgs[BATCH];
+	unsigned char *data;
+	double start, elapsed;
+	unsigned long long hashes = 0;
+	size_t i;
+
+	data = malloc(len * BATCH + 1);
+	for (i = 0; i < len * BATCH; i++)
+		data[i] = (unsigned char)(i * 131);
+	for (i = 0; i < BATCH; i++)
+		msgs[i] = data + i * len;
+
+	sha256_set_kernel(kernel);
+
+	start = now();
+	do {
+		for (i = 0; i < 16; i++) {
+			sha256_many(res, NULL, msgs, len, BATCH);
+			hashes += BATCH;
+		}
+		elapsed = now() - start;
+	} while (elapsed < seconds);
+
+	printf("%-10s %6zu %14.0f %10.1f\n", sha256_kernel_name(kernel), len,
+	       hashes / elapsed, hashes * len / elapsed / 1e6);
+
+	free(data);
+}
+
+int main(int argc, char *argv[])
+{
+	static const size_t lens[] = { 64, 256, 1024, 4096 };
+	double seconds = argc > 1 ? atof(argv[1]) : 0.5;
+	size_t l;
+	int k;
+
+	printf("selected kernel: %s\n", sha256_kernel_name(SHA256_KERNEL_AUTO));
+	printf("%-10s %6s %14s %10s\n", "kernel", "bytes", "hashes/s", "MB/s");
+
+	for (l = 0; l < sizeof(lens) / sizeof(lens[0]); l++) {
+		for (k = SHA256_KERNEL_SCALAR; k < SHA256_KERNEL_COUNT; k++) {
+			if (sha256_kernel_supported(k))
+				bench(k, lens[l], seconds);
+		}
+	}
+
+	return 0;
+}
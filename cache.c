@@ -0,0 +1,192 @@
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "cache.h"
+
+#define NIL -1
+
+struct cache_entry {
+	unsigned char key[32];
+	unsigned char val[32];
+
+	/* next entry in the same hash bucket */
+	int chain;
+
+	/* neighbours in recency order, head is the most recent */
+	int prev, next;
+};
+
+struct cache {
+	pthread_mutex_t lock;
+	struct cache_entry *entries;
+	int *buckets;
+	unsigned mask;
+	int capacity, used;
+	int head, tail;
+	uint64_t hits, misses;
+};
+
+/* keys are x coordinates, so their first bytes are already uniform */
+static unsigned bucket_of(struct cache *c, const unsigned char key[32])
+{
+	unsigned h;
+
+	memcpy(&h, key, sizeof(h));
+	return h & c->mask;
+}
+
+struct cache *cache_new(int capacity)
+{
+	struct cache *c;
+	unsigned nbuckets = 1;
+
+	if (capacity < 1)
+		capacity = 1;
+	while (nbuckets < (unsigned)capacity)
+		nbuckets *= 2;
+
+	if (!(c = calloc(1, sizeof(*c))))
+		return NULL;
+
+	pthread_mutex_init(&c->lock, NULL);
+	c->entries = calloc(capacity, sizeof(*c->entries));
+	c->buckets = malloc(nbuckets * sizeof(*c->buckets));
+	if (!c->entries || !c->buckets) {
+		cache_free(c);
+		return NULL;
+	}
+
+	memset(c->buckets, 0xff, nbuckets * sizeof(*c->buckets));
+	c->mask = nbuckets - 1;
+	c->capacity = capacity;
+	c->head = c->tail = NIL;
+	return c;
+}
+
+static void unlink_recent(struct cache *c, int i)
+{
+	struct cache_entry *e = &c->entries[i];
+
+	if (e->prev == NIL)
+		c->head = e->next;
+	else
+		c->entries[e->prev].next = e->next;
+
+	if (e->next == NIL)
+		c->tail = e->prev;
+	else
+		c->entries[e->next].prev = e->prev;
+}
+
+static void push_recent(struct cache *c, int i)
+{
+	struct cache_entry *e = &c->entries[i];
+
+	e->prev = NIL;
+	e->next = c->head;
+	if (c->head != NIL)
+		c->entries[c->head].prev = i;
+	c->head = i;
+	if (c->tail == NIL)
+		c->tail = i;
+}
+
+static int lookup(struct cache *c, const unsigned char key[32])
+{
+	int i;
+
+	for (i = c->buckets[bucket_of(c, key)]; i != NIL; i = c->entries[i].chain) {
+		if (!memcmp(c->entries[i].key, key, 32))
+			return i;
+	}
+	return NIL;
+}
+
+int cache_get(struct cache *c, const unsigned char key[32], unsigned char val[32])
+{
+	int i;
+
+	pthread_mutex_lock(&c->lock);
+
+	if ((i = lookup(c, key)) != NIL) {
+		memcpy(val, c->entries[i].val, 32);
+		if (c->head != i) {
+			unlink_recent(c, i);
+			push_recent(c, i);
+		}
+		c->hits++;
+	} else {
+		c->misses++;
+	}
+
+	pthread_mutex_unlock(&c->lock);
+	return i != NIL;
+}
+
+/* take the least recently used entry out of its bucket and the list */
+static int evict(struct cache *c)
+{
+	int i = c->tail, *p;
+
+	for (p = &c->buckets[bucket_of(c, c->entries[i].key)]; *p != i; p = &c->entries[*p].chain)
+		;
+	*p = c->entries[i].chain;
+
+	unlink_recent(c, i);
+	return i;
+}
+
+void cache_put(struct cache *c, const unsigned char key[32], const unsigned char val[32])
+{
+	unsigned b;
+	int i;
+
+	pthread_mutex_lock(&c->lock);
+
+	/* another thread may have computed the same secret meanwhile */
+	if ((i = lookup(c, key)) != NIL) {
+		memcpy(c->entries[i].val, val, 32);
+		pthread_mutex_unlock(&c->lock);
+		return;
+	}
+
+	i = c->used < c->capacity ? c->used++ : evict(c);
+
+	memcpy(c->entries[i].key, key, 32);
+	memcpy(c->entries[i].val, val, 32);
+	b = bucket_of(c, key);
+	c->entries[i].chain = c->buckets[b];
+	c->buckets[b] = i;
+	push_recent(c, i);
+
+	pthread_mutex_unlock(&c->lock);
+}
+
+void cache_stats(struct cache *c, uint64_t *hits, uint64_t *misses)
+{
+	pthread_mutex_lock(&c->lock);
+	*hits = c->hits;
+	*misses = c->misses;
+	pthread_mutex_unlock(&c->lock);
+}
+
+void cache_free(struct cache *c)
+{
+	if (!c)
+		return;
+
+	if (c->entries) {
+		/* volatile so the wipe isn't optimized away as a dead store */
+		volatile unsigned char *p = (volatile unsigned char *)c->entries;
+		size_t i, n = (size_t)c->capacity * sizeof(*c->entries);
+
+		for (i = 0; i < n; i++)
+			p[i] = 0;
+	}
+
+	pthread_mutex_destroy(&c->lock);
+	free(c->entries);
+	free(c->buckets);
+	free(c);
+}
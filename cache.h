@@ -0,0 +1,24 @@
+#ifndef CACHE_H
+#define CACHE_H
+
+#include <stdint.h>
+
+/* A fixed size LRU map from 32 byte keys to 32 byte values, shared by
+ * worker threads. Used to keep ECDH shared secrets per counterparty
+ * pubkey, so values are wiped when they're evicted or freed. */
+struct cache;
+
+struct cache *cache_new(int capacity);
+
+/* copy the value for key into val and mark it recently used, returns 0 if
+ * it isn't cached */
+int cache_get(struct cache *c, const unsigned char key[32], unsigned char val[32]);
+
+/* insert or update key, evicting the least recently used entry when full */
+void cache_put(struct cache *c, const unsigned char key[32], const unsigned char val[32]);
+
+void cache_stats(struct cache *c, uint64_t *hits, uint64_t *misses);
+
+void cache_free(struct cache *c);
+
+#endif
@@ -0,0 +1,543 @@
+#include <string.h>
+#include <stdint.h>
+
+#include "codec.h"
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define CODEC_X86_KERNELS 1
+#include <immintrin.h>
+#endif
+
+static const char hexdigits[] = "0123456789abcdef";
+
+/* 0-15 for hex digits, 0xff for everything else */
+static const unsigned char hexval[256] = {
+	['0'] = 1, ['1'] = 2, ['2'] = 3, ['3'] = 4, ['4'] = 5,
+	['5'] = 6, ['6'] = 7, ['7'] = 8, ['8'] = 9, ['9'] = 10,
+	['a'] = 11, ['b'] = 12, ['c'] = 13, ['d'] = 14, ['e'] = 15, ['f'] = 16,
+	['A'] = 11, ['B'] = 12, ['C'] = 13, ['D'] = 14, ['E'] = 15, ['F'] = 16,
+};
+
+static void hex_encode_scalar(const unsigned char *in, size_t n, char *out)
+{
+	size_t i;
+
+	for (i = 0; i < n; i++) {
+		out[2*i] = hexdigits[in[i] >> 4];
+		out[2*i+1] = hexdigits[in[i] & 15];
+	}
+}
+
+static int hex_decode_scalar(const char *in, size_t n, unsigned char *out)
+{
+	unsigned char hi, lo;
+	size_t i;
+
+	/* the table is offset by one so that zero can mean invalid */
+	for (i = 0; i < n; i++) {
+		hi = hexval[(unsigned char)in[2*i]];
+		lo = hexval[(unsigned char)in[2*i+1]];
+		if (!hi || !lo)
+			return 0;
+		out[i] = (hi - 1) << 4 | (lo - 1);
+	}
+
+	return 1;
+}
+
+static const unsigned char json_escaped[256] = {
+	['"'] = 1, ['\\'] = 1, ['\b'] = 1, ['\f'] = 1,
+	['\n'] = 1, ['\r'] = 1, ['\t'] = 1,
+};
+
+static size_t json_plain_scalar(const char *s, size_t n)
+{
+	size_t i;
+
+	for (i = 0; i < n && !json_escaped[(unsigned char)s[i]]; i++)
+		;
+	return i;
+}
+
+#ifdef CODEC_X86_KERNELS
+/* 16 bytes to 32 digits: split the nibbles, look them up with pshufb and
+ * interleave them back in order */
+__attribute__((target("ssse3")))
+static void hex_encode_ssse3(const unsigned char *in, size_t n, char *out)
+{
+	const __m128i lut = _mm_loadu_si128((const __m128i *)hexdigits);
+	const __m128i mask = _mm_set1_epi8(0x0f);
+	__m128i v, hi, lo;
+	size_t i;
+
+	for (i = 0; i + 16 <= n; i += 16) {
+		v = _mm_loadu_si128((const __m128i *)(in + i));
+		hi = _mm_shuffle_epi8(lut, _mm_and_si128(_mm_srli_epi16(v, 4), mask));
+		lo = _mm_shuffle_epi8(lut, _mm_and_si128(v, mask));
+		_mm_storeu_si128((__m128i *)(out + 2*i), _mm_unpacklo_epi8(hi, lo));
+		_mm_storeu_si128((__m128i *)(out + 2*i + 16), _mm_unpackhi_epi8(hi, lo));
+	}
+
+	hex_encode_scalar(in + i, n - i, out + 2*i);
+}
+
+/* nibble values for 16 digits, and a mask of which ones were digits */
+__attribute__((target("ssse3")))
+static inline __m128i hex_values_ssse3(__m128i c, int *valid)
+{
+	__m128i d = _mm_sub_epi8(c, _mm_set1_epi8('0'));
+	__m128i l = _mm_sub_epi8(_mm_or_si128(c, _mm_set1_epi8(0x20)), _mm_set1_epi8('a'));
+	__m128i is_digit = _mm_cmpeq_epi8(_mm_min_epu8(d, _mm_set1_epi8(9)), d);
+	__m128i is_letter = _mm_cmpeq_epi8(_mm_min_epu8(l, _mm_set1_epi8(5)), l);
+
+	*valid = _mm_movemask_epi8(_mm_or_si128(is_digit, is_letter)) == 0xffff;
+
+	return _mm_or_si128(_mm_and_si128(is_digit, d),
+			    _mm_and_si128(is_letter, _mm_add_epi8(l, _mm_set1_epi8(10))));
+}
+
+__attribute__((target("ssse3")))
+static int hex_decode_ssse3(const char *in, size_t n, unsigned char *out)
+{
+	/* hi * 16 + lo for every pair of nibbles */
+	const __m128i weights = _mm_set1_epi16(0x0110);
+	__m128i a, b;
+	size_t i;
+	int va, vb;
+
+	for (i = 0; i + 16 <= n; i += 16) {
+		a = hex_values_ssse3(_mm_loadu_si128((const __m128i *)(in + 2*i)), &va);
+		b = hex_values_ssse3(_mm_loadu_si128((const __m128i *)(in + 2*i + 16)), &vb);
+		if (!va || !vb)
+			return 0;
+		a = _mm_maddubs_epi16(a, weights);
+		b = _mm_maddubs_epi16(b, weights);
+		_mm_storeu_si128((__m128i *)(out + i), _mm_packus_epi16(a, b));
+	}
+
+	return hex_decode_scalar(in + 2*i, n - i, out + i);
+}
+
+__attribute__((target("avx2")))
+static void hex_encode_avx2(const unsigned char *in, size_t n, char *out)
+{
+	const __m256i lut = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)hexdigits));
+	const __m256i mask = _mm256_set1_epi8(0x0f);
+	__m256i v, hi, lo, a, b;
+	size_t i;
+
+	for (i = 0; i + 32 <= n; i += 32) {
+		v = _mm256_loadu_si256((const __m256i *)(in + i));
+		hi = _mm256_shuffle_epi8(lut, _mm256_and_si256(_mm256_srli_epi16(v, 4), mask));
+		lo = _mm256_shuffle_epi8(lut, _mm256_and_si256(v, mask));
+		/* the unpacks work per 128 bit lane, so put the lanes back in
+		 * order before storing */
+		a = _mm256_unpacklo_epi8(hi, lo);
+		b = _mm256_unpackhi_epi8(hi, lo);
+		_mm256_storeu_si256((__m256i *)(out + 2*i), _mm256_permute2x128_si256(a, b, 0x20));
+		_mm256_storeu_si256((__m256i *)(out + 2*i + 32), _mm256_permute2x128_si256(a, b, 0x31));
+	}
+
+	hex_encode_ssse3(in + i, n - i, out + 2*i);
+}
+
+__attribute__((target("avx2")))
+static inline __m256i hex_values_avx2(__m256i c, int *valid)
+{
+	__m256i d = _mm256_sub_epi8(c, _mm256_set1_epi8('0'));
+	__m256i l = _mm256_sub_epi8(_mm256_or_si256(c, _mm256_set1_epi8(0x20)), _mm256_set1_epi8('a'));
+	__m256i is_digit = _mm256_cmpeq_epi8(_mm256_min_epu8(d, _mm256_set1_epi8(9)), d);
+	__m256i is_letter = _mm256_cmpeq_epi8(_mm256_min_epu8(l, _mm256_set1_epi8(5)), l);
+
+	*valid = _mm256_movemask_epi8(_mm256_or_si256(is_digit, is_letter)) == -1;
+
+	return _mm256_or_si256(_mm256_and_si256(is_digit, d),
+			       _mm256_and_si256(is_letter, _mm256_add_epi8(l, _mm256_set1_epi8(10))));
+}
+
+__attribute__((target("avx2")))
+static int hex_decode_avx2(const char *in, size_t n, unsigned char *out)
+{
+	const __m256i weights = _mm256_set1_epi16(0x0110);
+	__m256i a, b;
+	size_t i;
+	int va, vb;
+
+	for (i = 0; i + 32 <= n; i += 32) {
+		a = hex_values_avx2(_mm256_loadu_si256((const __m256i *)(in + 2*i)), &va);
+		b = hex_values_avx2(_mm256_loadu_si256((const __m256i *)(in + 2*i + 32)), &vb);
+		if (!va || !vb)
+			return 0;
+		a = _mm256_maddubs_epi16(a, weights);
+		b = _mm256_maddubs_epi16(b, weights);
+		/* packus interleaves the lanes of a and b, undo that */
+		_mm256_storeu_si256((__m256i *)(out + i),
+				    _mm256_permute4x64_epi64(_mm256_packus_epi16(a, b), 0xd8));
+	}
+
+	return hex_decode_ssse3(in + 2*i, n - i, out + i);
+}
+
+/* Base64 after Muła and Lemire, "Faster Base64 Encoding and Decoding
+ * using AVX2 Instructions". Encoding spreads each 3 bytes over 4 lanes
+ * and turns the 6 bit indices into characters with one pshufb of
+ * offsets. Decoding classifies characters by their nibbles, which also
+ * finds the invalid ones, then packs 4 x 6 bits back into 3 bytes. */
+__attribute__((target("ssse3")))
+static inline __m128i b64_enc_reshuffle(__m128i in)
+{
+	__m128i t0, t1, t2, t3;
+
+	in = _mm_shuffle_epi8(in, _mm_set_epi8(10, 11, 9, 10, 7, 8, 6, 7, 4, 5, 3, 4, 1, 2, 0, 1));
+	t0 = _mm_and_si128(in, _mm_set1_epi32(0x0fc0fc00));
+	t1 = _mm_mulhi_epu16(t0, _mm_set1_epi32(0x04000040));
+	t2 = _mm_and_si128(in, _mm_set1_epi32(0x003f03f0));
+	t3 = _mm_mullo_epi16(t2, _mm_set1_epi32(0x01000010));
+	return _mm_or_si128(t1, t3);
+}
+
+__attribute__((target("ssse3")))
+static inline __m128i b64_enc_translate(__m128i in)
+{
+	const __m128i lut = _mm_setr_epi8(65, 71, -4, -4, -4, -4, -4, -4,
+					  -4, -4, -4, -4, -19, -16, 0, 0);
+	__m128i idx = _mm_subs_epu8(in, _mm_set1_epi8(51));
+	idx = _mm_sub_epi8(idx, _mm_cmpgt_epi8(in, _mm_set1_epi8(25)));
+	return _mm_add_epi8(in, _mm_shuffle_epi8(lut, idx));
+}
+
+/* 16 characters to 12 bytes in the low bytes, 0 if any was invalid */
+__attribute__((target("ssse3")))
+static inline int b64_dec_block(__m128i in, __m128i *out)
+{
+	const __m128i lut_lo = _mm_setr_epi8(0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11,
+					     0x11, 0x11, 0x13, 0x1a, 0x1b, 0x1b, 0x1b, 0x1a);
+	const __m128i lut_hi = _mm_setr_epi8(0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08,
+					     0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10);
+	const __m128i lut_roll = _mm_setr_epi8(0, 16, 19, 4, -65, -65, -71, -71,
+					       0, 0, 0, 0, 0, 0, 0, 0);
+	const __m128i mask = _mm_set1_epi8(0x0f);
+	__m128i hi_nibbles = _mm_and_si128(_mm_srli_epi32(in, 4), mask);
+	__m128i lo_nibbles = _mm_and_si128(in, mask);
+	__m128i lo = _mm_shuffle_epi8(lut_lo, lo_nibbles);
+	__m128i hi = _mm_shuffle_epi8(lut_hi, hi_nibbles);
+	__m128i eq_2f, roll, v;
+
+	if (_mm_movemask_epi8(_mm_cmpgt_epi8(_mm_and_si128(lo, hi), _mm_setzero_si128())))
+		return 0;
+
+	eq_2f = _mm_cmpeq_epi8(in, _mm_set1_epi8(0x2f));
+	roll = _mm_shuffle_epi8(lut_roll, _mm_add_epi8(eq_2f, hi_nibbles));
+	v = _mm_add_epi8(in, roll);
+
+	v = _mm_maddubs_epi16(v, _mm_set1_epi32(0x01400140));
+	v = _mm_madd_epi16(v, _mm_set1_epi32(0x00011000));
+	*out = _mm_shuffle_epi8(v, _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12,
+						 -1, -1, -1, -1));
+	return 1;
+}
+
+__attribute__((target("ssse3")))
+static size_t b64_encode_ssse3(const unsigned char *src, size_t srclen, char *dest)
+{
+	size_t i, o = 0;
+	__m128i v;
+
+	/* each step reads 16 bytes but only uses 12 */
+	for (i = 0; i + 16 <= srclen; i += 12, o += 16) {
+		v = b64_enc_reshuffle(_mm_loadu_si128((const __m128i *)(src + i)));
+		_mm_storeu_si128((__m128i *)(dest + o), b64_enc_translate(v));
+	}
+
+	return i;
+}
+
+__attribute__((target("ssse3")))
+static size_t b64_decode_ssse3(const char *src, size_t srclen, unsigned char *dest)
+{
+	unsigned char block[16];
+	size_t i, o = 0;
+	__m128i v;
+
+	/* the scalar code has to see the last quartet, it may be padded */
+	for (i = 0; i + 16 < srclen; i += 16, o += 12) {
+		if (!b64_dec_block(_mm_loadu_si128((const __m128i *)(src + i)), &v))
+			break;
+		_mm_storeu_si128((__m128i *)block, v);
+		memcpy(dest + o, block, 12);
+	}
+
+	return i;
+}
+
+__attribute__((target("avx2")))
+static size_t b64_encode_avx2(const unsigned char *src, size_t srclen, char *dest)
+{
+	size_t i, o = 0;
+	__m256i v, t0, t1, t2, t3, idx;
+	__m128i v128;
+
+	const __m256i shuf = _mm256_set_epi8(10, 11, 9, 10, 7, 8, 6, 7, 4, 5, 3, 4, 1, 2, 0, 1,
+					     10, 11, 9, 10, 7, 8, 6, 7, 4, 5, 3, 4, 1, 2, 0, 1);
+	const __m256i lut = _mm256_setr_epi8(65, 71, -4, -4, -4, -4, -4, -4,
+					     -4, -4, -4, -4, -19, -16, 0, 0,
+					     65, 71, -4, -4, -4, -4, -4, -4,
+					     -4, -4, -4, -4, -19, -16, 0, 0);
+
+	/* 12 bytes into each lane, the second load reads 4 bytes past them */
+	for (i = 0; i + 28 <= srclen; i += 24, o += 32) {
+		v = _mm256_inserti128_si256(
+			_mm256_castsi128_si256(_mm_loadu_si128((const __m128i *)(src + i))),
+			_mm_loadu_si128((const __m128i *)(src + i + 12)), 1);
+
+		v = _mm256_shuffle_epi8(v, shuf);
+		t0 = _mm256_and_si256(v, _mm256_set1_epi32(0x0fc0fc00));
+		t1 = _mm256_mulhi_epu16(t0, _mm256_set1_epi32(0x04000040));
+		t2 = _mm256_and_si256(v, _mm256_set1_epi32(0x003f03f0));
+		t3 = _mm256_mullo_epi16(t2, _mm256_set1_epi32(0x01000010));
+		v = _mm256_or_si256(t1, t3);
+
+		idx = _mm256_subs_epu8(v, _mm256_set1_epi8(51));
+		idx = _mm256_sub_epi8(idx, _mm256_cmpgt_epi8(v, _mm256_set1_epi8(25)));
+		v = _mm256_add_epi8(v, _mm256_shuffle_epi8(lut, idx));
+
+		_mm256_storeu_si256((__m256i *)(dest + o), v);
+	}
+
+	/* finish with 128 bit blocks here rather than calling the ssse3
+	 * kernel, so the whole loop stays vex encoded */
+	for (; i + 16 <= srclen; i += 12, o += 16) {
+		v128 = b64_enc_reshuffle(_mm_loadu_si128((const __m128i *)(src + i)));
+		_mm_storeu_si128((__m128i *)(dest + o), b64_enc_translate(v128));
+	}
+
+	return i;
+}
+
+__attribute__((target("avx2")))
+static size_t b64_decode_avx2(const char *src, size_t srclen, unsigned char *dest)
+{
+	const __m256i lut_lo = _mm256_setr_epi8(0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11,
+						0x11, 0x11, 0x13, 0x1a, 0x1b, 0x1b, 0x1b, 0x1a,
+						0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11,
+						0x11, 0x11, 0x13, 0x1a, 0x1b, 0x1b, 0x1b, 0x1a);
+	const __m256i lut_hi = _mm256_setr_epi8(0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08,
+						0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10,
+						0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08,
+						0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10);
+	const __m256i lut_roll = _mm256_setr_epi8(0, 16, 19, 4, -65, -65, -71, -71,
+						  0, 0, 0, 0, 0, 0, 0, 0,
+						  0, 16, 19, 4, -65, -65, -71, -71,
+						  0, 0, 0, 0, 0, 0, 0, 0);
+	const __m256i pack = _mm256_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1,
+					      2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1);
+	const __m256i mask = _mm256_set1_epi8(0x0f);
+	__m256i in, hi_nibbles, lo, hi, roll, v;
+	__m128i v128;
+	unsigned char block[32];
+	size_t i, o = 0;
+
+	for (i = 0; i + 32 < srclen; i += 32, o += 24) {
+		in = _mm256_loadu_si256((const __m256i *)(src + i));
+		hi_nibbles = _mm256_and_si256(_mm256_srli_epi32(in, 4), mask);
+		lo = _mm256_shuffle_epi8(lut_lo, _mm256_and_si256(in, mask));
+		hi = _mm256_shuffle_epi8(lut_hi, hi_nibbles);
+		if (!_mm256_testz_si256(lo, hi))
+			break;
+
+		roll = _mm256_shuffle_epi8(lut_roll,
+			_mm256_add_epi8(_mm256_cmpeq_epi8(in, _mm256_set1_epi8(0x2f)), hi_nibbles));
+		v = _mm256_add_epi8(in, roll);
+		v = _mm256_maddubs_epi16(v, _mm256_set1_epi32(0x01400140));
+		v = _mm256_madd_epi16(v, _mm256_set1_epi32(0x00011000));
+		v = _mm256_shuffle_epi8(v, pack);
+		/* 12 bytes at the bottom of each lane, close the gap */
+		v = _mm256_permutevar8x32_epi32(v, _mm256_setr_epi32(0, 1, 2, 4, 5, 6, 3, 7));
+
+		_mm256_storeu_si256((__m256i *)block, v);
+		memcpy(dest + o, block, 24);
+	}
+
+	for (; i + 16 < srclen; i += 16, o += 12) {
+		if (!b64_dec_block(_mm_loadu_si128((const __m128i *)(src + i)), &v128))
+			break;
+		_mm_storeu_si128((__m128i *)block, v128);
+		memcpy(dest + o, block, 12);
+	}
+
+	return i;
+}
+
+/* \b \t \n \f \r are 8 9 10 12 13, so one range check minus \v */
+__attribute__((target("ssse3")))
+static inline int json_escape_mask_ssse3(__m128i c)
+{
+	__m128i ctl = _mm_sub_epi8(c, _mm_set1_epi8('\b'));
+	__m128i m = _mm_cmpeq_epi8(_mm_min_epu8(ctl, _mm_set1_epi8(5)), ctl);
+
+	m = _mm_andnot_si128(_mm_cmpeq_epi8(c, _mm_set1_epi8('\v')), m);
+	m = _mm_or_si128(m, _mm_cmpeq_epi8(c, _mm_set1_epi8('"')));
+	m = _mm_or_si128(m, _mm_cmpeq_epi8(c, _mm_set1_epi8('\\')));
+	return _mm_movemask_epi8(m);
+}
+
+__attribute__((target("ssse3")))
+static size_t json_plain_ssse3(const char *s, size_t n)
+{
+	size_t i;
+	int m;
+
+	for (i = 0; i + 16 <= n; i += 16) {
+		if ((m = json_escape_mask_ssse3(_mm_loadu_si128((const __m128i *)(s + i)))))
+			return i + __builtin_ctz(m);
+	}
+
+	return i + json_plain_scalar(s + i, n - i);
+}
+
+__attribute__((target("avx2")))
+static size_t json_plain_avx2(const char *s, size_t n)
+{
+	__m256i c, ctl, m;
+	size_t i;
+	unsigned bits;
+
+	for (i = 0; i + 32 <= n; i += 32) {
+		c = _mm256_loadu_si256((const __m256i *)(s + i));
+		ctl = _mm256_sub_epi8(c, _mm256_set1_epi8('\b'));
+		m = _mm256_cmpeq_epi8(_mm256_min_epu8(ctl, _mm256_set1_epi8(5)), ctl);
+		m = _mm256_andnot_si256(_mm256_cmpeq_epi8(c, _mm256_set1_epi8('\v')), m);
+		m = _mm256_or_si256(m, _mm256_cmpeq_epi8(c, _mm256_set1_epi8('"')));
+		m = _mm256_or_si256(m, _mm256_cmpeq_epi8(c, _mm256_set1_epi8('\\')));
+		if ((bits = _mm256_movemask_epi8(m)))
+			return i + __builtin_ctz(bits);
+	}
+
+	if (i + 16 <= n && (bits = json_escape_mask_ssse3(_mm_loadu_si128((const __m128i *)(s + i)))))
+		return i + __builtin_ctz(bits);
+	if (i + 16 <= n)
+		i += 16;
+
+	return i + json_plain_scalar(s + i, n - i);
+}
+
+static int cpu_has_ssse3(void)
+{
+	return __builtin_cpu_supports("ssse3");
+}
+#endif /* CODEC_X86_KERNELS */
+
+static int kernel_supported(enum codec_kernel kernel)
+{
+	switch (kernel) {
+	case CODEC_KERNEL_AUTO:
+	case CODEC_KERNEL_SCALAR:
+		return 1;
+#ifdef CODEC_X86_KERNELS
+	case CODEC_KERNEL_SSSE3:
+		return cpu_has_ssse3();
+	case CODEC_KERNEL_AVX2:
+		return cpu_has_ssse3() && __builtin_cpu_supports("avx2");
+#endif
+	default:
+		return 0;
+	}
+}
+
+static enum codec_kernel best_kernel(void)
+{
+	if (kernel_supported(CODEC_KERNEL_AVX2))
+		return CODEC_KERNEL_AVX2;
+	if (kernel_supported(CODEC_KERNEL_SSSE3))
+		return CODEC_KERNEL_SSSE3;
+	return CODEC_KERNEL_SCALAR;
+}
+
+/* 0 means not selected yet; selection is idempotent, so racing threads
+ * just agree on the same answer */
+static enum codec_kernel selected_kernel;
+
+static enum codec_kernel current_kernel(void)
+{
+	if (selected_kernel == CODEC_KERNEL_AUTO)
+		selected_kernel = best_kernel();
+	return selected_kernel;
+}
+
+int codec_kernel_supported(enum codec_kernel kernel)
+{
+	return kernel_supported(kernel);
+}
+
+const char *codec_kernel_name(enum codec_kernel kernel)
+{
+	switch (kernel == CODEC_KERNEL_AUTO ? current_kernel() : kernel) {
+	case CODEC_KERNEL_SCALAR: return "scalar";
+	case CODEC_KERNEL_SSSE3: return "ssse3";
+	case CODEC_KERNEL_AVX2: return "avx2";
+	default: return "unknown";
+	}
+}
+
+int codec_set_kernel(enum codec_kernel kernel)
+{
+	if (!kernel_supported(kernel))
+		return 0;
+	selected_kernel = kernel == CODEC_KERNEL_AUTO ? best_kernel() : kernel;
+	return 1;
+}
+
+void codec_hex_encode(const unsigned char *in, size_t n, char *out)
+{
+	switch (current_kernel()) {
+#ifdef CODEC_X86_KERNELS
+	case CODEC_KERNEL_AVX2: hex_encode_avx2(in, n, out); return;
+	case CODEC_KERNEL_SSSE3: hex_encode_ssse3(in, n, out); return;
+#endif
+	default: hex_encode_scalar(in, n, out); return;
+	}
+}
+
+int codec_hex_decode(const char *in, size_t n, unsigned char *out)
+{
+	switch (current_kernel()) {
+#ifdef CODEC_X86_KERNELS
+	case CODEC_KERNEL_AVX2: return hex_decode_avx2(in, n, out);
+	case CODEC_KERNEL_SSSE3: return hex_decode_ssse3(in, n, out);
+#endif
+	default: return hex_decode_scalar(in, n, out);
+	}
+}
+
+size_t codec_base64_encode_blocks(const unsigned char *src, size_t srclen, char *dest)
+{
+	switch (current_kernel()) {
+#ifdef CODEC_X86_KERNELS
+	case CODEC_KERNEL_AVX2: return b64_encode_avx2(src, srclen, dest);
+	case CODEC_KERNEL_SSSE3: return b64_encode_ssse3(src, srclen, dest);
+#endif
+	default: return 0;
+	}
+}
+
+size_t codec_base64_decode_blocks(const char *src, size_t srclen, unsigned char *dest)
+{
+	switch (current_kernel()) {
+#ifdef CODEC_X86_KERNELS
+	case CODEC_KERNEL_AVX2: return b64_decode_avx2(src, srclen, dest);
+	case CODEC_KERNEL_SSSE3: return b64_decode_ssse3(src, srclen, dest);
+#endif
+	default: return 0;
+	}
+}
+
+size_t codec_json_plain(const char *s, size_t n)
+{
+	switch (current_kernel()) {
+#ifdef CODEC_X86_KERNELS
+	case CODEC_KERNEL_AVX2: return json_plain_avx2(s, n);
+	case CODEC_KERNEL_SSSE3: return json_plain_ssse3(s, n);
+#endif
+	default: return json_plain_scalar(s, n);
+	}
+}
@@ -0,0 +1,45 @@
+#ifndef CODEC_H
+#define CODEC_H
+
+#include <stddef.h>
+
+/* Vectorized kernels behind hex_encode/hex_decode in hex.h, the rfc4648
+ * base64 functions and json string escaping. The base64 kernels only take
+ * whole blocks off the front of the input; the scalar code in base64.c
+ * finishes the tail, and any block with a character outside the
+ * alphabet, so errors come out exactly as before. */
+enum codec_kernel {
+	CODEC_KERNEL_AUTO,
+	CODEC_KERNEL_SCALAR,
+	CODEC_KERNEL_SSSE3,
+	CODEC_KERNEL_AVX2,
+	CODEC_KERNEL_COUNT
+};
+
+int codec_kernel_supported(enum codec_kernel kernel);
+const char *codec_kernel_name(enum codec_kernel kernel);
+
+/* force a kernel, for tests and benchmarks, not thread safe */
+int codec_set_kernel(enum codec_kernel kernel);
+
+/* write 2 * n lowercase hex digits, no terminator */
+void codec_hex_encode(const unsigned char *in, size_t n, char *out);
+
+/* read 2 * n hex digits of either case, returns 0 on anything else */
+int codec_hex_decode(const char *in, size_t n, unsigned char *out);
+
+/* encode whole 12 or 24 byte blocks from the front of src, returns the
+ * number of bytes consumed, which produced consumed / 3 * 4 characters */
+size_t codec_base64_encode_blocks(const unsigned char *src, size_t srclen, char *dest);
+
+/* decode whole 16 or 32 character blocks from the front of src, leaving
+ * at least the last quartet, and stopping at the first block with a
+ * character outside the alphabet. Returns the number of characters
+ * consumed, which produced consumed / 4 * 3 bytes. */
+size_t codec_base64_decode_blocks(const char *src, size_t srclen, unsigned char *dest);
+
+/* length of the run at the front of s that cursor_push_jsonstr copies
+ * as is, ie. up to the first '"', '\\', \b, \f, \n, \r or \t */
+size_t codec_json_plain(const char *s, size_t n);
+
+#endif
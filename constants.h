@@ -1,6 +0,0 @@
-#ifndef MAX_TAGS
-#define MAX_TAGS 32
-#endif
-#ifndef MAX_TAG_ELEMS
-#define MAX_TAG_ELEMS 16
-#endif
\ No newline at end of file
@@ -0,0 +1,167 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "secp256k1.h"
+#include "secp256k1_ecdh.h"
+
+#include "cursor.h"
+#include "hex.h"
+#include "base64.h"
+#include "aes.h"
+#include "random.h"
+#include "event.h"
+#include "dm.h"
+
+/* encrypt `inlen` bytes of `in` and their padding into `out`, which needs
+ * room for inlen + 16 bytes */
+static int aes_encrypt(unsigned char *key, unsigned char *iv,
+		unsigned char *out, const unsigned char *in, size_t inlen)
+{
+	struct AES_ctx ctx;
+
+	AES_init_ctx_iv(&ctx, key, iv);
+	return AES_CBC_encrypt_final(&ctx, out, in, inlen);
+}
+
+static int copyx(unsigned char *output, const unsigned char *x32, const unsigned char *y32, void *data) {
+	memcpy(output, x32, 32);
+	return 1;
+}
+
+int dm_shared_secret(const secp256k1_context *ctx, const unsigned char *secret,
+		const unsigned char nostr_pubkey[32], unsigned char shared[32])
+{
+	unsigned char compressed_pubkey[33];
+	secp256k1_pubkey pubkey;
+
+	compressed_pubkey[0] = 2;
+	memcpy(&compressed_pubkey[1], nostr_pubkey, 32);
+
+	if (!secp256k1_ec_pubkey_parse(ctx, &pubkey, compressed_pubkey, sizeof(compressed_pubkey)))
+		return 0;
+
+	return secp256k1_ecdh(ctx, shared, &pubkey, secret, copyx, NULL);
+}
+
+int decrypt_dm(const unsigned char shared[32], const char *content, size_t len,
+		char *out, size_t outlen)
+{
+	struct AES_ctx ctx;
+	unsigned char iv[18];
+	const char *sep;
+	ssize_t n;
+	int padding, i;
+
+	/* the iv comes last, so look for it from the end */
+	if (len < 4)
+		return -1;
+	for (sep = content + len - 4; memcmp(sep, "?iv=", 4); sep--) {
+		if (sep == content)
+			return -1;
+	}
+
+	if (base64_decode((char *)iv, sizeof(iv), sep + 4, content + len - sep - 4) != 16)
+		return -1;
+
+	if ((n = base64_decode(out, outlen, content, sep - content)) <= 0 ||
+	    n % AES_BLOCKLEN)
+		return -1;
+
+	AES_init_ctx_iv(&ctx, shared, iv);
+	AES_CBC_decrypt(&ctx, (unsigned char *)out, (unsigned char *)out, n);
+
+	/* a wrong key shows up here, as garbage padding */
+	padding = (unsigned char)out[n - 1];
+	if (padding < 1 || padding > AES_BLOCKLEN)
+		return -1;
+	for (i = 1; i <= padding; i++) {
+		if ((unsigned char)out[n - i] != padding)
+			return -1;
+	}
+
+	n -= padding;
+	out[n] = 0;
+	return n;
+}
+
+int make_encrypted_dm(const secp256k1_context *ctx, struct key *key,
+		struct nostr_event *ev, unsigned char nostr_pubkey[32], int kind)
+{
+	size_t inl = strlen(ev->content);
+	int enclen = inl + 16;
+	size_t buflen = enclen * 3 + 65 * 10;
+	unsigned char *buf = arena_alloc(ev->arena, buflen);
+	unsigned char *encbuf = arena_alloc(ev->arena, inl + 16);
+	unsigned char shared_secret[32];
+	unsigned char iv[16];
+	struct cursor cur;
+
+	if (!buf || !encbuf)
+		return 0;
+
+	make_cursor(buf, buf + buflen, &cur);
+
+        if (!secp256k1_ec_seckey_verify(ctx, key->secret)) {
+		fprintf(stderr, "make_encrypted_dm: ec_seckey_verify failed\n");
+		return 0;
+	}
+
+	if (!dm_shared_secret(ctx, key->secret, nostr_pubkey, shared_secret)) {
+		fprintf(stderr, "make_encrypted_dm: secp256k1_ecdh failed\n");
+		return 0;
+	}
+
+	if (!fill_random(iv, sizeof(iv))) {
+		fprintf(stderr, "make_encrypted_dm: fill_random failed\n");
+		return 0;
+	}
+
+	//print_hex
+	//shared_secret
+	//fprintf(stderr, "shared_secret ");
+	//print_hex(shared_secret, 32);
+
+	enclen = aes_encrypt(shared_secret, iv, encbuf, (const unsigned char *)ev->content, inl);
+	if (enclen == 0) {
+		fprintf(stderr, "make_encrypted_dm: aes_encrypt failed\n");
+		return 0;
+	}
+
+	if ((enclen = base64_encode((char *)buf, buflen, (const char*)encbuf, enclen)) == -1) {
+		fprintf(stderr, "make_encrypted_dm: base64 encode of encrypted fata failed\n");
+		return 0;
+	}
+	cur.p += enclen;
+
+	if (!cursor_push_str(&cur, "?iv=")) {
+		fprintf(stderr, "make_encrypted_dm: buffer too small\n");
+		return 0;
+	}
+
+	if ((enclen = base64_encode((char *)cur.p, cur.end - cur.p, (const char*)iv, 16)) == -1) {
+		fprintf(stderr, "make_encrypted_dm: base64 encode of iv failed\n");
+		return 0;
+	}
+	cur.p += enclen;
+
+	if (!cursor_push_byte(&cur, 0)) {
+		fprintf(stderr, "make_encrypted_dm: out of memory by 1 byte!\n");
+		return 0;
+	}
+
+	ev->content = (const char*)cur.start;
+	ev->kind = kind;
+
+	if (!hex_encode(nostr_pubkey, 32, (char*)cur.p, cur.end - cur.p))
+		return 0;
+
+	if (!nostr_add_tag(ev, "p", (const char*)cur.p)) {
+		fprintf(stderr, "too many tags\n");
+		return 0;
+	}
+
+	cur.p += 65;
+
+	return 1;
+}
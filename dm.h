@@ -0,0 +1,26 @@
+#ifndef DM_H
+#define DM_H
+
+#include "secp256k1.h"
+#include "struct_key.h"
+#include "struct_nostr_event.h"
+
+/* Replace ev->content with its NIP-04 encryption to `nostr_pubkey`, as
+ * base64(aes-256-cbc(content))?iv=base64(iv) under the ECDH shared x
+ * coordinate, set the kind and add a p tag for the recipient. Buffers
+ * come from ev->arena. */
+int make_encrypted_dm(const secp256k1_context *ctx, struct key *key,
+		struct nostr_event *ev, unsigned char nostr_pubkey[32], int kind);
+
+/* The NIP-04 shared secret between `secret` and an x-only nostr pubkey:
+ * the bare x coordinate of the ECDH point, not its hash. */
+int dm_shared_secret(const secp256k1_context *ctx, const unsigned char *secret,
+		const unsigned char nostr_pubkey[32], unsigned char shared[32]);
+
+/* Decrypt NIP-04 content of `len` bytes into out and NUL terminate it.
+ * out needs base64_decoded_length(len) bytes. Returns the plaintext length,
+ * or -1 if the content is malformed or doesn't decrypt under `shared`. */
+int decrypt_dm(const unsigned char shared[32], const char *content, size_t len,
+		char *out, size_t outlen);
+
+#endif
@@ -0,0 +1,387 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+
+#include "hex.h"
+#include "codec.h"
+#include "sha256.h"
+#include "event.h"
+
+inline static int cursor_push_escaped_char(struct cursor *cur, char c)
+{
+        switch (c) {
+        case '"':  return cursor_push_str(cur, "\\\"");
+        case '\\': return cursor_push_str(cur, "\\\\");
+        case '\b': return cursor_push_str(cur, "\\b");
+        case '\f': return cursor_push_str(cur, "\\f");
+        case '\n': return cursor_push_str(cur, "\\n");
+        case '\r': return cursor_push_str(cur, "\\r");
+        case '\t': return cursor_push_str(cur, "\\t");
+        // TODO: \u hex hex hex hex
+        }
+        return cursor_push_byte(cur, c);
+}
+
+/* copy the runs that need no escaping in one go, most content is
+ * nothing but */
+static int cursor_push_escaped(struct cursor *cur, const char *str, size_t len)
+{
+	size_t run;
+
+	for (;;) {
+		run = codec_json_plain(str, len);
+		if (!cursor_push(cur, (unsigned char *)str, run))
+			return 0;
+		if (run == len)
+			return 1;
+		if (!cursor_push_escaped_char(cur, str[run]))
+			return 0;
+		str += run + 1;
+		len -= run + 1;
+	}
+}
+
+int cursor_push_jsonstr(struct cursor *cur, const char *str)
+{
+	return cursor_push_byte(cur, '"') &&
+	       cursor_push_escaped(cur, str, strlen(str)) &&
+	       cursor_push_byte(cur, '"');
+}
+
+static size_t jsonstr_size(const char *str)
+{
+	size_t size = 2, len = strlen(str), run;
+
+	/* every byte that isn't part of a plain run takes two */
+	for (;;) {
+		run = codec_json_plain(str, len);
+		size += run;
+		if (run == len)
+			return size;
+		size += 2;
+		str += run + 1;
+		len -= run + 1;
+	}
+}
+
+static int cursor_push_tag(struct cursor *cur, struct nostr_tag *tag)
+{
+        int i;
+
+        if (!cursor_push_byte(cur, '['))
+                return 0;
+
+        for (i = 0; i < tag->num_elems; i++) {
+                if (!cursor_push_jsonstr(cur, tag->strs[i]))
+                        return 0;
+                if (i != tag->num_elems-1) {
+                        if (!cursor_push_byte(cur, ','))
+                                return 0;
+                }
+        }
+
+        return cursor_push_byte(cur, ']');
+}
+
+int cursor_push_tags(struct cursor *cur, struct nostr_event *ev)
+{
+        int i;
+
+	if (ev->explicit_tags) {
+		return cursor_push_str(cur, ev->explicit_tags);
+	}
+
+        if (!cursor_push_byte(cur, '['))
+                return 0;
+
+        for (i = 0; i < ev->num_tags; i++) {
+                if (!cursor_push_tag(cur, &ev->tags[i]))
+                        return 0;
+                if (i != ev->num_tags-1) {
+                        if (!cursor_push_str(cur, ","))
+                                return 0;
+                }
+        }
+
+        return cursor_push_byte(cur, ']');
+}
+
+
+static size_t tags_size(struct nostr_event *ev)
+{
+	size_t size = 2;
+	int i, j;
+
+	if (ev->explicit_tags)
+		return strlen(ev->explicit_tags);
+
+	for (i = 0; i < ev->num_tags; i++) {
+		size += 3;
+		for (j = 0; j < ev->tags[i].num_elems; j++)
+			size += jsonstr_size(ev->tags[i].strs[j]) + 1;
+	}
+
+	return size;
+}
+
+/* Content, tags and the pubkey are serialized once per event into its
+ * arena and shared by event_size, the commitment, the id hash and the
+ * printed json. Each is tied to what it was made from: the content to the
+ * content pointer, the pubkey hex to the pubkey bytes, and the tags json
+ * stays until event_tags_changed(). */
+static int escape_content(struct nostr_event *ev)
+{
+	struct cursor cur;
+	size_t size;
+	unsigned char *buf;
+
+	if (ev->content_json && ev->content_json_src == ev->content)
+		return 1;
+
+	/* cursor_push wants one spare byte at the end */
+	size = jsonstr_size(ev->content);
+	if (!ev->arena || !(buf = arena_alloc(ev->arena, size + 1)))
+		return 0;
+
+	make_cursor(buf, buf + size + 1, &cur);
+	if (!cursor_push_jsonstr(&cur, ev->content))
+		return 0;
+
+	ev->content_json = (const char *)buf;
+	ev->content_json_src = ev->content;
+	ev->content_json_len = cur.p - cur.start;
+	return 1;
+}
+
+static int serialize_tags(struct nostr_event *ev)
+{
+	struct cursor cur;
+	size_t size;
+	unsigned char *buf;
+
+	if (ev->explicit_tags) {
+		ev->tags_json = ev->explicit_tags;
+		ev->tags_json_len = strlen(ev->explicit_tags);
+		return 1;
+	}
+
+	if (ev->tags_json)
+		return 1;
+
+	size = tags_size(ev);
+	if (!ev->arena || !(buf = arena_alloc(ev->arena, size + 1)))
+		return 0;
+
+	make_cursor(buf, buf + size + 1, &cur);
+	if (!cursor_push_tags(&cur, ev))
+		return 0;
+
+	ev->tags_json = (const char *)buf;
+	ev->tags_json_len = cur.p - cur.start;
+	return 1;
+}
+
+static int serialize_parts(struct nostr_event *ev)
+{
+	if (!ev->pubkey_hex[0] || memcmp(ev->pubkey_hex_src, ev->pubkey, 32)) {
+		hex_encode(ev->pubkey, 32, ev->pubkey_hex, sizeof(ev->pubkey_hex));
+		memcpy(ev->pubkey_hex_src, ev->pubkey, 32);
+	}
+
+	return escape_content(ev) && serialize_tags(ev);
+}
+
+void event_tags_changed(struct nostr_event *ev)
+{
+	ev->tags_json = NULL;
+}
+
+/* [0,"pubkey",created_at,kind, */
+#define COMMITMENT_HEAD_SIZE 128
+
+static int commitment_head(struct nostr_event *ev, char *buf)
+{
+	return snprintf(buf, COMMITMENT_HEAD_SIZE, "[0,\"%s\",%" PRIu64 ",%d,",
+			ev->pubkey_hex, ev->created_at, ev->kind);
+}
+
+int event_commitment(struct nostr_event *ev, unsigned char *buf, int buflen)
+{
+	char head[COMMITMENT_HEAD_SIZE];
+	struct cursor cur;
+	int ok;
+
+	if (!serialize_parts(ev))
+		return 0;
+
+	make_cursor(buf, buf + buflen, &cur);
+
+	ok =
+		cursor_push(&cur, (unsigned char *)head, commitment_head(ev, head)) &&
+		cursor_push(&cur, (unsigned char *)ev->tags_json, ev->tags_json_len) &&
+		cursor_push_byte(&cur, ',') &&
+		cursor_push(&cur, (unsigned char *)ev->content_json, ev->content_json_len) &&
+		cursor_push_byte(&cur, ']');
+
+	if (!ok)
+		return 0;
+
+	return cur.p - cur.start;
+}
+
+/* hash the pieces as they are, the commitment is never put together */
+int event_id(struct nostr_event *ev)
+{
+	char head[COMMITMENT_HEAD_SIZE];
+	struct sha256_ctx ctx;
+
+	if (!serialize_parts(ev))
+		return 0;
+
+	sha256_init(&ctx);
+	sha256_update(&ctx, head, commitment_head(ev, head));
+	sha256_update(&ctx, ev->tags_json, ev->tags_json_len);
+	sha256_update(&ctx, ",", 1);
+	sha256_update(&ctx, ev->content_json, ev->content_json_len);
+	sha256_update(&ctx, "]", 1);
+	sha256_done(&ctx, (struct sha256 *)ev->id);
+
+	return 1;
+}
+
+/* everything before the tags, and everything after the content */
+#define EVENT_HEAD_SIZE 256
+#define EVENT_TAIL_SIZE 160
+
+int event_json_iov(struct nostr_event *ev, int envelope, struct iovec iov[EVENT_IOV])
+{
+	static const char content_key[] = ",\"content\": ";
+	char id[65], sig[129];
+	char *head, *tail;
+
+	if (!serialize_parts(ev) ||
+	    !(head = arena_alloc(ev->arena, EVENT_HEAD_SIZE + EVENT_TAIL_SIZE)))
+		return 0;
+	tail = head + EVENT_HEAD_SIZE;
+
+	hex_encode(ev->id, sizeof(ev->id), id, sizeof(id));
+	hex_encode(ev->sig, sizeof(ev->sig), sig, sizeof(sig));
+
+	iov[0].iov_base = head;
+	iov[0].iov_len = snprintf(head, EVENT_HEAD_SIZE,
+		"%s{\"id\": \"%s\",\"pubkey\": \"%s\",\"created_at\": %" PRIu64 ",\"kind\": %d,\"tags\": ",
+		envelope ? "[\"EVENT\"," : "", id, ev->pubkey_hex, ev->created_at, ev->kind);
+
+	iov[1].iov_base = (void *)ev->tags_json;
+	iov[1].iov_len = ev->tags_json_len;
+
+	iov[2].iov_base = (void *)content_key;
+	iov[2].iov_len = sizeof(content_key) - 1;
+
+	iov[3].iov_base = (void *)ev->content_json;
+	iov[3].iov_len = ev->content_json_len;
+
+	iov[4].iov_base = tail;
+	iov[4].iov_len = snprintf(tail, EVENT_TAIL_SIZE, ",\"sig\": \"%s\"}%s",
+				  sig, envelope ? "]" : "");
+
+	return EVENT_IOV;
+}
+
+int event_json(struct cursor *cur, struct nostr_event *ev, int envelope)
+{
+	struct iovec iov[EVENT_IOV];
+	int i;
+
+	if (!event_json_iov(ev, envelope, iov))
+		return 0;
+
+	for (i = 0; i < EVENT_IOV; i++) {
+		if (!cursor_push(cur, iov[i].iov_base, iov[i].iov_len))
+			return 0;
+	}
+
+	return 1;
+}
+
+void event_init(struct nostr_event *ev, struct arena *arena)
+{
+	memset(ev, 0, sizeof(*ev));
+	ev->arena = arena;
+}
+
+/* everything but the tags and content fits in this: hex fields, numbers,
+ * keys and punctuation */
+#define EVENT_FIXED_SIZE 512
+
+size_t event_size(struct nostr_event *ev)
+{
+	if (!serialize_parts(ev))
+		return EVENT_FIXED_SIZE + tags_size(ev) + jsonstr_size(ev->content);
+
+	return EVENT_FIXED_SIZE + ev->tags_json_len + ev->content_json_len;
+}
+
+struct nostr_tag *nostr_new_tag(struct nostr_event *ev)
+{
+	struct nostr_tag *tags, *tag;
+	int cap;
+
+	if (ev->num_tags == ev->cap_tags) {
+		cap = ev->cap_tags ? ev->cap_tags * 2 : 8;
+		if (!(tags = arena_alloc(ev->arena, cap * sizeof(*tags))))
+			return NULL;
+		if (ev->num_tags)
+			memcpy(tags, ev->tags, ev->num_tags * sizeof(*tags));
+		ev->tags = tags;
+		ev->cap_tags = cap;
+	}
+
+	tag = &ev->tags[ev->num_tags++];
+	memset(tag, 0, sizeof(*tag));
+	event_tags_changed(ev);
+	return tag;
+}
+
+int nostr_tag_push(struct nostr_event *ev, struct nostr_tag *tag, const char *str)
+{
+	const char **strs;
+	int cap;
+
+	if (tag->num_elems == tag->cap_elems) {
+		cap = tag->cap_elems ? tag->cap_elems * 2 : 4;
+		if (!(strs = arena_alloc(ev->arena, cap * sizeof(*strs))))
+			return 0;
+		if (tag->num_elems)
+			memcpy(strs, tag->strs, tag->num_elems * sizeof(*strs));
+		tag->strs = strs;
+		tag->cap_elems = cap;
+	}
+
+	tag->strs[tag->num_elems++] = str;
+	event_tags_changed(ev);
+	return 1;
+}
+
+int nostr_add_tag_n(struct nostr_event *ev, const char **ts, int n_ts)
+{
+	struct nostr_tag *tag;
+	int i;
+
+	if (!(tag = nostr_new_tag(ev)))
+		return 0;
+
+	for (i = 0; i < n_ts; i++) {
+		if (!nostr_tag_push(ev, tag, ts[i]))
+			return 0;
+	}
+
+	return 1;
+}
+
+int nostr_add_tag(struct nostr_event *ev, const char *t1, const char *t2)
+{
+	const char *ts[] = {t1, t2};
+	return nostr_add_tag_n(ev, ts, 2);
+}
@@ -0,0 +1,47 @@
+#ifndef EVENT_H
+#define EVENT_H
+
+#include <sys/uio.h>
+
+#include "arena.h"
+#include "cursor.h"
+#include "struct_nostr_tag.h"
+#include "struct_nostr_event.h"
+
+/* zero ev and allocate its tags from arena */
+void event_init(struct nostr_event *ev, struct arena *arena);
+
+int cursor_push_jsonstr(struct cursor *cur, const char *str);
+int cursor_push_tags(struct cursor *cur, struct nostr_event *ev);
+
+/* serialize [0,pubkey,created_at,kind,tags,content] into buf, returns the
+ * number of bytes written or 0 if buf is too small */
+int event_commitment(struct nostr_event *ev, unsigned char *buf, int buflen);
+
+/* upper bound on the bytes event_commitment or event_json write */
+size_t event_size(struct nostr_event *ev);
+
+/* compute ev->id by hashing the serialized pieces in place */
+int event_id(struct nostr_event *ev);
+
+/* write the signed event as a json object, or wrapped in ["EVENT",...] */
+int event_json(struct cursor *cur, struct nostr_event *ev, int envelope);
+
+/* the same json as EVENT_IOV pieces for writev: the framing is written
+ * into the arena, and tags and content point at the cached serialization
+ * so they are never copied. Valid until the arena is reset. */
+#define EVENT_IOV 5
+int event_json_iov(struct nostr_event *ev, int envelope, struct iovec iov[EVENT_IOV]);
+
+/* call after changing a tag string in place, tags added through
+ * nostr_new_tag and nostr_tag_push are picked up on their own */
+void event_tags_changed(struct nostr_event *ev);
+
+/* append an empty tag, only valid until the next tag is added */
+struct nostr_tag *nostr_new_tag(struct nostr_event *ev);
+int nostr_tag_push(struct nostr_event *ev, struct nostr_tag *tag, const char *str);
+
+int nostr_add_tag_n(struct nostr_event *ev, const char **ts, int n_ts);
+int nostr_add_tag(struct nostr_event *ev, const char *t1, const char *t2);
+
+#endif
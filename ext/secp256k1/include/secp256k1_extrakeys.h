@@ -97,6 +97,32 @@ SECP256K1_API SECP256K1_WARN_UNUSED_RESULT int secp256k1_xonly_pubkey_from_pubke
     const secp256k1_pubkey *pubkey
 ) SECP256K1_ARG_NONNULL(1) SECP256K1_ARG_NONNULL(2) SECP256K1_ARG_NONNULL(4);
 
+/** Serialize the x coordinates of pubkey, pubkey + G, ..., pubkey + (n-1)*G.
+ *
+ *  Consecutive points are computed by adding the generator in jacobian
+ *  coordinates and converted to affine in batches that share a single field
+ *  inversion, which is much cheaper than n independent scalar
+ *  multiplications. This is meant for searching a range of keys, e.g. for
+ *  vanity public keys: the secret key of the i-th output is the starting
+ *  secret key plus i.
+ *
+ *  Returns: 1 if all points were computed. 0 if the pubkey is invalid or
+ *           one of the points (or the next starting point) is infinity.
+ *
+ *  Args:        ctx: pointer to a context object.
+ *  Out:   output32s: pointer to a n*32-byte array to place the serialized
+ *                    x coordinates in.
+ *  In/Out:   pubkey: pointer to the starting public key. If 1 is returned,
+ *                    it is set to pubkey + n*G so the search can continue.
+ *  In:            n: number of points to compute.
+ */
+SECP256K1_API SECP256K1_WARN_UNUSED_RESULT int secp256k1_xonly_pubkey_serialize_sequence(
+    const secp256k1_context *ctx,
+    unsigned char *output32s,
+    secp256k1_pubkey *pubkey,
+    size_t n
+) SECP256K1_ARG_NONNULL(1) SECP256K1_ARG_NONNULL(2) SECP256K1_ARG_NONNULL(3);
+
 /** Tweak an x-only public key by adding the generator multiplied with tweak32
  *  to it.
  *
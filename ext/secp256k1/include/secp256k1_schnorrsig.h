@@ -183,6 +183,30 @@ SECP256K1_API SECP256K1_WARN_UNUSED_RESULT int secp256k1_schnorrsig_verify(
     const secp256k1_xonly_pubkey *pubkey
 ) SECP256K1_ARG_NONNULL(1) SECP256K1_ARG_NONNULL(2) SECP256K1_ARG_NONNULL(5);
 
+/** Verify a batch of Schnorr signatures over 32-byte messages.
+ *
+ *  All signatures are checked at once with a single randomized linear
+ *  combination, which is considerably faster than calling
+ *  secp256k1_schnorrsig_verify for each of them. The result only says whether
+ *  every signature is valid; callers that need to know which one failed
+ *  should fall back to secp256k1_schnorrsig_verify.
+ *
+ *  Returns: 1: all signatures are correct (or n is 0)
+ *           0: at least one signature is incorrect, or out of memory
+ *  Args:    ctx: a secp256k1 context object.
+ *  In:    sig64: array of n pointers to 64-byte signatures.
+ *         msg32: array of n pointers to the 32-byte messages.
+ *       pubkeys: array of n pointers to x-only public keys.
+ *             n: number of signatures.
+ */
+SECP256K1_API SECP256K1_WARN_UNUSED_RESULT int secp256k1_schnorrsig_verify_batch(
+    const secp256k1_context *ctx,
+    const unsigned char *const *sig64,
+    const unsigned char *const *msg32,
+    const secp256k1_xonly_pubkey *const *pubkeys,
+    size_t n
+) SECP256K1_ARG_NONNULL(1);
+
 #ifdef __cplusplus
 }
 #endif
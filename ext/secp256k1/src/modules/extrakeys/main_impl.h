@@ -115,6 +115,51 @@ int secp256k1_xonly_pubkey_from_pubkey(const secp256k1_context* ctx, secp256k1_x
     return 1;
 }
 
+/* Points per batched affine conversion, each batch costs one inversion. */
+#define SECP256K1_XONLY_SEQUENCE_BATCH 256
+
+int secp256k1_xonly_pubkey_serialize_sequence(const secp256k1_context* ctx, unsigned char *output32s, secp256k1_pubkey *pubkey, size_t n) {
+    secp256k1_gej pj[SECP256K1_XONLY_SEQUENCE_BATCH];
+    secp256k1_ge pa[SECP256K1_XONLY_SEQUENCE_BATCH];
+    secp256k1_gej acc;
+    secp256k1_ge ge;
+    size_t i, m;
+
+    VERIFY_CHECK(ctx != NULL);
+    ARG_CHECK(output32s != NULL);
+    ARG_CHECK(pubkey != NULL);
+
+    if (!secp256k1_pubkey_load(ctx, &ge, pubkey)) {
+        return 0;
+    }
+    secp256k1_gej_set_ge(&acc, &ge);
+
+    while (n > 0) {
+        m = n < SECP256K1_XONLY_SEQUENCE_BATCH ? n : SECP256K1_XONLY_SEQUENCE_BATCH;
+        for (i = 0; i < m; i++) {
+            pj[i] = acc;
+            secp256k1_gej_add_ge_var(&acc, &acc, &secp256k1_ge_const_g, NULL);
+        }
+        secp256k1_ge_set_all_gej_var(pa, pj, m);
+        for (i = 0; i < m; i++) {
+            if (secp256k1_ge_is_infinity(&pa[i])) {
+                return 0;
+            }
+            secp256k1_fe_normalize_var(&pa[i].x);
+            secp256k1_fe_get_b32(output32s, &pa[i].x);
+            output32s += 32;
+        }
+        n -= m;
+    }
+
+    if (secp256k1_gej_is_infinity(&acc)) {
+        return 0;
+    }
+    secp256k1_ge_set_gej_var(&ge, &acc);
+    secp256k1_pubkey_save(pubkey, &ge);
+    return 1;
+}
+
 int secp256k1_xonly_pubkey_tweak_add(const secp256k1_context* ctx, secp256k1_pubkey *output_pubkey, const secp256k1_xonly_pubkey *internal_pubkey, const unsigned char *tweak32) {
     secp256k1_ge pk;
 
@@ -326,6 +326,38 @@ static void test_xonly_pubkey_tweak_recursive(void) {
 }
 #undef N_PUBKEYS
 
+/* Checks that serialize_sequence matches one scalar multiplication per
+ * key, across more than one inversion batch. */
+#define N_SEQUENCE 300
+static void test_xonly_pubkey_serialize_sequence(void) {
+    unsigned char sk[32];
+    unsigned char xs[N_SEQUENCE][32];
+    unsigned char expected[32];
+    unsigned char one[32] = {0};
+    secp256k1_pubkey pk, next;
+    secp256k1_xonly_pubkey xonly_pk;
+    int i;
+
+    one[31] = 1;
+    secp256k1_testrand256(sk);
+    CHECK(secp256k1_ec_pubkey_create(CTX, &pk, sk) == 1);
+    next = pk;
+    CHECK(secp256k1_xonly_pubkey_serialize_sequence(CTX, xs[0], &next, N_SEQUENCE) == 1);
+
+    for (i = 0; i < N_SEQUENCE; i++) {
+        CHECK(secp256k1_ec_pubkey_create(CTX, &pk, sk) == 1);
+        CHECK(secp256k1_xonly_pubkey_from_pubkey(CTX, &xonly_pk, NULL, &pk) == 1);
+        CHECK(secp256k1_xonly_pubkey_serialize(CTX, expected, &xonly_pk) == 1);
+        CHECK(secp256k1_memcmp_var(xs[i], expected, 32) == 0);
+        CHECK(secp256k1_ec_seckey_tweak_add(CTX, sk, one) == 1);
+    }
+
+    /* next is the point after the last one */
+    CHECK(secp256k1_ec_pubkey_create(CTX, &pk, sk) == 1);
+    CHECK(secp256k1_ec_pubkey_cmp(CTX, &pk, &next) == 0);
+}
+#undef N_SEQUENCE
+
 static void test_keypair(void) {
     unsigned char sk[32];
     unsigned char sk_tmp[32];
@@ -557,6 +589,7 @@ static void run_extrakeys_tests(void) {
     test_xonly_pubkey_tweak_check();
     test_xonly_pubkey_tweak_recursive();
     test_xonly_pubkey_comparison();
+    test_xonly_pubkey_serialize_sequence();
 
     /* keypair tests */
     test_keypair();
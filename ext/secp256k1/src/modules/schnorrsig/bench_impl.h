@@ -19,6 +19,11 @@ typedef struct {
     const unsigned char **pk;
     const unsigned char **sigs;
     const unsigned char **msgs;
+
+    /* signatures per secp256k1_schnorrsig_verify_batch call */
+    size_t batch;
+    secp256k1_xonly_pubkey *xonly;
+    const secp256k1_xonly_pubkey **xonly_ptrs;
 } bench_schnorrsig_data;
 
 static void bench_schnorrsig_sign(void* arg, int iters) {
@@ -45,6 +50,18 @@ static void bench_schnorrsig_verify(void* arg, int iters) {
     }
 }
 
+/* One iteration is one signature, so the reported time is per signature and
+ * directly comparable with schnorrsig_verify. */
+static void bench_schnorrsig_verify_batch(void* arg, int iters) {
+    bench_schnorrsig_data *data = (bench_schnorrsig_data *)arg;
+    size_t i, n;
+
+    for (i = 0; i < (size_t)iters; i += n) {
+        n = (size_t)iters - i < data->batch ? (size_t)iters - i : data->batch;
+        CHECK(secp256k1_schnorrsig_verify_batch(data->ctx, &data->sigs[i], &data->msgs[i], &data->xonly_ptrs[i], n));
+    }
+}
+
 static void run_schnorrsig_bench(int iters, int argc, char** argv) {
     int i;
     bench_schnorrsig_data data;
@@ -55,6 +72,8 @@ static void run_schnorrsig_bench(int iters, int argc, char** argv) {
     data.pk = (const unsigned char **)malloc(iters * sizeof(unsigned char *));
     data.msgs = (const unsigned char **)malloc(iters * sizeof(unsigned char *));
     data.sigs = (const unsigned char **)malloc(iters * sizeof(unsigned char *));
+    data.xonly = (secp256k1_xonly_pubkey *)malloc(iters * sizeof(secp256k1_xonly_pubkey));
+    data.xonly_ptrs = (const secp256k1_xonly_pubkey **)malloc(iters * sizeof(secp256k1_xonly_pubkey *));
 
     CHECK(MSGLEN >= 4);
     for (i = 0; i < iters; i++) {
@@ -80,10 +99,22 @@ static void run_schnorrsig_bench(int iters, int argc, char** argv) {
         CHECK(secp256k1_schnorrsig_sign_custom(data.ctx, sig, msg, MSGLEN, keypair, NULL));
         CHECK(secp256k1_keypair_xonly_pub(data.ctx, &pk, NULL, keypair));
         CHECK(secp256k1_xonly_pubkey_serialize(data.ctx, pk_char, &pk) == 1);
+        data.xonly[i] = pk;
+        data.xonly_ptrs[i] = &data.xonly[i];
     }
 
     if (d || have_flag(argc, argv, "schnorrsig") || have_flag(argc, argv, "sign") || have_flag(argc, argv, "schnorrsig_sign")) run_benchmark("schnorrsig_sign", bench_schnorrsig_sign, NULL, NULL, (void *) &data, 10, iters);
     if (d || have_flag(argc, argv, "schnorrsig") || have_flag(argc, argv, "verify") || have_flag(argc, argv, "schnorrsig_verify")) run_benchmark("schnorrsig_verify", bench_schnorrsig_verify, NULL, NULL, (void *) &data, 10, iters);
+    if (d || have_flag(argc, argv, "schnorrsig") || have_flag(argc, argv, "verify") || have_flag(argc, argv, "schnorrsig_verify_batch")) {
+        static const size_t batches[] = { 16, 64, 256, 1024, 4096 };
+        char name[64];
+        size_t k;
+        for (k = 0; k < sizeof(batches) / sizeof(batches[0]); k++) {
+            data.batch = batches[k];
+            sprintf(name, "schnorrsig_verify_batch_%d", (int)batches[k]);
+            run_benchmark(name, bench_schnorrsig_verify_batch, NULL, NULL, (void *) &data, 10, iters);
+        }
+    }
 
     for (i = 0; i < iters; i++) {
         free((void *)data.keypairs[i]);
@@ -97,6 +128,8 @@ static void run_schnorrsig_bench(int iters, int argc, char** argv) {
     free((void *)data.pk);
     free((void *)data.msgs);
     free((void *)data.sigs);
+    free(data.xonly);
+    free((void *)data.xonly_ptrs);
 
     secp256k1_context_destroy(data.ctx);
 }
@@ -264,4 +264,138 @@ int secp256k1_schnorrsig_verify(const secp256k1_context* ctx, const unsigned cha
            secp256k1_fe_equal_var(&rx, &r.x);
 }
 
+typedef struct {
+    const secp256k1_context *ctx;
+    const unsigned char *const *sig64;
+    const unsigned char *const *msg32;
+    const secp256k1_xonly_pubkey *const *pubkeys;
+    unsigned char seed[32];
+    /* randomizer of the last signature, R_i and P_i are visited in a row */
+    size_t a_idx;
+    secp256k1_scalar a;
+} secp256k1_schnorrsig_batch_data;
+
+/* Randomizer a_i for the i-th signature, derived from a hash of the whole batch
+ * so that an attacker can't pick signatures whose errors cancel out. */
+static void secp256k1_schnorrsig_batch_randomizer(secp256k1_scalar *a, const unsigned char *seed32, size_t i) {
+    unsigned char buf[32];
+    unsigned char idx[8];
+    secp256k1_sha256 sha;
+    int k;
+
+    for (k = 0; k < 8; k++) {
+        idx[k] = (unsigned char)(i >> (8 * k));
+    }
+    secp256k1_sha256_initialize(&sha);
+    secp256k1_sha256_write(&sha, seed32, 32);
+    secp256k1_sha256_write(&sha, idx, sizeof(idx));
+    secp256k1_sha256_finalize(&sha, buf);
+    secp256k1_scalar_set_b32(a, buf, NULL);
+}
+
+/* Point 2i is R_i with scalar a_i, point 2i+1 is P_i with scalar a_i*e_i. */
+static int secp256k1_schnorrsig_batch_callback(secp256k1_scalar *sc, secp256k1_ge *pt, size_t idx, void *cbdata) {
+    secp256k1_schnorrsig_batch_data *data = (secp256k1_schnorrsig_batch_data *)cbdata;
+    size_t i = idx / 2;
+    const unsigned char *sig64 = data->sig64[i];
+    unsigned char buf[32];
+    secp256k1_scalar e;
+    secp256k1_fe rx;
+
+    if (data->a_idx != i) {
+        secp256k1_schnorrsig_batch_randomizer(&data->a, data->seed, i);
+        data->a_idx = i;
+    }
+    *sc = data->a;
+
+    if (idx % 2 == 0) {
+        if (!secp256k1_fe_set_b32_limit(&rx, &sig64[0])) {
+            return 0;
+        }
+        return secp256k1_ge_set_xo_var(pt, &rx, 0);
+    }
+
+    if (!secp256k1_xonly_pubkey_load(data->ctx, pt, data->pubkeys[i])) {
+        return 0;
+    }
+    secp256k1_fe_get_b32(buf, &pt->x);
+    secp256k1_schnorrsig_challenge(&e, &sig64[0], data->msg32[i], 32, buf);
+    secp256k1_scalar_mul(sc, sc, &e);
+    return 1;
+}
+
+int secp256k1_schnorrsig_verify_batch(const secp256k1_context *ctx, const unsigned char *const *sig64, const unsigned char *const *msg32, const secp256k1_xonly_pubkey *const *pubkeys, size_t n) {
+    static const unsigned char tag[13] = "BIP0340/batch";
+    secp256k1_schnorrsig_batch_data data;
+    secp256k1_scratch *scratch;
+    secp256k1_scalar s, a, sum;
+    secp256k1_sha256 sha;
+    secp256k1_gej rj;
+    size_t i, n_points, scratch_size;
+    int overflow, ret;
+
+    VERIFY_CHECK(ctx != NULL);
+    ARG_CHECK(n == 0 || sig64 != NULL);
+    ARG_CHECK(n == 0 || msg32 != NULL);
+    ARG_CHECK(n == 0 || pubkeys != NULL);
+
+    if (n == 0) {
+        return 1;
+    }
+    if (n == 1) {
+        return secp256k1_schnorrsig_verify(ctx, sig64[0], msg32[0], 32, pubkeys[0]);
+    }
+
+    /* The seed commits to every input, so the randomizers can only be
+     * computed once the whole batch is fixed. */
+    secp256k1_sha256_initialize(&sha);
+    secp256k1_sha256_write(&sha, tag, sizeof(tag));
+    for (i = 0; i < n; i++) {
+        secp256k1_sha256_write(&sha, sig64[i], 64);
+        secp256k1_sha256_write(&sha, msg32[i], 32);
+        secp256k1_sha256_write(&sha, pubkeys[i]->data, sizeof(pubkeys[i]->data));
+    }
+    secp256k1_sha256_finalize(&sha, data.seed);
+
+    /* sum = -sum(a_i*s_i) */
+    secp256k1_scalar_set_int(&sum, 0);
+    for (i = 0; i < n; i++) {
+        secp256k1_scalar_set_b32(&s, &sig64[i][32], &overflow);
+        if (overflow) {
+            return 0;
+        }
+        secp256k1_schnorrsig_batch_randomizer(&a, data.seed, i);
+        secp256k1_scalar_mul(&s, &s, &a);
+        secp256k1_scalar_add(&sum, &sum, &s);
+    }
+    secp256k1_scalar_negate(&sum, &sum);
+
+    data.ctx = ctx;
+    data.sig64 = sig64;
+    data.msg32 = msg32;
+    data.pubkeys = pubkeys;
+    data.a_idx = SIZE_MAX;
+
+    /* ecmult_multi splits the points into batches that fit the scratch
+     * space, so bound its size rather than scaling it with n. */
+    n_points = 2 * n < 8192 ? 2 * n : 8192;
+    if (n_points < ECMULT_PIPPENGER_THRESHOLD) {
+        scratch_size = secp256k1_strauss_scratch_size(n_points) + STRAUSS_SCRATCH_OBJECTS*ALIGNMENT;
+    } else {
+        scratch_size = secp256k1_pippenger_scratch_size(n_points, secp256k1_pippenger_bucket_window(n_points)) + PIPPENGER_SCRATCH_OBJECTS*ALIGNMENT;
+    }
+    scratch = secp256k1_scratch_create(&ctx->error_callback, scratch_size);
+    if (scratch == NULL) {
+        return 0;
+    }
+
+    /* sum(a_i*R_i) + sum(a_i*e_i*P_i) - sum(a_i*s_i)*G must be infinity */
+    ret = secp256k1_ecmult_multi_var(&ctx->error_callback, scratch, &rj, &sum,
+                                     secp256k1_schnorrsig_batch_callback, &data, 2 * n)
+          && secp256k1_gej_is_infinity(&rj);
+
+    secp256k1_scratch_destroy(&ctx->error_callback, scratch);
+    return ret;
+}
+
 #endif
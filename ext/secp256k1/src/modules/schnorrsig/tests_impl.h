@@ -975,6 +975,71 @@ static void test_schnorrsig_sign_verify(void) {
 }
 #undef N_SIGS
 
+static void test_schnorrsig_verify_batch(void) {
+    enum { N_BATCH = 100 };
+    static const size_t sizes[] = { 0, 1, 2, 3, 17, N_BATCH };
+    unsigned char sk[32];
+    unsigned char msg[N_BATCH][32];
+    unsigned char sig[N_BATCH][64];
+    unsigned char tmp[32];
+    secp256k1_keypair keypair;
+    secp256k1_xonly_pubkey pk[N_BATCH];
+    const unsigned char *sigs[N_BATCH];
+    const unsigned char *msgs[N_BATCH];
+    const secp256k1_xonly_pubkey *pks[N_BATCH];
+    size_t i, k, n, idx;
+
+    for (i = 0; i < N_BATCH; i++) {
+        secp256k1_testrand256(sk);
+        secp256k1_testrand256(msg[i]);
+        CHECK(secp256k1_keypair_create(CTX, &keypair, sk));
+        CHECK(secp256k1_keypair_xonly_pub(CTX, &pk[i], NULL, &keypair));
+        CHECK(secp256k1_schnorrsig_sign32(CTX, sig[i], msg[i], &keypair, NULL));
+        sigs[i] = sig[i];
+        msgs[i] = msg[i];
+        pks[i] = &pk[i];
+    }
+
+    for (k = 0; k < sizeof(sizes) / sizeof(sizes[0]); k++) {
+        n = sizes[k];
+        CHECK(secp256k1_schnorrsig_verify_batch(CTX, sigs, msgs, pks, n));
+        if (n == 0) {
+            continue;
+        }
+
+        /* a bit flip in any part of any signature fails the whole batch */
+        idx = secp256k1_testrand_int(n);
+        i = secp256k1_testrand_int(64);
+        sig[idx][i] ^= 1;
+        CHECK(!secp256k1_schnorrsig_verify_batch(CTX, sigs, msgs, pks, n));
+        sig[idx][i] ^= 1;
+
+        i = secp256k1_testrand_int(32);
+        msg[idx][i] ^= 1;
+        CHECK(!secp256k1_schnorrsig_verify_batch(CTX, sigs, msgs, pks, n));
+        msg[idx][i] ^= 1;
+
+        pks[idx] = &pk[(idx + 1) % N_BATCH];
+        CHECK(!secp256k1_schnorrsig_verify_batch(CTX, sigs, msgs, pks, n));
+        pks[idx] = &pk[idx];
+
+        CHECK(secp256k1_schnorrsig_verify_batch(CTX, sigs, msgs, pks, n));
+    }
+
+    /* Swapping the s values of two signatures keeps the unweighted sum
+     * unchanged, which the randomizers must catch. */
+    memcpy(tmp, &sig[0][32], 32);
+    memcpy(&sig[0][32], &sig[1][32], 32);
+    memcpy(&sig[1][32], tmp, 32);
+    CHECK(!secp256k1_schnorrsig_verify_batch(CTX, sigs, msgs, pks, N_BATCH));
+    memcpy(&sig[1][32], &sig[0][32], 32);
+    memcpy(&sig[0][32], tmp, 32);
+
+    /* overflowing s */
+    memset(&sig[5][32], 0xFF, 32);
+    CHECK(!secp256k1_schnorrsig_verify_batch(CTX, sigs, msgs, pks, N_BATCH));
+}
+
 static void test_schnorrsig_taproot(void) {
     unsigned char sk[32];
     secp256k1_keypair keypair;
@@ -1022,6 +1087,7 @@ static void run_schnorrsig_tests(void) {
         test_schnorrsig_sign();
         test_schnorrsig_sign_verify();
     }
+    test_schnorrsig_verify_batch();
     test_schnorrsig_taproot();
 }
 
@@ -0,0 +1,265 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+
+#include "hex.h"
+#include "sha256.h"
+#include "key.h"
+#include "event.h"
+#include "gen.h"
+
+#define MAX_TAGS_EACH 64
+
+static const char *words[] = {
+	"the", "relay", "note", "gm", "bitcoin", "zap", "just", "shipped", "a",
+	"new", "build", "of", "nostril", "and", "it", "signs", "events", "fast",
+	"anyone", "else", "seeing", "this", "on", "their", "feed", "today",
+	"lightning", "keys", "client", "why", "not", "\"quoted\"", "\\o/",
+	"caf\xc3\xa9", "\xe2\x9a\xa1", "#nostr", "line\nbreak", "tab\tstop",
+};
+
+void gen_defaults(struct gen_opts *opts)
+{
+	memset(opts, 0, sizeof(*opts));
+	opts->count = 1000;
+	opts->authors = 1000;
+	opts->kinds[0] = 1; opts->weights[0] = 70;
+	opts->kinds[1] = 7; opts->weights[1] = 20;
+	opts->kinds[2] = 6; opts->weights[2] = 10;
+	opts->num_kinds = 3;
+	opts->e_tags = 0.3;
+	opts->p_tags = 0.6;
+	opts->t_tags = 0.2;
+	opts->topics = 1000;
+	opts->content_min = 0;
+	opts->content_max = 1024;
+	opts->created_at = 1700000000;
+}
+
+int gen_parse_kinds(struct gen_opts *opts, const char *arg)
+{
+	unsigned long kind, weight;
+	char *end;
+
+	for (opts->num_kinds = 0; *arg; arg = end + (*end == ',')) {
+		kind = strtoul(arg, &end, 10);
+		if (end == arg || *end != ':' || kind > INT32_MAX)
+			return 0;
+		arg = end + 1;
+		weight = strtoul(arg, &end, 10);
+		if (end == arg || (*end && *end != ',') || !weight || weight > 1000000 ||
+		    opts->num_kinds == GEN_MAX_KINDS)
+			return 0;
+		opts->kinds[opts->num_kinds] = kind;
+		opts->weights[opts->num_kinds++] = weight;
+	}
+
+	return opts->num_kinds > 0;
+}
+
+int gen_parse_tags(struct gen_opts *opts, const char *arg)
+{
+	double *avg;
+	char *end;
+
+	while (*arg) {
+		switch (arg[0]) {
+		case 'e': avg = &opts->e_tags; break;
+		case 'p': avg = &opts->p_tags; break;
+		case 't': avg = &opts->t_tags; break;
+		default: return 0;
+		}
+		if (arg[1] != ':')
+			return 0;
+		*avg = strtod(arg + 2, &end);
+		if (end == arg + 2 || *avg < 0 || *avg > MAX_TAGS_EACH / 2 || (*end && *end != ','))
+			return 0;
+		arg = end + (*end == ',');
+	}
+
+	return 1;
+}
+
+int gen_parse_content(struct gen_opts *opts, const char *arg)
+{
+	unsigned long min, max;
+	char *end;
+
+	min = strtoul(arg, &end, 10);
+	if (end == arg)
+		return 0;
+	max = min;
+	if (*end == '-') {
+		arg = end + 1;
+		max = strtoul(arg, &end, 10);
+		if (end == arg)
+			return 0;
+	}
+
+	if (*end || max < min || max > (1 << 20))
+		return 0;
+
+	opts->content_min = min;
+	opts->content_max = max;
+	return 1;
+}
+
+struct key *gen_keys(secp256k1_context *ctx, const struct gen_opts *opts)
+{
+	struct sha256_ctx sha;
+	struct key *keys;
+	uint32_t retry;
+	int i;
+
+	if (!(keys = calloc(opts->authors, sizeof(*keys))))
+		return NULL;
+
+	for (i = 0; i < opts->authors; i++) {
+		for (retry = 0; ; retry++) {
+			sha256_init(&sha);
+			sha256_update(&sha, "nostril gen key", 15);
+			sha256_u64(&sha, opts->seed);
+			sha256_u32(&sha, i);
+			sha256_u32(&sha, retry);
+			sha256_done(&sha, (struct sha256 *)keys[i].secret);
+			if (create_key(ctx, &keys[i]))
+				break;
+		}
+	}
+
+	return keys;
+}
+
+/* splitmix64, seeded per event so events don't depend on each other */
+static uint64_t next(uint64_t *s)
+{
+	uint64_t z = (*s += 0x9e3779b97f4a7c15ULL);
+
+	z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+	z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+	return z ^ (z >> 31);
+}
+
+/* in [0, 1) */
+static double uniform(uint64_t *s)
+{
+	return (next(s) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+/* geometric with the given mean */
+static int how_many(uint64_t *s, double mean)
+{
+	double q = mean / (1 + mean);
+	int n = 0;
+
+	while (n < MAX_TAGS_EACH && uniform(s) < q)
+		n++;
+	return n;
+}
+
+static const char *hex_str(struct arena *a, const unsigned char *bytes)
+{
+	char *hex;
+
+	if ((hex = arena_alloc(a, 65)))
+		hex_encode(bytes, 32, hex, 65);
+	return hex;
+}
+
+static int add_tag(struct nostr_event *ev, const char *name, const char *value)
+{
+	return value && nostr_add_tag(ev, name, value);
+}
+
+static const char *make_content(uint64_t *s, int len, struct arena *a)
+{
+	const char *w;
+	char *content;
+	size_t wl;
+	int n = 0;
+
+	if (!(content = arena_alloc(a, len + 1)))
+		return NULL;
+
+	while (n < len) {
+		w = words[next(s) % (sizeof(words) / sizeof(words[0]))];
+		wl = strlen(w);
+		/* never cut a multibyte character in half */
+		if (n + (int)wl + 1 > len) {
+			memset(content + n, '.', len - n);
+			n = len;
+			break;
+		}
+		if (n)
+			content[n++] = ' ';
+		memcpy(content + n, w, wl);
+		n += wl;
+	}
+
+	content[n] = 0;
+	return content;
+}
+
+int gen_event(const struct gen_opts *opts, const struct key *keys, uint64_t n,
+	      struct nostr_event *ev, unsigned char aux[32], int *author)
+{
+	unsigned char fake[32];
+	uint64_t s = opts->seed ^ (n * 0xd1342543de82ef95ULL), r, e, total = 0;
+	double u;
+	char *topic;
+	int i, j, count, len;
+
+	for (i = 0; i < opts->num_kinds; i++)
+		total += opts->weights[i];
+	r = next(&s) % total;
+	for (i = 0; r >= opts->weights[i]; i++)
+		r -= opts->weights[i];
+	ev->kind = opts->kinds[i];
+
+	*author = next(&s) % opts->authors;
+	memcpy(ev->pubkey, keys[*author].pubkey, 32);
+	ev->created_at = opts->created_at + n + next(&s) % 60;
+
+	/* replies go to recent events more than old ones, so the ids repeat */
+	count = how_many(&s, opts->e_tags);
+	for (i = 0; i < count; i++) {
+		r = next(&s);
+		e = opts->seed ^ (n - r % (1 + next(&s) % (n + 1)));
+		for (j = 0; j < 4; j++) {
+			r = next(&e);
+			memcpy(fake + 8 * j, &r, 8);
+		}
+		if (!add_tag(ev, "e", hex_str(ev->arena, fake)))
+			return 0;
+	}
+
+	count = how_many(&s, opts->p_tags);
+	for (i = 0; i < count; i++) {
+		if (!add_tag(ev, "p", hex_str(ev->arena, keys[next(&s) % opts->authors].pubkey)))
+			return 0;
+	}
+
+	count = how_many(&s, opts->t_tags);
+	for (i = 0; i < count && opts->topics; i++) {
+		if (!(topic = arena_alloc(ev->arena, 32)))
+			return 0;
+		r = next(&s);
+		snprintf(topic, 32, "topic%" PRIu64, r % (1 + next(&s) % opts->topics));
+		if (!add_tag(ev, "t", topic))
+			return 0;
+	}
+
+	/* mostly short, now and then up to the max */
+	u = uniform(&s);
+	len = opts->content_min + (int)((opts->content_max - opts->content_min) * u * u * u);
+	if (!(ev->content = make_content(&s, len, ev->arena)))
+		return 0;
+
+	for (i = 0; i < 4; i++) {
+		r = next(&s);
+		memcpy(aux + 8 * i, &r, 8);
+	}
+
+	return 1;
+}
@@ -0,0 +1,64 @@
+#ifndef GEN_H
+#define GEN_H
+
+#include <stdint.h>
+
+#include "secp256k1.h"
+#include "struct_key.h"
+#include "struct_nostr_event.h"
+
+/* Synthetic events for load testing relays and parsers.
+ *
+ * Everything about event n, its author, kind, tags, content, created_at
+ * and the aux randomness its signature is made with, comes from the seed
+ * and n alone. The same options give the same output byte for byte, no
+ * matter how many threads sign it. */
+
+#define GEN_MAX_KINDS 16
+
+struct gen_opts {
+	uint64_t count;
+	uint64_t seed;
+
+	/* size of the key pool, derived from the seed */
+	int authors;
+
+	/* kinds with relative weights */
+	int kinds[GEN_MAX_KINDS];
+	unsigned weights[GEN_MAX_KINDS];
+	int num_kinds;
+
+	/* average number of e, p and t tags per event; e tags point at made
+	 * up ids, p tags at authors in the pool, t tags at `topics` hashtags,
+	 * a few of them far more popular than the rest */
+	double e_tags, p_tags, t_tags;
+	int topics;
+
+	/* content length in bytes, short lengths are the most common */
+	int content_min, content_max;
+
+	/* events are about a second apart from here */
+	uint64_t created_at;
+};
+
+void gen_defaults(struct gen_opts *opts);
+
+/* "1:70,7:20,6:10" */
+int gen_parse_kinds(struct gen_opts *opts, const char *arg);
+
+/* "e:0.3,p:0.6,t:0.2" */
+int gen_parse_tags(struct gen_opts *opts, const char *arg);
+
+/* "MIN-MAX" or a fixed length */
+int gen_parse_content(struct gen_opts *opts, const char *arg);
+
+/* the opts->authors keys of the pool */
+struct key *gen_keys(secp256k1_context *ctx, const struct gen_opts *opts);
+
+/* Fill in event n, everything but the id and sig, and the aux randomness
+ * to sign it with. *author is the key that signs it. Tags and content are
+ * allocated from ev->arena. */
+int gen_event(const struct gen_opts *opts, const struct key *keys, uint64_t n,
+	      struct nostr_event *ev, unsigned char aux[32], int *author);
+
+#endif
@@ -0,0 +1,42 @@
+/* Copyright (c) 2006-2024 Jonas Fonseca <jonas.fonseca@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#ifndef TIG_LOADER_H
+#define TIG_LOADER_H
+
+#include "tig/tig.h"
+#include "tig/io.h"
+
+/*
+ * Background loading of a view's pipe.
+ *
+ * A loader thread owns the pipe while it runs: it waits for input, reads
+ * it in large chunks and hands batches of complete lines to the UI thread
+ * through a single-producer, single-consumer ring. The UI thread takes
+ * lines from the batches without ever blocking on the pipe. When the ring
+ * is full the loader stops reading, so the pipe fills up and the process
+ * writing to it is held back. Pausing the loader has the same effect
+ * without waiting for the ring to fill up.
+ */
+
+struct loader;
+
+bool loader_start(struct loader **loader, struct io *io);
+bool loader_get_line(struct loader *loader, struct buffer *buf);
+bool loader_has_lines(struct loader *loader);
+bool loader_is_done(struct loader *loader);
+void loader_pause(struct loader *loader, bool pause);
+void loader_stop(struct loader **loader);
+
+#endif
+/* vim: set ts=8 sw=8 noexpandtab: */
@@ -53,6 +53,7 @@ typedef struct view_column *view_settings;
 	_(ignore_case,			enum ignore_case,	VIEW_NO_FLAGS) \
 	_(ignore_space,			enum ignore_space,	VIEW_DIFF_LIKE) \
 	_(line_graphics,		enum graphic,		VIEW_RESET_DISPLAY) \
+	_(load_ahead,			int,			VIEW_NO_FLAGS) \
 	_(log_options,			const char **,		VIEW_LOG_LIKE) \
 	_(log_view,			view_settings,		VIEW_NO_FLAGS) \
 	_(reflog_view,			view_settings,		VIEW_NO_FLAGS) \
@@ -152,6 +152,10 @@ struct view {
 	const char *dir;	/* Directory from which to execute. */
 	struct io io;
 	struct io *pipe;
+	struct loader *loader;	/* Reads the pipe in the background. */
+	bool load_all;		/* Whether to ignore the load-ahead option. */
+	bool load_to_end;	/* Whether to keep the last line selected while loading. */
+	bool unfinished;	/* Whether loading was stopped before the end. */
 	time_t start_time;
 	time_t update_secs;
 	struct encoding *encoding;
@@ -351,6 +355,8 @@ void reset_view(struct view *view);
 enum status_code begin_update(struct view *view, const char *dir, const char **argv, enum open_flags flags);
 void end_update(struct view *view, bool force);
 bool update_view(struct view *view);
+bool view_has_lines_ready(struct view *view);
+bool view_is_loading(struct view *view);
 void update_view_title(struct view *view);
 
 /*
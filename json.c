@@ -0,0 +1,550 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+
+#include "cursor.h"
+#include "event.h"
+#include "json.h"
+
+#define MAX_DEPTH 64
+
+static inline void skip_ws(struct cursor *c)
+{
+	while (c->p < c->end &&
+	       (*c->p == ' ' || *c->p == '\n' || *c->p == '\r' || *c->p == '\t'))
+		c->p++;
+}
+
+static inline int consume(struct cursor *c, unsigned char ch)
+{
+	skip_ws(c);
+	if (c->p >= c->end || *c->p != ch)
+		return 0;
+	c->p++;
+	return 1;
+}
+
+static inline int peek(struct cursor *c)
+{
+	skip_ws(c);
+	return c->p < c->end ? *c->p : -1;
+}
+
+/* Find the first '"' or '\\' in [p, end), eight bytes at a time. Most
+ * strings have no escapes, so this is where nearly all the time goes. */
+static inline unsigned char *scan_str(unsigned char *p, unsigned char *end)
+{
+	const uint64_t ones = 0x0101010101010101ULL;
+	const uint64_t highs = 0x8080808080808080ULL;
+	uint64_t v, q, b;
+
+	for (; end - p >= 8; p += 8) {
+		memcpy(&v, p, 8);
+		q = v ^ (ones * '"');
+		b = v ^ (ones * '\\');
+		if (((q - ones) & ~q & highs) | ((b - ones) & ~b & highs))
+			break;
+	}
+
+	while (p < end && *p != '"' && *p != '\\')
+		p++;
+
+	return p;
+}
+
+/* a string without unescaping, for keys and hex values */
+static int pull_raw_str(struct cursor *c, const unsigned char **str, int *len)
+{
+	if (!consume(c, '"'))
+		return 0;
+
+	*str = c->p;
+	for (;;) {
+		c->p = scan_str(c->p, c->end);
+		if (c->p >= c->end)
+			return 0;
+		if (*c->p == '"')
+			break;
+		/* skip the escaped char */
+		c->p += 2;
+	}
+
+	*len = c->p - *str;
+	c->p++;
+	return 1;
+}
+
+/* nibble value of every byte, 0xff for non hex digits */
+static const unsigned char hexval[256] = {
+	0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,
+	0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,
+	0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,
+	   0,   1,   2,   3,   4,   5,   6,   7,   8,   9,0xff,0xff,0xff,0xff,0xff,0xff,
+	0xff,  10,  11,  12,  13,  14,  15,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,
+	0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,
+	0xff,  10,  11,  12,  13,  14,  15,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,
+	0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,
+	0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,
+	0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,
+	0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,
+	0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,
+	0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,
+	0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,
+	0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,
+	0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,
+};
+
+static int hex4(const unsigned char *p, unsigned int *v)
+{
+	unsigned char n;
+	int i;
+
+	for (*v = 0, i = 0; i < 4; i++) {
+		if ((n = hexval[p[i]]) == 0xff)
+			return 0;
+		*v = (*v << 4) | n;
+	}
+	return 1;
+}
+
+static unsigned char *push_utf8(unsigned char *dst, unsigned int cp)
+{
+	if (cp < 0x80) {
+		*dst++ = cp;
+	} else if (cp < 0x800) {
+		*dst++ = 0xC0 | (cp >> 6);
+		*dst++ = 0x80 | (cp & 0x3F);
+	} else if (cp < 0x10000) {
+		*dst++ = 0xE0 | (cp >> 12);
+		*dst++ = 0x80 | ((cp >> 6) & 0x3F);
+		*dst++ = 0x80 | (cp & 0x3F);
+	} else {
+		*dst++ = 0xF0 | (cp >> 18);
+		*dst++ = 0x80 | ((cp >> 12) & 0x3F);
+		*dst++ = 0x80 | ((cp >> 6) & 0x3F);
+		*dst++ = 0x80 | (cp & 0x3F);
+	}
+	return dst;
+}
+
+/* Unescape a string in place. The unescaped form is never longer than the
+ * escaped one, so the NUL terminator lands at or before the closing quote.
+ * Strings without escapes are only scanned, not copied. */
+static int pull_str(struct cursor *c, const char **str)
+{
+	unsigned char *dst, *end;
+	unsigned int cp, lo;
+
+	if (!consume(c, '"'))
+		return 0;
+
+	*str = (const char *)c->p;
+	dst = c->p;
+
+	for (;;) {
+		/* move the run up to the next quote or escape into place, which
+		 * is a no-op until the first escape */
+		end = scan_str(c->p, c->end);
+		if (dst != c->p)
+			memmove(dst, c->p, end - c->p);
+		dst += end - c->p;
+		c->p = end;
+
+		if (c->p >= c->end)
+			return 0;
+
+		if (*c->p++ == '"') {
+			*dst = 0;
+			return 1;
+		}
+
+		if (c->p >= c->end)
+			return 0;
+
+		switch (*c->p++) {
+		case '"':  *dst++ = '"';  break;
+		case '\\': *dst++ = '\\'; break;
+		case '/':  *dst++ = '/';  break;
+		case 'b':  *dst++ = '\b'; break;
+		case 'f':  *dst++ = '\f'; break;
+		case 'n':  *dst++ = '\n'; break;
+		case 'r':  *dst++ = '\r'; break;
+		case 't':  *dst++ = '\t'; break;
+		case 'u':
+			/* a NUL would silently cut the string short for
+			 * everything that treats it as a C string */
+			if (c->end - c->p < 4 || !hex4(c->p, &cp) || !cp)
+				return 0;
+			c->p += 4;
+			/* surrogate pair */
+			if (cp >= 0xD800 && cp < 0xDC00 && c->end - c->p >= 6 &&
+			    c->p[0] == '\\' && c->p[1] == 'u' &&
+			    hex4(c->p + 2, &lo) && lo >= 0xDC00 && lo < 0xE000) {
+				cp = 0x10000 + ((cp - 0xD800) << 10) + (lo - 0xDC00);
+				c->p += 6;
+			}
+			dst = push_utf8(dst, cp);
+			break;
+		default:
+			return 0;
+		}
+	}
+}
+
+static int pull_u64(struct cursor *c, uint64_t *n)
+{
+	skip_ws(c);
+
+	if (c->p >= c->end || *c->p < '0' || *c->p > '9')
+		return 0;
+
+	for (*n = 0; c->p < c->end && *c->p >= '0' && *c->p <= '9'; c->p++) {
+		if (*n > (UINT64_MAX - (*c->p - '0')) / 10)
+			return 0;
+		*n = *n * 10 + (*c->p - '0');
+	}
+
+	return 1;
+}
+
+static int pull_hex(struct cursor *c, unsigned char *out, int outlen)
+{
+	const unsigned char *str;
+	unsigned char hi, lo, bad = 0;
+	int i, len;
+
+	if (!pull_raw_str(c, &str, &len) || len != outlen * 2)
+		return 0;
+
+	for (i = 0; i < outlen; i++) {
+		hi = hexval[str[2*i]];
+		lo = hexval[str[2*i+1]];
+		bad |= hi | lo;
+		out[i] = (hi << 4) | lo;
+	}
+
+	return !(bad & 0xf0);
+}
+
+static int skip_value(struct cursor *c, int depth)
+{
+	const unsigned char *str;
+	int len, ch;
+
+	if (depth > MAX_DEPTH)
+		return 0;
+
+	switch ((ch = peek(c))) {
+	case '"':
+		return pull_raw_str(c, &str, &len);
+	case '{':
+	case '[':
+		c->p++;
+		if (consume(c, ch == '{' ? '}' : ']'))
+			return 1;
+		do {
+			if (ch == '{' && !(pull_raw_str(c, &str, &len) && consume(c, ':')))
+				return 0;
+			if (!skip_value(c, depth + 1))
+				return 0;
+		} while (consume(c, ','));
+		return consume(c, ch == '{' ? '}' : ']');
+	case -1:
+		return 0;
+	default:
+		/* numbers, true, false, null */
+		for (len = 0; c->p < c->end && !strchr(",]} \t\r\n", *c->p); c->p++)
+			len++;
+		return len > 0;
+	}
+}
+
+static int pull_tag(struct cursor *c, struct nostr_event *ev)
+{
+	struct nostr_tag *tag;
+	const char *str;
+
+	if (!consume(c, '[') || !(tag = nostr_new_tag(ev)))
+		return 0;
+
+	if (consume(c, ']'))
+		return 1;
+
+	do {
+		if (!pull_str(c, &str) || !nostr_tag_push(ev, tag, str))
+			return 0;
+	} while (consume(c, ','));
+
+	return consume(c, ']');
+}
+
+static int pull_tags(struct cursor *c, struct nostr_event *ev)
+{
+	ev->num_tags = 0;
+
+	if (!consume(c, '['))
+		return 0;
+
+	if (consume(c, ']'))
+		return 1;
+
+	do {
+		if (!pull_tag(c, ev))
+			return 0;
+	} while (consume(c, ','));
+
+	return consume(c, ']');
+}
+
+#define KEY_IS(k, s) (len == sizeof(s) - 1 && !memcmp(k, s, sizeof(s) - 1))
+
+static int pull_event_object(struct cursor *c, struct nostr_event *ev, int *fields)
+{
+	const unsigned char *key;
+	uint64_t n;
+	int len, ok;
+
+	*fields = 0;
+
+	if (!consume(c, '{'))
+		return 0;
+
+	if (consume(c, '}'))
+		return 1;
+
+	do {
+		if (!pull_raw_str(c, &key, &len) || !consume(c, ':'))
+			return 0;
+
+		if (KEY_IS(key, "id")) {
+			ok = pull_hex(c, ev->id, sizeof(ev->id));
+			*fields |= EVENT_HAS_ID;
+		} else if (KEY_IS(key, "pubkey")) {
+			ok = pull_hex(c, ev->pubkey, sizeof(ev->pubkey));
+			*fields |= EVENT_HAS_PUBKEY;
+		} else if (KEY_IS(key, "sig")) {
+			ok = pull_hex(c, ev->sig, sizeof(ev->sig));
+			*fields |= EVENT_HAS_SIG;
+		} else if (KEY_IS(key, "created_at")) {
+			ok = pull_u64(c, &ev->created_at);
+			*fields |= EVENT_HAS_CREATED_AT;
+		} else if (KEY_IS(key, "kind")) {
+			ok = pull_u64(c, &n) && n <= INT32_MAX;
+			ev->kind = (int)n;
+			*fields |= EVENT_HAS_KIND;
+		} else if (KEY_IS(key, "content")) {
+			ok = pull_str(c, &ev->content);
+			*fields |= EVENT_HAS_CONTENT;
+		} else if (KEY_IS(key, "tags")) {
+			ok = pull_tags(c, ev);
+			*fields |= EVENT_HAS_TAGS;
+		} else {
+			ok = skip_value(c, 0);
+		}
+
+		if (!ok)
+			return 0;
+	} while (consume(c, ','));
+
+	return consume(c, '}');
+}
+
+int parse_event(char *json, int len, struct nostr_event *ev, int *fields)
+{
+	const unsigned char *str;
+	struct cursor c;
+	int slen;
+
+	make_cursor((unsigned char *)json, (unsigned char *)json + len, &c);
+
+	ev->explicit_tags = NULL;
+	ev->tags = NULL;
+	ev->num_tags = ev->cap_tags = 0;
+
+	if (peek(&c) == '[') {
+		/* ["EVENT", <subid>?, {...}] */
+		c.p++;
+		if (!pull_raw_str(&c, &str, &slen) || slen != 5 ||
+		    memcmp(str, "EVENT", 5) || !consume(&c, ','))
+			return 0;
+		if (peek(&c) == '"' &&
+		    !(pull_raw_str(&c, &str, &slen) && consume(&c, ',')))
+			return 0;
+		if (!pull_event_object(&c, ev, fields) || !consume(&c, ']'))
+			return 0;
+	} else if (!pull_event_object(&c, ev, fields)) {
+		return 0;
+	}
+
+	skip_ws(&c);
+	return c.p == c.end;
+}
+
+/* room for one more in an arena array, which moves when it grows */
+static void *grow(struct arena *a, void *arr, int num, int *cap, size_t size)
+{
+	void *p;
+	int newcap;
+
+	if (arr && num < *cap)
+		return arr;
+
+	newcap = *cap ? *cap * 2 : 4;
+	if (!(p = arena_alloc(a, newcap * size)))
+		return NULL;
+	if (num)
+		memcpy(p, arr, num * size);
+
+	*cap = newcap;
+	return p;
+}
+
+/* the arrays of fields that are there are never NULL, even when empty */
+static int pull_hex32s(struct cursor *c, struct arena *a, unsigned char (**out)[32], int *num)
+{
+	int cap = 0;
+
+	*num = 0;
+	if (!consume(c, '[') || !(*out = grow(a, NULL, 0, &cap, 32)))
+		return 0;
+
+	if (consume(c, ']'))
+		return 1;
+
+	do {
+		if (!(*out = grow(a, *out, *num, &cap, 32)) || !pull_hex(c, (*out)[*num], 32))
+			return 0;
+		(*num)++;
+	} while (consume(c, ','));
+
+	return consume(c, ']');
+}
+
+static int pull_kinds(struct cursor *c, struct arena *a, struct nostr_filter *f)
+{
+	uint64_t n;
+	int cap = 0;
+
+	if (!consume(c, '[') || !(f->kinds = grow(a, NULL, 0, &cap, sizeof(int))))
+		return 0;
+
+	if (consume(c, ']'))
+		return 1;
+
+	do {
+		if (!(f->kinds = grow(a, f->kinds, f->num_kinds, &cap, sizeof(int))) ||
+		    !pull_u64(c, &n) || n > INT32_MAX)
+			return 0;
+		f->kinds[f->num_kinds++] = (int)n;
+	} while (consume(c, ','));
+
+	return consume(c, ']');
+}
+
+static int pull_tag_values(struct cursor *c, struct arena *a, struct nostr_filter_tag *tag)
+{
+	if (!consume(c, '[') ||
+	    !(tag->values = grow(a, NULL, 0, &tag->cap_values, sizeof(char *))))
+		return 0;
+
+	if (consume(c, ']'))
+		return 1;
+
+	do {
+		if (!(tag->values = grow(a, tag->values, tag->num_values, &tag->cap_values, sizeof(char *))) ||
+		    !pull_str(c, &tag->values[tag->num_values]))
+			return 0;
+		tag->num_values++;
+	} while (consume(c, ','));
+
+	return consume(c, ']');
+}
+
+static int pull_filter(struct cursor *c, struct arena *a, struct nostr_filter *f)
+{
+	const unsigned char *key;
+	struct nostr_filter_tag *tag;
+	uint64_t n;
+	int len, ok, cap_tags = 0;
+
+	memset(f, 0, sizeof(*f));
+	f->limit = -1;
+
+	if (!consume(c, '{'))
+		return 0;
+
+	if (consume(c, '}'))
+		return 1;
+
+	do {
+		if (!pull_raw_str(c, &key, &len) || !consume(c, ':'))
+			return 0;
+
+		if (KEY_IS(key, "ids")) {
+			ok = pull_hex32s(c, a, &f->ids, &f->num_ids);
+		} else if (KEY_IS(key, "authors")) {
+			ok = pull_hex32s(c, a, &f->authors, &f->num_authors);
+		} else if (KEY_IS(key, "kinds")) {
+			ok = pull_kinds(c, a, f);
+		} else if (KEY_IS(key, "limit")) {
+			ok = pull_u64(c, &n) && n <= INT64_MAX;
+			f->limit = (int64_t)n;
+		} else if (len == 2 && key[0] == '#' &&
+			   ((key[1] >= 'a' && key[1] <= 'z') || (key[1] >= 'A' && key[1] <= 'Z'))) {
+			if (!(f->tags = grow(a, f->tags, f->num_tags, &cap_tags, sizeof(*tag))))
+				return 0;
+			tag = &f->tags[f->num_tags++];
+			memset(tag, 0, sizeof(*tag));
+			tag->name = key[1];
+			ok = pull_tag_values(c, a, tag);
+		} else {
+			fprintf(stderr, "unsupported filter field '%.*s'\n", len, key);
+			return 0;
+		}
+
+		if (!ok)
+			return 0;
+	} while (consume(c, ','));
+
+	return consume(c, '}');
+}
+
+int parse_req(char *json, int len, struct arena *arena, const char **subid,
+	      struct nostr_filter **filters, int *num_filters)
+{
+	const unsigned char *str;
+	struct cursor c;
+	int slen, cap = 0;
+
+	make_cursor((unsigned char *)json, (unsigned char *)json + len, &c);
+
+	*subid = NULL;
+	*num_filters = 0;
+	*filters = NULL;
+
+	if (peek(&c) == '{') {
+		if (!(*filters = grow(arena, NULL, 0, &cap, sizeof(**filters))) ||
+		    !pull_filter(&c, arena, *filters))
+			return 0;
+		*num_filters = 1;
+	} else {
+		/* ["REQ", <subid>, <filter>...] */
+		if (!consume(&c, '[') || !pull_raw_str(&c, &str, &slen) || slen != 3 ||
+		    memcmp(str, "REQ", 3) || !consume(&c, ',') || !pull_str(&c, subid))
+			return 0;
+
+		while (consume(&c, ',')) {
+			if (!(*filters = grow(arena, *filters, *num_filters, &cap, sizeof(**filters))) ||
+			    !pull_filter(&c, arena, &(*filters)[*num_filters]))
+				return 0;
+			(*num_filters)++;
+		}
+
+		if (!consume(&c, ']'))
+			return 0;
+	}
+
+	skip_ws(&c);
+	return c.p == c.end;
+}
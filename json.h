@@ -0,0 +1,38 @@
+#ifndef JSON_H
+#define JSON_H
+
+#include "struct_nostr_event.h"
+#include "struct_nostr_filter.h"
+
+/* fields seen by parse_event */
+#define EVENT_HAS_ID         (1<<0)
+#define EVENT_HAS_PUBKEY     (1<<1)
+#define EVENT_HAS_CREATED_AT (1<<2)
+#define EVENT_HAS_KIND       (1<<3)
+#define EVENT_HAS_TAGS       (1<<4)
+#define EVENT_HAS_CONTENT    (1<<5)
+#define EVENT_HAS_SIG        (1<<6)
+
+#define EVENT_HAS_ALL (EVENT_HAS_ID | EVENT_HAS_PUBKEY | EVENT_HAS_CREATED_AT | \
+		       EVENT_HAS_KIND | EVENT_HAS_TAGS | EVENT_HAS_CONTENT | \
+		       EVENT_HAS_SIG)
+
+/* Parse a nostr event object from json. The event may also be wrapped in
+ * an ["EVENT", ...] envelope, with or without a subscription id.
+ *
+ * Strings are unescaped in place and NUL terminated, so ev->content and the
+ * tag strings point into json, which must stay alive as long as ev. Hex
+ * fields are decoded straight into ev. Tags are allocated from ev->arena,
+ * which must be set. Returns 0 on malformed input or out of memory. */
+int parse_event(char *json, int len, struct nostr_event *ev, int *fields);
+
+/* Parse a ["REQ", <subid>, <filter>...] message, or a lone filter object,
+ * for which subid is set to NULL. Supports what nostril-query builds: ids,
+ * authors, kinds, single letter tags and limit. ids and authors are full
+ * 64 character hex. Any other field is reported and rejected, rather than
+ * ignored and matching more than was asked for. Strings are unescaped in
+ * place as in parse_event and the filters are allocated from arena. */
+int parse_req(char *json, int len, struct arena *arena, const char **subid,
+	      struct nostr_filter **filters, int *num_filters);
+
+#endif
@@ -0,0 +1,95 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "secp256k1.h"
+#include "secp256k1_schnorrsig.h"
+
+#include "hex.h"
+#include "random.h"
+#include "mine.h"
+#include "key.h"
+
+int make_sig(secp256k1_context *ctx, struct key *key,
+		unsigned char *id, unsigned char sig[64])
+{
+	unsigned char aux[32];
+
+	if (!fill_random(aux, sizeof(aux))) {
+		return 0;
+	}
+
+	return secp256k1_schnorrsig_sign32(ctx, sig, id, &key->pair, aux);
+}
+
+int create_key(secp256k1_context *ctx, struct key *key)
+{
+	secp256k1_xonly_pubkey pubkey;
+
+	/* Try to create a keypair with a valid context, it should only
+	 * fail if the secret key is zero or out of range. */
+	if (!secp256k1_keypair_create(ctx, &key->pair, key->secret))
+		return 0;
+
+	if (!secp256k1_keypair_xonly_pub(ctx, &pubkey, NULL, &key->pair))
+		return 0;
+
+	/* Serialize the public key. Should always return 1 for a valid public key. */
+	return secp256k1_xonly_pubkey_serialize(ctx, key->pubkey, &pubkey);
+}
+
+int decode_key(secp256k1_context *ctx, const char *secstr, struct key *key)
+{
+	if (!hex_decode(secstr, strlen(secstr), key->secret, 32)) {
+		fprintf(stderr, "could not hex decode secret key\n");
+		return 0;
+	}
+
+	return create_key(ctx, key);
+}
+
+int generate_key(secp256k1_context *ctx, struct key *key, int *difficulty, int threads)
+{
+	/* If the secret key is zero or out of range (bigger than secp256k1's
+	 * order), we try to sample a new key. Note that the probability of this
+	 * happening is negligible. */
+	if (!fill_random(key->secret, sizeof(key->secret))) {
+		return 0;
+	}
+
+	if (difficulty == NULL) {
+		return create_key(ctx, key);
+	}
+
+	if (!mine_pubkey(ctx, key->secret, *difficulty, threads, NULL))
+		return 0;
+
+	return create_key(ctx, key);
+}
+
+int generate_vanity_key(secp256k1_context *ctx, struct key *key,
+			const struct key_pattern *patterns, int num_patterns,
+			int threads)
+{
+	if (!mine_pubkey_patterns(ctx, key->secret, patterns, num_patterns,
+				  threads, NULL, NULL))
+		return 0;
+
+	return create_key(ctx, key);
+}
+
+
+int init_secp_context(secp256k1_context **ctx)
+{
+	unsigned char randomize[32];
+
+	*ctx = secp256k1_context_create(SECP256K1_CONTEXT_SIGN | SECP256K1_CONTEXT_VERIFY);
+	if (!fill_random(randomize, sizeof(randomize))) {
+		return 0;
+	}
+
+	/* Randomizing the context is recommended to protect against side-channel
+	 * leakage See `secp256k1_context_randomize` in secp256k1.h for more
+	 * information about it. This should never fail. */
+	return secp256k1_context_randomize(*ctx, randomize);
+}
@@ -0,0 +1,30 @@
+#ifndef KEY_H
+#define KEY_H
+
+#include "secp256k1.h"
+#include "struct_key.h"
+#include "vanity.h"
+
+/* create a context and randomize it against side channel leakage */
+int init_secp_context(secp256k1_context **ctx);
+
+/* fill in key->pair and key->pubkey from key->secret */
+int create_key(secp256k1_context *ctx, struct key *key);
+
+/* create the key from a hex encoded secret */
+int decode_key(secp256k1_context *ctx, const char *secstr, struct key *key);
+
+/* create a random key, or when `difficulty` is set, mine one whose pubkey
+ * has that many leading zero bits */
+int generate_key(secp256k1_context *ctx, struct key *key, int *difficulty, int threads);
+
+/* mine a key whose npub matches any of the patterns */
+int generate_vanity_key(secp256k1_context *ctx, struct key *key,
+			const struct key_pattern *patterns, int num_patterns,
+			int threads);
+
+/* schnorr sign a 32 byte event id with fresh auxiliary randomness */
+int make_sig(secp256k1_context *ctx, struct key *key,
+	     unsigned char *id, unsigned char sig[64]);
+
+#endif
@@ -0,0 +1,651 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <time.h>
+#include <errno.h>
+#include <assert.h>
+
+#include "secp256k1.h"
+#include "secp256k1_extrakeys.h"
+
+#include "sha256.h"
+#include "proof.h"
+#include "random.h"
+#include "event.h"
+#include "mine.h"
+
+/* attempts hashed per sha256_many() call, enough to fill the widest
+ * kernel's lanes */
+#define MINE_BATCH 8
+
+/* how often mine_range() reports progress */
+#define MINE_PROGRESS_MS 200
+
+struct mine_state {
+	const struct mine_job *job;
+	int threads;
+	uint64_t start, end;
+
+	atomic_int done;
+	pthread_mutex_t lock;
+	pthread_cond_t exited;
+	int running;
+	int found;
+	atomic_int best;
+	uint64_t nonce;
+	unsigned char id[32];
+};
+
+struct mine_worker {
+	pthread_t thread;
+	struct mine_state *state;
+	unsigned char *tails[MINE_BATCH];
+	uint64_t start;
+
+	/* every nonce of this worker's stride below it has been tried */
+	atomic_uint_fast64_t frontier;
+};
+
+int online_cpus(void)
+{
+	long n = sysconf(_SC_NPROCESSORS_ONLN);
+	return n < 1 ? 1 : (int)n;
+}
+
+static int ensure_nonce_tag(struct nostr_event *ev, int target, int *index)
+{
+	char str_target[16];
+	struct nostr_tag *tag;
+	int i;
+
+	for (i = 0; i < ev->num_tags; i++) {
+		tag = &ev->tags[i];
+		if (tag->num_elems >= 2 && !strcmp(tag->strs[0], "nonce")) {
+			*index = i;
+			return 1;
+		}
+	}
+
+	*index = ev->num_tags;
+
+	snprintf(str_target, sizeof(str_target), "%d", target);
+	const char *ts[] = { "nonce", "0", arena_strdup(ev->arena, str_target) };
+
+	return ts[2] && nostr_add_tag_n(ev, ts, 3);
+}
+
+static void render_nonce(char *dst, uint64_t nonce)
+{
+	int i;
+
+	for (i = NONCE_WIDTH - 1; i >= 0; i--) {
+		dst[i] = '0' + nonce % 10;
+		nonce /= 10;
+	}
+}
+
+/* serialize the commitment with the nonce at `index` set to `str` into a
+ * buffer from the event's arena */
+static unsigned char *commitment_with_nonce(struct nostr_event *ev, int index,
+		const char *str, int *len)
+{
+	unsigned char *buf;
+	size_t size;
+
+	ev->tags[index].strs[1] = str;
+	event_tags_changed(ev);
+	size = event_size(ev);
+
+	if (!(buf = arena_alloc(ev->arena, size)))
+		return NULL;
+
+	*len = event_commitment(ev, buf, size);
+	return *len ? buf : NULL;
+}
+
+int mine_job_init(struct mine_job *job, const unsigned char *commitment,
+		  int len, int nonce_off, int difficulty)
+{
+	int block;
+
+	if (nonce_off < 0 || nonce_off + NONCE_WIDTH > len)
+		return 0;
+
+	memset(job, 0, sizeof(*job));
+	job->difficulty = difficulty;
+	job->commitment = commitment;
+	job->len = len;
+
+	/* hash everything up to the last full block before the nonce once */
+	block = nonce_off - nonce_off % 64;
+	sha256_init(&job->midstate);
+	sha256_update(&job->midstate, commitment, block);
+
+	job->tail = commitment + block;
+	job->tail_len = len - block;
+	job->nonce_off = nonce_off - block;
+
+	return 1;
+}
+
+/* Serialize the commitment once and hash everything up to the last full
+ * block before the nonce. The nonce offset is found by serializing with
+ * two different placeholders, so escaping in earlier tags can't fool it */
+int mine_job_event(struct mine_job *job, struct nostr_event *ev, int difficulty)
+{
+	char zeros[NONCE_WIDTH + 1], nines[NONCE_WIDTH + 1];
+	unsigned char *commitment, *other;
+	struct nostr_tag *tag;
+	char *strnonce;
+	int index, len, other_len, off;
+
+	if (!ensure_nonce_tag(ev, difficulty, &index))
+		return 0;
+
+	tag = &ev->tags[index];
+	assert(!strcmp(tag->strs[0], "nonce"));
+
+	memset(zeros, '0', NONCE_WIDTH);
+	memset(nines, '9', NONCE_WIDTH);
+	zeros[NONCE_WIDTH] = nines[NONCE_WIDTH] = 0;
+
+	if (!(commitment = commitment_with_nonce(ev, index, zeros, &len)) ||
+	    !(other = commitment_with_nonce(ev, index, nines, &other_len)) ||
+	    !(strnonce = arena_alloc(ev->arena, NONCE_WIDTH + 1)))
+		return 0;
+
+	assert(len == other_len);
+	for (off = 0; off < len && commitment[off] == other[off]; off++)
+		;
+
+	if (!mine_job_init(job, commitment, len, off, difficulty))
+		return 0;
+
+	/* the tag pointed at the placeholders until now */
+	render_nonce(strnonce, 0);
+	strnonce[NONCE_WIDTH] = 0;
+	tag->strs[1] = strnonce;
+	event_tags_changed(ev);
+
+	job->ev = ev;
+	job->strnonce = strnonce;
+	return 1;
+}
+
+int mine_check(const struct mine_job *job, uint64_t nonce, unsigned char id[32])
+{
+	struct sha256_ctx sha = job->midstate;
+	struct sha256 hash;
+	char digits[NONCE_WIDTH];
+
+	render_nonce(digits, nonce);
+	sha256_update(&sha, job->tail, job->nonce_off);
+	sha256_update(&sha, digits, NONCE_WIDTH);
+	sha256_update(&sha, job->tail + job->nonce_off + NONCE_WIDTH,
+		      job->tail_len - job->nonce_off - NONCE_WIDTH);
+	sha256_done(&sha, &hash);
+
+	memcpy(id, hash.u.u8, 32);
+	return count_leading_zero_bits(hash.u.u8) >= job->difficulty;
+}
+
+void mine_job_set(struct mine_job *job, uint64_t nonce, const unsigned char id[32])
+{
+	render_nonce(job->strnonce, nonce);
+	event_tags_changed(job->ev);
+	memcpy(job->ev->id, id, 32);
+}
+
+static void *mine_worker_run(void *data)
+{
+	struct mine_worker *w = data;
+	struct mine_state *st = w->state;
+	const struct mine_job *job = st->job;
+	const int nonce_off = job->nonce_off, tail_len = job->tail_len;
+	const int difficulty = job->difficulty;
+	const uint64_t end = st->end, behind = w->start - st->start;
+	struct sha256 ids[MINE_BATCH];
+	uint64_t nonce, cand, stride = st->threads;
+	int i, bits, best = 0;
+
+	for (nonce = w->start;
+	     nonce < end && !atomic_load_explicit(&st->done, memory_order_relaxed);
+	     nonce += stride * MINE_BATCH) {
+		atomic_store_explicit(&w->frontier, nonce - behind, memory_order_relaxed);
+
+		for (i = 0; i < MINE_BATCH; i++)
+			render_nonce((char *)w->tails[i] + nonce_off, nonce + i * stride);
+
+		sha256_many(ids, &job->midstate, (const unsigned char *const *)w->tails,
+			    tail_len, MINE_BATCH);
+
+		for (i = 0; i < MINE_BATCH; i++) {
+			cand = nonce + i * stride;
+			if (cand >= end)
+				continue;
+
+			/* a new best is rare enough to share right away */
+			if ((bits = count_leading_zero_bits(ids[i].u.u8)) > best) {
+				best = atomic_load_explicit(&st->best, memory_order_relaxed);
+				while (bits > best && !atomic_compare_exchange_weak(&st->best, &best, bits))
+					;
+				if (best < bits)
+					best = bits;
+			}
+			if (bits < difficulty)
+				continue;
+
+			pthread_mutex_lock(&st->lock);
+			if (!atomic_load(&st->done)) {
+				st->nonce = cand;
+				st->found = 1;
+				memcpy(st->id, ids[i].u.u8, 32);
+				atomic_store(&st->done, 1);
+			}
+			pthread_mutex_unlock(&st->lock);
+			goto out;
+		}
+	}
+
+	if (nonce >= end)
+		atomic_store(&w->frontier, end);
+out:
+	pthread_mutex_lock(&st->lock);
+	st->running--;
+	pthread_cond_signal(&st->exited);
+	pthread_mutex_unlock(&st->lock);
+	return NULL;
+}
+
+static uint64_t search_frontier(struct mine_worker *workers, int n, uint64_t end)
+{
+	uint64_t f, min = end;
+	int i;
+
+	for (i = 0; i < n; i++) {
+		f = atomic_load_explicit(&workers[i].frontier, memory_order_relaxed);
+		if (f < min)
+			min = f;
+	}
+
+	return min;
+}
+
+/* wait for the workers, calling progress every MINE_PROGRESS_MS */
+static void wait_workers(struct mine_state *st, struct mine_worker *workers,
+			 int started, mine_progress_fn *progress, void *data)
+{
+	struct mine_progress p;
+	struct timespec deadline;
+
+	pthread_mutex_lock(&st->lock);
+	while (st->running) {
+		if (!progress) {
+			pthread_cond_wait(&st->exited, &st->lock);
+			continue;
+		}
+
+		clock_gettime(CLOCK_REALTIME, &deadline);
+		deadline.tv_nsec += MINE_PROGRESS_MS * 1000000L;
+		deadline.tv_sec += deadline.tv_nsec / 1000000000L;
+		deadline.tv_nsec %= 1000000000L;
+
+		if (pthread_cond_timedwait(&st->exited, &st->lock, &deadline) != ETIMEDOUT)
+			continue;
+
+		pthread_mutex_unlock(&st->lock);
+		p.frontier = search_frontier(workers, started, st->end);
+		p.best = atomic_load(&st->best);
+		if (!progress(&p, data))
+			atomic_store(&st->done, 1);
+		pthread_mutex_lock(&st->lock);
+	}
+	pthread_mutex_unlock(&st->lock);
+}
+
+int mine_range(const struct mine_job *job, uint64_t start, uint64_t end,
+	       int threads, mine_progress_fn *progress, void *data,
+	       uint64_t *nonce, unsigned char id[32])
+{
+	struct mine_worker *workers;
+	struct mine_state st;
+	int i, j, started, ret = MINE_ERROR;
+
+	memset(&st, 0, sizeof(st));
+	st.job = job;
+	st.threads = threads < 1 ? online_cpus() : threads;
+	st.start = start;
+	st.end = end;
+
+	if (!(workers = calloc(st.threads, sizeof(*workers))))
+		return MINE_ERROR;
+
+	pthread_mutex_init(&st.lock, NULL);
+	pthread_cond_init(&st.exited, NULL);
+	atomic_init(&st.done, 0);
+	atomic_init(&st.best, 0);
+
+	for (started = 0; started < st.threads; started++) {
+		struct mine_worker *w = &workers[started];
+
+		w->state = &st;
+		w->start = start + started;
+		atomic_init(&w->frontier, start);
+		for (j = 0; j < MINE_BATCH; j++) {
+			if (!(w->tails[j] = malloc(job->tail_len)))
+				break;
+			memcpy(w->tails[j], job->tail, job->tail_len);
+		}
+		if (j != MINE_BATCH)
+			break;
+
+		pthread_mutex_lock(&st.lock);
+		st.running++;
+		pthread_mutex_unlock(&st.lock);
+		if (pthread_create(&w->thread, NULL, mine_worker_run, w)) {
+			pthread_mutex_lock(&st.lock);
+			st.running--;
+			pthread_mutex_unlock(&st.lock);
+			break;
+		}
+	}
+
+	/* if we couldn't start every worker, the nonce space has holes, so
+	 * stop the ones we have and report failure */
+	if (started != st.threads)
+		atomic_store(&st.done, 1);
+
+	wait_workers(&st, workers, started, started == st.threads ? progress : NULL, data);
+
+	for (i = 0; i < started; i++)
+		pthread_join(workers[i].thread, NULL);
+
+	if (started == st.threads) {
+		ret = st.found ? MINE_FOUND : MINE_NOT_FOUND;
+		if (st.found) {
+			*nonce = st.nonce;
+			memcpy(id, st.id, 32);
+		}
+	}
+
+	for (i = 0; i < st.threads; i++) {
+		for (j = 0; j < MINE_BATCH; j++)
+			free(workers[i].tails[j]);
+	}
+
+	pthread_cond_destroy(&st.exited);
+	pthread_mutex_destroy(&st.lock);
+	free(workers);
+	return ret;
+}
+
+int mine_event(struct nostr_event *ev, int difficulty, int threads)
+{
+	struct mine_job job;
+	unsigned char id[32];
+	uint64_t nonce;
+
+	if (!mine_job_event(&job, ev, difficulty))
+		return 0;
+
+	if (mine_range(&job, 0, UINT64_MAX, threads, NULL, NULL, &nonce, id) != MINE_FOUND)
+		return 0;
+
+	mine_job_set(&job, nonce, id);
+	return 1;
+}
+
+/* keys walked per secp256k1_xonly_pubkey_serialize_sequence() call */
+#define PUBKEY_BATCH 1024
+
+/* how often mine_pubkey_patterns() reports the odds */
+#define PUBKEY_REPORT_MS 5000
+
+struct pubkey_state {
+	const secp256k1_context *ctx;
+	const struct key_pattern *patterns;
+	int num_patterns;
+
+	atomic_int done;
+	atomic_int failed;
+	atomic_uint_fast64_t attempts;
+	pthread_mutex_t lock;
+	pthread_cond_t exited;
+	int running;
+	unsigned char secret[32];
+	int which;
+};
+
+struct pubkey_worker {
+	pthread_t thread;
+	struct pubkey_state *state;
+};
+
+void format_duration(char *buf, size_t size, double secs)
+{
+	if (secs < 60)
+		snprintf(buf, size, "%.0fs", secs);
+	else if (secs < 3600)
+		snprintf(buf, size, "%dm%02ds", (int)secs / 60, (int)secs % 60);
+	else if (secs < 86400)
+		snprintf(buf, size, "%dh%02dm", (int)(secs / 3600), (int)secs % 3600 / 60);
+	else if (secs < 86400 * 1000.0)
+		snprintf(buf, size, "%dd%02dh", (int)(secs / 86400), (int)(secs / 3600) % 24);
+	else
+		snprintf(buf, size, "%.3g years", secs / (86400 * 365.25));
+}
+
+/* big endian 32 byte scalar holding a small offset */
+static void offset_tweak(unsigned char tweak[32], uint64_t offset)
+{
+	int i;
+
+	memset(tweak, 0, 32);
+	for (i = 0; i < 8; i++)
+		tweak[31 - i] = offset >> (8 * i);
+}
+
+static void *pubkey_worker_run(void *data)
+{
+	struct pubkey_worker *w = data;
+	struct pubkey_state *st = w->state;
+	unsigned char secret[32], tweak[32];
+	unsigned char *xs = NULL;
+	secp256k1_pubkey pubkey;
+	uint64_t base = 0;
+	int i, j;
+
+	if (!(xs = malloc(PUBKEY_BATCH * 32)))
+		goto fail;
+
+	do {
+		if (!fill_random(secret, sizeof(secret)))
+			goto fail;
+	} while (!secp256k1_ec_pubkey_create(st->ctx, &pubkey, secret));
+
+	while (!atomic_load_explicit(&st->done, memory_order_relaxed)) {
+		/* only fails if we walk into the point at infinity, which
+		 * would take ~2^256 steps from a random start */
+		if (!secp256k1_xonly_pubkey_serialize_sequence(st->ctx, xs, &pubkey, PUBKEY_BATCH))
+			goto fail;
+
+		atomic_fetch_add_explicit(&st->attempts, PUBKEY_BATCH, memory_order_relaxed);
+
+		for (i = 0; i < PUBKEY_BATCH; i++) {
+			for (j = 0; j < st->num_patterns; j++) {
+				if (key_pattern_match(&st->patterns[j], xs + i * 32))
+					break;
+			}
+			if (j == st->num_patterns)
+				continue;
+
+			/* the i-th point of this batch is (secret + base + i)G */
+			offset_tweak(tweak, base + i);
+			if (!secp256k1_ec_seckey_tweak_add(st->ctx, secret, tweak))
+				goto fail;
+
+			pthread_mutex_lock(&st->lock);
+			if (!atomic_load(&st->done)) {
+				memcpy(st->secret, secret, 32);
+				st->which = j;
+				atomic_store(&st->done, 1);
+			}
+			pthread_mutex_unlock(&st->lock);
+			goto out;
+		}
+
+		base += PUBKEY_BATCH;
+	}
+
+	goto out;
+fail:
+	atomic_store(&st->failed, 1);
+	atomic_store(&st->done, 1);
+out:
+	free(xs);
+	pthread_mutex_lock(&st->lock);
+	st->running--;
+	pthread_cond_signal(&st->exited);
+	pthread_mutex_unlock(&st->lock);
+	return NULL;
+}
+
+static uint64_t elapsed_ms(const struct timespec *t1)
+{
+	struct timespec t2;
+
+	clock_gettime(CLOCK_MONOTONIC, &t2);
+	return ((t2.tv_sec - t1->tv_sec) * 1000000000ULL + (t2.tv_nsec - t1->tv_nsec)) / 1000000ULL;
+}
+
+/* The odds of each pattern, 1 in 1/p keys, and the time left until we
+ * have tried that many. Half of the searches are done by about 0.69/p. */
+static void report_odds(const struct pubkey_state *st, uint64_t tried, double rate)
+{
+	const struct key_pattern *pat;
+	double expected;
+	char eta[32];
+	int i;
+
+	for (i = 0; i < st->num_patterns; i++) {
+		pat = &st->patterns[i];
+		expected = 1 / pat->p;
+
+		if (rate <= 0)
+			snprintf(eta, sizeof(eta), "unknown");
+		else if (tried >= expected)
+			snprintf(eta, sizeof(eta), "overdue");
+		else
+			format_duration(eta, sizeof(eta), (expected - tried) / rate);
+
+		fprintf(stderr, "vanity: '%s' is 1 in %.3g keys, %.3g%% of them tried, eta %s\n",
+			pat->text, expected, tried * 100.0 / expected, eta);
+	}
+}
+
+static void wait_pubkey_workers(struct pubkey_state *st, const struct timespec *t1)
+{
+	struct timespec deadline;
+	uint64_t tried, last_tried = 0, now, last = 0;
+
+	pthread_mutex_lock(&st->lock);
+	while (st->running) {
+		clock_gettime(CLOCK_REALTIME, &deadline);
+		deadline.tv_sec += PUBKEY_REPORT_MS / 1000;
+
+		if (pthread_cond_timedwait(&st->exited, &st->lock, &deadline) != ETIMEDOUT)
+			continue;
+
+		pthread_mutex_unlock(&st->lock);
+		now = elapsed_ms(t1);
+		tried = atomic_load(&st->attempts);
+		fprintf(stderr, "vanity: %.2f Mkeys/s, %" PRIu64 " keys tried\n",
+			(tried - last_tried) / 1000.0 / (now - last), tried);
+		report_odds(st, tried, (tried - last_tried) * 1000.0 / (now - last));
+		last = now;
+		last_tried = tried;
+		pthread_mutex_lock(&st->lock);
+	}
+	pthread_mutex_unlock(&st->lock);
+}
+
+int mine_pubkey_patterns(const secp256k1_context *ctx, unsigned char secret[32],
+			 const struct key_pattern *patterns, int num_patterns,
+			 int threads, int *which, uint64_t *nattempts)
+{
+	struct pubkey_worker *workers;
+	struct pubkey_state st;
+	struct timespec t1;
+	uint64_t attempts, duration;
+	int i, started, ok = 0;
+
+	memset(&st, 0, sizeof(st));
+	st.ctx = ctx;
+	st.patterns = patterns;
+	st.num_patterns = num_patterns;
+	threads = threads < 1 ? online_cpus() : threads;
+
+	if (num_patterns < 1 || !(workers = calloc(threads, sizeof(*workers))))
+		return 0;
+
+	pthread_mutex_init(&st.lock, NULL);
+	pthread_cond_init(&st.exited, NULL);
+	atomic_init(&st.done, 0);
+	atomic_init(&st.failed, 0);
+	atomic_init(&st.attempts, 0);
+
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+
+	pthread_mutex_lock(&st.lock);
+	for (started = 0; started < threads; started++) {
+		workers[started].state = &st;
+		if (pthread_create(&workers[started].thread, NULL,
+				   pubkey_worker_run, &workers[started]))
+			break;
+		st.running++;
+	}
+	pthread_mutex_unlock(&st.lock);
+
+	if (started == 0)
+		atomic_store(&st.failed, 1);
+	else
+		report_odds(&st, 0, 0);
+
+	wait_pubkey_workers(&st, &t1);
+
+	for (i = 0; i < started; i++)
+		pthread_join(workers[i].thread, NULL);
+
+	duration = elapsed_ms(&t1);
+
+	if (!atomic_load(&st.failed)) {
+		memcpy(secret, st.secret, 32);
+		attempts = atomic_load(&st.attempts);
+		fprintf(stderr, "mined pubkey matching %s after %" PRIu64 " attempts, %" PRIu64 " ms, %.0f attempts per second on %d threads\n",
+			patterns[st.which].text, attempts, duration,
+			duration ? attempts * 1000.0 / duration : 0.0, started);
+		if (which)
+			*which = st.which;
+		if (nattempts)
+			*nattempts = attempts;
+		ok = 1;
+	}
+
+	pthread_cond_destroy(&st.exited);
+	pthread_mutex_destroy(&st.lock);
+	free(workers);
+	return ok;
+}
+
+int mine_pubkey(const secp256k1_context *ctx, unsigned char secret[32],
+		int difficulty, int threads, uint64_t *nattempts)
+{
+	struct key_pattern pat;
+
+	key_pattern_zero_bits(&pat, difficulty);
+	return mine_pubkey_patterns(ctx, secret, &pat, 1, threads, NULL, nattempts);
+}
@@ -0,0 +1,102 @@
+#ifndef MINE_H
+#define MINE_H
+
+#include <stdint.h>
+
+#include "secp256k1.h"
+#include "sha256.h"
+#include "struct_nostr_event.h"
+#include "vanity.h"
+
+/* number of online cpus, used as the default --threads */
+int online_cpus(void);
+
+/* nonces are rendered zero padded to the width of u64 max, so every
+ * attempt serializes to the same length and only the digits change */
+#define NONCE_WIDTH 20
+
+/* A nonce search over one commitment, everything needed to hash an
+ * attempt. Jobs made from an event also point back at its nonce tag. */
+struct mine_job {
+	int difficulty;
+
+	/* the whole commitment with a zero nonce, how a job is handed to
+	 * other processes */
+	const unsigned char *commitment;
+	int len;
+
+	/* sha256 state over every full block that precedes the nonce */
+	struct sha256_ctx midstate;
+
+	/* the rest of the commitment, starting at the midstate block
+	 * boundary, and where the nonce digits live within it */
+	const unsigned char *tail;
+	int tail_len;
+	int nonce_off;
+
+	struct nostr_event *ev;
+	char *strnonce;
+};
+
+/* add a nonce tag to ev if it has none and make the job for it */
+int mine_job_event(struct mine_job *job, struct nostr_event *ev, int difficulty);
+
+/* the job for a commitment with NONCE_WIDTH nonce digits at nonce_off,
+ * which must outlive it */
+int mine_job_init(struct mine_job *job, const unsigned char *commitment,
+		  int len, int nonce_off, int difficulty);
+
+/* hash one nonce into id, returns 1 if it meets the difficulty */
+int mine_check(const struct mine_job *job, uint64_t nonce, unsigned char id[32]);
+
+/* write the mined nonce into the event's nonce tag and id */
+void mine_job_set(struct mine_job *job, uint64_t nonce, const unsigned char id[32]);
+
+struct mine_progress {
+	/* every nonce below it has been tried */
+	uint64_t frontier;
+	/* most leading zero bits of any id so far */
+	int best;
+};
+
+/* Called every few hundred ms during mine_range(). Return 0 to stop the
+ * search. */
+typedef int mine_progress_fn(const struct mine_progress *p, void *data);
+
+#define MINE_FOUND 1
+#define MINE_NOT_FOUND 0
+#define MINE_ERROR -1
+
+/* Try the nonces in [start, end) on `threads` workers until one meets the
+ * difficulty, which is returned in *nonce and id. Returns MINE_FOUND,
+ * MINE_NOT_FOUND if the range is used up or progress stopped the search,
+ * or MINE_ERROR if the workers couldn't be started. */
+int mine_range(const struct mine_job *job, uint64_t start, uint64_t end,
+	       int threads, mine_progress_fn *progress, void *data,
+	       uint64_t *nonce, unsigned char id[32]);
+
+/* mine a nonce tag so that the event id has at least `difficulty` leading
+ * zero bits. The nonce space is split across `threads` workers and the
+ * first hit stops all of them. On success ev->id holds the mined id. */
+int mine_event(struct nostr_event *ev, int difficulty, int threads);
+
+/* Search for a secret key whose x-only pubkey matches any of the
+ * patterns. Every worker starts at a random key and walks forward by
+ * adding G, so each attempt is a point addition instead of a scalar
+ * multiplication. The rate and the odds of every pattern are reported on
+ * stderr every few seconds. The index of the pattern that matched is
+ * stored in *which and the number of keys tried in *nattempts, either may
+ * be NULL. */
+int mine_pubkey_patterns(const secp256k1_context *ctx, unsigned char secret[32],
+			 const struct key_pattern *patterns, int num_patterns,
+			 int threads, int *which, uint64_t *nattempts);
+
+/* mine_pubkey_patterns() for a pubkey with at least `difficulty` leading
+ * zero bits */
+int mine_pubkey(const secp256k1_context *ctx, unsigned char secret[32],
+		int difficulty, int threads, uint64_t *nattempts);
+
+/* "42s", "3m07s", "5h12m", "12d04h" */
+void format_duration(char *buf, size_t size, double secs);
+
+#endif
@@ -8,6 +8,7 @@
 #include <inttypes.h>
 #include <limits.h>
 #include <unistd.h>
+#include <sys/wait.h>
 
 #include<libgen.h>
 
@@ -18,13 +19,21 @@
 
 #include "cursor.h"
 #include "hex.h"
-#include "base64.h"
-#include "aes.h"
 #include "sha256.h"
-#include "random.h"
-#include "proof.h"
+#include "event.h"
+#include "mine.h"
+#include "key.h"
+#include "bech32.h"
+#include "dm.h"
+#include "batch.h"
+#include "serve.h"
+#include "store.h"
+#include "query.h"
+#include "json.h"
+#include "gen.h"
+#include "patch.h"
+#include "pow.h"
 
-#include "constants.h"
 #include "struct_key.h"
 #include "struct_args.h"
 #include "struct_nostr_tag.h"
@@ -34,16 +43,18 @@
 
 #define VERSION "0.0.54"
 
-#define MAX_TAGS 32
-#define MAX_TAG_ELEMS 16
-
 #define HAS_CREATED_AT (1<<1)
 #define HAS_KIND (1<<2)
 #define HAS_ENVELOPE (1<<3)
 #define HAS_ENCRYPT (1<<4)
 #define HAS_DIFFICULTY (1<<5)
 #define HAS_MINE_PUBKEY (1<<6)
+#define HAS_STDIN_JSONL (1<<7)
+#define HAS_DM_LIST (1<<8)
 #define TO_BASE_N (sizeof(unsigned)*CHAR_BIT + 1)
+
+/* --threads beyond this is a typo, not a machine, and is cut down to it */
+#define MAX_THREADS 1024
 #define TO_BASE(x, b) my_to_base((char [TO_BASE_N]){""}, (x), (b))
 //                               ^--compound literal--^
 char *my_to_base(char buf[TO_BASE_N], unsigned i, int base) {
@@ -175,16 +186,33 @@ void usage(char *appname)
 	printf("\n");
 	printf("      --content <string>              the content of the note\n");
 	printf("      --dm <hex pubkey>               make an encrypted dm to said pubkey. sets kind and tags.\n");
+	printf("      --dm-list <file>                make an encrypted dm to every hex pubkey in file, one per line\n");
 	printf("      --envelope                      wrap in [\"EVENT\",...] for easy relaying\n");
 	printf("      --kind <number>                 set kind\n");
 	printf("      --created-at <unix timestamp>   set a specific created-at time\n");
 	printf("      --sec <hex seckey>              set the secret key for signing, otherwise one will be randomly generated\n");
 	printf("      --pow <difficulty>              number of leading 0 bits of the id to mine\n");
 	printf("      --mine-pubkey                   mine a pubkey instead of id\n");
+	printf("      --vanity <pattern>              mine a key whose npub starts with pattern, like npub1dev, [ac]?x or hex:c0ffee, repeatable\n");
+	printf("      --pow-workers <number>          mine the id in this many worker processes, leasing them nonce ranges\n");
+	printf("      --pow-listen <path>             also lease nonce ranges to pow-worker processes connecting to this unix socket\n");
+	printf("      --pow-lease <number>            nonces per lease, default 2^28\n");
+	printf("      --checkpoint <file>             save mining progress to file every few seconds and when interrupted\n");
+	printf("      --resume                        continue mining from the --checkpoint file\n");
+	printf("      --threads <number>              number of mining threads, defaults to the number of cpus, at most 1024\n");
 	printf("      --tag <key> <value>             add a tag\n");
+	printf("      --stdin-jsonl                   sign event templates read from stdin, one json object per line\n");
 	printf("\n");
 	printf("      --hash <value>                  return sha256 of <value>\n");
 	printf("\n");
+	printf("      verify [--threads <n>] [file]   check the ids and signatures of json lines events\n");
+	printf("      serve --sec <hex> --socket <path>  sign json lines event templates sent to a unix socket\n");
+	printf("      decrypt --sec <hex> [file]      decrypt json lines kind 4 dms to or from the key\n");
+	printf("      store [--dir <path>] <cmd>      keep events in a local store, cmd is add [file], get <id>..., query [filter], dump, index, rebuild or stats\n");
+	printf("      gen [--count <n>] [--seed <n>]  print synthetic signed events, the same for the same options\n");
+	printf("      patches --sec <hex> [--range <revs>]  make NIP-34 patch events from git format-patch output\n");
+	printf("      pow-worker --connect <path>     mine nonce ranges leased by nostril --pow-listen <path>\n");
+	printf("\n");
 	printf("      -e <event_id>                   shorthand for --tag e <event_id>\n");
 	printf("      -p <pubkey>                     shorthand for --tag p <pubkey>\n");
 	printf("      -t <hashtag>                    shorthand for --tag t <hashtag>\n");
@@ -202,240 +230,13 @@ void usage(char *appname)
 }
 
 
-inline static int cursor_push_escaped_char(struct cursor *cur, char c)
-{
-        switch (c) {
-        case '"':  return cursor_push_str(cur, "\\\"");
-        case '\\': return cursor_push_str(cur, "\\\\");
-        case '\b': return cursor_push_str(cur, "\\b");
-        case '\f': return cursor_push_str(cur, "\\f");
-        case '\n': return cursor_push_str(cur, "\\n");
-        case '\r': return cursor_push_str(cur, "\\r");
-        case '\t': return cursor_push_str(cur, "\\t");
-        // TODO: \u hex hex hex hex
-        }
-        return cursor_push_byte(cur, c);
-}
-
-static int cursor_push_jsonstr(struct cursor *cur, const char *str)
-{
-	int i;
-        int len;
-
-	len = strlen(str);
-
-        if (!cursor_push_byte(cur, '"'))
-                return 0;
-
-        for (i = 0; i < len; i++) {
-                if (!cursor_push_escaped_char(cur, str[i]))
-                        return 0;
-        }
-
-        if (!cursor_push_byte(cur, '"'))
-                return 0;
-
-        return 1;
-}
-
-static int cursor_push_tag(struct cursor *cur, struct nostr_tag *tag)
-{
-        int i;
-
-        if (!cursor_push_byte(cur, '['))
-                return 0;
-
-        for (i = 0; i < tag->num_elems; i++) {
-                if (!cursor_push_jsonstr(cur, tag->strs[i]))
-                        return 0;
-                if (i != tag->num_elems-1) {
-                        if (!cursor_push_byte(cur, ','))
-                                return 0;
-                }
-        }
-
-        return cursor_push_byte(cur, ']');
-}
-
-static int cursor_push_tags(struct cursor *cur, struct nostr_event *ev)
-{
-        int i;
-
-	if (ev->explicit_tags) {
-		return cursor_push_str(cur, ev->explicit_tags);
-	}
-
-        if (!cursor_push_byte(cur, '['))
-                return 0;
-
-        for (i = 0; i < ev->num_tags; i++) {
-                if (!cursor_push_tag(cur, &ev->tags[i]))
-                        return 0;
-                if (i != ev->num_tags-1) {
-                        if (!cursor_push_str(cur, ","))
-                                return 0;
-                }
-        }
-
-        return cursor_push_byte(cur, ']');
-}
-
-
-int event_commitment(struct nostr_event *ev, unsigned char *buf, int buflen)
-{
-	char timebuf[16] = {0};
-	char kindbuf[16] = {0};
-	char pubkey[65];
-	struct cursor cur;
-	int ok;
-
-	ok = hex_encode(ev->pubkey, sizeof(ev->pubkey), pubkey, sizeof(pubkey));
-	assert(ok);
-
-	make_cursor(buf, buf + buflen, &cur);
-
-	snprintf(timebuf, sizeof(timebuf), "%" PRIu64 "", ev->created_at);
-        snprintf(kindbuf, sizeof(kindbuf), "%d", ev->kind);
-
-	ok =
-                cursor_push_str(&cur, "[0,\"") &&
-                cursor_push_str(&cur, pubkey) &&
-                cursor_push_str(&cur, "\",") &&
-                cursor_push_str(&cur, timebuf) &&
-                cursor_push_str(&cur, ",") &&
-                cursor_push_str(&cur, kindbuf) &&
-                cursor_push_str(&cur, ",") &&
-                cursor_push_tags(&cur, ev) &&
-                cursor_push_str(&cur, ",") &&
-                cursor_push_jsonstr(&cur, ev->content) &&
-                cursor_push_str(&cur, "]");
-
-	if (!ok)
-		return 0;
-
-	return cur.p - cur.start;
-}
-
-static int make_sig(secp256k1_context *ctx, struct key *key,
-		unsigned char *id, unsigned char sig[64])
-{
-	unsigned char aux[32];
-
-	if (!fill_random(aux, sizeof(aux))) {
-		return 0;
-	}
-
-	return secp256k1_schnorrsig_sign32(ctx, sig, id, &key->pair, aux);
-}
-
-static int create_key(secp256k1_context *ctx, struct key *key)
-{
-	secp256k1_xonly_pubkey pubkey;
-
-	/* Try to create a keypair with a valid context, it should only
-	 * fail if the secret key is zero or out of range. */
-	if (!secp256k1_keypair_create(ctx, &key->pair, key->secret))
-		return 0;
-
-	if (!secp256k1_keypair_xonly_pub(ctx, &pubkey, NULL, &key->pair))
-		return 0;
-
-	/* Serialize the public key. Should always return 1 for a valid public key. */
-	return secp256k1_xonly_pubkey_serialize(ctx, key->pubkey, &pubkey);
-}
-
-static int decode_key(secp256k1_context *ctx, const char *secstr, struct key *key)
-{
-	if (!hex_decode(secstr, strlen(secstr), key->secret, 32)) {
-		fprintf(stderr, "could not hex decode secret key\n");
-		return 0;
-	}
-
-	return create_key(ctx, key);
-}
-
-static inline void xor_mix(unsigned char *dest, const unsigned char *a, const unsigned char *b, int size)
-{
-    int i;
-    for (i = 0; i < size; i++)
-        dest[i] = a[i] ^ b[i];
-}
-
-static int generate_key(secp256k1_context *ctx, struct key *key, int *difficulty)
-{
-	//uint64_t attempts = 0;
-	//uint64_t duration;
-	int bits;
-	//double pers;
-	struct timespec t1, t2;
-
-	/* If the secret key is zero or out of range (bigger than secp256k1's
-	 * order), we try to sample a new key. Note that the probability of this
-	 * happening is negligible. */
-	if (!fill_random(key->secret, sizeof(key->secret))) {
-		return 0;
-	}
-
-	if (difficulty == NULL) {
-		return create_key(ctx, key);
-	}
-
-	clock_gettime(CLOCK_MONOTONIC, &t1);
-	while (1) {
-		if (!create_key(ctx, key))
-			return 0;
-
-		//attempts++;
-
-		if ((bits = count_leading_zero_bits(key->pubkey)) >= *difficulty) {
-			clock_gettime(CLOCK_MONOTONIC, &t2);
-			//duration = ((t2.tv_sec - t1.tv_sec) * 1e9L + (t2.tv_nsec - t1.tv_nsec)) / 1e6L;
-			//pers = (double)attempts / (double)duration;
-			//fprintf(stderr, "mined pubkey with %d bits after %" PRIu64 " attempts, %" PRId64 " ms, %f attempts per ms\n", bits, attempts, duration, pers);
-			return 1;
-		}
-
-		// NOTE: Get a new secret key by xor mixing the current secret
-		// key with the current public key. This doesn't rely on the
-		// system's crypto number generator so it should be fast. There
-		// shouldn't be any secret key entropy issues since we got a
-		// good source of entropy from the first fill_random call at
-		// the start of the function.
-		xor_mix(key->secret, key->secret, key->pubkey, 32);
-	}
-}
-
-
-static int init_secp_context(secp256k1_context **ctx)
-{
-	unsigned char randomize[32];
-
-	*ctx = secp256k1_context_create(SECP256K1_CONTEXT_SIGN | SECP256K1_CONTEXT_VERIFY);
-	if (!fill_random(randomize, sizeof(randomize))) {
-		return 0;
-	}
-
-	/* Randomizing the context is recommended to protect against side-channel
-	 * leakage See `secp256k1_context_randomize` in secp256k1.h for more
-	 * information about it. This should never fail. */
-	return secp256k1_context_randomize(*ctx, randomize);
-}
-
 static int generate_event_id(struct nostr_event *ev)
 {
-	static unsigned char buf[102400];
-
-	int len;
-
-	if (!(len = event_commitment(ev, buf, sizeof(buf)))) {
-		fprintf(stderr, "event_commitment: buffer out of space\n");
+	if (!event_id(ev)) {
+		fprintf(stderr, "event_commitment: out of memory\n");
 		return 0;
 	}
 
-	//fprintf(stderr, "commitment: '%.*s'\n", len, buf);
-
-	sha256((struct sha256*)ev->id, buf, len);
-
 	return 1;
 }
 
@@ -447,47 +248,19 @@ static int sign_event(secp256k1_context *ctx, struct key *key, struct nostr_even
 	return 1;
 }
 
+/* tags and content go out from where they were serialized for the id */
 static int print_event(struct nostr_event *ev, int envelope)
 {
-	unsigned char buf[102400];
-	char pubkey[65];
-	char id[65];
-	char sig[129];
-	struct cursor cur;
-	int ok;
-
-	ok = hex_encode(ev->id, sizeof(ev->id), id, sizeof(id)) &&
-	hex_encode(ev->pubkey, sizeof(ev->pubkey), pubkey, sizeof(pubkey)) &&
-	hex_encode(ev->sig, sizeof(ev->sig), sig, sizeof(sig));
-
-	assert(ok);
+	struct iovec iov[EVENT_IOV + 1];
 
-	make_cursor(buf, buf+sizeof(buf), &cur);
-	if (!cursor_push_tags(&cur, ev))
+	if (!event_json_iov(ev, envelope, iov))
 		return 0;
 
-	if (envelope)
-		printf("[\"EVENT\",");
-
-	printf("{\"id\": \"%s\",", id);
-	printf("\"pubkey\": \"%s\",", pubkey);
-	printf("\"created_at\": %" PRIu64 ",", ev->created_at);
-	printf("\"kind\": %d,", ev->kind);
-	printf("\"tags\": %.*s,", (int)cursor_len(&cur), cur.start);
-
-	reset_cursor(&cur);
-	if (!cursor_push_jsonstr(&cur, ev->content))
-		return 0;
-
-	printf("\"content\": %.*s,", (int)cursor_len(&cur), cur.start);
-	printf("\"sig\": \"%s\"}", sig);
-
-	if (envelope)
-		printf("]");
+	iov[EVENT_IOV].iov_base = "\n";
+	iov[EVENT_IOV].iov_len = 1;
 
-	printf("\n");
-
-	return 1;
+	fflush(stdout);
+	return write_iov(STDOUT_FILENO, iov, EVENT_IOV + 1);
 }
 
 static void make_event_from_args(struct nostr_event *ev, struct args *args)
@@ -503,31 +276,22 @@ static int parse_num(const char *arg, uint64_t *t)
 	return errno != EINVAL;
 }
 
-static int nostr_add_tag_n(struct nostr_event *ev, const char **ts, int n_ts)
+/* a --threads value, at least 1 and at most MAX_THREADS. parse_num
+ * would take -1 as a huge count that turns into -1 again as an int. */
+static int parse_threads(const char *arg, int *threads)
 {
-	int i;
-	struct nostr_tag *tag;
+	char *end;
+	long n;
 
-	if (ev->num_tags + 1 > MAX_TAGS)
+	errno = 0;
+	n = strtol(arg, &end, 10);
+	if (errno || end == arg || *end || n < 1)
 		return 0;
 
-	tag = &ev->tags[ev->num_tags++];
-
-	tag->num_elems = n_ts;
-	for (i = 0; i < n_ts; i++) {
-		tag->strs[i] = ts[i];
-	}
-
+	*threads = n > MAX_THREADS ? MAX_THREADS : (int)n;
 	return 1;
 }
 
-static int nostr_add_tag(struct nostr_event *ev, const char *t1, const char *t2)
-{
-	const char *ts[] = {t1, t2};
-	return nostr_add_tag_n(ev, ts, 2);
-}
-
-
 static int parse_args(int argc, const char *argv[], struct args *args, struct nostr_event *ev)
 {
 	const char *arg, *arg2;
@@ -557,6 +321,21 @@ static int parse_args(int argc, const char *argv[], struct args *args, struct no
       hash(argc, argv, args);
     }
 
+		/* flags without a value */
+		if (!strcmp(arg, "--envelope")) {
+			args->flags |= HAS_ENVELOPE;
+			continue;
+		} else if (!strcmp(arg, "--stdin-jsonl")) {
+			args->flags |= HAS_STDIN_JSONL;
+			continue;
+		} else if (!strcmp(arg, "--resume")) {
+			args->pow_resume = 1;
+			continue;
+		} else if (!strcmp(arg, "--mine-pubkey")) {
+			args->flags |= HAS_MINE_PUBKEY;
+			continue;
+		}
+
 		if (!argc) {
 			fprintf(stderr, "expected argument: '%s'\n", arg);
 			return 0;
@@ -583,8 +362,6 @@ static int parse_args(int argc, const char *argv[], struct args *args, struct no
 			}
 			args->kind = (int)n;
 			args->flags |= HAS_KIND;
-		} else if (!strcmp(arg, "--envelope")) {
-			args->flags |= HAS_ENVELOPE;
 		} else if (!strcmp(arg, "--tags")) {
 			if (args->flags & HAS_DIFFICULTY) {
 				fprintf(stderr, "can't combine --tags and --pow (yet)\n");
@@ -633,8 +410,6 @@ static int parse_args(int argc, const char *argv[], struct args *args, struct no
 				fprintf(stderr, "couldn't add tag '%s' '%s'\n", arg, arg2);
 				return 0;
 			}
-		} else if (!strcmp(arg, "--mine-pubkey")) {
-			args->flags |= HAS_MINE_PUBKEY;
 		} else if (!strcmp(arg, "--pow")) {
 			if (args->tags) {
 				fprintf(stderr, "can't combine --tags and --pow (yet)\n");
@@ -647,6 +422,35 @@ static int parse_args(int argc, const char *argv[], struct args *args, struct no
 			}
 			args->difficulty = n;
 			args->flags |= HAS_DIFFICULTY;
+		} else if (!strcmp(arg, "--threads")) {
+			arg = *argv++; argc--;
+			if (!parse_threads(arg, &args->threads)) {
+				fprintf(stderr, "could not parse threads as number: '%s'\n", arg);
+				return 0;
+			}
+		} else if (!strcmp(arg, "--pow-workers")) {
+			arg = *argv++; argc--;
+			if (!parse_num(arg, &n) || n < 1 || n > 4096) {
+				fprintf(stderr, "could not parse pow workers as number: '%s'\n", arg);
+				return 0;
+			}
+			args->pow_workers = (int)n;
+		} else if (!strcmp(arg, "--vanity")) {
+			if (args->num_vanity == VANITY_MAX_PATTERNS) {
+				fprintf(stderr, "at most %d --vanity patterns\n", VANITY_MAX_PATTERNS);
+				return 0;
+			}
+			args->vanity[args->num_vanity++] = *argv++; argc--;
+		} else if (!strcmp(arg, "--pow-listen")) {
+			args->pow_listen = *argv++; argc--;
+		} else if (!strcmp(arg, "--checkpoint")) {
+			args->pow_checkpoint = *argv++; argc--;
+		} else if (!strcmp(arg, "--pow-lease")) {
+			arg = *argv++; argc--;
+			if (!parse_num(arg, &args->pow_lease) || args->pow_lease < 1) {
+				fprintf(stderr, "could not parse pow lease as number: '%s'\n", arg);
+				return 0;
+			}
 		} else if (!strcmp(arg, "--dm")) {
 			arg = *argv++; argc--;
 			if (!hex_decode(arg, strlen(arg), args->encrypt_to, 32)) {
@@ -654,9 +458,14 @@ static int parse_args(int argc, const char *argv[], struct args *args, struct no
 				return 0;
 			}
 			args->flags |= HAS_ENCRYPT;
+		} else if (!strcmp(arg, "--dm-list")) {
+			args->dm_list = *argv++; argc--;
+			args->flags |= HAS_DM_LIST;
 		} else if (!strcmp(arg, "--content")) {
 			arg = *argv++; argc--;
 			args->content = arg;
+		} else if (!strcmp(arg, "--socket")) {
+			args->socket = *argv++; argc--;
 		} else {
 			fprintf(stderr, "unexpected argument '%s'\n", arg);
 			return 0;
@@ -669,182 +478,582 @@ static int parse_args(int argc, const char *argv[], struct args *args, struct no
 	return 1;
 }
 
-static int aes_encrypt(unsigned char *key, unsigned char *iv,
-		unsigned char *buf, size_t buflen)
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+// verify
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+
+static int verify(int argc, const char *argv[], secp256k1_context *ctx)
 {
-	struct AES_ctx ctx;
-	unsigned char padding;
-	int i;
-	struct cursor cur;
+	const char *arg, *path = NULL;
+	uint64_t nbad;
+	FILE *in = stdin;
+	int threads = 0, ok;
 
-	padding = 16 - (buflen % 16);
-	make_cursor(buf, buf + buflen + padding, &cur);
-	cur.p += buflen;
-	//fprintf(stderr, "aes_encrypt: len %ld, padding %d\n", buflen, padding);
+	argv++; argc--;
+	for (; argc; ) {
+		arg = *argv++; argc--;
+		if (!strcmp(arg, "--threads") && argc) {
+			arg = *argv++; argc--;
+			if (!parse_threads(arg, &threads)) {
+				fprintf(stderr, "could not parse threads as number: '%s'\n", arg);
+				return 10;
+			}
+		} else if (arg[0] != '-' && !path) {
+			path = arg;
+		} else {
+			fprintf(stderr, "usage: nostril verify [--threads <number>] [file.jsonl]\n");
+			return 10;
+		}
+	}
 
-	for (i = 0; i < padding; i++) {
-		if (!cursor_push_byte(&cur, padding)) {
-			return 0;
+	if (path && !(in = fopen(path, "r"))) {
+		fprintf(stderr, "could not open '%s'\n", path);
+		return 3;
+	}
+
+	ok = batch_verify(ctx, in, stdout, threads, &nbad);
+
+	if (in != stdin)
+		fclose(in);
+
+	return !ok ? 2 : nbad ? 1 : 0;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+// decrypt
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#define DECRYPT_CACHE_SIZE 4096
+
+static int decrypt(int argc, const char *argv[], secp256k1_context *ctx)
+{
+	const char *arg, *path = NULL, *sec = NULL;
+	uint64_t n, nbad;
+	struct key key;
+	FILE *in = stdin;
+	int threads = 0, cache_size = DECRYPT_CACHE_SIZE, ok;
+
+	argv++; argc--;
+	for (; argc; ) {
+		arg = *argv++; argc--;
+		if (!strcmp(arg, "--sec") && argc) {
+			sec = *argv++; argc--;
+		} else if (!strcmp(arg, "--threads") && argc) {
+			arg = *argv++; argc--;
+			if (!parse_threads(arg, &threads)) {
+				fprintf(stderr, "could not parse threads as number: '%s'\n", arg);
+				return 10;
+			}
+		} else if (!strcmp(arg, "--cache") && argc) {
+			arg = *argv++; argc--;
+			if (!parse_num(arg, &n) || n < 1 || n > INT_MAX) {
+				fprintf(stderr, "could not parse cache as number: '%s'\n", arg);
+				return 10;
+			}
+			cache_size = (int)n;
+		} else if (!strcmp(arg, "--stdin-jsonl")) {
+			/* the default, accepted so it reads like the signing mode */
+		} else if (arg[0] != '-' && !path) {
+			path = arg;
+		} else {
+			fprintf(stderr, "usage: nostril decrypt --sec <hex> [--threads <number>] [--cache <peers>] [--stdin-jsonl | file.jsonl]\n");
+			return 10;
 		}
 	}
-	assert(cur.p == cur.end);
-	assert((cur.p - cur.start) % 16 == 0);
 
-	AES_init_ctx_iv(&ctx, key, iv);
-	//fprintf(stderr, "encrypting %ld bytes: ", cur.p - cur.start);
-	//print_hex(cur.start, cur.p - cur.start);
-	AES_CBC_encrypt_buffer(&ctx, cur.start, cur.p - cur.start);
+	if (!sec) {
+		fprintf(stderr, "decrypt: --sec <hex> is required\n");
+		return 10;
+	}
+
+	if (!decode_key(ctx, sec, &key))
+		return 8;
 
-	return cur.p - cur.start;
+	if (path && !(in = fopen(path, "r"))) {
+		fprintf(stderr, "could not open '%s'\n", path);
+		return 3;
+	}
+
+	ok = batch_decrypt(ctx, &key, in, stdout, threads, cache_size, &nbad);
+
+	if (in != stdin)
+		fclose(in);
+
+	return !ok ? 2 : nbad ? 1 : 0;
 }
 
-static int copyx(unsigned char *output, const unsigned char *x32, const unsigned char *y32, void *data) {
-	memcpy(output, x32, 32);
-	return 1;
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+// gen
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+
+static void gen_usage(void)
+{
+	fprintf(stderr, "usage: nostril gen [--count <n>] [--seed <n>] [--authors <n>] [--kinds <kind:weight,...>] [--tags <e:avg,p:avg,t:avg>] [--topics <n>] [--content <min-max>] [--created-at <unix timestamp>] [--threads <number>] [--envelope]\n");
 }
 
-static int ensure_nonce_tag(struct nostr_event *ev, int target, int *index)
+static int gen_cmd(int argc, const char *argv[], secp256k1_context *ctx)
 {
-	char *str_target = malloc(8);
-	struct nostr_tag *tag;
-	int i;
-
-	for (i = 0; i < ev->num_tags; i++) {
-		tag = &ev->tags[i];
-		if (tag->num_elems == 2 && !strcmp(tag->strs[0], "nonce")) {
-			*index = i;
-			return 1;
+	struct batch_opts opts = {0};
+	struct gen_opts gen;
+	struct key *keys;
+	const char *arg, *val;
+	uint64_t n;
+	int ok;
+
+	gen_defaults(&gen);
+
+	argv++; argc--;
+	for (; argc; ) {
+		arg = *argv++; argc--;
+		if (!strcmp(arg, "--envelope")) {
+			opts.envelope = 1;
+			continue;
+		}
+		if (!argc) {
+			gen_usage();
+			return 10;
+		}
+		val = *argv++; argc--;
+		if (!strcmp(arg, "--kinds")) {
+			ok = gen_parse_kinds(&gen, val);
+		} else if (!strcmp(arg, "--tags")) {
+			ok = gen_parse_tags(&gen, val);
+		} else if (!strcmp(arg, "--content")) {
+			ok = gen_parse_content(&gen, val);
+		} else if (!strcmp(arg, "--count")) {
+			ok = parse_num(val, &gen.count);
+		} else if (!strcmp(arg, "--seed")) {
+			ok = parse_num(val, &gen.seed);
+		} else if (!strcmp(arg, "--created-at")) {
+			ok = parse_num(val, &gen.created_at);
+		} else if (!strcmp(arg, "--authors")) {
+			ok = parse_num(val, &n) && n >= 1 && n <= INT_MAX;
+			gen.authors = (int)n;
+		} else if (!strcmp(arg, "--topics")) {
+			ok = parse_num(val, &n) && n <= INT_MAX;
+			gen.topics = (int)n;
+		} else if (!strcmp(arg, "--threads")) {
+			ok = parse_threads(val, &opts.threads);
+		} else {
+			gen_usage();
+			return 10;
+		}
+		if (!ok) {
+			fprintf(stderr, "could not parse %s: '%s'\n", arg + 2, val);
+			return 10;
 		}
 	}
 
-	*index = ev->num_tags;
+	if (!(keys = gen_keys(ctx, &gen))) {
+		fprintf(stderr, "out of memory\n");
+		return 2;
+	}
 
-	snprintf(str_target, 7, "%d", target);
-	const char *ts[] = { "nonce", "0", str_target };
+	ok = batch_gen(ctx, keys, &gen, stdout, &opts);
+	free(keys);
 
-	return nostr_add_tag_n(ev, ts, 3);
+	return ok ? 0 : 2;
 }
 
-static int mine_event(struct nostr_event *ev, int difficulty)
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+// patches
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+
+static void patches_usage(void)
 {
-	char *strnonce = malloc(33);
-	struct nostr_tag *tag;
-	uint64_t nonce;
-	int index, res;
+	fprintf(stderr, "usage: nostril patches --sec <hex> [--repo <owner pubkey>:<identifier>] [--euc <commit>] [--created-at <unix timestamp>] [--threads <number>] [--envelope] [--range <revisions> | file.mbox]\n");
+}
 
-	if (!ensure_nonce_tag(ev, difficulty, &index))
-		return 0;
+/* `git format-patch --stdout <range>` as a stream, without a shell */
+static FILE *format_patch(const char *range, pid_t *pid)
+{
+	int fds[2];
+	FILE *in;
+
+	if (pipe(fds))
+		return NULL;
 
-	tag = &ev->tags[index];
-	assert(tag->num_elems == 3);
-	assert(!strcmp(tag->strs[0], "nonce"));
-	tag->strs[1] = strnonce;
+	if ((*pid = fork()) < 0) {
+		close(fds[0]);
+		close(fds[1]);
+		return NULL;
+	}
 
-	for (nonce = 0;; nonce++) {
-		snprintf(strnonce, 32, "%" PRIu64, nonce);
+	if (*pid == 0) {
+		dup2(fds[1], STDOUT_FILENO);
+		close(fds[0]);
+		close(fds[1]);
+		execlp("git", "git", "format-patch", "--stdout", range, (char *)NULL);
+		fprintf(stderr, "could not run git: %s\n", strerror(errno));
+		_exit(127);
+	}
 
-		if (!generate_event_id(ev))
-			return 0;
+	close(fds[1]);
+	if (!(in = fdopen(fds[0], "r")))
+		close(fds[0]);
+	return in;
+}
 
-		if ((res = count_leading_zero_bits(ev->id)) >= difficulty) {
-			//fprintf(stderr, "mined %d bits\n", res);
-			fprintf(stderr, "");
-			return 1;
+static int patches_cmd(int argc, const char *argv[], secp256k1_context *ctx)
+{
+	struct batch_opts opts = {0};
+	struct patch_opts patch = {0};
+	const char *arg, *path = NULL, *range = NULL, *sec = NULL;
+	struct key key;
+	FILE *in = stdin;
+	pid_t pid = -1;
+	uint64_t n;
+	int ok, status;
+
+	argv++; argc--;
+	for (; argc; ) {
+		arg = *argv++; argc--;
+		if (!strcmp(arg, "--envelope")) {
+			opts.envelope = 1;
+		} else if (!strcmp(arg, "--sec") && argc) {
+			sec = *argv++; argc--;
+		} else if (!strcmp(arg, "--repo") && argc) {
+			patch.repo = *argv++; argc--;
+		} else if (!strcmp(arg, "--euc") && argc) {
+			patch.euc = *argv++; argc--;
+		} else if (!strcmp(arg, "--range") && argc) {
+			range = *argv++; argc--;
+		} else if (!strcmp(arg, "--threads") && argc) {
+			arg = *argv++; argc--;
+			if (!parse_threads(arg, &opts.threads)) {
+				fprintf(stderr, "could not parse threads as number: '%s'\n", arg);
+				return 10;
+			}
+		} else if (!strcmp(arg, "--created-at") && argc) {
+			arg = *argv++; argc--;
+			if (!parse_num(arg, &n)) {
+				fprintf(stderr, "could not parse created-at as number: '%s'\n", arg);
+				return 10;
+			}
+			opts.created_at = n;
+		} else if (arg[0] != '-' && !path) {
+			path = arg;
+		} else {
+			patches_usage();
+			return 10;
 		}
 	}
 
-	return 0;
+	if (!sec) {
+		fprintf(stderr, "patches: --sec <hex> is required\n");
+		return 10;
+	}
+
+	if (path && range) {
+		patches_usage();
+		return 10;
+	}
+
+	if (patch.repo && !patch_check_repo(patch.repo)) {
+		fprintf(stderr, "patches: --repo should be <hex owner pubkey>:<identifier>\n");
+		return 10;
+	}
+
+	if (!decode_key(ctx, sec, &key))
+		return 8;
+
+	if (path && !(in = fopen(path, "r"))) {
+		fprintf(stderr, "could not open '%s'\n", path);
+		return 3;
+	}
+
+	if (range && !(in = format_patch(range, &pid))) {
+		fprintf(stderr, "could not run git format-patch\n");
+		return 3;
+	}
+
+	ok = batch_patches(ctx, &key, in, stdout, &patch, &opts);
+
+	if (in != stdin)
+		fclose(in);
+
+	if (pid > 0 && (waitpid(pid, &status, 0) < 0 || !WIFEXITED(status) ||
+			WEXITSTATUS(status))) {
+		fprintf(stderr, "git format-patch failed\n");
+		ok = 0;
+	}
+
+	return ok ? 0 : 2;
 }
 
-static int make_encrypted_dm(secp256k1_context *ctx, struct key *key,
-		struct nostr_event *ev, unsigned char nostr_pubkey[32], int kind)
-{
-	size_t inl = strlen(ev->content);
-	int enclen = inl + 16;
-	size_t buflen = enclen * 3 + 65 * 10;
-	unsigned char *buf = malloc(buflen);
-	unsigned char shared_secret[32];
-	unsigned char iv[16];
-	unsigned char compressed_pubkey[33];
-	int content_len = strlen(ev->content);
-	unsigned char encbuf[content_len + (content_len % 16) + 1];
-	struct cursor cur;
-	secp256k1_pubkey pubkey;
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+// pow-worker
+/////////////////////////////////////////////////////////////////////////////////////////////////////
 
-	compressed_pubkey[0] = 2;
-	memcpy(&compressed_pubkey[1], nostr_pubkey, 32);
+static int pow_worker_cmd(int argc, const char *argv[])
+{
+	const char *arg, *path = NULL;
+	int fd, threads = 0;
 
-	make_cursor(buf, buf + buflen, &cur);
+	argv++; argc--;
+	for (; argc; ) {
+		arg = *argv++; argc--;
+		if (!strcmp(arg, "--connect") && argc) {
+			path = *argv++; argc--;
+		} else if (!strcmp(arg, "--threads") && argc) {
+			arg = *argv++; argc--;
+			if (!parse_threads(arg, &threads)) {
+				fprintf(stderr, "could not parse threads as number: '%s'\n", arg);
+				return 10;
+			}
+		} else {
+			path = NULL;
+			break;
+		}
+	}
 
-        if (!secp256k1_ec_seckey_verify(ctx, key->secret)) {
-		fprintf(stderr, "make_encrypted_dm: ec_seckey_verify failed\n");
-		return 0;
+	if (!path) {
+		fprintf(stderr, "usage: nostril pow-worker --connect <socket> [--threads <number>]\n");
+		return 10;
 	}
 
-	if (!secp256k1_ec_pubkey_parse(ctx, &pubkey, compressed_pubkey, sizeof(compressed_pubkey))) {
-		fprintf(stderr, "make_encrypted_dm: ec_pubkey_parse failed\n");
-		return 0;
+	if ((fd = pow_connect(path)) < 0)
+		return 3;
+
+	return pow_work(fd, threads) ? 0 : 2;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+// store
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#define STORE_DIR ".nostril-store"
+
+static void store_usage(void)
+{
+	fprintf(stderr, "usage: nostril store [--dir <path>] add [--no-verify] [file.jsonl] | get <id>... | query [filter] | dump | index | rebuild | stats\n");
+}
+
+static int print_rec(const struct store_rec *rec, uint64_t loc, void *data)
+{
+	(void)loc;
+	(void)data;
+	fwrite(store_rec_json(rec), 1, rec->len, stdout);
+	return putchar('\n') != EOF;
+}
+
+/* ids are checked by the store itself, signatures need the context */
+static int verify_stored_sig(const struct nostr_event *ev, void *data)
+{
+	secp256k1_xonly_pubkey pubkey;
+
+	return secp256k1_xonly_pubkey_parse(data, &pubkey, ev->pubkey) &&
+	       secp256k1_schnorrsig_verify(data, ev->sig, ev->id, 32, &pubkey);
+}
+
+static int store_get_ids(struct store *s, int argc, const char *argv[])
+{
+	unsigned char id[32];
+	const struct store_rec *rec;
+	int i, missing = 0;
+
+	for (i = 0; i < argc; i++) {
+		if (!hex_decode(argv[i], strlen(argv[i]), id, sizeof(id))) {
+			fprintf(stderr, "invalid id '%s'\n", argv[i]);
+			return 10;
+		}
+		if (!(rec = store_get(s, id))) {
+			fprintf(stderr, "%s: not found\n", argv[i]);
+			missing = 1;
+			continue;
+		}
+		print_rec(rec, 0, NULL);
 	}
 
-	if (!secp256k1_ecdh(ctx, shared_secret, &pubkey, key->secret, copyx, NULL)) {
-		fprintf(stderr, "make_encrypted_dm: secp256k1_ecdh failed\n");
+	return missing;
+}
+
+/* the events are answered the way a relay would for a REQ, a bare
+ * filter gets them as json lines */
+struct req_out {
+	char *subid;
+};
+
+static int print_req_rec(const struct store_rec *rec, uint64_t loc, void *data)
+{
+	struct req_out *out = data;
+
+	if (!out->subid)
+		return print_rec(rec, loc, NULL);
+
+	printf("[\"EVENT\",%s,", out->subid);
+	fwrite(store_rec_json(rec), 1, rec->len, stdout);
+	return fputs("]\n", stdout) != EOF;
+}
+
+static int store_query_one(struct query *q, char *req, struct arena *arena)
+{
+	struct nostr_filter *filters;
+	struct req_out out = { NULL };
+	struct cursor cur;
+	const char *subid;
+	size_t size;
+	int num, ok;
+
+	arena_reset(arena);
+	if (!parse_req(req, strlen(req), arena, &subid, &filters, &num)) {
+		fprintf(stderr, "could not parse filter: '%s'\n", req);
 		return 0;
 	}
 
-	if (!fill_random(iv, sizeof(iv))) {
-		fprintf(stderr, "make_encrypted_dm: fill_random failed\n");
-		return 0;
+	if (subid) {
+		size = 2 * strlen(subid) + 3;
+		if (!(out.subid = arena_alloc(arena, size)))
+			return 0;
+		make_cursor((unsigned char *)out.subid, (unsigned char *)out.subid + size, &cur);
+		if (!cursor_push_jsonstr(&cur, subid))
+			return 0;
+		*cur.p = 0;
 	}
 
-	//print_hex
-	//shared_secret
-	//fprintf(stderr, "shared_secret ");
-	//print_hex(shared_secret, 32);
+	ok = query_run_all(q, filters, num, print_req_rec, &out);
+	if (ok && out.subid)
+		printf("[\"EOSE\",%s]\n", out.subid);
 
-	memcpy(encbuf, ev->content, strlen(ev->content));
-	enclen = aes_encrypt(shared_secret, iv, encbuf, strlen(ev->content));
-	if (enclen == 0) {
-		fprintf(stderr, "make_encrypted_dm: aes_encrypt failed\n");
-		free(buf);
-		return 0;
+	return ok;
+}
+
+/* the filter in the argument, or one per line on stdin */
+static int store_query(struct store *s, int argc, const char *argv[])
+{
+	struct arena arena;
+	struct query *q;
+	size_t linecap = 0;
+	ssize_t len;
+	char *line = NULL;
+	int ret = 0;
+
+	if (!(q = query_open(s, 0)))
+		return 2;
+
+	arena_init(&arena);
+
+	if (argc) {
+		line = strdup(argv[0]);
+		ret = line && store_query_one(q, line, &arena) ? 0 : 1;
+	} else {
+		while ((len = getline(&line, &linecap, stdin)) != -1) {
+			while (len && (line[len-1] == '\n' || line[len-1] == '\r'))
+				line[--len] = 0;
+			if (len && !store_query_one(q, line, &arena))
+				ret = 1;
+		}
 	}
 
-	if ((enclen = base64_encode((char *)buf, buflen, (const char*)encbuf, enclen)) == -1) {
-		fprintf(stderr, "make_encrypted_dm: base64 encode of encrypted fata failed\n");
-		return 0;
+	free(line);
+	arena_free(&arena);
+	query_close(q);
+	return ret;
+}
+
+static int store_cmd(int argc, const char *argv[], secp256k1_context *ctx)
+{
+	const char *dir = STORE_DIR, *cmd, *path = NULL;
+	uint64_t added, dups, invalid;
+	struct store_stats stats;
+	struct timespec t0, t1;
+	struct query *q;
+	struct store *s;
+	FILE *in = stdin;
+	double secs;
+	int ret = 0, check_sigs = 1;
+
+	argv++; argc--;
+	if (argc >= 2 && !strcmp(argv[0], "--dir")) {
+		dir = argv[1];
+		argv += 2; argc -= 2;
 	}
-	cur.p += enclen;
 
-	if (!cursor_push_str(&cur, "?iv=")) {
-		fprintf(stderr, "make_encrypted_dm: buffer too small\n");
-		return 0;
+	if (!argc) {
+		store_usage();
+		return 10;
 	}
+	cmd = *argv++; argc--;
 
-	if ((enclen = base64_encode((char *)cur.p, cur.end - cur.p, (const char*)iv, 16)) == -1) {
-		fprintf(stderr, "make_encrypted_dm: base64 encode of iv failed\n");
-		return 0;
+	if (!strcmp(cmd, "add")) {
+		if (argc && !strcmp(argv[0], "--no-verify")) {
+			check_sigs = 0;
+			argv++; argc--;
+		}
+		if (argc > 1) {
+			store_usage();
+			return 10;
+		}
+		path = argc ? argv[0] : NULL;
+	} else if (!strcmp(cmd, "query")) {
+		if (argc > 1) {
+			store_usage();
+			return 10;
+		}
+	} else if (strcmp(cmd, "get") && argc) {
+		store_usage();
+		return 10;
+	} else if (strcmp(cmd, "get") && strcmp(cmd, "dump") && strcmp(cmd, "index") &&
+		   strcmp(cmd, "rebuild") && strcmp(cmd, "stats")) {
+		store_usage();
+		return 10;
 	}
-	cur.p += enclen;
 
-	if (!cursor_push_byte(&cur, 0)) {
-		fprintf(stderr, "make_encrypted_dm: out of memory by 1 byte!\n");
-		return 0;
+	if (path && !(in = fopen(path, "r"))) {
+		fprintf(stderr, "could not open '%s'\n", path);
+		return 3;
 	}
 
-	ev->content = (const char*)cur.start;
-	ev->kind = kind;
+	if (!(s = store_open(dir))) {
+		if (in != stdin)
+			fclose(in);
+		return 2;
+	}
 
-	if (!hex_encode(nostr_pubkey, 32, (char*)cur.p, cur.end - cur.p))
-		return 0;
+	if (!strcmp(cmd, "add")) {
+		if (check_sigs)
+			store_set_checks(s, 1, verify_stored_sig, ctx);
+		clock_gettime(CLOCK_MONOTONIC, &t0);
+		if (!store_add_file(s, in, &added, &dups, &invalid))
+			ret = 2;
+		clock_gettime(CLOCK_MONOTONIC, &t1);
+		secs = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9;
+		fprintf(stderr, "%" PRIu64 " added, %" PRIu64 " duplicates, %" PRIu64 " invalid in %.2fs (%.0f events/s)\n",
+			added, dups, invalid, secs,
+			secs > 0 ? (added + dups + invalid) / secs : 0.0);
+		if (!ret && invalid)
+			ret = 1;
+	} else if (!strcmp(cmd, "get")) {
+		ret = store_get_ids(s, argc, argv);
+	} else if (!strcmp(cmd, "dump")) {
+		ret = store_foreach(s, print_rec, NULL) ? 0 : 2;
+	} else if (!strcmp(cmd, "rebuild")) {
+		ret = store_rebuild(s) ? 0 : 2;
+	} else if (!strcmp(cmd, "query")) {
+		ret = store_query(s, argc, argv);
+	} else if (!strcmp(cmd, "index")) {
+		clock_gettime(CLOCK_MONOTONIC, &t0);
+		query_close(q = query_open(s, 1));
+		clock_gettime(CLOCK_MONOTONIC, &t1);
+		if (!q)
+			ret = 2;
+		else
+			fprintf(stderr, "query index built in %.2fs\n",
+				(t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9);
+	}
 
-	if (!nostr_add_tag(ev, "p", (const char*)cur.p)) {
-		fprintf(stderr, "too many tags\n");
-		return 0;
+	if (!strcmp(cmd, "stats") || !strcmp(cmd, "rebuild")) {
+		store_stats(s, &stats);
+		printf("events %" PRIu64 "\nbytes %" PRIu64 "\nsegments %d\nindex_slots %" PRIu64 "\n",
+		       stats.events, stats.bytes, stats.segments, stats.index_slots);
 	}
 
-	cur.p += 65;
+	if (in != stdin)
+		fclose(in);
+	if (!store_close(s))
+		ret = 2;
 
-	return 1;
+	return ret;
 }
 
 /////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -875,9 +1084,11 @@ int main(int argc, const char *argv[])
     //return EXIT_SUCCESS;
 
 	struct args args = {0};
-	struct nostr_event ev = {0};
+	struct nostr_event ev;
+	struct arena arena;
 	struct key key;
 	secp256k1_context *ctx;
+	int serving = 0;
 
 	if (argc < 2)
 		usage(exe_name);
@@ -885,7 +1096,35 @@ int main(int argc, const char *argv[])
         if (!init_secp_context(&ctx))
 		return 2;
 
-	try_subcommand(argc, argv);
+	if (!strcmp(argv[1], "verify"))
+		return verify(argc - 1, argv + 1, ctx);
+
+	if (!strcmp(argv[1], "decrypt"))
+		return decrypt(argc - 1, argv + 1, ctx);
+
+	if (!strcmp(argv[1], "store"))
+		return store_cmd(argc - 1, argv + 1, ctx);
+
+	if (!strcmp(argv[1], "gen"))
+		return gen_cmd(argc - 1, argv + 1, ctx);
+
+	if (!strcmp(argv[1], "patches"))
+		return patches_cmd(argc - 1, argv + 1, ctx);
+
+	if (!strcmp(argv[1], "pow-worker"))
+		return pow_worker_cmd(argc - 1, argv + 1);
+
+	/* serve takes the usual key options, so parse the rest as normal */
+	if (!strcmp(argv[1], "serve")) {
+		serving = 1;
+		argv++; argc--;
+	}
+
+	if (!serving)
+		try_subcommand(argc, argv);
+
+	arena_init(&arena);
+	event_init(&ev, &arena);
 
 	if (!parse_args(argc, argv, &args, &ev)) {
 		usage(exe_name);
@@ -898,28 +1137,110 @@ int main(int argc, const char *argv[])
 
 	make_event_from_args(&ev, &args);
 
+	if (args.pow_resume && !args.pow_checkpoint) {
+		fprintf(stderr, "--resume needs the --checkpoint <file> to resume from\n");
+		return 10;
+	}
+
+	/* the checkpoint is only good for the same event, created_at and all */
+	if (args.pow_resume && !(args.flags & HAS_CREATED_AT))
+		pow_checkpoint_created_at(args.pow_checkpoint, &ev.created_at);
+
+	if ((args.flags & HAS_MINE_PUBKEY) && !(args.flags & HAS_DIFFICULTY) && !args.num_vanity) {
+		fprintf(stderr, "--mine-pubkey needs --pow <difficulty> or --vanity <pattern>\n");
+		return 10;
+	}
+
+	/* a throwaway key would sign for clients nobody can follow */
+	if (serving && !args.sec) {
+		fprintf(stderr, "serve: --sec <hex> is required\n");
+		return 10;
+	}
+
+	if (args.sec && args.num_vanity) {
+		fprintf(stderr, "--vanity mines a new key, it can't be combined with --sec\n");
+		return 10;
+	}
+
 	if (args.sec) {
 		if (!decode_key(ctx, args.sec, &key)) {
 			return 8;
 		}
-	} else {
-		int *difficulty = NULL;
-		if ((args.flags & HAS_DIFFICULTY) && (args.flags & HAS_MINE_PUBKEY)) {
-			difficulty = &args.difficulty;
+	} else if (args.num_vanity || (args.flags & HAS_MINE_PUBKEY)) {
+		struct key_pattern patterns[VANITY_MAX_PATTERNS + 1];
+		char npub[128], secret[65];
+		int i, n = 0;
+
+		for (i = 0; i < args.num_vanity; i++) {
+			if (!key_pattern_compile(&patterns[n++], args.vanity[i]))
+				return 10;
 		}
+		if ((args.flags & HAS_DIFFICULTY) && (args.flags & HAS_MINE_PUBKEY))
+			key_pattern_zero_bits(&patterns[n++], args.difficulty);
 
-		if (!generate_key(ctx, &key, difficulty)) {
+		if (!generate_vanity_key(ctx, &key, patterns, n, args.threads)) {
 			fprintf(stderr, "could not generate key\n");
 			return 4;
 		}
-		if ((args.flags & HAS_DIFFICULTY) && (args.flags & HAS_MINE_PUBKEY)) {
-		fprintf(stderr, "{\"secret_key\":\"");
-		print_hex(key.secret, sizeof(key.secret));
-		fprintf(stderr, "\"},");
+		hex_encode(key.secret, 32, secret, sizeof(secret));
+		bech32_encode(npub, sizeof(npub), "npub", key.pubkey, 32);
+		fprintf(stderr, "{\"secret_key\":\"%s\",\"npub\":\"%s\"},\n", secret, npub);
+	} else {
+		if (!generate_key(ctx, &key, NULL, args.threads)) {
+			fprintf(stderr, "could not generate key\n");
+			return 4;
 		}
 		fprintf(stderr, "\n");
 	}
 
+	if (serving) {
+		struct batch_opts opts = {
+			.envelope = args.flags & HAS_ENVELOPE,
+			.created_at = args.flags & HAS_CREATED_AT ? args.created_at : 0,
+			.kind = ev.kind,
+			.error_lines = 1,
+		};
+		if (!args.socket) {
+			fprintf(stderr, "serve: --socket <path> is required\n");
+			return 10;
+		}
+		return serve(ctx, &key, args.socket, &opts) ? 0 : 3;
+	}
+
+	if (args.flags & HAS_STDIN_JSONL) {
+		struct batch_opts opts = {
+			.threads = args.threads,
+			.envelope = args.flags & HAS_ENVELOPE,
+			.created_at = ev.created_at,
+			.kind = ev.kind,
+		};
+		return batch_sign(ctx, &key, stdin, stdout, &opts) ? 0 : 9;
+	}
+
+	if (args.flags & HAS_DM_LIST) {
+		struct batch_opts opts = {
+			.threads = args.threads,
+			.envelope = args.flags & HAS_ENVELOPE,
+			.kind = args.flags & HAS_KIND ? args.kind : 4,
+		};
+		FILE *recipients;
+		int ok;
+
+		if (args.flags & (HAS_ENCRYPT|HAS_DIFFICULTY)) {
+			fprintf(stderr, "--dm-list can't be combined with --dm or --pow\n");
+			return 10;
+		}
+
+		if (!(recipients = fopen(args.dm_list, "r"))) {
+			fprintf(stderr, "could not open '%s'\n", args.dm_list);
+			return 3;
+		}
+
+		ok = batch_dm(ctx, &key, &ev, recipients, stdout, &opts);
+		fclose(recipients);
+		return ok ? 0 : 9;
+	}
+
 	if (args.flags & HAS_ENCRYPT) {
 		int kind = args.flags & HAS_KIND? args.kind : 4;
 		if (!make_encrypted_dm(ctx, &key, &ev, args.encrypt_to, kind)) {
@@ -932,7 +1253,18 @@ int main(int argc, const char *argv[])
 	memcpy(ev.pubkey, key.pubkey, 32);
 
 	if (args.flags & HAS_DIFFICULTY && !(args.flags & HAS_MINE_PUBKEY)) {
-		if (!mine_event(&ev, args.difficulty)) {
+		struct pow_opts opts;
+
+		pow_defaults(&opts);
+		opts.workers = args.pow_workers;
+		opts.threads = args.threads;
+		opts.listen = args.pow_listen;
+		opts.checkpoint = args.pow_checkpoint;
+		opts.resume = args.pow_resume;
+		if (args.pow_lease)
+			opts.lease = args.pow_lease;
+
+		if (!pow_mine_event(&ev, args.difficulty, &opts)) {
 			fprintf(stderr, "error when mining id\n");
 			return 22;
 		}
@@ -953,5 +1285,6 @@ int main(int argc, const char *argv[])
 		return 88;
 	}
 
+	arena_free(&arena);
 	return 0;
 }
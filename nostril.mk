@@ -1,7 +1,7 @@
 
-CFLAGS = -Wall -O2 -Iext/secp256k1/include
-OBJS = sha256.o nostril.o aes.o base64.o
-HEADERS = hex.h random.h config.h sha256.h ext/secp256k1/include/secp256k1.h
+CFLAGS = -Wall -O2 -pthread -Iext/secp256k1/include
+OBJS = sha256.o codec.o nostril.o aes.o base64.o arena.o event.o mine.o key.o dm.o json.o workq.o cache.o batch.o serve.o store.o query.o gen.o patch.o pow.o bech32.o vanity.o
+HEADERS = hex.h codec.h random.h config.h sha256.h arena.h event.h mine.h key.h dm.h json.h workq.h cache.h batch.h serve.h store.h query.h gen.h patch.h pow.h bech32.h vanity.h struct_nostr_filter.h ext/secp256k1/include/secp256k1.h
 PREFIX ?= /usr/local
 ARS = libsecp256k1.a
 
@@ -59,6 +59,50 @@ nostril: libsecp256k1.a $(HEADERS) $(OBJS)## 	nostril
 	@$(CC) $(CFLAGS) $(OBJS) $(ARS) -o $@ || $(MAKE) $(ARS)
 	cp nostril gnostr
 
+bench_sha256: bench_sha256.o sha256.o## 	sha256 kernel microbenchmark
+	@$(CC) $(CFLAGS) $^ -o $@
+
+sha256-bench: bench_sha256## 	run the sha256 kernel microbenchmark
+	./bench_sha256
+
+bench_json: bench_json.o json.o event.o arena.o sha256.o codec.o## 	json event parser benchmark
+	@$(CC) $(CFLAGS) $^ -o $@
+
+json-bench: bench_json## 	run the json parser benchmark, CORPUS=file.jsonl to use a real dump
+	./bench_json $(CORPUS)
+
+bench_codec: bench_codec.o codec.o base64.o## 	hex, base64 and json escaping kernel microbenchmark
+	@$(CC) $(CFLAGS) $^ -o $@
+
+codec-bench: bench_codec## 	run the codec kernel microbenchmark
+	./bench_codec
+
+codec-fuzz: bench_codec## 	check every codec kernel against the scalar code
+	./bench_codec --fuzz
+
+bench_query: bench_query.o store.o query.o json.o event.o arena.o sha256.o codec.o## 	store query benchmark over a synthetic corpus
+	@$(CC) $(CFLAGS) $^ -o $@
+
+query-bench: bench_query## 	run the query benchmark on 10M events, QUERY_ARGS="--events N" for fewer
+	./bench_query $(QUERY_ARGS)
+
+query-check: bench_query## 	check indexed queries against full scans on a small corpus
+	./bench_query --events 200000 --dir bench-query-check --queries 200 --check 20
+
+BENCH_OBJS = sha256.o codec.o aes.o base64.o arena.o event.o mine.o key.o dm.o bech32.o vanity.o
+bench_nostril: libsecp256k1.a $(HEADERS) $(BENCH_OBJS) bench_nostril.o## 	nostril hot path benchmark
+	@$(CC) $(CFLAGS) $(BENCH_OBJS) bench_nostril.o $(ARS) -o $@
+
+nostril-bench: bench_nostril## 	run the hot path benchmark as json lines, BENCH_ARGS="--content 0,1024 --tags 0,16"
+	./bench_nostril $(BENCH_ARGS)
+
+TEST_OBJS = $(filter-out nostril.o,$(OBJS))
+test_nostril: libsecp256k1.a $(HEADERS) $(TEST_OBJS) test_nostril.o## 	unit tests
+	@$(CC) $(CFLAGS) $(TEST_OBJS) test_nostril.o $(ARS) -o $@
+
+nostril-check: test_nostril## 	run the unit tests
+	./test_nostril
+
 nostril-install: all## 	install
 	@mkdir -p $(PREFIX)/bin || true
 	@install -m644 doc/nostril.1 $(PREFIX)/share/man/man1/nostril.1 || true
@@ -80,7 +124,8 @@ nostril-clean:## 	clean
 	rm -f nostril *.o *.a
 	rm -f *-tig
 	rm -rf ext/secp256k1/.lib
-	rm -f configurator
+	rm -f configurator bench_sha256 bench_json bench_nostril bench_codec bench_query test_nostril
+	rm -rf bench-query-store bench-query-check
 	rm -rf configurator.out.dSYM
 
 tags: fake
@@ -95,4 +140,4 @@ nostril-test: nostril
 	type -P gnostr-sha256 "" && gnostr-sha256 ""
 	type -P gnostr-sha256 && gnostr-sha256 ' '
 	type -P gnostr-sha256 " " && gnostr-sha256 " "
-.PHONY:docs doc/nostril.1 fake nostril version
+.PHONY:docs doc/nostril.1 fake nostril version sha256-bench json-bench nostril-bench codec-bench codec-fuzz query-bench query-check nostril-check
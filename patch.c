@@ -0,0 +1,197 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "hex.h"
+#include "event.h"
+#include "patch.h"
+
+/* "From " + commit + the fixed date format-patch uses */
+#define FROM_DATE " Mon Sep 17 00:00:00 2001"
+#define FROM_LEN (5 + 40 + sizeof(FROM_DATE) - 1)
+
+static int is_hex(const char *s, size_t len)
+{
+	size_t i;
+
+	for (i = 0; i < len; i++) {
+		if (!((s[i] >= '0' && s[i] <= '9') || (s[i] >= 'a' && s[i] <= 'f')))
+			return 0;
+	}
+	return 1;
+}
+
+static int is_from_line(const char *line, ssize_t len)
+{
+	while (len && (line[len-1] == '\n' || line[len-1] == '\r'))
+		len--;
+
+	return len == (ssize_t)FROM_LEN && !memcmp(line, "From ", 5) &&
+	       is_hex(line + 5, 40) && !memcmp(line + 45, FROM_DATE, sizeof(FROM_DATE) - 1);
+}
+
+void patch_reader_init(struct patch_reader *r, FILE *in)
+{
+	memset(r, 0, sizeof(*r));
+	r->in = in;
+	r->pending = -1;
+}
+
+void patch_reader_free(struct patch_reader *r)
+{
+	free(r->line);
+	free(r->buf);
+}
+
+static int append(struct patch_reader *r, const char *p, size_t len)
+{
+	size_t cap;
+	char *buf;
+
+	if (r->cap - r->len < len + 1) {
+		for (cap = r->cap ? r->cap : 1 << 16; cap - r->len < len + 1; cap *= 2)
+			;
+		if (!(buf = realloc(r->buf, cap)))
+			return 0;
+		r->buf = buf;
+		r->cap = cap;
+	}
+
+	memcpy(r->buf + r->len, p, len);
+	r->len += len;
+	return 1;
+}
+
+const char *patch_next(struct patch_reader *r, struct arena *a, size_t *len)
+{
+	ssize_t n;
+	char *patch;
+
+	r->len = 0;
+
+	while (r->pending < 0) {
+		if ((n = getline(&r->line, &r->linecap, r->in)) == -1) {
+			r->error = ferror(r->in);
+			return NULL;
+		}
+		if (is_from_line(r->line, n))
+			r->pending = n;
+	}
+
+	if (!append(r, r->line, r->pending))
+		goto fail;
+	r->pending = -1;
+
+	while ((n = getline(&r->line, &r->linecap, r->in)) != -1) {
+		if (is_from_line(r->line, n)) {
+			r->pending = n;
+			break;
+		}
+		if (!append(r, r->line, n))
+			goto fail;
+	}
+
+	if (n == -1 && ferror(r->in))
+		goto fail;
+
+	if (!(patch = arena_alloc(a, r->len + 1)))
+		goto fail;
+	memcpy(patch, r->buf, r->len);
+	patch[r->len] = 0;
+	*len = r->len;
+	return patch;
+
+fail:
+	r->error = 1;
+	return NULL;
+}
+
+int patch_check_repo(const char *repo)
+{
+	if (!strncmp(repo, "30617:", 6))
+		repo += 6;
+
+	return strlen(repo) > 65 && is_hex(repo, 64) && repo[64] == ':';
+}
+
+/* a cover letter is patch 0 of the series, [PATCH 0/3], [PATCH v2 00/12] */
+static int is_cover_letter(const char *patch)
+{
+	const char *subject, *end, *p;
+
+	end = strstr(patch, "\n\n");
+	subject = strstr(patch, "\nSubject: [");
+	if (!subject || (end && subject > end))
+		return 0;
+
+	subject += 11;
+	if (!(end = strchr(subject, ']')))
+		return 0;
+
+	for (p = subject; p < end; p++) {
+		if (*p != '0' || (p > subject && p[-1] != ' '))
+			continue;
+		while (*p == '0')
+			p++;
+		if (*p == '/')
+			return 1;
+	}
+
+	return 0;
+}
+
+int patch_event(const struct patch_opts *opts, const char *patch,
+		const unsigned char *prev, struct nostr_event *ev)
+{
+	const char *reply[4] = { "e", NULL, "", "reply" };
+	const char *repo;
+	char *a, *owner = NULL, *hex, *commit;
+	size_t len;
+
+	ev->kind = PATCH_KIND;
+	ev->content = patch;
+
+	if (opts->repo) {
+		repo = opts->repo + (strncmp(opts->repo, "30617:", 6) ? 0 : 6);
+		len = strlen(repo);
+		if (!(a = arena_alloc(ev->arena, len + 7)) ||
+		    !(owner = arena_alloc(ev->arena, 65)))
+			return 0;
+		memcpy(a, "30617:", 6);
+		memcpy(a + 6, repo, len + 1);
+		memcpy(owner, repo, 64);
+		owner[64] = 0;
+		if (!nostr_add_tag(ev, "a", a))
+			return 0;
+	}
+
+	if (opts->euc && !nostr_add_tag(ev, "r", opts->euc))
+		return 0;
+
+	if (opts->repo && !nostr_add_tag(ev, "p", owner))
+		return 0;
+
+	if (!prev) {
+		if (!nostr_add_tag(ev, "t", "root"))
+			return 0;
+	} else {
+		if (!(hex = arena_alloc(ev->arena, 65)))
+			return 0;
+		hex_encode(prev, 32, hex, 65);
+		reply[1] = hex;
+		if (!nostr_add_tag_n(ev, reply, 4))
+			return 0;
+	}
+
+	/* the cover letter's From line has the last commit of the series */
+	if (!is_cover_letter(patch)) {
+		if (!(commit = arena_alloc(ev->arena, 41)))
+			return 0;
+		memcpy(commit, patch + 5, 40);
+		commit[40] = 0;
+		if (!nostr_add_tag(ev, "commit", commit) || !nostr_add_tag(ev, "r", commit))
+			return 0;
+	}
+
+	return 1;
+}
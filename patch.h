@@ -0,0 +1,59 @@
+#ifndef PATCH_H
+#define PATCH_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#include "arena.h"
+#include "struct_nostr_event.h"
+
+/* NIP-34 patch events from the mbox `git format-patch --stdout` writes.
+ *
+ * Every "From <commit> Mon Sep 17 00:00:00 2001" line starts a patch, and
+ * the patch, that line and all up to the next one, is the content of a
+ * kind 1617 event. The first patch is tagged as the root of the series
+ * and every later one is a NIP-10 reply to the one before, so patch
+ * events have to be made in order. */
+
+#define PATCH_KIND 1617
+
+struct patch_opts {
+	/* the repository announcement, "<owner pubkey>:<identifier>", for the
+	 * a and p tags, may be NULL */
+	const char *repo;
+	/* the earliest unique commit of the repository, for the r tag, may be
+	 * NULL */
+	const char *euc;
+};
+
+struct patch_reader {
+	FILE *in;
+	char *line;
+	size_t linecap;
+	/* the From line that ended the last patch and starts the next */
+	ssize_t pending;
+
+	char *buf;
+	size_t len, cap;
+	int error;
+};
+
+void patch_reader_init(struct patch_reader *r, FILE *in);
+void patch_reader_free(struct patch_reader *r);
+
+/* The next patch as a string allocated from a, NULL at the end of the
+ * input or on error, which sets r->error. Anything before the first From
+ * line is skipped. */
+const char *patch_next(struct patch_reader *r, struct arena *a, size_t *len);
+
+/* "<hex pubkey>:<identifier>", or the same after "30617:" */
+int patch_check_repo(const char *repo);
+
+/* Fill in the content and tags of the event for patch, replying to prev,
+ * the id of the patch before it, unless it is the first. Tags come from
+ * ev->arena. */
+int patch_event(const struct patch_opts *opts, const char *patch,
+		const unsigned char *prev, struct nostr_event *ev);
+
+#endif
@@ -0,0 +1,983 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <inttypes.h>
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <limits.h>
+
+#include "hex.h"
+#include "sha256.h"
+#include "batch.h"
+#include "serve.h"
+#include "pow.h"
+
+/* a job line carries the whole commitment, content and all */
+#define POW_LINE_MAX (64 << 20)
+
+/* workers checkpoint this often */
+#define POW_CHECKPOINT_MS 1000
+
+/* the rate is reported and the checkpoint file saved this often */
+#define POW_REPORT_MS 5000
+#define POW_SAVE_MS 10000
+
+#define POW_CHECKPOINT_MAGIC "nostril-pow 1"
+
+struct conn {
+	int fd;
+	/* unread input is buf[off, len) */
+	char *buf;
+	size_t off, len, cap;
+};
+
+struct lease {
+	uint64_t start, end;
+};
+
+struct pow_worker {
+	struct conn conn;
+	/* for the workers we forked, 0 for the ones that connected */
+	pid_t pid;
+	int num;
+
+	int leased;
+	uint64_t start, frontier, end;
+	int64_t seen;
+};
+
+struct coord {
+	const struct mine_job *job;
+	struct pow_opts *opts;
+
+	char *job_line;
+	size_t job_len;
+
+	/* nonces from here up were never leased */
+	uint64_t next;
+
+	/* what is left of the leases taken back from lost workers */
+	struct lease *returned;
+	int nreturned, cap_returned;
+	uint64_t releases;
+
+	struct pow_worker **workers;
+	int nworkers, cap_workers, seq;
+
+	/* the range this process is mining when there are no workers */
+	int here;
+	uint64_t here_frontier, here_end;
+
+	char job_hash[65];
+	uint64_t tried, resumed;
+	int best;
+	int64_t t1, saved, reported;
+	uint64_t reported_tried;
+
+	int found;
+	uint64_t nonce;
+	unsigned char id[32];
+};
+
+static volatile sig_atomic_t interrupted;
+
+static void on_interrupt(int sig)
+{
+	(void)sig;
+	interrupted = 1;
+}
+
+void pow_defaults(struct pow_opts *opts)
+{
+	memset(opts, 0, sizeof(*opts));
+	opts->lease = POW_LEASE;
+	opts->timeout = POW_TIMEOUT;
+}
+
+static int64_t now_ms(void)
+{
+	struct timespec t;
+
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return t.tv_sec * 1000LL + t.tv_nsec / 1000000;
+}
+
+/* the next whole line in the buffer with its newline cut off, or NULL. It
+ * is only valid until the next conn_read() */
+static char *conn_line(struct conn *c)
+{
+	char *nl, *line;
+
+	if (!c->buf || !(nl = memchr(c->buf + c->off, '\n', c->len - c->off)))
+		return NULL;
+
+	*nl = 0;
+	line = c->buf + c->off;
+	c->off = nl - c->buf + 1;
+	return line;
+}
+
+/* read what is there once, returns 0 on EOF or error */
+static int conn_read(struct conn *c)
+{
+	size_t cap;
+	ssize_t n;
+	char *buf;
+
+	if (c->off) {
+		memmove(c->buf, c->buf + c->off, c->len - c->off);
+		c->len -= c->off;
+		c->off = 0;
+	}
+
+	if (c->cap - c->len < 4096) {
+		cap = c->cap ? c->cap * 2 : 1 << 16;
+		if (cap > POW_LINE_MAX || !(buf = realloc(c->buf, cap)))
+			return 0;
+		c->buf = buf;
+		c->cap = cap;
+	}
+
+	do {
+		n = read(c->fd, c->buf + c->len, c->cap - c->len);
+	} while (n < 0 && errno == EINTR);
+
+	if (n <= 0)
+		return 0;
+
+	c->len += n;
+	return 1;
+}
+
+/* block until a whole line is in, NULL on EOF or error */
+static char *conn_wait_line(struct conn *c)
+{
+	char *line;
+
+	while (!(line = conn_line(c))) {
+		if (!conn_read(c))
+			return NULL;
+	}
+
+	return line;
+}
+
+static int send_line(int fd, const char *fmt, ...)
+{
+	struct iovec iov;
+	char buf[128];
+	va_list ap;
+	int n;
+
+	va_start(ap, fmt);
+	n = vsnprintf(buf, sizeof(buf), fmt, ap);
+	va_end(ap);
+
+	iov.iov_base = buf;
+	iov.iov_len = n;
+	return write_iov(fd, &iov, 1);
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// coordinator
+/////////////////////////////////////////////////////////////////////////////
+
+static int make_job_line(struct coord *c)
+{
+	const struct mine_job *job = c->job;
+	size_t size = 64 + job->len * 2;
+	int n;
+
+	if (!(c->job_line = malloc(size)))
+		return 0;
+
+	n = snprintf(c->job_line, size, "job %d %d ", job->difficulty,
+		     (int)(job->tail - job->commitment) + job->nonce_off);
+	hex_encode(job->commitment, job->len, c->job_line + n, size - n);
+	n += job->len * 2;
+	c->job_line[n++] = '\n';
+	c->job_len = n;
+	return 1;
+}
+
+static int give_back(struct coord *c, uint64_t start, uint64_t end)
+{
+	struct lease *l;
+	int cap;
+
+	if (start >= end)
+		return 1;
+
+	if (c->nreturned == c->cap_returned) {
+		cap = c->cap_returned ? c->cap_returned * 2 : 16;
+		if (!(l = realloc(c->returned, cap * sizeof(*l))))
+			return 0;
+		c->returned = l;
+		c->cap_returned = cap;
+	}
+
+	c->returned[c->nreturned].start = start;
+	c->returned[c->nreturned++].end = end;
+	return 1;
+}
+
+static int give_lease(struct coord *c, struct pow_worker *w)
+{
+	uint64_t left = UINT64_MAX - c->next;
+
+	if (c->nreturned) {
+		c->nreturned--;
+		w->start = c->returned[c->nreturned].start;
+		w->end = c->returned[c->nreturned].end;
+		c->releases++;
+	} else if (left) {
+		w->start = c->next;
+		w->end = c->next + (left < c->opts->lease ? left : c->opts->lease);
+		c->next = w->end;
+	} else {
+		/* every nonce was leased, nothing left to try */
+		w->leased = 0;
+		return 1;
+	}
+
+	w->leased = 1;
+	w->frontier = w->start;
+	w->seen = now_ms();
+
+	return send_line(w->conn.fd, "lease %" PRIu64 " %" PRIu64 "\n", w->start, w->end);
+}
+
+static void drop_worker(struct coord *c, int i, const char *why)
+{
+	struct pow_worker *w = c->workers[i];
+
+	if (why) {
+		fprintf(stderr, "pow: worker %d %s", w->num, why);
+		if (w->leased && w->frontier < w->end)
+			fprintf(stderr, ", leasing %" PRIu64 "..%" PRIu64 " again",
+				w->frontier, w->end);
+		fprintf(stderr, "\n");
+	}
+
+	if (w->leased && !give_back(c, w->frontier, w->end))
+		fprintf(stderr, "pow: out of memory, nonces %" PRIu64 "..%" PRIu64 " are lost\n",
+			w->frontier, w->end);
+
+	if (w->pid > 0) {
+		kill(w->pid, SIGKILL);
+		waitpid(w->pid, NULL, 0);
+	}
+
+	close(w->conn.fd);
+	free(w->conn.buf);
+	free(w);
+	c->workers[i] = c->workers[--c->nworkers];
+}
+
+static int add_worker(struct coord *c, int fd, pid_t pid)
+{
+	struct pow_worker *w, **ws;
+	struct iovec iov;
+	int cap;
+
+	if (c->nworkers == c->cap_workers) {
+		cap = c->cap_workers ? c->cap_workers * 2 : 16;
+		if (!(ws = realloc(c->workers, cap * sizeof(*ws))))
+			goto fail;
+		c->workers = ws;
+		c->cap_workers = cap;
+	}
+
+	if (!(w = calloc(1, sizeof(*w))))
+		goto fail;
+
+	w->conn.fd = fd;
+	w->pid = pid;
+	w->num = ++c->seq;
+	c->workers[c->nworkers++] = w;
+
+	iov.iov_base = c->job_line;
+	iov.iov_len = c->job_len;
+	if (!write_iov(fd, &iov, 1) || !give_lease(c, w)) {
+		drop_worker(c, c->nworkers - 1, "could not be sent the job");
+		return 0;
+	}
+
+	return 1;
+
+fail:
+	fprintf(stderr, "pow: out of memory\n");
+	if (pid > 0) {
+		kill(pid, SIGKILL);
+		waitpid(pid, NULL, 0);
+	}
+	close(fd);
+	return 0;
+}
+
+static int fork_worker(struct coord *c, int listen_fd)
+{
+	int fds[2], i;
+	pid_t pid;
+
+	if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds)) {
+		fprintf(stderr, "pow: socketpair: %s\n", strerror(errno));
+		return 0;
+	}
+
+	if ((pid = fork()) < 0) {
+		fprintf(stderr, "pow: fork: %s\n", strerror(errno));
+		close(fds[0]);
+		close(fds[1]);
+		return 0;
+	}
+
+	if (pid == 0) {
+		/* keep only our end, or the coordinator won't see other
+		 * workers go away */
+		close(fds[0]);
+		if (listen_fd >= 0)
+			close(listen_fd);
+		for (i = 0; i < c->nworkers; i++)
+			close(c->workers[i]->conn.fd);
+		_exit(pow_work(fds[1], c->opts->threads) ? 0 : 1);
+	}
+
+	close(fds[1]);
+	return add_worker(c, fds[0], pid);
+}
+
+/* handle every line the worker sent, returns 0 if it has to go */
+static int worker_lines(struct coord *c, struct pow_worker *w, const char **why)
+{
+	unsigned char id[32];
+	uint64_t n;
+	char *line, *end;
+	long best;
+
+	while ((line = conn_line(&w->conn))) {
+		if (!strncmp(line, "progress ", 9)) {
+			n = strtoull(line + 9, &end, 10);
+			best = *end == ' ' ? strtol(end + 1, &end, 10) : 0;
+			if (*end || !w->leased || n < w->frontier || n > w->end) {
+				*why = "sent a bad checkpoint";
+				return 0;
+			}
+			if (best > c->best && best <= 256)
+				c->best = best;
+			c->tried += n - w->frontier;
+			w->frontier = n;
+			w->seen = now_ms();
+			if (n == w->end && !give_lease(c, w)) {
+				*why = "could not be sent a lease";
+				return 0;
+			}
+		} else if (!strncmp(line, "found ", 6)) {
+			n = strtoull(line + 6, &end, 10);
+			/* don't take its word for it */
+			if (*end || !mine_check(c->job, n, id)) {
+				*why = "sent a nonce that doesn't work";
+				return 0;
+			}
+			c->found = 1;
+			c->nonce = n;
+			memcpy(c->id, id, 32);
+			return 1;
+		} else {
+			*why = "sent something we don't understand";
+			return 0;
+		}
+	}
+
+	return 1;
+}
+
+static void check_leases(struct coord *c)
+{
+	struct pow_worker *w;
+	int64_t now = now_ms();
+	int i;
+
+	for (i = c->nworkers - 1; i >= 0; i--) {
+		w = c->workers[i];
+		if (w->leased && now - w->seen > c->opts->timeout * 1000LL)
+			drop_worker(c, i, "stopped checkpointing");
+	}
+}
+
+/* The rate over the last interval, and the time left until the number of
+ * attempts we expect to need for the difficulty, 2^difficulty. Every
+ * attempt is a fresh chance, so this is only an estimate: the search can
+ * end long before it or run past it. */
+static void report(struct coord *c, int64_t now)
+{
+	double rate, expected = 1, left;
+	char eta[32];
+	int i;
+
+	for (i = 0; i < c->job->difficulty; i++)
+		expected *= 2;
+
+	rate = now > c->reported ? (c->tried - c->reported_tried) * 1000.0 / (now - c->reported) : 0;
+	left = expected - c->tried;
+
+	if (left <= 0)
+		snprintf(eta, sizeof(eta), "overdue");
+	else if (rate <= 0)
+		snprintf(eta, sizeof(eta), "unknown");
+	else
+		format_duration(eta, sizeof(eta), left / rate);
+
+	fprintf(stderr, "pow: %.2f MH/s, %.3g of %.3g expected attempts, best %d of %d bits, eta %s\n",
+		rate / 1e6, (double)c->tried, expected, c->best, c->job->difficulty, eta);
+
+	c->reported = now;
+	c->reported_tried = c->tried;
+}
+
+static int write_range(FILE *f, uint64_t start, uint64_t end)
+{
+	return start >= end || fprintf(f, "range %" PRIu64 " %" PRIu64 "\n", start, end) > 0;
+}
+
+/* Everything not tried yet: the nonces from next up, what is left of
+ * every lease and the ranges waiting to be leased again. The file is
+ * replaced in one rename, so a crash leaves the last whole checkpoint. */
+static int save_checkpoint(struct coord *c)
+{
+	const char *path = c->opts->checkpoint;
+	struct pow_worker *w;
+	char tmp[PATH_MAX];
+	FILE *f;
+	int i, ok;
+
+	snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+	if (!(f = fopen(tmp, "w"))) {
+		fprintf(stderr, "pow: could not save checkpoint '%s': %s\n", tmp, strerror(errno));
+		return 0;
+	}
+
+	fprintf(f, POW_CHECKPOINT_MAGIC "\n");
+	fprintf(f, "job %s\n", c->job_hash);
+	fprintf(f, "created_at %" PRIu64 "\n", c->job->ev ? c->job->ev->created_at : 0);
+	fprintf(f, "difficulty %d\n", c->job->difficulty);
+	fprintf(f, "tried %" PRIu64 "\n", c->tried);
+	fprintf(f, "best %d\n", c->best);
+	fprintf(f, "next %" PRIu64 "\n", c->next);
+
+	ok = 1;
+	for (i = 0; i < c->nreturned; i++)
+		ok &= write_range(f, c->returned[i].start, c->returned[i].end);
+	for (i = 0; i < c->nworkers; i++) {
+		w = c->workers[i];
+		if (w->leased)
+			ok &= write_range(f, w->frontier, w->end);
+	}
+	if (c->here)
+		ok &= write_range(f, c->here_frontier, c->here_end);
+
+	ok = ok && !fflush(f) && !fsync(fileno(f));
+	ok = !fclose(f) && ok && !rename(tmp, path);
+
+	if (!ok) {
+		fprintf(stderr, "pow: could not save checkpoint '%s': %s\n", path, strerror(errno));
+		unlink(tmp);
+	}
+
+	c->saved = now_ms();
+	return ok;
+}
+
+static FILE *open_checkpoint(const char *path)
+{
+	char line[128];
+	FILE *f;
+
+	if (!(f = fopen(path, "r")))
+		return NULL;
+
+	if (!fgets(line, sizeof(line), f) || strcmp(line, POW_CHECKPOINT_MAGIC "\n")) {
+		fprintf(stderr, "pow: '%s' is not a checkpoint\n", path);
+		fclose(f);
+		errno = EINVAL;
+		return NULL;
+	}
+
+	return f;
+}
+
+int pow_checkpoint_created_at(const char *path, uint64_t *created_at)
+{
+	char line[128];
+	FILE *f;
+	int ok = 0;
+
+	if (!(f = open_checkpoint(path)))
+		return 0;
+
+	while (!ok && fgets(line, sizeof(line), f))
+		ok = sscanf(line, "created_at %" SCNu64, created_at) == 1;
+
+	fclose(f);
+	return ok;
+}
+
+static int load_checkpoint(struct coord *c)
+{
+	const char *path = c->opts->checkpoint;
+	char line[128], hash[65];
+	uint64_t start, end;
+	int difficulty = -1, ok = 1, n;
+	FILE *f;
+
+	if (!(f = open_checkpoint(path))) {
+		if (errno != ENOENT)
+			return 0;
+		fprintf(stderr, "pow: no checkpoint at '%s', starting from the beginning\n", path);
+		return 1;
+	}
+
+	hash[0] = 0;
+	while (ok && fgets(line, sizeof(line), f)) {
+		if (sscanf(line, "range %" SCNu64 " %" SCNu64 "%n", &start, &end, &n) == 2)
+			ok = start < end && give_back(c, start, end);
+		else if (sscanf(line, "job %64s", hash) == 1 ||
+			 sscanf(line, "difficulty %d", &difficulty) == 1 ||
+			 sscanf(line, "tried %" SCNu64, &c->tried) == 1 ||
+			 sscanf(line, "best %d", &c->best) == 1 ||
+			 sscanf(line, "next %" SCNu64, &c->next) == 1 ||
+			 !strncmp(line, "created_at ", 11))
+			;
+		else
+			ok = 0;
+	}
+	fclose(f);
+
+	if (!ok) {
+		fprintf(stderr, "pow: could not read checkpoint '%s'\n", path);
+		return 0;
+	}
+
+	if (strcmp(hash, c->job_hash) || difficulty != c->job->difficulty) {
+		fprintf(stderr, "pow: checkpoint '%s' is for a different event or difficulty\n", path);
+		return 0;
+	}
+
+	c->resumed = c->reported_tried = c->tried;
+	fprintf(stderr, "pow: resuming after %" PRIu64 " attempts, best %d bits so far\n",
+		c->tried, c->best);
+	return 1;
+}
+
+/* report and checkpoint when it's time */
+static void tick(struct coord *c)
+{
+	int64_t now = now_ms();
+
+	if (now - c->reported >= POW_REPORT_MS)
+		report(c, now);
+	if (c->opts->checkpoint && now - c->saved >= POW_SAVE_MS)
+		save_checkpoint(c);
+}
+
+static int here_progress(const struct mine_progress *p, void *data)
+{
+	struct coord *c = data;
+
+	c->tried += p->frontier - c->here_frontier;
+	c->here_frontier = p->frontier;
+	if (p->best > c->best)
+		c->best = p->best;
+
+	tick(c);
+	return !interrupted;
+}
+
+/* no workers, mine what is left right here, leases first */
+static int mine_here(struct coord *c)
+{
+	struct lease l;
+	int ret;
+
+	while (!c->found && !interrupted) {
+		if (c->nreturned) {
+			l = c->returned[--c->nreturned];
+		} else if (c->next < UINT64_MAX) {
+			l.start = c->next;
+			l.end = c->next = UINT64_MAX;
+		} else {
+			fprintf(stderr, "pow: every nonce was tried\n");
+			return 0;
+		}
+
+		c->here = 1;
+		c->here_frontier = l.start;
+		c->here_end = l.end;
+
+		ret = mine_range(c->job, l.start, l.end, c->opts->threads,
+				 here_progress, c, &c->nonce, c->id);
+		c->here = 0;
+
+		if (ret == MINE_ERROR) {
+			fprintf(stderr, "pow: could not start mining\n");
+			give_back(c, c->here_frontier, c->here_end);
+			return 0;
+		}
+
+		if (ret == MINE_FOUND) {
+			c->tried += c->nonce + 1 - c->here_frontier;
+			c->found = 1;
+		} else if (interrupted) {
+			give_back(c, c->here_frontier, c->here_end);
+		} else {
+			c->tried += c->here_end - c->here_frontier;
+		}
+	}
+
+	return c->found;
+}
+
+static int coordinate(struct coord *c, int listen_fd)
+{
+	struct pollfd *fds = NULL, *tmp;
+	const char *why;
+	int i, n, cap = 0, fd, base = listen_fd >= 0;
+
+	while (!c->found && !interrupted) {
+		if (!c->nworkers && listen_fd < 0) {
+			fprintf(stderr, "pow: all workers are gone\n");
+			break;
+		}
+
+		if (cap < c->nworkers + 1) {
+			cap = (c->nworkers + 1) * 2;
+			if (!(tmp = realloc(fds, cap * sizeof(*fds))))
+				break;
+			fds = tmp;
+		}
+
+		if (listen_fd >= 0) {
+			fds[0].fd = listen_fd;
+			fds[0].events = POLLIN;
+		}
+		for (i = 0; i < c->nworkers; i++) {
+			fds[base + i].fd = c->workers[i]->conn.fd;
+			fds[base + i].events = POLLIN;
+		}
+		n = c->nworkers;
+
+		if (poll(fds, base + n, 1000) < 0) {
+			if (errno == EINTR)
+				continue;
+			fprintf(stderr, "pow: poll: %s\n", strerror(errno));
+			break;
+		}
+
+		/* backwards, dropping a worker moves the last one into its
+		 * place */
+		for (i = n - 1; i >= 0 && !c->found; i--) {
+			if (!fds[base + i].revents)
+				continue;
+			why = NULL;
+			if (!conn_read(&c->workers[i]->conn))
+				why = "went away";
+			else if (!worker_lines(c, c->workers[i], &why))
+				;
+			else
+				continue;
+			drop_worker(c, i, why);
+		}
+
+		if (!c->found && listen_fd >= 0 && fds[0].revents & POLLIN) {
+			if ((fd = accept(listen_fd, NULL, NULL)) >= 0 && add_worker(c, fd, 0))
+				fprintf(stderr, "pow: worker %d connected\n", c->seq);
+		}
+
+		check_leases(c);
+		tick(c);
+	}
+
+	free(fds);
+	return c->found;
+}
+
+static int pow_coordinate(const struct mine_job *job, struct pow_opts *opts,
+			  uint64_t *nonce, unsigned char id[32])
+{
+	struct sigaction sa;
+	struct sha256 hash;
+	struct coord c;
+	int64_t duration;
+	int i, listen_fd = -1, ok = 0;
+
+	memset(&c, 0, sizeof(c));
+	c.job = job;
+	c.opts = opts;
+
+	sha256(&hash, job->commitment, job->len);
+	hex_encode(hash.u.u8, 32, c.job_hash, sizeof(c.job_hash));
+
+	if (opts->checkpoint && opts->resume && !load_checkpoint(&c))
+		goto out;
+
+	/* writes to workers that died are handled where they fail */
+	signal(SIGPIPE, SIG_IGN);
+
+	/* with a checkpoint, stop cleanly so the last of the progress is
+	 * saved too. No SA_RESTART, so poll() returns */
+	interrupted = 0;
+	if (opts->checkpoint) {
+		memset(&sa, 0, sizeof(sa));
+		sa.sa_handler = on_interrupt;
+		sigaction(SIGINT, &sa, NULL);
+		sigaction(SIGTERM, &sa, NULL);
+	}
+
+	if (!make_job_line(&c))
+		goto out;
+
+	if (opts->listen) {
+		if ((listen_fd = listen_unix(opts->listen, "pow")) < 0)
+			goto out;
+		fprintf(stderr, "pow: waiting for workers on %s\n", opts->listen);
+	}
+
+	c.t1 = c.saved = c.reported = now_ms();
+
+	for (i = 0; i < opts->workers; i++) {
+		if (!fork_worker(&c, listen_fd))
+			break;
+	}
+
+	if (opts->workers || opts->listen)
+		ok = coordinate(&c, listen_fd);
+	else
+		ok = mine_here(&c);
+
+	if (ok) {
+		*nonce = c.nonce;
+		memcpy(id, c.id, 32);
+
+		duration = now_ms() - c.t1;
+		fprintf(stderr, "pow: found nonce %" PRIu64 " after %" PRIu64 " attempts, %" PRId64 " ms, %.0f attempts per second",
+			c.nonce, c.tried, duration,
+			duration ? (c.tried - c.resumed) * 1000.0 / duration : 0.0);
+		if (opts->workers || opts->listen)
+			fprintf(stderr, " on %d workers, %" PRIu64 " leases given out again",
+				c.nworkers, c.releases);
+		fprintf(stderr, "\n");
+	}
+
+	/* the winner is announced so every worker can stop */
+	for (i = c.nworkers - 1; i >= 0; i--) {
+		if (ok)
+			send_line(c.workers[i]->conn.fd, "found %" PRIu64 "\n", c.nonce);
+		shutdown(c.workers[i]->conn.fd, SHUT_WR);
+	}
+
+	/* our own workers have nothing left to do, stuck or not. On an
+	 * interrupt their leases go to the checkpoint */
+	for (i = c.nworkers - 1; i >= 0; i--) {
+		c.workers[i]->leased = !ok && c.workers[i]->leased;
+		drop_worker(&c, i, NULL);
+	}
+
+	if (opts->checkpoint) {
+		if (ok)
+			unlink(opts->checkpoint);
+		else if (interrupted && save_checkpoint(&c))
+			fprintf(stderr, "pow: interrupted, progress saved to '%s', continue with --resume\n",
+				opts->checkpoint);
+		signal(SIGINT, SIG_DFL);
+		signal(SIGTERM, SIG_DFL);
+	}
+
+	if (listen_fd >= 0) {
+		close(listen_fd);
+		unlink(opts->listen);
+	}
+
+out:
+	free(c.workers);
+	free(c.returned);
+	free(c.job_line);
+	return ok;
+}
+
+int pow_mine_event(struct nostr_event *ev, int difficulty, struct pow_opts *opts)
+{
+	struct mine_job job;
+	unsigned char id[32];
+	uint64_t nonce;
+
+	if (!mine_job_event(&job, ev, difficulty) ||
+	    !pow_coordinate(&job, opts, &nonce, id))
+		return 0;
+
+	mine_job_set(&job, nonce, id);
+	return 1;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// worker
+/////////////////////////////////////////////////////////////////////////////
+
+struct work {
+	struct conn conn;
+	int64_t checkpointed;
+	int best;
+	/* someone found it, or the coordinator is gone */
+	int stop, lost;
+};
+
+/* checkpoint now and then, and stop when the coordinator says so */
+static int work_progress(const struct mine_progress *p, void *data)
+{
+	struct work *wk = data;
+	struct pollfd pfd = { wk->conn.fd, POLLIN, 0 };
+	char *line;
+
+	if (p->best > wk->best)
+		wk->best = p->best;
+
+	if (now_ms() - wk->checkpointed >= POW_CHECKPOINT_MS) {
+		if (!send_line(wk->conn.fd, "progress %" PRIu64 " %d\n", p->frontier, wk->best))
+			wk->lost = 1;
+		wk->checkpointed = now_ms();
+	}
+
+	while (!wk->lost && !wk->stop && poll(&pfd, 1, 0) > 0) {
+		if (!conn_read(&wk->conn)) {
+			wk->lost = 1;
+			break;
+		}
+		while ((line = conn_line(&wk->conn))) {
+			if (!strncmp(line, "found ", 6))
+				wk->stop = 1;
+		}
+	}
+
+	return !wk->lost && !wk->stop;
+}
+
+static int read_job(struct work *wk, struct mine_job *job, unsigned char **commitment)
+{
+	int difficulty, off, n;
+	size_t hexlen;
+	char *line;
+
+	if (!(line = conn_wait_line(&wk->conn)) ||
+	    sscanf(line, "job %d %d %n", &difficulty, &off, &n) != 2)
+		return 0;
+
+	line += n;
+	hexlen = strlen(line);
+	if (hexlen % 2 || !(*commitment = malloc(hexlen / 2)))
+		return 0;
+
+	return hex_decode(line, hexlen, *commitment, hexlen / 2) &&
+	       mine_job_init(job, *commitment, hexlen / 2, off, difficulty);
+}
+
+int pow_work(int fd, int threads)
+{
+	struct mine_job job;
+	struct work wk;
+	unsigned char *commitment = NULL, id[32];
+	uint64_t start, end, nonce;
+	char *line;
+	int ret = 0, n;
+
+	memset(&wk, 0, sizeof(wk));
+	wk.conn.fd = fd;
+	signal(SIGPIPE, SIG_IGN);
+
+	if (!read_job(&wk, &job, &commitment)) {
+		fprintf(stderr, "pow-worker: could not read the job\n");
+		goto out;
+	}
+
+	while (!wk.stop && !wk.lost) {
+		if (!(line = conn_wait_line(&wk.conn))) {
+			wk.lost = 1;
+			break;
+		}
+
+		if (!strncmp(line, "found ", 6)) {
+			wk.stop = 1;
+			break;
+		}
+
+		if (sscanf(line, "lease %" SCNu64 " %" SCNu64 "%n", &start, &end, &n) != 2 ||
+		    line[n] || start >= end) {
+			fprintf(stderr, "pow-worker: unexpected '%.40s'\n", line);
+			goto out;
+		}
+
+		wk.checkpointed = now_ms();
+		ret = mine_range(&job, start, end, threads, work_progress, &wk, &nonce, id);
+
+		if (ret == MINE_ERROR) {
+			fprintf(stderr, "pow-worker: could not start mining\n");
+			ret = 0;
+			goto out;
+		}
+
+		if (ret == MINE_FOUND) {
+			send_line(fd, "found %" PRIu64 "\n", nonce);
+			/* wait for it to be announced, or for the coordinator
+			 * to hang up */
+			while ((line = conn_wait_line(&wk.conn)) && strncmp(line, "found ", 6))
+				;
+			wk.stop = 1;
+		} else if (!wk.stop && !wk.lost &&
+			   !send_line(fd, "progress %" PRIu64 " %d\n", end, wk.best)) {
+			wk.lost = 1;
+		}
+	}
+
+	if (wk.lost)
+		fprintf(stderr, "pow-worker: lost the coordinator\n");
+	ret = wk.stop;
+out:
+	free(commitment);
+	free(wk.conn.buf);
+	close(fd);
+	return ret;
+}
+
+int pow_connect(const char *path)
+{
+	struct sockaddr_un addr;
+	int fd;
+
+	if (strlen(path) >= sizeof(addr.sun_path)) {
+		fprintf(stderr, "pow-worker: socket path too long: '%s'\n", path);
+		return -1;
+	}
+
+	if ((fd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0) {
+		fprintf(stderr, "pow-worker: socket: %s\n", strerror(errno));
+		return -1;
+	}
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strcpy(addr.sun_path, path);
+
+	if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+		fprintf(stderr, "pow-worker: connect to '%s': %s\n", path, strerror(errno));
+		close(fd);
+		return -1;
+	}
+
+	return fd;
+}
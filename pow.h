@@ -0,0 +1,74 @@
+#ifndef POW_H
+#define POW_H
+
+#include <stdint.h>
+
+#include "mine.h"
+#include "struct_nostr_event.h"
+
+/* Proof of work for one event spread over worker processes.
+ *
+ * A coordinator hands out disjoint leases of the nonce space to workers
+ * connected over a socketpair (workers it forks itself) or a unix socket
+ * (`nostril pow-worker --connect`, from other containers on the box). The
+ * protocol is newline delimited text:
+ *
+ *   coordinator -> worker   job <difficulty> <nonce offset> <hex commitment>
+ *                           lease <start> <end>
+ *                           found <nonce>
+ *   worker -> coordinator   progress <frontier> <best bits>
+ *                           found <nonce>
+ *
+ * A worker checkpoints the frontier of its lease, every nonce below it
+ * tried, about once a second, and asks for the next lease by reporting the
+ * end of the last. When a worker goes away, or stops checkpointing for
+ * `timeout` seconds, the rest of its lease from the last checkpoint goes
+ * to the next worker that needs one. A found nonce is checked by the
+ * coordinator before it is announced to every worker.
+ *
+ * Without workers the nonces are mined in this process. Either way the
+ * rate, the best id so far and an ETA are reported every few seconds, and
+ * with a checkpoint file everything not tried yet is saved to it every
+ * few seconds and on SIGINT or SIGTERM, for --resume. */
+
+struct pow_opts {
+	/* worker processes to fork, each mining on `threads` threads */
+	int workers;
+	int threads;
+
+	/* unix socket to accept more workers on, may be NULL */
+	const char *listen;
+
+	/* nonces per lease */
+	uint64_t lease;
+
+	/* seconds without a checkpoint before a lease is taken back */
+	int timeout;
+
+	/* file to save progress to, and whether to start from it */
+	const char *checkpoint;
+	int resume;
+};
+
+#define POW_LEASE (1ULL << 28)
+#define POW_TIMEOUT 30
+
+void pow_defaults(struct pow_opts *opts);
+
+/* the created_at of the event a checkpoint is for, so the same event can
+ * be made again to resume it. Returns 0 if there is no checkpoint */
+int pow_checkpoint_created_at(const char *path, uint64_t *created_at);
+
+/* like mine_event(), with progress reports, checkpoints, and the nonce
+ * search spread over workers if there are any */
+int pow_mine_event(struct nostr_event *ev, int difficulty, struct pow_opts *opts);
+
+/* Mine leases from the coordinator on fd with `threads` threads until a
+ * nonce is found by anyone. Returns 0 if the coordinator went away first
+ * or on error. */
+int pow_work(int fd, int threads);
+
+/* connect to a coordinator's unix socket, -1 on error */
+int pow_connect(const char *path);
+
+#endif
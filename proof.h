@@ -12,7 +12,7 @@ static inline int zero_bits(unsigned char b)
 }
 
 /* find the number of leading zero bits in a hash */
-static int count_leading_zero_bits(unsigned char *hash)
+static inline int count_leading_zero_bits(unsigned char *hash)
 {
 	int bits, total, i;
 
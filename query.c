@@ -0,0 +1,933 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "arena.h"
+#include "event.h"
+#include "json.h"
+#include "query.h"
+
+#define INDEX_MAGIC "NSTRQIX1"
+#define NO_RANK UINT32_MAX
+
+/* the kinds of key with a posting list, tags are KEY_TAG + the letter */
+#define KEY_AUTHOR 1
+#define KEY_KIND   2
+#define KEY_TAG    256
+
+/* Events are numbered by rank, their position in created_at order with
+ * the newest first, and the posting lists hold ranks in increasing
+ * order. The file is the header, the location of every event by rank,
+ * the key table and the posting lists. */
+struct index_header {
+	char magic[8];
+	uint64_t events;
+	uint64_t slots;
+	uint64_t postings;
+	/* store_end() when the index was built */
+	uint64_t end;
+	uint64_t unused[3];
+};
+
+/* an open addressing table, a key with no postings isn't there, so a
+ * count of 0 is an empty slot */
+struct key_slot {
+	uint64_t hash;
+	uint32_t start;
+	uint32_t count;
+};
+
+struct query {
+	struct store *store;
+
+	int fd;
+	size_t size;
+	struct index_header *hdr;
+	const uint64_t *locs;
+	const struct key_slot *slots;
+	const uint32_t *postings;
+
+	/* for checking tags, which means parsing a copy of the json */
+	struct arena arena;
+	char *buf;
+	size_t bufsize;
+};
+
+/* a match by created_at and location, for the results that don't come
+ * out of the index already in order */
+struct hit {
+	uint64_t created_at;
+	uint64_t loc;
+};
+
+struct hits {
+	struct hit *hits;
+	size_t num, cap;
+};
+
+static inline uint64_t mix(uint64_t h)
+{
+	h ^= h >> 33;
+	h *= 0xff51afd7ed558ccdULL;
+	h ^= h >> 33;
+	h *= 0xc4ceb9fe1a85ec53ULL;
+	h ^= h >> 33;
+	return h;
+}
+
+static uint64_t key_hash(int type, const void *key, size_t len)
+{
+	const unsigned char *p = key;
+	uint64_t h = mix(type * 0x9e3779b97f4a7c15ULL + len), w;
+	size_t i;
+
+	for (i = 0; i + 8 <= len; i += 8) {
+		memcpy(&w, p + i, 8);
+		h = mix(h ^ w);
+	}
+	if (i < len) {
+		w = 0;
+		memcpy(&w, p + i, len - i);
+		h = mix(h ^ w);
+	}
+
+	return h;
+}
+
+static uint64_t kind_hash(int kind)
+{
+	uint32_t k = kind;
+	return key_hash(KEY_KIND, &k, sizeof(k));
+}
+
+/* only single letter tags are indexed, by their first value */
+static int indexed_tag(const struct nostr_tag *tag)
+{
+	const char *name = tag->strs[0];
+
+	return tag->num_elems >= 2 && name[0] && !name[1] &&
+	       ((name[0] >= 'a' && name[0] <= 'z') || (name[0] >= 'A' && name[0] <= 'Z'));
+}
+
+static uint64_t tag_hash(char name, const char *value)
+{
+	return key_hash(KEY_TAG + (unsigned char)name, value, strlen(value));
+}
+
+static int hits_push(struct hits *h, uint64_t created_at, uint64_t loc)
+{
+	struct hit *hits;
+	size_t cap;
+
+	if (h->num == h->cap) {
+		cap = h->cap ? h->cap * 2 : 64;
+		if (!(hits = realloc(h->hits, cap * sizeof(*hits))))
+			return 0;
+		h->hits = hits;
+		h->cap = cap;
+	}
+
+	h->hits[h->num].created_at = created_at;
+	h->hits[h->num].loc = loc;
+	h->num++;
+	return 1;
+}
+
+/* newest first, and the later added first when they were made in the same
+ * second, which is also the order of the ranks */
+static int hit_cmp(const void *a, const void *b)
+{
+	const struct hit *x = a, *y = b;
+
+	if (x->created_at != y->created_at)
+		return x->created_at < y->created_at ? 1 : -1;
+	return x->loc < y->loc ? 1 : x->loc > y->loc ? -1 : 0;
+}
+
+static void hits_sort(struct hits *h)
+{
+	qsort(h->hits, h->num, sizeof(*h->hits), hit_cmp);
+}
+
+/* the event's tags, from a copy of its json since parsing unescapes in
+ * place and the store is mapped shared */
+static int parse_rec(struct query *q, const struct store_rec *rec, struct nostr_event *ev)
+{
+	int fields;
+	char *buf;
+
+	if (rec->len + 1 > q->bufsize) {
+		if (!(buf = realloc(q->buf, rec->len + 1)))
+			return 0;
+		q->buf = buf;
+		q->bufsize = rec->len + 1;
+	}
+	memcpy(q->buf, store_rec_json(rec), rec->len);
+	q->buf[rec->len] = 0;
+
+	arena_reset(&q->arena);
+	event_init(ev, &q->arena);
+	return parse_event(q->buf, rec->len, ev, &fields);
+}
+
+static int tag_matches(const struct nostr_filter_tag *want, const struct nostr_event *ev)
+{
+	int i, j;
+
+	for (i = 0; i < ev->num_tags; i++) {
+		if (!indexed_tag(&ev->tags[i]) || ev->tags[i].strs[0][0] != want->name)
+			continue;
+		for (j = 0; j < want->num_values; j++) {
+			if (!strcmp(ev->tags[i].strs[1], want->values[j]))
+				return 1;
+		}
+	}
+
+	return 0;
+}
+
+static int filter_matches(struct query *q, const struct nostr_filter *f,
+			  const struct store_rec *rec)
+{
+	struct nostr_event ev;
+	int i;
+
+	if (f->ids) {
+		for (i = 0; i < f->num_ids && memcmp(f->ids[i], rec->id, 32); i++)
+			;
+		if (i == f->num_ids)
+			return 0;
+	}
+
+	if (f->authors) {
+		for (i = 0; i < f->num_authors && memcmp(f->authors[i], rec->pubkey, 32); i++)
+			;
+		if (i == f->num_authors)
+			return 0;
+	}
+
+	if (f->kinds) {
+		for (i = 0; i < f->num_kinds && (uint32_t)f->kinds[i] != rec->kind; i++)
+			;
+		if (i == f->num_kinds)
+			return 0;
+	}
+
+	if (!f->num_tags)
+		return 1;
+
+	if (!parse_rec(q, rec, &ev))
+		return 0;
+
+	for (i = 0; i < f->num_tags; i++) {
+		if (!tag_matches(&f->tags[i], &ev))
+			return 0;
+	}
+
+	return 1;
+}
+
+/* the matches in order when there is no index to give it */
+static int emit_hits(struct query *q, struct hits *h, int64_t limit,
+		     store_rec_fn *fn, void *data)
+{
+	size_t i;
+
+	hits_sort(h);
+	for (i = 0; i < h->num && limit; i++) {
+		/* the same id more than once in ids */
+		if (i && h->hits[i].loc == h->hits[i-1].loc)
+			continue;
+		if (!fn(store_at(q->store, h->hits[i].loc), h->hits[i].loc, data))
+			return 0;
+		limit--;
+	}
+
+	return 1;
+}
+
+struct scan {
+	struct query *q;
+	const struct nostr_filter *f;
+	struct hits hits;
+	uint64_t count;
+	int ok;
+};
+
+static int scan_rec(const struct store_rec *rec, uint64_t loc, void *data)
+{
+	struct scan *scan = data;
+
+	scan->count++;
+	if (filter_matches(scan->q, scan->f, rec) &&
+	    !hits_push(&scan->hits, rec->created_at, loc))
+		return scan->ok = 0;
+
+	return 1;
+}
+
+static int count_rec(const struct store_rec *rec, uint64_t loc, void *data)
+{
+	(void)rec;
+	(void)loc;
+	return ++((struct scan *)data)->count <= QUERY_TAIL_MAX;
+}
+
+int query_scan(struct query *q, const struct nostr_filter *f,
+	       store_rec_fn *fn, void *data)
+{
+	struct scan scan = { .q = q, .f = f, .ok = 1 };
+	int ok;
+
+	ok = store_foreach(q->store, scan_rec, &scan) &&
+	     emit_hits(q, &scan.hits, f->limit, fn, data);
+
+	free(scan.hits.hits);
+	return ok;
+}
+
+/*
+ * building the index
+ */
+
+struct build_key {
+	uint64_t hash;
+	/* id + 1, 0 for an empty slot */
+	uint32_t id;
+};
+
+struct order {
+	uint64_t created_at;
+	uint32_t ord;
+};
+
+struct build {
+	struct query *q;
+
+	/* by the order the events were added */
+	uint64_t n, cap;
+	uint64_t *locs;
+	struct order *order;
+	uint32_t *ref_start;
+
+	/* the keys of every event, as key ids */
+	uint32_t *refs;
+	uint64_t num_refs, cap_refs;
+
+	struct build_key *table;
+	uint64_t table_size;
+	uint64_t *key_hashes;
+	uint32_t *key_counts;
+	uint32_t num_keys, cap_keys;
+
+	int ok;
+};
+
+static int build_table_grow(struct build *b)
+{
+	struct build_key *table;
+	uint64_t size = b->table_size ? b->table_size * 2 : 1 << 16, i, j;
+
+	if (!(table = calloc(size, sizeof(*table))))
+		return 0;
+
+	for (i = 0; i < b->table_size; i++) {
+		if (!b->table[i].id)
+			continue;
+		for (j = b->table[i].hash & (size - 1); table[j].id; j = (j + 1) & (size - 1))
+			;
+		table[j] = b->table[i];
+	}
+
+	free(b->table);
+	b->table = table;
+	b->table_size = size;
+	return 1;
+}
+
+static int build_add_key(struct build *b, uint64_t hash)
+{
+	uint64_t i, mask;
+	uint32_t id, cap;
+	void *p;
+
+	if ((uint64_t)(b->num_keys + 1) * 2 > b->table_size && !build_table_grow(b))
+		return 0;
+
+	mask = b->table_size - 1;
+	for (i = hash & mask; b->table[i].id; i = (i + 1) & mask) {
+		if (b->table[i].hash == hash)
+			break;
+	}
+
+	if (b->table[i].id) {
+		id = b->table[i].id - 1;
+		/* a tag repeated in the same event */
+		for (i = b->ref_start[b->n]; i < b->num_refs; i++) {
+			if (b->refs[i] == id)
+				return 1;
+		}
+	} else {
+		if (b->num_keys == b->cap_keys) {
+			cap = b->cap_keys ? b->cap_keys * 2 : 1 << 16;
+			if (!(p = realloc(b->key_hashes, cap * sizeof(*b->key_hashes))))
+				return 0;
+			b->key_hashes = p;
+			if (!(p = realloc(b->key_counts, cap * sizeof(*b->key_counts))))
+				return 0;
+			b->key_counts = p;
+			b->cap_keys = cap;
+		}
+		id = b->num_keys++;
+		b->key_hashes[id] = hash;
+		b->key_counts[id] = 0;
+		b->table[i].hash = hash;
+		b->table[i].id = id + 1;
+	}
+
+	if (b->num_refs == b->cap_refs) {
+		b->cap_refs = b->cap_refs ? b->cap_refs * 2 : 1 << 20;
+		if (!(p = realloc(b->refs, b->cap_refs * sizeof(*b->refs))))
+			return 0;
+		b->refs = p;
+	}
+
+	/* posting list starts are 32 bit */
+	if (b->num_refs == UINT32_MAX)
+		return 0;
+
+	b->refs[b->num_refs++] = id;
+	b->key_counts[id]++;
+	return 1;
+}
+
+static int build_event(const struct store_rec *rec, uint64_t loc, void *data)
+{
+	struct build *b = data;
+	struct nostr_event ev;
+	uint64_t cap;
+	void *p;
+	int i;
+
+	if (b->n + 1 >= b->cap) {
+		cap = b->cap ? b->cap * 2 : 1 << 16;
+		if (cap > UINT32_MAX ||
+		    !(p = realloc(b->locs, cap * sizeof(*b->locs))) || !(b->locs = p, 1) ||
+		    !(p = realloc(b->order, cap * sizeof(*b->order))) || !(b->order = p, 1) ||
+		    !(p = realloc(b->ref_start, cap * sizeof(*b->ref_start))) || !(b->ref_start = p, 1))
+			return b->ok = 0;
+		b->cap = cap;
+	}
+
+	b->locs[b->n] = loc;
+	b->order[b->n].created_at = rec->created_at;
+	b->order[b->n].ord = b->n;
+	b->ref_start[b->n] = b->num_refs;
+
+	if (!build_add_key(b, key_hash(KEY_AUTHOR, rec->pubkey, 32)) ||
+	    !build_add_key(b, kind_hash(rec->kind)))
+		return b->ok = 0;
+
+	/* the store only takes events that parse */
+	if (parse_rec(b->q, rec, &ev)) {
+		for (i = 0; i < ev.num_tags; i++) {
+			if (indexed_tag(&ev.tags[i]) &&
+			    !build_add_key(b, tag_hash(ev.tags[i].strs[0][0], ev.tags[i].strs[1])))
+				return b->ok = 0;
+		}
+	}
+
+	b->n++;
+	return 1;
+}
+
+static int order_cmp(const void *a, const void *b)
+{
+	const struct order *x = a, *y = b;
+
+	if (x->created_at != y->created_at)
+		return x->created_at < y->created_at ? 1 : -1;
+	return x->ord < y->ord ? 1 : x->ord > y->ord ? -1 : 0;
+}
+
+static char *index_path(struct query *q, const char *name)
+{
+	size_t len = strlen(store_dir(q->store)) + strlen(name) + 2;
+	char *path;
+
+	if ((path = malloc(len)))
+		snprintf(path, len, "%s/%s", store_dir(q->store), name);
+	return path;
+}
+
+static int write_index(struct query *q, struct build *b)
+{
+	struct index_header *hdr;
+	struct key_slot *slots;
+	uint64_t nslots, size, i, j, mask, *locs;
+	uint32_t *postings, *fill = b->key_counts, k, start, r;
+	char *tmp, *path = NULL;
+	void *map = MAP_FAILED;
+	int fd = -1, ok = 0;
+
+	for (nslots = 1024; nslots < (uint64_t)b->num_keys * 2; nslots *= 2)
+		;
+
+	size = sizeof(*hdr) + b->n * sizeof(*locs) + nslots * sizeof(*slots) +
+	       b->num_refs * sizeof(*postings);
+
+	if (!(tmp = index_path(q, "query.tmp")) || !(path = index_path(q, "query")))
+		goto out;
+
+	if ((fd = open(tmp, O_RDWR | O_CREAT | O_TRUNC, 0600)) < 0 || ftruncate(fd, size) < 0 ||
+	    (map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0)) == MAP_FAILED) {
+		fprintf(stderr, "query: could not write '%s': %s\n", tmp, strerror(errno));
+		goto out;
+	}
+
+	hdr = map;
+	locs = (uint64_t *)(hdr + 1);
+	slots = (struct key_slot *)(locs + b->n);
+	postings = (uint32_t *)(slots + nslots);
+
+	memcpy(hdr->magic, INDEX_MAGIC, 8);
+	hdr->events = b->n;
+	hdr->slots = nslots;
+	hdr->postings = b->num_refs;
+	hdr->end = store_end(q->store);
+
+	/* lay the lists out in key order, then fill them by rank so each
+	 * comes out sorted */
+	mask = nslots - 1;
+	for (start = 0, k = 0; k < b->num_keys; k++) {
+		for (j = b->key_hashes[k] & mask; slots[j].count; j = (j + 1) & mask)
+			;
+		slots[j].hash = b->key_hashes[k];
+		slots[j].start = start;
+		slots[j].count = fill[k];
+		start += fill[k];
+		fill[k] = slots[j].start;
+	}
+
+	for (r = 0; r < b->n; r++) {
+		i = b->order[r].ord;
+		locs[r] = b->locs[i];
+		for (j = b->ref_start[i]; j < (i + 1 < b->n ? b->ref_start[i + 1] : b->num_refs); j++)
+			postings[fill[b->refs[j]]++] = r;
+	}
+
+	if (msync(map, size, MS_SYNC) < 0 || rename(tmp, path) < 0) {
+		fprintf(stderr, "query: could not write '%s': %s\n", path, strerror(errno));
+		goto out;
+	}
+	ok = 1;
+out:
+	if (map != MAP_FAILED)
+		munmap(map, size);
+	if (fd >= 0)
+		close(fd);
+	free(tmp);
+	free(path);
+	return ok;
+}
+
+static int build_index(struct query *q)
+{
+	struct build b = { .q = q, .ok = 1 };
+	int ok;
+
+	ok = store_foreach(q->store, build_event, &b) && b.ok;
+	if (ok) {
+		qsort(b.order, b.n, sizeof(*b.order), order_cmp);
+		ok = write_index(q, &b);
+	}
+
+	if (!ok)
+		fprintf(stderr, "query: could not build the index\n");
+
+	free(b.locs);
+	free(b.order);
+	free(b.ref_start);
+	free(b.refs);
+	free(b.table);
+	free(b.key_hashes);
+	free(b.key_counts);
+	return ok;
+}
+
+/*
+ * opening
+ */
+
+static void unmap_index(struct query *q)
+{
+	if (q->hdr)
+		munmap(q->hdr, q->size);
+	if (q->fd >= 0)
+		close(q->fd);
+	q->hdr = NULL;
+	q->fd = -1;
+}
+
+/* map the index if it is one for this store */
+static int map_index(struct query *q)
+{
+	struct index_header *hdr;
+	struct stat st;
+	char *path;
+	void *map;
+
+	if (!(path = index_path(q, "query")))
+		return 0;
+	q->fd = open(path, O_RDONLY);
+	free(path);
+
+	if (q->fd < 0 || fstat(q->fd, &st) < 0 || (size_t)st.st_size < sizeof(*hdr) ||
+	    (map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, q->fd, 0)) == MAP_FAILED) {
+		unmap_index(q);
+		return 0;
+	}
+
+	q->hdr = hdr = map;
+	q->size = st.st_size;
+
+	/* an index from before the store lost a torn record is no good */
+	if (memcmp(hdr->magic, INDEX_MAGIC, 8) || hdr->end > store_end(q->store) ||
+	    q->size != sizeof(*hdr) + hdr->events * sizeof(*q->locs) +
+		       hdr->slots * sizeof(*q->slots) + hdr->postings * sizeof(*q->postings)) {
+		unmap_index(q);
+		return 0;
+	}
+
+	q->locs = (const uint64_t *)(hdr + 1);
+	q->slots = (const struct key_slot *)(q->locs + hdr->events);
+	q->postings = (const uint32_t *)(q->slots + hdr->slots);
+	return 1;
+}
+
+struct query *query_open(struct store *s, int rebuild)
+{
+	struct scan tail = { .ok = 1 };
+	struct query *q;
+
+	if (!(q = calloc(1, sizeof(*q))))
+		return NULL;
+
+	q->store = s;
+	q->fd = -1;
+	arena_init(&q->arena);
+
+	if (!rebuild && map_index(q)) {
+		/* catch up if too much was added since the last build */
+		if (store_foreach_from(s, q->hdr->end, count_rec, &tail))
+			return q;
+		unmap_index(q);
+	}
+
+	if (!build_index(q) || !map_index(q)) {
+		query_close(q);
+		return NULL;
+	}
+
+	return q;
+}
+
+void query_close(struct query *q)
+{
+	if (!q)
+		return;
+
+	unmap_index(q);
+	arena_free(&q->arena);
+	free(q->buf);
+	free(q);
+}
+
+/*
+ * querying
+ */
+
+struct list {
+	const uint32_t *p, *end;
+};
+
+/* a field of the filter, the union of the lists of its values */
+struct term {
+	struct list *lists;
+	int num_lists;
+	uint64_t size;
+};
+
+static struct list find_list(struct query *q, uint64_t hash)
+{
+	uint64_t mask = q->hdr->slots - 1, i;
+	struct list list = { NULL, NULL };
+
+	for (i = hash & mask; q->slots[i].count; i = (i + 1) & mask) {
+		if (q->slots[i].hash == hash) {
+			list.p = q->postings + q->slots[i].start;
+			list.end = list.p + q->slots[i].count;
+			break;
+		}
+	}
+
+	return list;
+}
+
+static void term_add(struct query *q, struct term *t, uint64_t hash)
+{
+	struct list list = find_list(q, hash);
+
+	if (list.p == list.end)
+		return;
+
+	t->lists[t->num_lists++] = list;
+	t->size += list.end - list.p;
+}
+
+/* the first rank in the list at or after target, galloping ahead from
+ * where the list was left, since the next match is often close */
+static uint32_t list_seek(struct list *l, uint32_t target)
+{
+	const uint32_t *lo = l->p, *hi;
+	size_t step = 1;
+
+	if (lo == l->end || *lo >= target)
+		return lo == l->end ? NO_RANK : *lo;
+
+	for (;;) {
+		hi = (size_t)(l->end - lo) > step ? lo + step : l->end;
+		if (hi == l->end || *hi >= target)
+			break;
+		lo = hi;
+		step *= 2;
+	}
+
+	/* *lo < target, and *hi >= target unless hi is the end */
+	while (hi - lo > 1) {
+		const uint32_t *mid = lo + (hi - lo) / 2;
+		if (*mid < target)
+			lo = mid;
+		else
+			hi = mid;
+	}
+
+	l->p = hi;
+	return hi == l->end ? NO_RANK : *hi;
+}
+
+static uint32_t term_seek(struct term *t, uint32_t target)
+{
+	uint32_t min = NO_RANK, r;
+	int i;
+
+	for (i = 0; i < t->num_lists; i++) {
+		if ((r = list_seek(&t->lists[i], target)) == NO_RANK) {
+			t->lists[i--] = t->lists[--t->num_lists];
+			continue;
+		}
+		if (r < min)
+			min = r;
+	}
+
+	return min;
+}
+
+static int term_cmp(const void *a, const void *b)
+{
+	const struct term *x = a, *y = b;
+	return x->size < y->size ? -1 : x->size > y->size;
+}
+
+/* the terms of f, with the smallest first, since it drives the search */
+static struct term *make_terms(struct query *q, const struct nostr_filter *f,
+			       int *num, struct list **all)
+{
+	struct term *terms;
+	struct list *lists;
+	int i, j, n = 0, nlists = 0;
+
+	nlists = f->num_authors + f->num_kinds;
+	for (i = 0; i < f->num_tags; i++)
+		nlists += f->tags[i].num_values;
+
+	if (!(terms = calloc(2 + f->num_tags, sizeof(*terms))) ||
+	    !(lists = calloc(nlists + 1, sizeof(*lists)))) {
+		free(terms);
+		return NULL;
+	}
+	*all = lists;
+
+	if (f->authors) {
+		terms[n].lists = lists;
+		for (i = 0; i < f->num_authors; i++)
+			term_add(q, &terms[n], key_hash(KEY_AUTHOR, f->authors[i], 32));
+		lists += terms[n++].num_lists;
+	}
+
+	if (f->kinds) {
+		terms[n].lists = lists;
+		for (i = 0; i < f->num_kinds; i++)
+			term_add(q, &terms[n], kind_hash(f->kinds[i]));
+		lists += terms[n++].num_lists;
+	}
+
+	for (i = 0; i < f->num_tags; i++) {
+		terms[n].lists = lists;
+		for (j = 0; j < f->tags[i].num_values; j++)
+			term_add(q, &terms[n], tag_hash(f->tags[i].name, f->tags[i].values[j]));
+		lists += terms[n++].num_lists;
+	}
+
+	qsort(terms, n, sizeof(*terms), term_cmp);
+	*num = n;
+	return terms;
+}
+
+int query_run(struct query *q, const struct nostr_filter *f,
+	      store_rec_fn *fn, void *data)
+{
+	struct scan tail = { .q = q, .f = f, .ok = 1 };
+	const struct store_rec *rec;
+	struct term *terms = NULL;
+	struct list *lists = NULL;
+	int64_t left = f->limit;
+	uint32_t r = 0, v;
+	size_t t = 0;
+	int i, agree, nterms = 0, ok = 0;
+
+	if (f->ids) {
+		/* straight from the store's id index, which has every event */
+		for (i = 0; i < f->num_ids; i++) {
+			uint64_t loc = store_lookup(q->store, f->ids[i]);
+			if (loc && filter_matches(q, f, rec = store_at(q->store, loc)) &&
+			    !hits_push(&tail.hits, rec->created_at, loc))
+				goto out;
+		}
+		ok = emit_hits(q, &tail.hits, f->limit, fn, data);
+		goto out;
+	}
+
+	/* the events added since the index was built */
+	if (!store_foreach_from(q->store, q->hdr->end, scan_rec, &tail) && !tail.ok)
+		goto out;
+	hits_sort(&tail.hits);
+
+	if (!(terms = make_terms(q, f, &nterms, &lists)))
+		goto out;
+
+	/* a value that isn't in the index rules the whole term out */
+	for (i = 0; i < nterms; i++) {
+		if (!terms[i].num_lists)
+			r = NO_RANK;
+	}
+
+	/* leapfrog the terms up to a rank they all have, which is a
+	 * candidate, and merge the candidates with the tail as we go */
+	while (left && r < q->hdr->events) {
+		for (agree = 0, i = 0; agree < nterms; i = (i + 1) % nterms) {
+			if ((v = term_seek(&terms[i], r)) == NO_RANK)
+				goto rest;
+			if (v == r) {
+				agree++;
+			} else {
+				r = v;
+				agree = 1;
+			}
+		}
+
+		rec = store_at(q->store, q->locs[r]);
+		for (; left && t < tail.hits.num && tail.hits.hits[t].created_at >= rec->created_at; t++, left--) {
+			if (!fn(store_at(q->store, tail.hits.hits[t].loc), tail.hits.hits[t].loc, data))
+				goto out;
+		}
+
+		if (left && filter_matches(q, f, rec)) {
+			if (!fn(rec, q->locs[r], data))
+				goto out;
+			left--;
+		}
+		r++;
+	}
+
+rest:
+	for (; left && t < tail.hits.num; t++, left--) {
+		if (!fn(store_at(q->store, tail.hits.hits[t].loc), tail.hits.hits[t].loc, data))
+			goto out;
+	}
+	ok = 1;
+out:
+	free(lists);
+	free(terms);
+	free(tail.hits.hits);
+	return ok;
+}
+
+struct seen {
+	uint64_t *locs;
+	uint64_t size, num;
+	store_rec_fn *fn;
+	void *data;
+	int ok;
+};
+
+static int seen_add(struct seen *s, uint64_t loc)
+{
+	uint64_t *locs, size, i, j;
+
+	if ((s->num + 1) * 2 > s->size) {
+		size = s->size ? s->size * 2 : 1024;
+		if (!(locs = calloc(size, sizeof(*locs))))
+			return s->ok = 0;
+		for (i = 0; i < s->size; i++) {
+			if (!s->locs[i])
+				continue;
+			for (j = mix(s->locs[i]) & (size - 1); locs[j]; j = (j + 1) & (size - 1))
+				;
+			locs[j] = s->locs[i];
+		}
+		free(s->locs);
+		s->locs = locs;
+		s->size = size;
+	}
+
+	for (i = mix(loc) & (s->size - 1); s->locs[i]; i = (i + 1) & (s->size - 1)) {
+		if (s->locs[i] == loc)
+			return 0;
+	}
+
+	s->locs[i] = loc;
+	s->num++;
+	return 1;
+}
+
+static int emit_unseen(const struct store_rec *rec, uint64_t loc, void *data)
+{
+	struct seen *s = data;
+
+	if (!seen_add(s, loc))
+		return s->ok;
+	return s->fn(rec, loc, s->data);
+}
+
+int query_run_all(struct query *q, const struct nostr_filter *filters,
+		  int num_filters, store_rec_fn *fn, void *data)
+{
+	struct seen seen = { .fn = fn, .data = data, .ok = 1 };
+	int i, ok = 1;
+
+	if (num_filters == 1)
+		return query_run(q, filters, fn, data);
+
+	for (i = 0; ok && i < num_filters; i++)
+		ok = query_run(q, &filters[i], emit_unseen, &seen);
+
+	free(seen.locs);
+	return ok;
+}
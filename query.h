@@ -0,0 +1,46 @@
+#ifndef QUERY_H
+#define QUERY_H
+
+#include <stdint.h>
+
+#include "store.h"
+#include "struct_nostr_filter.h"
+
+/* REQ filters evaluated against a store, newest first, the way a relay
+ * answers them.
+ *
+ * The query index is a file next to the segments with a posting list per
+ * author, kind and single letter tag value, each listing events in
+ * created_at order, newest first. A filter intersects the lists of its
+ * fields, each the union of the lists of its values, and so finds the
+ * newest matches first and stops as soon as it has `limit` of them.
+ * Lists are keyed by a hash, so every event found is checked against the
+ * filter before it is returned.
+ *
+ * The index is built from the whole store and not updated as events are
+ * added, those are scanned and merged in instead, until there are more
+ * than QUERY_TAIL_MAX of them and the index is built again. */
+
+#define QUERY_TAIL_MAX 65536
+
+struct query;
+
+/* the query index of the store, built if it is missing, out of date or
+ * rebuild is set */
+struct query *query_open(struct store *s, int rebuild);
+void query_close(struct query *q);
+
+/* call fn on the events matching f, newest first, stopping at the limit */
+int query_run(struct query *q, const struct nostr_filter *f,
+	      store_rec_fn *fn, void *data);
+
+/* the same for several filters, as in one REQ, without repeating events
+ * that match more than one */
+int query_run_all(struct query *q, const struct nostr_filter *filters,
+		  int num_filters, store_rec_fn *fn, void *data);
+
+/* query_run without the index, checking every event in the store */
+int query_scan(struct query *q, const struct nostr_filter *f,
+	       store_rec_fn *fn, void *data);
+
+#endif
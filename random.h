@@ -34,7 +34,7 @@
 
 
 /* Returns 1 on success, and 0 on failure. */
-static int fill_random(unsigned char* data, size_t size) {
+static inline int fill_random(unsigned char* data, size_t size) {
 #if defined(_WIN32)
     NTSTATUS res = BCryptGenRandom(NULL, data, size, BCRYPT_USE_SYSTEM_PREFERRED_RNG);
     if (res != STATUS_SUCCESS || size > ULONG_MAX) {
@@ -63,7 +63,7 @@ static int fill_random(unsigned char* data, size_t size) {
     return 0;
 }
 
-static void print_hex(unsigned char* data, size_t size) {
+static inline void print_hex(unsigned char* data, size_t size) {
     size_t i;
     for (i = 0; i < size; i++) {
         fprintf(stderr, "%02x", data[i]);
@@ -0,0 +1,181 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+#include "batch.h"
+#include "serve.h"
+
+struct client {
+	int fd;
+	const secp256k1_context *ctx;
+	struct key *key;
+	struct batch_opts *opts;
+};
+
+/* connections served at once, more wait in the listen backlog */
+#define SERVE_MAX_CLIENTS 256
+
+/* pause after an accept() error like EMFILE that retrying right away
+ * would only repeat */
+#define SERVE_ACCEPT_BACKOFF_US (100 * 1000)
+
+static volatile sig_atomic_t stopping;
+
+static pthread_mutex_t clients_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t clients_done = PTHREAD_COND_INITIALIZER;
+static int clients;
+
+static void on_signal(int sig)
+{
+	(void)sig;
+	stopping = 1;
+}
+
+/* wait for a free client slot and take it, waking up every second to
+ * notice a signal. Returns 0 when stopping. */
+static int client_reserve(void)
+{
+	struct timespec ts;
+	int ok;
+
+	pthread_mutex_lock(&clients_lock);
+	while (clients >= SERVE_MAX_CLIENTS && !stopping) {
+		clock_gettime(CLOCK_REALTIME, &ts);
+		ts.tv_sec++;
+		pthread_cond_timedwait(&clients_done, &clients_lock, &ts);
+	}
+	if ((ok = !stopping))
+		clients++;
+	pthread_mutex_unlock(&clients_lock);
+	return ok;
+}
+
+static void client_release(void)
+{
+	pthread_mutex_lock(&clients_lock);
+	clients--;
+	pthread_cond_signal(&clients_done);
+	pthread_mutex_unlock(&clients_lock);
+}
+
+static void *client_run(void *data)
+{
+	struct client *c = data;
+
+	batch_sign_fd(c->ctx, c->key, c->fd, c->opts);
+
+	close(c->fd);
+	free(c);
+	client_release();
+	return NULL;
+}
+
+int listen_unix(const char *path, const char *who)
+{
+	struct sockaddr_un addr;
+	struct stat st;
+	mode_t mask;
+	int fd, bound;
+
+	if (strlen(path) >= sizeof(addr.sun_path)) {
+		fprintf(stderr, "%s: socket path too long: '%s'\n", who, path);
+		return -1;
+	}
+
+	/* replace a stale socket from an earlier run, but nothing else */
+	if (!lstat(path, &st)) {
+		if (!S_ISSOCK(st.st_mode)) {
+			fprintf(stderr, "%s: '%s' exists and is not a socket\n", who, path);
+			return -1;
+		}
+		unlink(path);
+	}
+
+	if ((fd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0) {
+		fprintf(stderr, "%s: socket: %s\n", who, strerror(errno));
+		return -1;
+	}
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strcpy(addr.sun_path, path);
+
+	/* anyone who can connect can sign with our key */
+	mask = umask(077);
+	bound = bind(fd, (struct sockaddr *)&addr, sizeof(addr));
+	umask(mask);
+
+	if (bound < 0 || listen(fd, 64) < 0) {
+		fprintf(stderr, "%s: bind: %s\n", who, strerror(errno));
+		close(fd);
+		return -1;
+	}
+
+	return fd;
+}
+
+int serve(const secp256k1_context *ctx, struct key *key, const char *path,
+	  struct batch_opts *opts)
+{
+	struct sigaction sa;
+	struct client *c;
+	pthread_attr_t attr;
+	pthread_t thread;
+	int fd, cfd;
+
+	if ((fd = listen_unix(path, "serve")) < 0)
+		return 0;
+
+	/* no SA_RESTART, so accept() returns when we're asked to stop */
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = on_signal;
+	sigaction(SIGINT, &sa, NULL);
+	sigaction(SIGTERM, &sa, NULL);
+	signal(SIGPIPE, SIG_IGN);
+
+	pthread_attr_init(&attr);
+	pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+
+	fprintf(stderr, "serve: listening on %s\n", path);
+
+	while (client_reserve()) {
+		if ((cfd = accept(fd, NULL, NULL)) < 0) {
+			if (errno != EINTR && errno != ECONNABORTED) {
+				perror("serve: accept");
+				usleep(SERVE_ACCEPT_BACKOFF_US);
+			}
+			client_release();
+			continue;
+		}
+
+		if (!(c = malloc(sizeof(*c)))) {
+			close(cfd);
+			client_release();
+			continue;
+		}
+
+		c->fd = cfd;
+		c->ctx = ctx;
+		c->key = key;
+		c->opts = opts;
+
+		if (pthread_create(&thread, &attr, client_run, c)) {
+			close(cfd);
+			free(c);
+			client_release();
+		}
+	}
+
+	pthread_attr_destroy(&attr);
+	close(fd);
+	unlink(path);
+	return 1;
+}
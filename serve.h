@@ -0,0 +1,22 @@
+#ifndef SERVE_H
+#define SERVE_H
+
+#include "secp256k1.h"
+#include "struct_key.h"
+#include "batch.h"
+
+/* Listen on a unix socket at `path` and sign newline delimited event
+ * templates for every client that connects, with the key and context kept
+ * resident. Each connection is served by its own thread, up to 256 at
+ * once; further connections wait in the listen backlog. Runs until
+ * SIGINT or SIGTERM, then removes the socket. Returns 0 if the socket
+ * can't be set up. */
+int serve(const secp256k1_context *ctx, struct key *key, const char *path,
+	  struct batch_opts *opts);
+
+/* Bind and listen on a unix socket at path that only this user can
+ * connect to, replacing a stale socket. Errors are reported on stderr
+ * prefixed with `who`. Returns the fd, or -1. */
+int listen_unix(const char *path, const char *who);
+
+#endif
@@ -48,6 +48,36 @@ void sha256_done(struct sha256_ctx *ctx, struct sha256 *res)
 	SHA256_Final(res->u.u8, &ctx->c);
 	invalidate_sha256(ctx);
 }
+int sha256_kernel_supported(enum sha256_kernel kernel)
+{
+	return kernel == SHA256_KERNEL_AUTO || kernel == SHA256_KERNEL_SCALAR;
+}
+
+const char *sha256_kernel_name(enum sha256_kernel kernel)
+{
+	return "openssl";
+}
+
+int sha256_set_kernel(enum sha256_kernel kernel)
+{
+	return sha256_kernel_supported(kernel);
+}
+
+void sha256_many(struct sha256 *res, const struct sha256_ctx *start,
+		 const unsigned char *const *msgs, size_t len, size_t n)
+{
+	struct sha256_ctx ctx;
+	size_t i;
+
+	for (i = 0; i < n; i++) {
+		if (start)
+			ctx = *start;
+		else
+			sha256_init(&ctx);
+		sha256_update(&ctx, msgs[i], len);
+		sha256_done(&ctx, &res[i]);
+	}
+}
 #else
 static uint32_t Ch(uint32_t x, uint32_t y, uint32_t z)
 {
@@ -168,6 +198,270 @@ static void Transform(uint32_t *s, const uint32_t *chunk)
 }
 
 
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define SHA256_X86_KERNELS 1
+#include <cpuid.h>
+#include <immintrin.h>
+#endif
+
+static const uint32_t K[64] = {
+	0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+	0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+	0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+	0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+	0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+	0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+	0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+	0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+};
+
+/* Multi-lane transforms process one 64 byte block from each of `lanes`
+ * messages. The state is stored interleaved: word w of lane l lives at
+ * state[w * lanes + l]. */
+typedef void (*multi_transform_fn)(uint32_t *state, const unsigned char *const *blocks);
+
+static void transform_scalar_x1(uint32_t *state, const unsigned char *const *blocks)
+{
+	uint32_t chunk[16];
+
+	memcpy(chunk, blocks[0], sizeof(chunk));
+	Transform(state, chunk);
+}
+
+#ifdef SHA256_X86_KERNELS
+static inline uint32_t load_be32(const unsigned char *p)
+{
+	return (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 8 | p[3];
+}
+
+/* SSE2 is part of the x86_64 baseline, so this one needs no target */
+#define ROTR4(x, n) _mm_or_si128(_mm_srli_epi32(x, n), _mm_slli_epi32(x, 32 - (n)))
+
+static void transform_sse2_x4(uint32_t *state, const unsigned char *const *blocks)
+{
+	__m128i s[8], w[16], v[8], t1, t2;
+	int i, t;
+
+	for (i = 0; i < 8; i++)
+		v[i] = s[i] = _mm_loadu_si128((const __m128i *)&state[i * 4]);
+
+#pragma GCC unroll 64
+	for (t = 0; t < 64; t++) {
+		if (t < 16) {
+			w[t] = _mm_set_epi32(load_be32(blocks[3] + t * 4),
+					     load_be32(blocks[2] + t * 4),
+					     load_be32(blocks[1] + t * 4),
+					     load_be32(blocks[0] + t * 4));
+		} else {
+			__m128i w2 = w[(t - 2) & 15], w15 = w[(t - 15) & 15];
+			__m128i s1 = _mm_xor_si128(_mm_xor_si128(ROTR4(w2, 17), ROTR4(w2, 19)), _mm_srli_epi32(w2, 10));
+			__m128i s0 = _mm_xor_si128(_mm_xor_si128(ROTR4(w15, 7), ROTR4(w15, 18)), _mm_srli_epi32(w15, 3));
+			w[t & 15] = _mm_add_epi32(_mm_add_epi32(w[t & 15], s1), _mm_add_epi32(w[(t - 7) & 15], s0));
+		}
+
+		/* t1 = h + Sigma1(e) + Ch(e, f, g) + k + w */
+		t1 = _mm_xor_si128(_mm_xor_si128(ROTR4(v[4], 6), ROTR4(v[4], 11)), ROTR4(v[4], 25));
+		t1 = _mm_add_epi32(t1, _mm_xor_si128(v[6], _mm_and_si128(v[4], _mm_xor_si128(v[5], v[6]))));
+		t1 = _mm_add_epi32(_mm_add_epi32(t1, v[7]), _mm_add_epi32(_mm_set1_epi32(K[t]), w[t & 15]));
+		/* t2 = Sigma0(a) + Maj(a, b, c) */
+		t2 = _mm_xor_si128(_mm_xor_si128(ROTR4(v[0], 2), ROTR4(v[0], 13)), ROTR4(v[0], 22));
+		t2 = _mm_add_epi32(t2, _mm_or_si128(_mm_and_si128(v[0], v[1]), _mm_and_si128(v[2], _mm_or_si128(v[0], v[1]))));
+
+		v[7] = v[6]; v[6] = v[5]; v[5] = v[4];
+		v[4] = _mm_add_epi32(v[3], t1);
+		v[3] = v[2]; v[2] = v[1]; v[1] = v[0];
+		v[0] = _mm_add_epi32(t1, t2);
+	}
+
+	for (i = 0; i < 8; i++)
+		_mm_storeu_si128((__m128i *)&state[i * 4], _mm_add_epi32(s[i], v[i]));
+}
+
+#define ROTR8(x, n) _mm256_or_si256(_mm256_srli_epi32(x, n), _mm256_slli_epi32(x, 32 - (n)))
+
+__attribute__((target("avx2")))
+static void transform_avx2_x8(uint32_t *state, const unsigned char *const *blocks)
+{
+	__m256i s[8], w[16], v[8], t1, t2;
+	int i, t;
+
+	for (i = 0; i < 8; i++)
+		v[i] = s[i] = _mm256_loadu_si256((const __m256i *)&state[i * 8]);
+
+#pragma GCC unroll 64
+	for (t = 0; t < 64; t++) {
+		if (t < 16) {
+			w[t] = _mm256_set_epi32(load_be32(blocks[7] + t * 4),
+						load_be32(blocks[6] + t * 4),
+						load_be32(blocks[5] + t * 4),
+						load_be32(blocks[4] + t * 4),
+						load_be32(blocks[3] + t * 4),
+						load_be32(blocks[2] + t * 4),
+						load_be32(blocks[1] + t * 4),
+						load_be32(blocks[0] + t * 4));
+		} else {
+			__m256i w2 = w[(t - 2) & 15], w15 = w[(t - 15) & 15];
+			__m256i s1 = _mm256_xor_si256(_mm256_xor_si256(ROTR8(w2, 17), ROTR8(w2, 19)), _mm256_srli_epi32(w2, 10));
+			__m256i s0 = _mm256_xor_si256(_mm256_xor_si256(ROTR8(w15, 7), ROTR8(w15, 18)), _mm256_srli_epi32(w15, 3));
+			w[t & 15] = _mm256_add_epi32(_mm256_add_epi32(w[t & 15], s1), _mm256_add_epi32(w[(t - 7) & 15], s0));
+		}
+
+		t1 = _mm256_xor_si256(_mm256_xor_si256(ROTR8(v[4], 6), ROTR8(v[4], 11)), ROTR8(v[4], 25));
+		t1 = _mm256_add_epi32(t1, _mm256_xor_si256(v[6], _mm256_and_si256(v[4], _mm256_xor_si256(v[5], v[6]))));
+		t1 = _mm256_add_epi32(_mm256_add_epi32(t1, v[7]), _mm256_add_epi32(_mm256_set1_epi32(K[t]), w[t & 15]));
+		t2 = _mm256_xor_si256(_mm256_xor_si256(ROTR8(v[0], 2), ROTR8(v[0], 13)), ROTR8(v[0], 22));
+		t2 = _mm256_add_epi32(t2, _mm256_or_si256(_mm256_and_si256(v[0], v[1]), _mm256_and_si256(v[2], _mm256_or_si256(v[0], v[1]))));
+
+		v[7] = v[6]; v[6] = v[5]; v[5] = v[4];
+		v[4] = _mm256_add_epi32(v[3], t1);
+		v[3] = v[2]; v[2] = v[1]; v[1] = v[0];
+		v[0] = _mm256_add_epi32(t1, t2);
+	}
+
+	for (i = 0; i < 8; i++)
+		_mm256_storeu_si256((__m256i *)&state[i * 8], _mm256_add_epi32(s[i], v[i]));
+}
+
+/* Intel SHA extensions, one message at a time. Based on the public domain
+ * sha256-x86.c by Jeffrey Walton. */
+__attribute__((target("sha,sse4.1,ssse3")))
+static void transform_shani_blocks(uint32_t *state, const unsigned char *data, size_t blocks)
+{
+	const __m128i MASK = _mm_set_epi64x(0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL);
+	__m128i STATE0, STATE1, MSG, TMP, ABEF_SAVE, CDGH_SAVE;
+	__m128i M[4];
+	int i;
+
+	TMP = _mm_loadu_si128((const __m128i *)&state[0]);
+	STATE1 = _mm_loadu_si128((const __m128i *)&state[4]);
+
+	TMP = _mm_shuffle_epi32(TMP, 0xB1);          /* CDAB */
+	STATE1 = _mm_shuffle_epi32(STATE1, 0x1B);    /* EFGH */
+	STATE0 = _mm_alignr_epi8(TMP, STATE1, 8);    /* ABEF */
+	STATE1 = _mm_blend_epi16(STATE1, TMP, 0xF0); /* CDGH */
+
+	for (; blocks; blocks--, data += 64) {
+		ABEF_SAVE = STATE0;
+		CDGH_SAVE = STATE1;
+
+#pragma GCC unroll 16
+		for (i = 0; i < 16; i++) {
+			if (i < 4)
+				M[i] = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(data + i * 16)), MASK);
+
+			MSG = _mm_add_epi32(M[i & 3], _mm_loadu_si128((const __m128i *)&K[i * 4]));
+			STATE1 = _mm_sha256rnds2_epu32(STATE1, STATE0, MSG);
+			if (i >= 3 && i <= 14) {
+				TMP = _mm_alignr_epi8(M[i & 3], M[(i - 1) & 3], 4);
+				M[(i + 1) & 3] = _mm_add_epi32(M[(i + 1) & 3], TMP);
+				M[(i + 1) & 3] = _mm_sha256msg2_epu32(M[(i + 1) & 3], M[i & 3]);
+			}
+			MSG = _mm_shuffle_epi32(MSG, 0x0E);
+			STATE0 = _mm_sha256rnds2_epu32(STATE0, STATE1, MSG);
+			if (i >= 1 && i <= 12)
+				M[(i - 1) & 3] = _mm_sha256msg1_epu32(M[(i - 1) & 3], M[i & 3]);
+		}
+
+		STATE0 = _mm_add_epi32(STATE0, ABEF_SAVE);
+		STATE1 = _mm_add_epi32(STATE1, CDGH_SAVE);
+	}
+
+	TMP = _mm_shuffle_epi32(STATE0, 0x1B);       /* FEBA */
+	STATE1 = _mm_shuffle_epi32(STATE1, 0xB1);    /* DCHG */
+	STATE0 = _mm_blend_epi16(TMP, STATE1, 0xF0); /* DCBA */
+	STATE1 = _mm_alignr_epi8(STATE1, TMP, 8);    /* ABEF */
+
+	_mm_storeu_si128((__m128i *)&state[0], STATE0);
+	_mm_storeu_si128((__m128i *)&state[4], STATE1);
+}
+
+static void transform_shani_x1(uint32_t *state, const unsigned char *const *blocks)
+{
+	transform_shani_blocks(state, blocks[0], 1);
+}
+
+static void Transform_shani(uint32_t *s, const uint32_t *chunk)
+{
+	transform_shani_blocks(s, (const unsigned char *)chunk, 1);
+}
+
+static int cpu_has_shani(void)
+{
+	unsigned int a, b, c, d;
+
+	if (!__get_cpuid(1, &a, &b, &c, &d))
+		return 0;
+	/* SSSE3 and SSE4.1 */
+	if (!(c & (1 << 9)) || !(c & (1 << 19)))
+		return 0;
+	if (!__get_cpuid_count(7, 0, &a, &b, &c, &d))
+		return 0;
+	return (b >> 29) & 1;
+}
+#endif /* SHA256_X86_KERNELS */
+
+static int kernel_supported(enum sha256_kernel kernel)
+{
+	switch (kernel) {
+	case SHA256_KERNEL_AUTO:
+	case SHA256_KERNEL_SCALAR:
+		return 1;
+#ifdef SHA256_X86_KERNELS
+	case SHA256_KERNEL_SSE2_4WAY:
+		return 1;
+	case SHA256_KERNEL_AVX2_8WAY:
+		return __builtin_cpu_supports("avx2");
+	case SHA256_KERNEL_SHANI:
+		return cpu_has_shani();
+#endif
+	default:
+		return 0;
+	}
+}
+
+static enum sha256_kernel best_kernel(void)
+{
+	/* a single SHA-NI stream beats 8 AVX2 lanes on every cpu that has
+	 * both, so prefer it */
+	static const enum sha256_kernel order[] = {
+		SHA256_KERNEL_SHANI,
+		SHA256_KERNEL_AVX2_8WAY,
+		SHA256_KERNEL_SSE2_4WAY,
+	};
+	size_t i;
+
+	for (i = 0; i < sizeof(order) / sizeof(order[0]); i++) {
+		if (kernel_supported(order[i]))
+			return order[i];
+	}
+	return SHA256_KERNEL_SCALAR;
+}
+
+/* Both are chosen once by select_kernels() before main() runs, so threads
+ * only ever read them. Without the x86 kernels they keep these values. */
+static enum sha256_kernel selected_kernel = SHA256_KERNEL_SCALAR;
+static void (*transform)(uint32_t *s, const uint32_t *chunk) = Transform;
+
+static enum sha256_kernel current_kernel(void)
+{
+	return selected_kernel;
+}
+
+#ifdef SHA256_X86_KERNELS
+/* Single stream hashing uses SHA-NI when present, the multi-lane kernels
+ * only help when there are several messages. */
+__attribute__((constructor))
+static void select_kernels(void)
+{
+	/* constructors can run before libgcc has read the cpu features */
+	__builtin_cpu_init();
+	selected_kernel = best_kernel();
+	if (kernel_supported(SHA256_KERNEL_SHANI))
+		transform = Transform_shani;
+}
+#endif
+
+
 static void add(struct sha256_ctx *ctx, const void *p, size_t len)
 {
 	const unsigned char *data = p;
@@ -179,17 +473,17 @@ static void add(struct sha256_ctx *ctx, const void *p, size_t len)
 		ctx->bytes += 64 - bufsize;
 		data += 64 - bufsize;
 		len -= 64 - bufsize;
-		Transform(ctx->s, ctx->buf.u32);
+		transform(ctx->s, ctx->buf.u32);
 		bufsize = 0;
 	}
 
 	while (len >= 64) {
 		/* Process full chunks directly from the source. */
 		if (alignment_ok(data, sizeof(uint32_t)))
-			Transform(ctx->s, (const uint32_t *)data);
+			transform(ctx->s, (const uint32_t *)data);
 		else {
 			memcpy(ctx->buf.u8, data, sizeof(ctx->buf));
-			Transform(ctx->s, ctx->buf.u32);
+			transform(ctx->s, ctx->buf.u32);
 		}
 		ctx->bytes += 64;
 		data += 64;
@@ -230,6 +524,106 @@ void sha256_done(struct sha256_ctx *ctx, struct sha256 *res)
 		res->u.u32[i] = cpu_to_be32(ctx->s[i]);
 	invalidate_sha256(ctx);
 }
+
+int sha256_kernel_supported(enum sha256_kernel kernel)
+{
+	return kernel_supported(kernel);
+}
+
+const char *sha256_kernel_name(enum sha256_kernel kernel)
+{
+	switch (kernel == SHA256_KERNEL_AUTO ? current_kernel() : kernel) {
+	case SHA256_KERNEL_SCALAR:    return "scalar";
+	case SHA256_KERNEL_SSE2_4WAY: return "sse2-4way";
+	case SHA256_KERNEL_AVX2_8WAY: return "avx2-8way";
+	case SHA256_KERNEL_SHANI:     return "sha-ni";
+	default:                      return "unknown";
+	}
+}
+
+int sha256_set_kernel(enum sha256_kernel kernel)
+{
+	if (!kernel_supported(kernel))
+		return 0;
+	selected_kernel = kernel == SHA256_KERNEL_AUTO ? best_kernel() : kernel;
+	return 1;
+}
+
+/* Hash messages `lanes` at a time. Full blocks are read straight from the
+ * messages, only the final padded block(s) are copied. Unused lanes of the
+ * last group repeat lane 0 and their output is dropped. */
+static void many_lanes(size_t lanes, multi_transform_fn fn,
+		       struct sha256 *res, const struct sha256_ctx *start,
+		       const unsigned char *const *msgs, size_t len, size_t n)
+{
+	uint32_t state[8 * 8];
+	unsigned char pad[8][128];
+	const unsigned char *blocks[8];
+	size_t full = len / 64, rem = len % 64;
+	size_t nfinal = rem + 9 > 64 ? 2 : 1;
+	uint64_t bits = ((uint64_t)start->bytes + len) << 3;
+	size_t i, l, m, b, w;
+
+	for (i = 0; i < n; i += lanes) {
+		m = n - i < lanes ? n - i : lanes;
+
+		for (w = 0; w < 8; w++)
+			for (l = 0; l < lanes; l++)
+				state[w * lanes + l] = start->s[w];
+
+		for (b = 0; b < full; b++) {
+			for (l = 0; l < lanes; l++)
+				blocks[l] = msgs[i + (l < m ? l : 0)] + b * 64;
+			fn(state, blocks);
+		}
+
+		for (l = 0; l < m; l++) {
+			memcpy(pad[l], msgs[i + l] + full * 64, rem);
+			pad[l][rem] = 0x80;
+			memset(pad[l] + rem + 1, 0, nfinal * 64 - rem - 1 - 8);
+			for (b = 0; b < 8; b++)
+				pad[l][nfinal * 64 - 1 - b] = bits >> (8 * b);
+		}
+
+		for (b = 0; b < nfinal; b++) {
+			for (l = 0; l < lanes; l++)
+				blocks[l] = pad[l < m ? l : 0] + b * 64;
+			fn(state, blocks);
+		}
+
+		for (l = 0; l < m; l++)
+			for (w = 0; w < 8; w++)
+				res[i + l].u.u32[w] = cpu_to_be32(state[w * lanes + l]);
+	}
+}
+
+void sha256_many(struct sha256 *res, const struct sha256_ctx *start,
+		 const unsigned char *const *msgs, size_t len, size_t n)
+{
+	struct sha256_ctx init = SHA256_INIT;
+
+	if (!start)
+		start = &init;
+
+	check_sha256((struct sha256_ctx *)start);
+	assert(start->bytes % 64 == 0);
+
+	switch (current_kernel()) {
+#ifdef SHA256_X86_KERNELS
+	case SHA256_KERNEL_SSE2_4WAY:
+		many_lanes(4, transform_sse2_x4, res, start, msgs, len, n);
+		return;
+	case SHA256_KERNEL_AVX2_8WAY:
+		many_lanes(8, transform_avx2_x8, res, start, msgs, len, n);
+		return;
+	case SHA256_KERNEL_SHANI:
+		many_lanes(1, transform_shani_x1, res, start, msgs, len, n);
+		return;
+#endif
+	default:
+		many_lanes(1, transform_scalar_x1, res, start, msgs, len, n);
+	}
+}
 #endif
 
 void sha256(struct sha256 *sha, const void *p, size_t size)
@@ -152,4 +152,61 @@ void sha256_be16(struct sha256_ctx *ctx, uint16_t v);
 void sha256_be32(struct sha256_ctx *ctx, uint32_t v);
 void sha256_be64(struct sha256_ctx *ctx, uint64_t v);
 
+/**
+ * enum sha256_kernel - implementations available to sha256_many()
+ *
+ * SHA256_KERNEL_AUTO picks the fastest one the cpu supports at runtime.
+ */
+enum sha256_kernel {
+	SHA256_KERNEL_AUTO,
+	SHA256_KERNEL_SCALAR,
+	SHA256_KERNEL_SSE2_4WAY,
+	SHA256_KERNEL_AVX2_8WAY,
+	SHA256_KERNEL_SHANI,
+	SHA256_KERNEL_COUNT
+};
+
+/**
+ * sha256_kernel_supported - can this kernel run on the current cpu?
+ * @kernel: the kernel to check
+ */
+int sha256_kernel_supported(enum sha256_kernel kernel);
+
+/**
+ * sha256_kernel_name - human readable name of a kernel
+ * @kernel: the kernel, SHA256_KERNEL_AUTO resolves to the selected one
+ */
+const char *sha256_kernel_name(enum sha256_kernel kernel);
+
+/**
+ * sha256_set_kernel - force the kernel used by sha256_many()
+ * @kernel: the kernel to use, or SHA256_KERNEL_AUTO
+ *
+ * Returns 0 if the kernel isn't supported on this cpu. This is meant
+ * for benchmarks and tests and isn't thread safe.
+ */
+int sha256_set_kernel(enum sha256_kernel kernel);
+
+/**
+ * sha256_many - hash several equal-length messages at once
+ * @res: array of @n hashes to fill in
+ * @start: state every message continues from, or NULL to start fresh.
+ *         It must have consumed a multiple of 64 bytes.
+ * @msgs: array of @n pointers to @len bytes each
+ * @len: the length of every message
+ * @n: the number of messages
+ *
+ * This is equivalent to copying @start, then sha256_update() and
+ * sha256_done() for each message, but the messages are interleaved across
+ * SIMD lanes when the cpu allows it.
+ *
+ * Example:
+ *	// hash the same prefix with four different 8 byte suffixes
+ *	struct sha256_ctx mid = SHA256_INIT;
+ *	sha256_update(&mid, prefix, 64);
+ *	sha256_many(hashes, &mid, suffixes, 8, 4);
+ */
+void sha256_many(struct sha256 *res, const struct sha256_ctx *start,
+		 const unsigned char *const *msgs, size_t len, size_t n);
+
 #endif /* CCAN_CRYPTO_SHA256_H */
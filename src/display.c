@@ -745,18 +745,26 @@ get_input_char(void)
 	return getc(opt_tty.file);
 }
 
+/* How long to wait for keys while the views wait for their pipes. */
+#define UPDATE_VIEWS_WAIT	10
+
 static bool
-update_views(void)
+update_views(bool *ready)
 {
 	struct view *view;
 	int i;
 	bool is_loading = false;
 
+	*ready = false;
+
 	foreach_view (view, i) {
+		bool changed = view_is_displayed(view) && view->watch.changed;
+
 		update_view(view);
-		if (view->pipe ||
-		    (view_is_displayed(view) && view->watch.changed))
+		if (view_is_loading(view) || changed)
 			is_loading = true;
+		if (view_has_lines_ready(view) || changed)
+			*ready = true;
 	}
 
 	return is_loading;
@@ -775,6 +783,7 @@ get_input(int prompt_position, struct key *key)
 
 	while (true) {
 		int delay = -1;
+		bool loading, ready;
 
 		if (opt_refresh_mode != REFRESH_MODE_MANUAL) {
 			bool refs_refreshed = false;
@@ -794,8 +803,9 @@ get_input(int prompt_position, struct key *key)
 			}
 		}
 
-		if (update_views())
-			delay = 0;
+		loading = update_views(&ready);
+		if (loading)
+			delay = ready ? 0 : UPDATE_VIEWS_WAIT;
 
 		/* Update the cursor position. */
 		if (prompt_position) {
@@ -811,7 +821,12 @@ get_input(int prompt_position, struct key *key)
 
 		if (is_script_executing()) {
 			/* Wait for the current command to complete. */
-			if (delay == 0 || !read_script(key))
+			if (loading) {
+				if (!ready)
+					napms(1);
+				continue;
+			}
+			if (!read_script(key))
 				continue;
 			return key->modifiers.multibytes ? OK : key->data.value;
 
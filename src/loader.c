@@ -0,0 +1,342 @@
+/* Copyright (c) 2006-2024 Jonas Fonseca <jonas.fonseca@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include "tig/tig.h"
+#include "tig/io.h"
+#include "tig/loader.h"
+
+#include <poll.h>
+#include <pthread.h>
+#include <stdatomic.h>
+
+#define LOADER_QUEUE_SIZE	64	/* Batches in flight, a power of two. */
+#define LOADER_BATCH_SIZE	(64 * 1024)
+#define LOADER_FULL_WAIT	10	/* Milliseconds between checks of a full queue. */
+#define LOADER_IDLE_WAIT	5	/* Milliseconds to wait for more before handing over lines. */
+
+struct loader_batch {
+	char *data;		/* Lines separated by newlines and NUL terminated. */
+	size_t size;
+	size_t alloc;
+	size_t pos;		/* Start of the next line to hand out. */
+};
+
+struct loader {
+	pthread_t thread;
+	struct io *io;
+	int wakeup[2];		/* Written to when the loader must stop or resume. */
+	atomic_bool stop;
+	atomic_bool paused;	/* Leave the pipe alone until resumed. */
+	atomic_bool done;	/* Set after the last batch has been queued. */
+
+	/* The loader only advances tail and the UI only advances head. */
+	struct loader_batch *queue[LOADER_QUEUE_SIZE];
+	atomic_size_t head;
+	atomic_size_t tail;
+
+	struct loader_batch *batch;	/* The batch the UI is reading from. */
+};
+
+static void
+loader_batch_free(struct loader_batch *batch)
+{
+	if (batch)
+		free(batch->data);
+	free(batch);
+}
+
+static bool
+loader_batch_reserve(struct loader_batch *batch, size_t size)
+{
+	size_t alloc = batch->alloc ? batch->alloc : LOADER_BATCH_SIZE + BUFSIZ;
+	char *data;
+
+	/* Keep room for the NUL terminating the last line. */
+	while (alloc < size + 1)
+		alloc *= 2;
+	if (alloc == batch->alloc)
+		return true;
+
+	data = realloc(batch->data, alloc);
+	if (!data)
+		return false;
+	batch->data = data;
+	batch->alloc = alloc;
+	return true;
+}
+
+static void
+loader_wakeup(struct loader *loader)
+{
+	while (write(loader->wakeup[1], "", 1) == -1 && errno == EINTR)
+		;
+}
+
+/* Wait for input on fd, or for timeout milliseconds, unless the loader is
+ * told to stop. Being resumed also ends the wait. */
+static int
+loader_wait(struct loader *loader, int fd, int timeout)
+{
+	struct pollfd fds[] = {
+		{ loader->wakeup[0], POLLIN },
+		{ fd, POLLIN },
+	};
+	int ready;
+
+	do {
+		if (atomic_load(&loader->stop))
+			return -1;
+		ready = poll(fds, ARRAY_SIZE(fds), timeout);
+	} while (ready < 0 && errno == EINTR);
+
+	if (ready < 0 || atomic_load(&loader->stop))
+		return -1;
+
+	if (fds[0].revents) {
+		char buf[32];
+
+		while (read(loader->wakeup[0], buf, sizeof(buf)) > 0)
+			;
+	}
+
+	return fds[1].revents != 0;
+}
+
+/* Queue the complete lines of the batch and start the next batch with the
+ * rest. */
+static bool
+loader_push(struct loader *loader, struct loader_batch **batch_ptr, size_t lines_end)
+{
+	struct loader_batch *batch = *batch_ptr;
+	struct loader_batch *next = calloc(1, sizeof(*next));
+	size_t rest = batch->size - lines_end;
+	size_t tail = atomic_load_explicit(&loader->tail, memory_order_relaxed);
+
+	if (!next || !loader_batch_reserve(next, rest)) {
+		loader_batch_free(next);
+		loader->io->error = ENOMEM;
+		return false;
+	}
+
+	memcpy(next->data, batch->data + lines_end, rest);
+	next->size = rest;
+	batch->size = lines_end;
+	batch->data[lines_end] = 0;
+
+	while (tail - atomic_load_explicit(&loader->head, memory_order_acquire) == LOADER_QUEUE_SIZE) {
+		if (loader_wait(loader, -1, LOADER_FULL_WAIT) < 0) {
+			loader_batch_free(next);
+			return false;
+		}
+	}
+
+	loader->queue[tail % LOADER_QUEUE_SIZE] = batch;
+	atomic_store_explicit(&loader->tail, tail + 1, memory_order_release);
+	*batch_ptr = next;
+	return true;
+}
+
+static size_t
+find_lines_end(const char *data, size_t from, size_t to, size_t lines_end)
+{
+	while (to > from) {
+		if (data[--to] == '\n')
+			return to + 1;
+	}
+
+	return lines_end;
+}
+
+static void *
+loader_run(void *data)
+{
+	struct loader *loader = data;
+	struct io *io = loader->io;
+	struct loader_batch *batch = calloc(1, sizeof(*batch));
+	size_t lines_end = 0;
+
+	if (!batch || !loader_batch_reserve(batch, LOADER_BATCH_SIZE))
+		io->error = ENOMEM;
+
+	while (!io_eof(io) && !io_error(io)) {
+		/* While paused, nothing more is read so the pipe fills up and
+		 * the writer blocks until the view wants more lines. */
+		if (atomic_load(&loader->paused)) {
+			if (lines_end && !loader_push(loader, &batch, lines_end))
+				break;
+			lines_end = 0;
+			if (loader_wait(loader, -1, -1) < 0)
+				break;
+			continue;
+		}
+
+		/* Hand over the complete lines once the pipe has been idle for
+		 * a while or the batch is full, otherwise keep reading. */
+		int ready = loader_wait(loader, io->pipe, lines_end ? LOADER_IDLE_WAIT : -1);
+		ssize_t readsize;
+
+		if (ready < 0)
+			break;
+
+		if (!ready || batch->size >= LOADER_BATCH_SIZE) {
+			if (lines_end && !loader_push(loader, &batch, lines_end))
+				break;
+			lines_end = 0;
+			if (!ready)
+				continue;
+		}
+
+		if (!loader_batch_reserve(batch, batch->size + BUFSIZ)) {
+			io->error = ENOMEM;
+			break;
+		}
+
+		readsize = io_read(io, batch->data + batch->size, batch->alloc - batch->size - 1);
+		if (readsize > 0) {
+			lines_end = find_lines_end(batch->data, batch->size, batch->size + readsize, lines_end);
+			batch->size += readsize;
+		}
+	}
+
+	/* The last line does not have to end with a newline. */
+	if (io_eof(io) && batch && batch->size)
+		loader_push(loader, &batch, batch->size);
+
+	loader_batch_free(batch);
+	atomic_store_explicit(&loader->done, true, memory_order_release);
+	return NULL;
+}
+
+bool
+loader_start(struct loader **loader_ptr, struct io *io)
+{
+	struct loader *loader = calloc(1, sizeof(*loader));
+	sigset_t blocked, old;
+	int i, error;
+
+	if (!loader)
+		return false;
+
+	loader->io = io;
+	if (pipe(loader->wakeup) == -1) {
+		free(loader);
+		return false;
+	}
+
+	/* Don't leak the wakeup pipe to processes started while loading. */
+	for (i = 0; i < ARRAY_SIZE(loader->wakeup); i++)
+		fcntl(loader->wakeup[i], F_SETFD, FD_CLOEXEC);
+	fcntl(loader->wakeup[0], F_SETFL, O_NONBLOCK);
+
+	/* Leave signals, like SIGWINCH, to the UI thread. */
+	sigfillset(&blocked);
+	pthread_sigmask(SIG_SETMASK, &blocked, &old);
+	error = pthread_create(&loader->thread, NULL, loader_run, loader);
+	pthread_sigmask(SIG_SETMASK, &old, NULL);
+
+	if (error) {
+		close(loader->wakeup[0]);
+		close(loader->wakeup[1]);
+		free(loader);
+		errno = error;
+		return false;
+	}
+
+	*loader_ptr = loader;
+	return true;
+}
+
+bool
+loader_get_line(struct loader *loader, struct buffer *buf)
+{
+	struct loader_batch *batch = loader->batch;
+	char *eol;
+
+	if (batch && batch->pos >= batch->size) {
+		loader_batch_free(batch);
+		loader->batch = batch = NULL;
+	}
+
+	if (!batch) {
+		size_t head = atomic_load_explicit(&loader->head, memory_order_relaxed);
+
+		if (head == atomic_load_explicit(&loader->tail, memory_order_acquire))
+			return false;
+
+		batch = loader->batch = loader->queue[head % LOADER_QUEUE_SIZE];
+		atomic_store_explicit(&loader->head, head + 1, memory_order_release);
+	}
+
+	buf->data = batch->data + batch->pos;
+	eol = memchr(buf->data, '\n', batch->size - batch->pos);
+	if (eol) {
+		*eol = 0;
+		buf->size = eol - buf->data;
+		batch->pos += buf->size + 1;
+	} else {
+		buf->size = batch->size - batch->pos;
+		batch->pos = batch->size;
+	}
+
+	return true;
+}
+
+bool
+loader_has_lines(struct loader *loader)
+{
+	return (loader->batch && loader->batch->pos < loader->batch->size) ||
+	       atomic_load_explicit(&loader->head, memory_order_relaxed) !=
+	       atomic_load_explicit(&loader->tail, memory_order_acquire);
+}
+
+/* Everything has been read from the pipe and handed out. The pipe's EOF
+ * and error state can be checked after loader_stop(). */
+bool
+loader_is_done(struct loader *loader)
+{
+	return atomic_load_explicit(&loader->done, memory_order_acquire) &&
+	       !loader_has_lines(loader);
+}
+
+void
+loader_pause(struct loader *loader, bool pause)
+{
+	if (atomic_exchange(&loader->paused, pause) && !pause)
+		loader_wakeup(loader);
+}
+
+void
+loader_stop(struct loader **loader_ptr)
+{
+	struct loader *loader = *loader_ptr;
+	size_t head;
+
+	if (!loader)
+		return;
+
+	atomic_store(&loader->stop, true);
+	loader_wakeup(loader);
+	pthread_join(loader->thread, NULL);
+
+	head = atomic_load(&loader->head);
+	while (head != atomic_load(&loader->tail))
+		loader_batch_free(loader->queue[head++ % LOADER_QUEUE_SIZE]);
+	loader_batch_free(loader->batch);
+
+	close(loader->wakeup[0]);
+	close(loader->wakeup[1]);
+	free(loader);
+	*loader_ptr = NULL;
+}
+
+/* vim: set ts=8 sw=8 noexpandtab: */
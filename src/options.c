@@ -721,6 +721,8 @@ parse_option(struct option_info *option, const char *prefix, const char *arg)
 			return parse_int(option->value, arg, 1, 1024);
 		else if (!strcmp(name, "id-width"))
 			return parse_int(option->value, arg, 0, SIZEOF_REV - 1);
+		else if (!strcmp(name, "load-ahead"))
+			return parse_int(option->value, arg, 0, 999999);
 		else
 			return parse_int(option->value, arg, 0, 1024);
 	}
@@ -927,6 +927,9 @@ run_prompt_command(struct view *view, const char *argv[])
 				lineno = 1;
 			select_view_line(view, lineno - 1);
 			report_clear();
+		} else if (view->pipe) {
+			view->load_all = true;
+			report("Line %s has not been loaded yet", cmd);
 		} else {
 			report("Unable to parse '%s' as a line number", cmd);
 		}
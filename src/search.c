@@ -138,6 +138,10 @@ find_next_match(struct view *view, enum request request)
 		return setup_and_find_next(view, request);
 	}
 
+	/* Search everything, not only the lines loaded so far. */
+	if (view->pipe)
+		view->load_all = true;
+
 	switch (request) {
 	case REQ_SEARCH:
 	case REQ_FIND_NEXT:
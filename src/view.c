@@ -20,6 +20,7 @@
 #include "tig/search.h"
 #include "tig/draw.h"
 #include "tig/display.h"
+#include "tig/loader.h"
 
 /*
  * Navigation
@@ -201,6 +202,8 @@ move_view(struct view *view, enum request request)
 
 	case REQ_MOVE_LAST_LINE:
 		steps = view->lines - view->pos.lineno - 1;
+		if (view->pipe)
+			view->load_all = view->load_to_end = true;
 		break;
 
 	case REQ_MOVE_PAGE_UP:
@@ -373,6 +376,9 @@ goto_id(struct view *view, const char *expr, bool from_start, bool save_search)
 		}
 	}
 
+	/* The commit may come later in a view that is still loading. */
+	if (view->pipe)
+		view->load_all = true;
 	report("Unable to find commit '%s'", id);
 }
 
@@ -496,6 +502,11 @@ end_update(struct view *view, bool force)
 {
 	if (!view->pipe)
 		return;
+	/* Lines left on the pipe, e.g. because load-ahead paused it, mean
+	 * the view has to be loaded again the next time it is opened. */
+	if (force && (!view->loader || !loader_is_done(view->loader)))
+		view->unfinished = true;
+	loader_stop(&view->loader);
 	while (!view->ops->read(view, NULL, force))
 		if (!force)
 			return;
@@ -512,13 +523,16 @@ setup_update(struct view *view, const char *vid)
 	/* XXX: Do not use string_copy_rev(), it copies until first space. */
 	string_ncopy(view->vid, vid, strlen(vid));
 	view->pipe = &view->io;
+	view->load_all = false;
+	view->load_to_end = false;
+	view->unfinished = false;
 	view->start_time = time(NULL);
 }
 
 static bool
 view_no_refresh(struct view *view, enum open_flags flags)
 {
-	bool reload = !!(flags & OPEN_ALWAYS_LOAD) || !view->lines;
+	bool reload = !!(flags & OPEN_ALWAYS_LOAD) || !view->lines || view->unfinished;
 
 	return (!reload && !strcmp(view->vid, view->ops->id)) ||
 	       ((flags & OPEN_REFRESH) && !view_can_refresh(view));
@@ -581,6 +595,7 @@ begin_update(struct view *view, const char *dir, const char **argv, enum open_fl
 		return SUCCESS;
 
 	if (view->pipe) {
+		loader_stop(&view->loader);
 		if (extra)
 			io_done(view->pipe);
 		else
@@ -618,20 +633,76 @@ begin_update(struct view *view, const char *dir, const char **argv, enum open_fl
 	return SUCCESS;
 }
 
+/* Lines are parsed in slices of this many microseconds so keys are read
+ * between slices while a large view is loading. */
+#define UPDATE_VIEW_SLICE	20000
+
+static bool
+update_view_slice_expired(struct timeval *start)
+{
+	struct timeval now;
+
+	gettimeofday(&now, NULL);
+	return (now.tv_sec - start->tv_sec) * 1000000 + now.tv_usec - start->tv_usec
+		>= UPDATE_VIEW_SLICE;
+}
+
+/* Whether the view holds load-ahead lines past what is shown, or past the
+ * position it is being restored to, so reading can wait. */
+static bool
+view_has_enough_lines(struct view *view)
+{
+	unsigned long lines = view->pos.offset + view->height;
+
+	if (!opt_load_ahead || view->load_all || !view_has_flags(view, VIEW_LOG_LIKE))
+		return false;
+
+	if (check_position(&view->prev_pos))
+		lines = MAX(lines, view->prev_pos.lineno + view->height);
+
+	return view->lines >= lines + opt_load_ahead;
+}
+
+bool
+view_is_loading(struct view *view)
+{
+	return view->pipe && !view_has_enough_lines(view);
+}
+
+/* Whether update_view() has something to do besides waiting. */
+bool
+view_has_lines_ready(struct view *view)
+{
+	return view_is_loading(view) &&
+	       (!view->loader || loader_has_lines(view->loader) || loader_is_done(view->loader));
+}
+
 bool
 update_view(struct view *view)
 {
 	/* Clear the view and redraw everything since the tree sorting
 	 * might have rearranged things. */
 	bool redraw = view->lines == 0;
-	bool can_read = true;
 	struct encoding *encoding = view->encoding ? view->encoding : default_encoding;
 	struct buffer line;
+	struct timeval start;
+	size_t lines, last;
 
 	if (!view->pipe)
 		return true;
 
-	if (!io_can_read(view->pipe, false)) {
+	/* The pipe is new, or was replaced by a view asking for more. */
+	if (!view->loader && !io_eof(view->pipe) && !io_error(view->pipe) &&
+	    !loader_start(&view->loader, view->pipe)) {
+		report("Failed to start loading: %s", strerror(errno));
+		end_update(view, true);
+		return false;
+	}
+
+	if (view->loader)
+		loader_pause(view->loader, !view_is_loading(view));
+
+	if (!view_has_lines_ready(view)) {
 		if (view->lines == 0 && view_is_displayed(view)) {
 			time_t secs = time(NULL) - view->start_time;
 
@@ -645,7 +716,10 @@ update_view(struct view *view)
 		return true;
 	}
 
-	for (; io_get(view->pipe, &line, '\n', can_read); can_read = false) {
+	gettimeofday(&start, NULL);
+	last = view->lines;
+
+	for (lines = 1; view->loader && loader_get_line(view->loader, &line); lines++) {
 		if (encoding && !encoding_convert(encoding, &line))
 			report("Encoding failure");
 
@@ -654,14 +728,38 @@ update_view(struct view *view)
 			end_update(view, true);
 			return false;
 		}
+
+		if (!view_is_loading(view) ||
+		    (lines % 64 == 0 && update_view_slice_expired(&start)))
+			break;
 	}
 
-	if (io_error(view->pipe)) {
-		report("Failed to read: %s", io_strerror(view->pipe));
-		end_update(view, true);
+	/* Keep the last line selected after <End> unless it was moved
+	 * away from while the rest was loading. */
+	if (view->load_to_end) {
+		if (view->pos.lineno + 1 == last && view->lines > last) {
+			unsigned long offset = view->lines > view->height ? view->lines - view->height : 0;
+
+			if (goto_view_line(view, offset, view->lines - 1)) {
+				if (view_is_displayed(view))
+					werase(view->win);
+				redraw = true;
+			}
+		} else if (view->pos.lineno + 1 != last) {
+			view->load_to_end = false;
+		}
+	}
 
-	} else if (io_eof(view->pipe)) {
-		end_update(view, false);
+	if (view->pipe && (!view->loader || loader_is_done(view->loader))) {
+		loader_stop(&view->loader);
+
+		if (io_error(view->pipe)) {
+			report("Failed to read: %s", io_strerror(view->pipe));
+			end_update(view, true);
+
+		} else if (io_eof(view->pipe)) {
+			end_update(view, false);
+		}
 	}
 
 	if (restore_view_position(view))
@@ -720,7 +818,7 @@ update_view_title(struct view *view)
 		}
 	}
 
-	if (view->pipe) {
+	if (view_is_loading(view)) {
 		long long secs = (long long) difftime(time(NULL), view->start_time);
 
 		/* Three git seconds are a long time ... */
@@ -0,0 +1,755 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "arena.h"
+#include "event.h"
+#include "json.h"
+#include "store.h"
+
+#define REC_MAGIC 0x4e535452 /* NSTR */
+#define INDEX_MAGIC "NSTRIDX1"
+#define INDEX_HEADER_SIZE 64
+#define INDEX_MIN_SLOTS (1 << 16)
+
+#define REC_SIZE(len) (sizeof(struct store_rec) + (((size_t)(len) + 7) & ~(size_t)7))
+
+struct segment {
+	int fd;
+	unsigned char *map;
+	size_t used;
+};
+
+struct index_header {
+	char magic[8];
+	uint64_t slots;
+	uint64_t count;
+	uint32_t segments;
+	uint32_t clean;
+	/* bytes of the last segment the index covers */
+	uint64_t last_used;
+};
+
+/* key is the last 8 bytes of the id, the first ones are zeros for mined
+ * ids. loc is the segment number plus one in the high half and the
+ * offset of the record in the low half, 0 for an empty slot. */
+struct index_slot {
+	uint64_t key;
+	uint64_t loc;
+};
+
+struct store {
+	char *dir;
+	int lockfd;
+
+	struct segment *segs;
+	int nsegs, segs_cap;
+
+	int index_fd;
+	size_t index_size;
+	struct index_header *index;
+	struct index_slot *slots;
+
+	/* tags of the event being added */
+	struct arena arena;
+
+	int check_id;
+	store_verify_fn *verify;
+	void *verify_data;
+};
+
+static char *store_path(struct store *s, const char *name)
+{
+	size_t len = strlen(s->dir) + strlen(name) + 2;
+	char *path;
+
+	if ((path = malloc(len)))
+		snprintf(path, len, "%s/%s", s->dir, name);
+	return path;
+}
+
+static char *segment_path(struct store *s, int i)
+{
+	char name[32];
+
+	snprintf(name, sizeof(name), "seg-%08d.dat", i);
+	return store_path(s, name);
+}
+
+/* cheap enough to run over every event on ingest, it is only there to
+ * find records that were half written when we crashed */
+static uint32_t record_sum(const unsigned char *p, size_t len)
+{
+	uint64_t h = 0xcbf29ce484222325ULL ^ len, w;
+	size_t i;
+
+	for (i = 0; i + 8 <= len; i += 8) {
+		memcpy(&w, p + i, 8);
+		h = (h ^ w) * 0x100000001b3ULL;
+		h ^= h >> 32;
+	}
+	for (; i < len; i++)
+		h = (h ^ p[i]) * 0x100000001b3ULL;
+
+	return (uint32_t)(h ^ (h >> 32));
+}
+
+static uint64_t id_key(const unsigned char id[32])
+{
+	uint64_t key;
+
+	memcpy(&key, id + 24, 8);
+	return key;
+}
+
+static const struct store_rec *rec_at(struct store *s, uint64_t loc)
+{
+	return (const struct store_rec *)(s->segs[(loc >> 32) - 1].map + (uint32_t)loc);
+}
+
+/* the slot holding id, or the empty one where it would go */
+static struct index_slot *index_find(struct store *s, const unsigned char id[32])
+{
+	uint64_t key = id_key(id), mask = s->index->slots - 1, i;
+	struct index_slot *slot;
+
+	for (i = key & mask; ; i = (i + 1) & mask) {
+		slot = &s->slots[i];
+		if (!slot->loc)
+			return slot;
+		if (slot->key == key && !memcmp(rec_at(s, slot->loc)->id, id, 32))
+			return slot;
+	}
+}
+
+static void index_unmap(struct store *s)
+{
+	if (s->index)
+		munmap(s->index, s->index_size);
+	if (s->index_fd >= 0)
+		close(s->index_fd);
+	s->index = NULL;
+	s->index_fd = -1;
+}
+
+/* a new empty index in index.tmp, moved over the old one by the caller
+ * once it is filled */
+static int index_create(struct store *s, uint64_t nslots, int *fd,
+			struct index_header **hdr, size_t *size)
+{
+	char *path;
+	void *map;
+	int ok = 0;
+
+	*size = INDEX_HEADER_SIZE + nslots * sizeof(struct index_slot);
+
+	if (!(path = store_path(s, "index.tmp")))
+		return 0;
+
+	if ((*fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0600)) < 0 ||
+	    ftruncate(*fd, *size) < 0) {
+		fprintf(stderr, "store: could not create '%s': %s\n", path, strerror(errno));
+		goto out;
+	}
+
+	if ((map = mmap(NULL, *size, PROT_READ | PROT_WRITE, MAP_SHARED, *fd, 0)) == MAP_FAILED) {
+		fprintf(stderr, "store: could not map '%s': %s\n", path, strerror(errno));
+		goto out;
+	}
+
+	*hdr = map;
+	memcpy((*hdr)->magic, INDEX_MAGIC, 8);
+	(*hdr)->slots = nslots;
+	ok = 1;
+out:
+	if (!ok && *fd >= 0)
+		close(*fd);
+	free(path);
+	return ok;
+}
+
+static int index_install(struct store *s, int fd, struct index_header *hdr, size_t size)
+{
+	char *tmp, *path;
+	int ok;
+
+	tmp = store_path(s, "index.tmp");
+	path = store_path(s, "index");
+	ok = tmp && path && rename(tmp, path) == 0;
+	if (!ok)
+		fprintf(stderr, "store: could not install the new index: %s\n", strerror(errno));
+	free(tmp);
+	free(path);
+
+	index_unmap(s);
+	s->index_fd = fd;
+	s->index = hdr;
+	s->index_size = size;
+	s->slots = (struct index_slot *)((unsigned char *)hdr + INDEX_HEADER_SIZE);
+	return ok;
+}
+
+/* double the table, the keys are all we need to place the slots again */
+static int index_grow(struct store *s)
+{
+	struct index_header *hdr;
+	struct index_slot *slots, *old = s->slots;
+	uint64_t i, j, mask, n = s->index->slots;
+	size_t size;
+	int fd;
+
+	if (!index_create(s, n * 2, &fd, &hdr, &size))
+		return 0;
+
+	slots = (struct index_slot *)((unsigned char *)hdr + INDEX_HEADER_SIZE);
+	mask = n * 2 - 1;
+	for (i = 0; i < n; i++) {
+		if (!old[i].loc)
+			continue;
+		for (j = old[i].key & mask; slots[j].loc; j = (j + 1) & mask)
+			;
+		slots[j] = old[i];
+	}
+	hdr->count = s->index->count;
+	hdr->segments = s->index->segments;
+	hdr->last_used = s->index->last_used;
+
+	return index_install(s, fd, hdr, size);
+}
+
+static int index_insert(struct store *s, const struct store_rec *rec, int seg, size_t off)
+{
+	struct index_slot *slot;
+
+	/* keep probe runs short, the load stays under 70% */
+	if ((s->index->count + 1) * 10 > s->index->slots * 7 && !index_grow(s))
+		return 0;
+
+	slot = index_find(s, rec->id);
+	if (slot->loc)
+		return 1;
+
+	slot->key = id_key(rec->id);
+	slot->loc = ((uint64_t)(seg + 1) << 32) | off;
+	s->index->count++;
+	return 1;
+}
+
+/* walk the valid records of a segment from off up to limit, indexing
+ * them if asked, returns where the valid part ends */
+static size_t scan_segment(struct store *s, int seg, size_t off, size_t limit, int index)
+{
+	const struct store_rec *rec;
+	unsigned char *map = s->segs[seg].map;
+
+	while (off + sizeof(*rec) <= limit) {
+		rec = (const struct store_rec *)(map + off);
+		if (rec->magic != REC_MAGIC || rec->len > limit - off - sizeof(*rec) ||
+		    rec->sum != record_sum((const unsigned char *)(rec + 1), rec->len))
+			break;
+		if (index && !index_insert(s, rec, seg, off))
+			return (size_t)-1;
+		off += REC_SIZE(rec->len);
+	}
+
+	return off;
+}
+
+static int segment_map(struct store *s, int i, int create, size_t *file_size)
+{
+	struct segment *seg = &s->segs[i];
+	struct stat st;
+	char *path;
+	int ok = 0;
+
+	if (!(path = segment_path(s, i)))
+		return 0;
+
+	seg->map = NULL;
+	if ((seg->fd = open(path, O_RDWR | (create ? O_CREAT | O_EXCL : 0), 0600)) < 0 ||
+	    fstat(seg->fd, &st) < 0) {
+		fprintf(stderr, "store: could not open '%s': %s\n", path, strerror(errno));
+		goto out;
+	}
+
+	/* map the full size up front so appends never remap, only the last
+	 * segment's file is grown to match */
+	*file_size = st.st_size;
+	seg->map = mmap(NULL, STORE_SEGMENT_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, seg->fd, 0);
+	if (seg->map == MAP_FAILED) {
+		seg->map = NULL;
+		fprintf(stderr, "store: could not map '%s': %s\n", path, strerror(errno));
+		goto out;
+	}
+	ok = 1;
+out:
+	free(path);
+	return ok;
+}
+
+static int segments_reserve(struct store *s, int n)
+{
+	struct segment *segs;
+	int cap;
+
+	if (n <= s->segs_cap)
+		return 1;
+
+	for (cap = s->segs_cap ? s->segs_cap : 16; cap < n; cap *= 2)
+		;
+	if (!(segs = realloc(s->segs, cap * sizeof(*segs))))
+		return 0;
+
+	s->segs = segs;
+	s->segs_cap = cap;
+	return 1;
+}
+
+/* the active segment is the last one, its file is kept at full size while
+ * the store is open and cut back to what is used on close */
+static int segment_activate(struct store *s)
+{
+	struct segment *seg = &s->segs[s->nsegs - 1];
+
+	if (ftruncate(seg->fd, STORE_SEGMENT_SIZE) < 0) {
+		fprintf(stderr, "store: could not grow segment %d: %s\n", s->nsegs - 1, strerror(errno));
+		return 0;
+	}
+	return 1;
+}
+
+static int segment_seal(struct store *s, int i)
+{
+	struct segment *seg = &s->segs[i];
+
+	return msync(seg->map, seg->used, MS_SYNC) == 0 &&
+	       ftruncate(seg->fd, seg->used) == 0;
+}
+
+static int segment_new(struct store *s)
+{
+	size_t size;
+
+	if (!segments_reserve(s, s->nsegs + 1))
+		return 0;
+
+	if (!segment_map(s, s->nsegs, 1, &size))
+		return 0;
+
+	s->segs[s->nsegs++].used = 0;
+	if (s->index)
+		s->index->segments = s->nsegs;
+	return segment_activate(s);
+}
+
+static int rebuild(struct store *s, size_t *limits)
+{
+	struct index_header *hdr;
+	size_t size;
+	int i, fd;
+
+	if (!index_create(s, INDEX_MIN_SLOTS, &fd, &hdr, &size) ||
+	    !index_install(s, fd, hdr, size))
+		return 0;
+
+	for (i = 0; i < s->nsegs; i++) {
+		if ((s->segs[i].used = scan_segment(s, i, 0, limits[i], 1)) == (size_t)-1)
+			return 0;
+	}
+
+	s->index->segments = s->nsegs;
+	return 1;
+}
+
+/* is the index on disk one we can pick up from */
+static int index_load(struct store *s, size_t *limits)
+{
+	struct index_header *hdr;
+	struct stat st;
+	char *path;
+	void *map;
+	int fd;
+
+	if (!(path = store_path(s, "index")))
+		return 0;
+	fd = open(path, O_RDWR);
+	free(path);
+
+	if (fd < 0)
+		return 0;
+
+	if (fstat(fd, &st) < 0 || (size_t)st.st_size < INDEX_HEADER_SIZE ||
+	    (map = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0)) == MAP_FAILED) {
+		close(fd);
+		return 0;
+	}
+
+	hdr = map;
+	if (memcmp(hdr->magic, INDEX_MAGIC, 8) || !hdr->clean ||
+	    hdr->segments != (uint32_t)s->nsegs ||
+	    (size_t)st.st_size != INDEX_HEADER_SIZE + hdr->slots * sizeof(struct index_slot) ||
+	    hdr->last_used > limits[s->nsegs - 1]) {
+		munmap(map, st.st_size);
+		close(fd);
+		return 0;
+	}
+
+	s->index_fd = fd;
+	s->index = hdr;
+	s->index_size = st.st_size;
+	s->slots = (struct index_slot *)((unsigned char *)hdr + INDEX_HEADER_SIZE);
+	return 1;
+}
+
+static int load(struct store *s)
+{
+	size_t *limits = NULL;
+	struct stat st;
+	char *path;
+	int i, ok = 0;
+
+	for (s->nsegs = 0; ; s->nsegs++) {
+		if (!(path = segment_path(s, s->nsegs)))
+			return 0;
+		i = stat(path, &st);
+		free(path);
+		if (i < 0)
+			break;
+	}
+
+	if (!s->nsegs)
+		return segment_new(s) && rebuild(s, (size_t[]){ 0 });
+
+	if (!segments_reserve(s, s->nsegs) || !(limits = calloc(s->nsegs, sizeof(*limits))))
+		return 0;
+
+	for (i = 0; i < s->nsegs; i++) {
+		if (!segment_map(s, i, 0, &limits[i])) {
+			s->nsegs = i;
+			goto out;
+		}
+		s->segs[i].used = limits[i];
+	}
+
+	if (index_load(s, limits)) {
+		/* anything appended after the index was last written */
+		i = s->nsegs - 1;
+		s->segs[i].used = scan_segment(s, i, s->index->last_used, limits[i], 1);
+		if (s->segs[i].used == (size_t)-1)
+			goto out;
+	} else {
+		fprintf(stderr, "store: rebuilding the index of '%s'\n", s->dir);
+		if (!rebuild(s, limits))
+			goto out;
+	}
+
+	ok = segment_activate(s);
+out:
+	free(limits);
+	return ok;
+}
+
+struct store *store_open(const char *dir)
+{
+	struct store *s;
+	char *path;
+
+	if (mkdir(dir, 0700) < 0 && errno != EEXIST) {
+		fprintf(stderr, "store: could not create '%s': %s\n", dir, strerror(errno));
+		return NULL;
+	}
+
+	if (!(s = calloc(1, sizeof(*s))))
+		return NULL;
+
+	s->lockfd = s->index_fd = -1;
+	s->check_id = 1;
+	arena_init(&s->arena);
+
+	if (!(s->dir = strdup(dir)) || !(path = store_path(s, "lock")))
+		goto fail;
+
+	s->lockfd = open(path, O_RDWR | O_CREAT, 0600);
+	free(path);
+	if (s->lockfd < 0 || flock(s->lockfd, LOCK_EX | LOCK_NB) < 0) {
+		fprintf(stderr, "store: '%s' is in use or not writable\n", dir);
+		goto fail;
+	}
+
+	if (!load(s))
+		goto fail;
+
+	/* until store_close says otherwise, a crash means a rebuild */
+	s->index->clean = 0;
+	if (msync(s->index, INDEX_HEADER_SIZE, MS_SYNC) < 0)
+		goto fail;
+
+	return s;
+
+fail:
+	store_close(s);
+	return NULL;
+}
+
+int store_close(struct store *s)
+{
+	struct segment *last;
+	int i, ok = 1;
+
+	if (!s)
+		return 1;
+
+	if (s->nsegs && s->index) {
+		last = &s->segs[s->nsegs - 1];
+		ok = segment_seal(s, s->nsegs - 1);
+
+		s->index->segments = s->nsegs;
+		s->index->last_used = last->used;
+		ok = ok && msync(s->index, s->index_size, MS_SYNC) == 0;
+
+		/* the segments are on disk before the index says so */
+		s->index->clean = ok;
+		ok = ok && msync(s->index, INDEX_HEADER_SIZE, MS_SYNC) == 0;
+	}
+
+	for (i = 0; i < s->nsegs; i++) {
+		if (s->segs[i].map)
+			munmap(s->segs[i].map, STORE_SEGMENT_SIZE);
+		close(s->segs[i].fd);
+	}
+
+	index_unmap(s);
+	if (s->lockfd >= 0)
+		close(s->lockfd);
+	arena_free(&s->arena);
+	free(s->segs);
+	free(s->dir);
+	free(s);
+	return ok;
+}
+
+/* the object itself, without an envelope or whitespace around it */
+static char *event_object(char *json, size_t len, size_t *objlen)
+{
+	char *start, *end;
+
+	if (!(start = memchr(json, '{', len)))
+		return NULL;
+
+	for (end = json + len; end > start && end[-1] != '}'; end--)
+		;
+	if (end == start)
+		return NULL;
+
+	*objlen = end - start;
+	return start;
+}
+
+void store_set_checks(struct store *s, int check_id, store_verify_fn *verify, void *data)
+{
+	s->check_id = check_id;
+	s->verify = verify;
+	s->verify_data = data;
+}
+
+enum store_result store_add(struct store *s, char *json, size_t len)
+{
+	struct segment *seg = &s->segs[s->nsegs - 1];
+	struct store_rec *rec;
+	struct nostr_event ev;
+	unsigned char id[32];
+	size_t n, size;
+	char *obj;
+	int fields;
+
+	if (!(obj = event_object(json, len, &n)) || REC_SIZE(n) > STORE_SEGMENT_SIZE)
+		return STORE_INVALID;
+
+	size = REC_SIZE(n);
+	if (seg->used + size > STORE_SEGMENT_SIZE) {
+		if (!segment_seal(s, s->nsegs - 1) || !segment_new(s))
+			return STORE_ERROR;
+		seg = &s->segs[s->nsegs - 1];
+	}
+
+	/* copy before parsing, which unescapes in place, if it turns out to be
+	 * a duplicate the next event just overwrites it */
+	rec = (struct store_rec *)(seg->map + seg->used);
+	memcpy(rec + 1, obj, n);
+
+	arena_reset(&s->arena);
+	event_init(&ev, &s->arena);
+	if (!parse_event(obj, n, &ev, &fields) || (fields & EVENT_HAS_ALL) != EVENT_HAS_ALL)
+		return STORE_INVALID;
+
+	if (s->check_id) {
+		memcpy(id, ev.id, 32);
+		if (!event_id(&ev))
+			return STORE_INVALID;
+		if (memcmp(id, ev.id, 32))
+			return STORE_BAD_ID;
+	}
+
+	if (index_find(s, ev.id)->loc)
+		return STORE_DUPLICATE;
+
+	if (s->verify && !s->verify(&ev, s->verify_data))
+		return STORE_BAD_SIG;
+
+	memset((unsigned char *)(rec + 1) + n, 0, size - sizeof(*rec) - n);
+	rec->len = n;
+	rec->kind = ev.kind;
+	rec->created_at = ev.created_at;
+	memcpy(rec->id, ev.id, 32);
+	memcpy(rec->pubkey, ev.pubkey, 32);
+	rec->sum = record_sum((const unsigned char *)(rec + 1), n);
+	rec->magic = REC_MAGIC;
+
+	if (!index_insert(s, rec, s->nsegs - 1, seg->used))
+		return STORE_ERROR;
+
+	seg->used += size;
+	return STORE_ADDED;
+}
+
+int store_add_file(struct store *s, FILE *in, uint64_t *added,
+		   uint64_t *duplicates, uint64_t *invalid)
+{
+	uint64_t lineno = 0;
+	size_t linecap = 0;
+	char *line = NULL;
+	ssize_t len;
+	int ok = 1;
+
+	*added = *duplicates = *invalid = 0;
+
+	while ((len = getline(&line, &linecap, in)) != -1) {
+		lineno++;
+		while (len && (line[len-1] == '\n' || line[len-1] == '\r' || line[len-1] == ' '))
+			len--;
+		if (!len)
+			continue;
+
+		switch (store_add(s, line, len)) {
+		case STORE_ADDED:
+			(*added)++;
+			break;
+		case STORE_DUPLICATE:
+			(*duplicates)++;
+			break;
+		case STORE_INVALID:
+			(*invalid)++;
+			fprintf(stderr, "line %" PRIu64 ": not a complete event\n", lineno);
+			break;
+		case STORE_BAD_ID:
+			(*invalid)++;
+			fprintf(stderr, "line %" PRIu64 ": id mismatch\n", lineno);
+			break;
+		case STORE_BAD_SIG:
+			(*invalid)++;
+			fprintf(stderr, "line %" PRIu64 ": invalid signature\n", lineno);
+			break;
+		case STORE_ERROR:
+			ok = 0;
+			goto out;
+		}
+	}
+
+	if (ferror(in)) {
+		fprintf(stderr, "error reading input\n");
+		ok = 0;
+	}
+out:
+	free(line);
+	return ok;
+}
+
+const struct store_rec *store_get(struct store *s, const unsigned char id[32])
+{
+	struct index_slot *slot = index_find(s, id);
+
+	return slot->loc ? rec_at(s, slot->loc) : NULL;
+}
+
+const struct store_rec *store_at(struct store *s, uint64_t loc)
+{
+	uint64_t seg = loc >> 32;
+
+	if (!seg || seg > (uint64_t)s->nsegs ||
+	    (uint32_t)loc + sizeof(struct store_rec) > s->segs[seg - 1].used)
+		return NULL;
+
+	return rec_at(s, loc);
+}
+
+uint64_t store_lookup(struct store *s, const unsigned char id[32])
+{
+	return index_find(s, id)->loc;
+}
+
+uint64_t store_end(struct store *s)
+{
+	return ((uint64_t)s->nsegs << 32) | s->segs[s->nsegs - 1].used;
+}
+
+const char *store_dir(struct store *s)
+{
+	return s->dir;
+}
+
+int store_foreach_from(struct store *s, uint64_t loc, store_rec_fn *fn, void *data)
+{
+	const struct store_rec *rec;
+	size_t off = (uint32_t)loc;
+	int i = loc ? (int)(loc >> 32) - 1 : 0;
+
+	for (; i < s->nsegs; i++, off = 0) {
+		for (; off < s->segs[i].used; off += REC_SIZE(rec->len)) {
+			rec = (const struct store_rec *)(s->segs[i].map + off);
+			if (!fn(rec, ((uint64_t)(i + 1) << 32) | off, data))
+				return 0;
+		}
+	}
+
+	return 1;
+}
+
+int store_foreach(struct store *s, store_rec_fn *fn, void *data)
+{
+	return store_foreach_from(s, 0, fn, data);
+}
+
+int store_rebuild(struct store *s)
+{
+	size_t *limits;
+	int i, ok;
+
+	if (!(limits = calloc(s->nsegs, sizeof(*limits))))
+		return 0;
+
+	for (i = 0; i < s->nsegs; i++)
+		limits[i] = s->segs[i].used;
+
+	ok = rebuild(s, limits);
+	free(limits);
+	return ok;
+}
+
+void store_stats(struct store *s, struct store_stats *stats)
+{
+	int i;
+
+	stats->events = s->index->count;
+	stats->index_slots = s->index->slots;
+	stats->segments = s->nsegs;
+	stats->bytes = 0;
+	for (i = 0; i < s->nsegs; i++)
+		stats->bytes += s->segs[i].used;
+}
@@ -0,0 +1,119 @@
+#ifndef STORE_H
+#define STORE_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+
+/* A local, append-only event store, a stand-in for a relay's storage.
+ *
+ * Events are appended as records to memory mapped segment files in a
+ * directory, seg-00000000.dat, seg-00000001.dat and so on, each up to
+ * STORE_SEGMENT_SIZE. A record is a fixed header with the fields queries
+ * need, followed by the event json as it was given. Segments are never
+ * rewritten, only appended to.
+ *
+ * The index file is an open addressing hash table from event id to
+ * record, so adding an event that is already stored is a lookup and
+ * nothing else. It is only a cache of the segments: it is marked clean
+ * on store_close, and a store that wasn't closed cleanly, or whose index
+ * doesn't match its segments, has the index rebuilt from the segments
+ * when it is opened. Torn records at the end of the last segment are
+ * found by their checksum and dropped. */
+
+#define STORE_SEGMENT_SIZE (1u << 28)
+
+struct store_rec {
+	uint32_t magic;
+	/* bytes of json following the header, the record is padded to 8 */
+	uint32_t len;
+	uint32_t kind;
+	uint32_t sum;
+	uint64_t created_at;
+	unsigned char id[32];
+	unsigned char pubkey[32];
+};
+
+struct store_stats {
+	uint64_t events;
+	uint64_t bytes;
+	uint64_t index_slots;
+	int segments;
+};
+
+enum store_result {
+	STORE_ERROR = -1,
+	STORE_ADDED,
+	STORE_DUPLICATE,
+	STORE_INVALID,
+	/* complete, but the id isn't the hash of the event */
+	STORE_BAD_ID,
+	/* the verify function passed to store_set_checks said no */
+	STORE_BAD_SIG,
+};
+
+struct store;
+struct nostr_event;
+
+/* check the signature of an event whose id is known to be right */
+typedef int store_verify_fn(const struct nostr_event *ev, void *data);
+
+/* open or create the store in dir, which is locked while it is open,
+ * recovering the index if needed */
+struct store *store_open(const char *dir);
+
+/* sync everything and mark the index clean */
+int store_close(struct store *s);
+
+/* What store_add checks. By default it recomputes every event's id and
+ * rejects the event if it doesn't match; check_id 0 turns that off, for
+ * generated corpora with made up ids. The store doesn't link secp256k1,
+ * so signatures are only checked if verify is given. */
+void store_set_checks(struct store *s, int check_id, store_verify_fn *verify, void *data);
+
+/* Add one event, json or an ["EVENT",...] envelope. All of id, pubkey,
+ * created_at, kind, tags, content and sig must be there, and the id and
+ * signature are checked as set by store_set_checks. The json is unescaped
+ * in place while it is parsed. */
+enum store_result store_add(struct store *s, char *json, size_t len);
+
+/* store_add every line of in, reporting bad ones on stderr */
+int store_add_file(struct store *s, FILE *in, uint64_t *added,
+		   uint64_t *duplicates, uint64_t *invalid);
+
+/* the record for id, its json follows it, NULL if it isn't stored */
+const struct store_rec *store_get(struct store *s, const unsigned char id[32]);
+
+/* Where a record is: the segment and offset, growing in the order
+ * records were added, 0 before the first one. Locations stay valid as long
+ * as the store exists. */
+const struct store_rec *store_at(struct store *s, uint64_t loc);
+
+/* the location of id, 0 if it isn't stored */
+uint64_t store_lookup(struct store *s, const unsigned char id[32]);
+
+/* the location the next record will get */
+uint64_t store_end(struct store *s);
+
+const char *store_dir(struct store *s);
+
+static inline const char *store_rec_json(const struct store_rec *rec)
+{
+	return (const char *)(rec + 1);
+}
+
+typedef int store_rec_fn(const struct store_rec *rec, uint64_t loc, void *data);
+
+/* call fn on every record in the order they were added, stops early and
+ * returns 0 when fn does */
+int store_foreach(struct store *s, store_rec_fn *fn, void *data);
+
+/* the same for the records at or after loc */
+int store_foreach_from(struct store *s, uint64_t loc, store_rec_fn *fn, void *data);
+
+/* throw the index away and build it again from the segments */
+int store_rebuild(struct store *s);
+
+void store_stats(struct store *s, struct store_stats *stats);
+
+#endif
@@ -14,10 +14,13 @@
 #include <stdio.h>
 #include <string.h>
 
+#include "vanity.h"
+
 struct args {
 	unsigned int flags;
 	int kind;
 	int difficulty;
+	int threads;
 
 	unsigned char encrypt_to[32];
 	const char *sec;
@@ -27,6 +30,15 @@ struct args {
 	const char *xor_result;
 	const char *tags;
 	const char *content;
+	const char *socket;
+	const char *dm_list;
+	const char *pow_listen;
+	const char *pow_checkpoint;
+	int pow_resume;
+	int pow_workers;
+	uint64_t pow_lease;
+	const char *vanity[VANITY_MAX_PATTERNS];
+	int num_vanity;
 
 	uint64_t created_at;
 };
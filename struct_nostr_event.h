@@ -14,6 +14,7 @@
 #include <stdio.h>
 #include <string.h>
 
+#include "arena.h"
 #include "struct_key.h"
 #include "struct_nostr_tag.h"
 
@@ -24,13 +25,29 @@ struct nostr_event {
 
        const char *content;
 
+       /* content, tags and pubkey serialized on first use and shared by
+        * the commitment and the printed event. The content is tied to the
+        * content pointer, so point content at a new string rather than
+        * editing it; see event_tags_changed() for the tags */
+       const char *content_json;
+       const char *content_json_src;
+       size_t content_json_len;
+       const char *tags_json;
+       size_t tags_json_len;
+       char pubkey_hex[65];
+       unsigned char pubkey_hex_src[32];
+
        uint64_t created_at;
        int kind;
 
        const char *explicit_tags;
 
-       struct nostr_tag tags[MAX_TAGS];
+       /* tags, and everything else built for this event, are allocated
+        * from the arena */
+       struct arena *arena;
+       struct nostr_tag *tags;
        int num_tags;
+       int cap_tags;
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,27 @@
+#ifndef STRUCT_NOSTR_FILTER_H
+#define STRUCT_NOSTR_FILTER_H
+
+#include <inttypes.h>
+
+/* "#e": [...], "#p": [...] and the like, name is the tag letter */
+struct nostr_filter_tag {
+       char name;
+       const char **values;
+       int num_values;
+       int cap_values;
+};
+
+/* A REQ filter. An event matches when it matches every field that is
+ * there, and it matches a field when it matches any of its values. */
+struct nostr_filter {
+       unsigned char (*ids)[32];
+       unsigned char (*authors)[32];
+       int *kinds;
+       struct nostr_filter_tag *tags;
+       int num_ids, num_authors, num_kinds, num_tags;
+
+       /* -1 for no limit */
+       int64_t limit;
+};
+
+#endif
@@ -15,7 +15,8 @@
 #include <string.h>
 
 struct nostr_tag {
-       const char *strs[MAX_TAG_ELEMS];
+       const char **strs;
        int num_elems;
+       int cap_elems;
 };
 #endif
\ No newline at end of file
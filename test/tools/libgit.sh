@@ -107,6 +107,23 @@ create_worktree()
 	})
 }
 
+# A history of N commits, "Commit 001" and so on, each changing the
+# file "commits", made with fast-import since it is too long for
+# git_commit.
+create_linear_repo()
+{
+	git_init .
+
+	for i in $(seq 1 "$1"); do
+		printf 'commit refs/heads/master\n'
+		printf 'author %s %d +0000\n' "$IDENT_A" "$((author_date + i * 3600))"
+		printf 'committer %s %d +0000\n' "$IDENT_A" "$((author_date + i * 3600))"
+		printf 'data <<EOM\nCommit %03d\nEOM\n' "$i"
+		printf 'M 644 inline commits\ndata <<EOM\n%d\nEOM\n\n' "$i"
+	done | git fast-import --quiet
+	git reset -q --hard master
+}
+
 create_repo_from_tgz()
 {
 	git_init .
@@ -0,0 +1,876 @@
+/* Unit tests for nostril's own code, run by ctest and make nostril-check.
+ *
+ * usage: test_nostril
+ *
+ * Prints one line per failed check and exits non-zero if any failed.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <unistd.h>
+#include <signal.h>
+#include <pthread.h>
+
+#include "hex.h"
+#include "aes.h"
+#include "sha256.h"
+#include "event.h"
+#include "json.h"
+#include "mine.h"
+#include "pow.h"
+#include "vanity.h"
+#include "store.h"
+#include "query.h"
+
+static int failures;
+
+#define CHECK(cond) do { \
+	if (!(cond)) { \
+		fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+		failures++; \
+	} \
+} while (0)
+
+static int hash_is(const struct sha256 *h, const char *hex)
+{
+	char buf[65];
+
+	hex_encode(h->u.u8, 32, buf, sizeof(buf));
+	return !strcmp(buf, hex);
+}
+
+/* FIPS 180-2 vectors, through the single stream path */
+static void test_sha256_vectors(void)
+{
+	static const char *million_a =
+		"cdc76e5c9914fb9281a1c7e284d73e67f1809a48a497200e046d39ccc7112cd0";
+	struct sha256_ctx ctx;
+	struct sha256 h;
+	char a[1000];
+	int i;
+
+	sha256(&h, "abc", 3);
+	CHECK(hash_is(&h, "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad"));
+
+	sha256(&h, "", 0);
+	CHECK(hash_is(&h, "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855"));
+
+	sha256(&h, "abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq", 56);
+	CHECK(hash_is(&h, "248d6a61d20638b8e5c026930c3e6039a33ce45964ff2167f6ecedd419db06c1"));
+
+	memset(a, 'a', sizeof(a));
+	sha256_init(&ctx);
+	for (i = 0; i < 1000; i++)
+		sha256_update(&ctx, a, sizeof(a));
+	sha256_done(&ctx, &h);
+	CHECK(hash_is(&h, million_a));
+}
+
+/* every kernel the cpu has must agree with the scalar one, for lengths
+ * around the padding boundaries, with and without a midstate, and for
+ * counts that leave lanes of the last group unused */
+static void test_sha256_kernels(void)
+{
+	static const size_t lens[] = { 0, 1, 55, 56, 63, 64, 65, 119, 120, 128, 200 };
+	enum sha256_kernel k;
+	struct sha256 expect[9], got[9];
+	struct sha256_ctx mid;
+	unsigned char data[9][256], prefix[128];
+	const unsigned char *msgs[9];
+	size_t i, j, l, n;
+	int with_mid;
+
+	for (i = 0; i < 9; i++) {
+		for (j = 0; j < sizeof(data[i]); j++)
+			data[i][j] = (unsigned char)(i * 31 + j * 7);
+		msgs[i] = data[i];
+	}
+	for (j = 0; j < sizeof(prefix); j++)
+		prefix[j] = (unsigned char)j;
+	sha256_init(&mid);
+	sha256_update(&mid, prefix, sizeof(prefix));
+
+	for (k = SHA256_KERNEL_SCALAR + 1; k < SHA256_KERNEL_COUNT; k++) {
+		if (!sha256_kernel_supported(k))
+			continue;
+
+		for (l = 0; l < sizeof(lens) / sizeof(lens[0]); l++)
+		for (n = 1; n <= 9; n++)
+		for (with_mid = 0; with_mid < 2; with_mid++) {
+			CHECK(sha256_set_kernel(SHA256_KERNEL_SCALAR));
+			sha256_many(expect, with_mid ? &mid : NULL, msgs, lens[l], n);
+			CHECK(sha256_set_kernel(k));
+			sha256_many(got, with_mid ? &mid : NULL, msgs, lens[l], n);
+
+			if (memcmp(expect, got, n * sizeof(got[0]))) {
+				fprintf(stderr, "%s: len %zu, %zu messages, midstate %d differ from scalar\n",
+					sha256_kernel_name(k), lens[l], n, with_mid);
+				failures++;
+			}
+		}
+	}
+
+	/* the scalar kernel itself against a vector */
+	CHECK(sha256_set_kernel(SHA256_KERNEL_SCALAR));
+	msgs[0] = (const unsigned char *)"abc";
+	sha256_many(got, NULL, msgs, 3, 1);
+	CHECK(hash_is(&got[0], "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad"));
+
+	CHECK(sha256_set_kernel(SHA256_KERNEL_AUTO));
+}
+
+static void unhex(const char *hex, unsigned char *buf, size_t len)
+{
+	if (!hex_decode(hex, strlen(hex), buf, len))
+		CHECK(!"bad hex in test vector");
+}
+
+/* FIPS-197 C.3 and NIST SP 800-38A F.2.5/F.2.6 vectors through every aes
+ * kernel the cpu has: in one call, a block per call with the chain carried
+ * in ctx->Iv, and in place */
+static void test_aes_vectors(void)
+{
+	static const struct {
+		const char *key, *iv, *pt, *ct;
+	} vecs[] = {
+		{ "000102030405060708090a0b0c0d0e0f101112131415161718191a1b1c1d1e1f",
+		  "00000000000000000000000000000000",
+		  "00112233445566778899aabbccddeeff",
+		  "8ea2b7ca516745bfeafc49904b496089" },
+		{ "603deb1015ca71be2b73aef0857d77811f352c073b6108d72d9810a30914dff4",
+		  "000102030405060708090a0b0c0d0e0f",
+		  "6bc1bee22e409f96e93d7e117393172a"
+		  "ae2d8a571e03ac9c9eb76fac45af8e51"
+		  "30c81c46a35ce411e5fbc1191a0a52ef"
+		  "f69f2445df4f9b17ad2b417be66c3710",
+		  "f58c4c04d6e5f1ba779eabfb5f7bfbd6"
+		  "9cfc4e967edb808d679f777bc6702c7d"
+		  "39f23369a9d9bacfa530e26304231461"
+		  "b2eb05e2c39be9fcda6c19078c6a9d1b" },
+	};
+	unsigned char key[AES_KEYLEN], iv[AES_BLOCKLEN], pt[64], ct[64], buf[64];
+	struct AES_ctx ctx;
+	enum aes_kernel k;
+	size_t i, j, len;
+	int tested = 0, before;
+
+	for (k = AES_KERNEL_AUTO + 1; k < AES_KERNEL_COUNT; k++) {
+		if (!aes_kernel_supported(k))
+			continue;
+		CHECK(aes_set_kernel(k));
+		tested++;
+
+		for (i = 0; i < sizeof(vecs) / sizeof(vecs[0]); i++) {
+			before = failures;
+			len = strlen(vecs[i].pt) / 2;
+			unhex(vecs[i].key, key, sizeof(key));
+			unhex(vecs[i].iv, iv, sizeof(iv));
+			unhex(vecs[i].pt, pt, len);
+			unhex(vecs[i].ct, ct, len);
+
+			AES_init_ctx_iv(&ctx, key, iv);
+			AES_CBC_encrypt(&ctx, buf, pt, len);
+			CHECK(!memcmp(buf, ct, len));
+			CHECK(!memcmp(ctx.Iv, ct + len - AES_BLOCKLEN, AES_BLOCKLEN));
+
+			AES_ctx_set_iv(&ctx, iv);
+			AES_CBC_decrypt(&ctx, buf, ct, len);
+			CHECK(!memcmp(buf, pt, len));
+
+			AES_ctx_set_iv(&ctx, iv);
+			for (j = 0; j < len; j += AES_BLOCKLEN)
+				AES_CBC_encrypt(&ctx, buf + j, pt + j, AES_BLOCKLEN);
+			CHECK(!memcmp(buf, ct, len));
+
+			AES_ctx_set_iv(&ctx, iv);
+			for (j = 0; j < len; j += AES_BLOCKLEN)
+				AES_CBC_decrypt(&ctx, buf + j, ct + j, AES_BLOCKLEN);
+			CHECK(!memcmp(buf, pt, len));
+
+			memcpy(buf, pt, len);
+			AES_ctx_set_iv(&ctx, iv);
+			AES_CBC_encrypt_buffer(&ctx, buf, len);
+			CHECK(!memcmp(buf, ct, len));
+			AES_ctx_set_iv(&ctx, iv);
+			AES_CBC_decrypt_buffer(&ctx, buf, len);
+			CHECK(!memcmp(buf, pt, len));
+
+			if (failures != before)
+				fprintf(stderr, "aes %s: vector %zu failed\n", aes_kernel_name(k), i);
+		}
+	}
+
+	/* the t-table kernel runs everywhere, the others are extra */
+	CHECK(aes_kernel_supported(AES_KERNEL_TTABLE));
+	CHECK(tested >= 2);
+	CHECK(aes_set_kernel(AES_KERNEL_AUTO));
+}
+
+static int parses(const char *json)
+{
+	struct nostr_event ev;
+	struct arena arena;
+	char buf[256];
+	int fields, ok;
+
+	snprintf(buf, sizeof(buf), "%s", json);
+	arena_init(&arena);
+	event_init(&ev, &arena);
+	ok = parse_event(buf, strlen(buf), &ev, &fields);
+	arena_free(&arena);
+	return ok;
+}
+
+static void test_parse_event(void)
+{
+	CHECK(parses("{\"content\":\"a\\u0041b\",\"created_at\":18446744073709551615}"));
+	CHECK(!parses("{\"content\":\"a\\u0000b\"}"));
+	CHECK(!parses("{\"created_at\":18446744073709551616}"));
+	CHECK(!parses("{\"created_at\":99999999999999999999}"));
+}
+
+static int reject_sig(const struct nostr_event *ev, void *data)
+{
+	(void)ev;
+	(*(int *)data)++;
+	return 0;
+}
+
+/* store_add the event as json, with the first id byte changed by flip */
+static enum store_result add_event(struct store *s, struct nostr_event *ev, int flip)
+{
+	unsigned char buf[1024];
+	struct cursor cur;
+
+	ev->id[0] ^= flip;
+	make_cursor(buf, buf + sizeof(buf), &cur);
+	if (!event_json(&cur, ev, 0))
+		return STORE_ERROR;
+	ev->id[0] ^= flip;
+	return store_add(s, (char *)buf, cur.p - buf);
+}
+
+/* remove a test store and its query index */
+static void remove_store(const char *dir)
+{
+	static const char *files[] = { "seg-00000000.dat", "index", "lock", "query" };
+	char path[64];
+	size_t i;
+
+	for (i = 0; i < sizeof(files) / sizeof(files[0]); i++) {
+		snprintf(path, sizeof(path), "%s/%s", dir, files[i]);
+		unlink(path);
+	}
+	rmdir(dir);
+}
+
+static void test_store_checks(void)
+{
+	char dir[] = "/tmp/test_nostril.XXXXXX";
+	struct nostr_event ev;
+	struct arena arena;
+	struct store *s;
+	int verified = 0;
+
+	if (!mkdtemp(dir)) {
+		CHECK(!"mkdtemp");
+		return;
+	}
+
+	arena_init(&arena);
+	event_init(&ev, &arena);
+	memset(ev.pubkey, 0x11, 32);
+	memset(ev.sig, 0x22, 64);
+	ev.content = "hello";
+	ev.created_at = 1700000000;
+	ev.kind = 1;
+	CHECK(event_id(&ev));
+
+	CHECK((s = store_open(dir)) != NULL);
+	if (s) {
+		CHECK(add_event(s, &ev, 1) == STORE_BAD_ID);
+		CHECK(store_get(s, ev.id) == NULL);
+
+		store_set_checks(s, 1, reject_sig, &verified);
+		CHECK(add_event(s, &ev, 0) == STORE_BAD_SIG);
+		CHECK(verified == 1);
+
+		store_set_checks(s, 1, NULL, NULL);
+		CHECK(add_event(s, &ev, 0) == STORE_ADDED);
+		CHECK(add_event(s, &ev, 0) == STORE_DUPLICATE);
+
+		/* made up ids are let through when asked for */
+		store_set_checks(s, 0, NULL, NULL);
+		CHECK(add_event(s, &ev, 1) == STORE_ADDED);
+		CHECK(store_close(s));
+	}
+
+	remove_store(dir);
+	arena_free(&arena);
+}
+
+struct locs {
+	uint64_t locs[512];
+	int num;
+};
+
+static int collect_loc(const struct store_rec *rec, uint64_t loc, void *data)
+{
+	struct locs *l = data;
+
+	(void)rec;
+	if (l->num == (int)(sizeof(l->locs) / sizeof(l->locs[0])))
+		return 0;
+	l->locs[l->num++] = loc;
+	return 1;
+}
+
+/* event n of the query corpus: 4 authors, kinds 1, 7 and 30023, and an
+ * e and a p tag out of a few values each */
+static enum store_result add_query_event(struct store *s, struct arena *arena,
+					 int n, uint64_t created_at)
+{
+	static const int kinds[] = { 1, 7, 30023 };
+	static const char *es[] = { "e0", "e1", "e2", "e3", "e4" };
+	static const char *ps[] = { "p0", "p1", "p2", "p3", "p4", "p5", "p6" };
+	struct nostr_event ev;
+	char content[16];
+
+	arena_reset(arena);
+	event_init(&ev, arena);
+	memset(ev.pubkey, 0xa0 + n % 4, 32);
+	memset(ev.sig, 0x22, 64);
+	snprintf(content, sizeof(content), "n%d", n);
+	ev.content = content;
+	ev.created_at = created_at;
+	ev.kind = kinds[n % 3];
+	if (!nostr_add_tag(&ev, "e", es[n % 5]) || !nostr_add_tag(&ev, "p", ps[n % 7]) ||
+	    !event_id(&ev))
+		return STORE_ERROR;
+	return add_event(s, &ev, 0);
+}
+
+/* query_run must give what query_scan does, in the same order */
+static int run_matches_scan(struct query *q, const struct nostr_filter *f)
+{
+	struct locs run = { .num = 0 }, scan = { .num = 0 };
+
+	CHECK(query_run(q, f, collect_loc, &run));
+	CHECK(query_scan(q, f, collect_loc, &scan));
+	CHECK(run.num == scan.num);
+	CHECK(!memcmp(run.locs, scan.locs, scan.num * sizeof(scan.locs[0])));
+	return scan.num;
+}
+
+static void test_query(void)
+{
+	char dir[] = "/tmp/test_nostril.XXXXXX";
+	unsigned char authors[3][32], missing_id[1][32];
+	int kinds[] = { 1, 7 }, missing_kind[] = { 5 };
+	const char *e1[] = { "e1" }, *p35[] = { "p3", "p5" }, *nothere[] = { "e9" };
+	struct nostr_filter_tag tags[] = {
+		{ 'e', e1, 1, 0 },
+		{ 'p', p35, 2, 0 },
+	};
+	struct nostr_filter_tag missing_tag[] = { { 'e', nothere, 1, 0 } };
+	struct nostr_filter by_author_kind = {
+		.authors = authors, .num_authors = 2,
+		.kinds = kinds, .num_kinds = 2, .limit = -1,
+	};
+	struct nostr_filter by_tags = { .tags = tags, .num_tags = 2, .limit = -1 };
+	struct nostr_filter by_e_kind = {
+		.kinds = kinds, .num_kinds = 2,
+		.tags = tags, .num_tags = 1, .limit = -1,
+	};
+	struct nostr_filter one_missing = { .authors = authors, .num_authors = 3, .limit = -1 };
+	struct nostr_filter none[] = {
+		{ .kinds = missing_kind, .num_kinds = 1, .limit = -1 },
+		{ .tags = missing_tag, .num_tags = 1, .limit = -1 },
+		{ .authors = authors + 2, .num_authors = 1, .limit = -1 },
+		{ .ids = missing_id, .num_ids = 1, .limit = -1 },
+	};
+	struct nostr_filter overlap[] = {
+		{ .authors = authors + 1, .num_authors = 1, .limit = -1 },
+		{ .kinds = kinds + 1, .num_kinds = 1, .limit = -1 },
+	};
+	struct nostr_filter *filters[] = { &by_author_kind, &by_tags, &by_e_kind, &one_missing };
+	struct locs all, a, b;
+	struct arena arena;
+	struct query *q;
+	struct store *s;
+	size_t i;
+	int n, round, dups, both;
+
+	if (!mkdtemp(dir)) {
+		CHECK(!"mkdtemp");
+		return;
+	}
+
+	memset(authors[0], 0xa0, 32);
+	memset(authors[1], 0xa2, 32);
+	/* no event has this author, so it has no list in the index */
+	memset(authors[2], 0xee, 32);
+	memset(missing_id[0], 0xee, 32);
+
+	arena_init(&arena);
+	CHECK((s = store_open(dir)) != NULL);
+	if (!s)
+		goto out;
+	store_set_checks(s, 0, NULL, NULL);
+
+	/* two events a second */
+	for (n = 0; n < 200; n++)
+		CHECK(add_query_event(s, &arena, n, 1700000000 + n / 2) == STORE_ADDED);
+	CHECK((q = query_open(s, 0)) != NULL);
+	if (!q)
+		goto close;
+
+	/* the second round has events added after the index was built, some
+	 * older than what it has and some newer */
+	for (round = 0; round < 2; round++) {
+		if (round) {
+			for (n = 0; n < 40; n++)
+				CHECK(add_query_event(s, &arena, 200 + n, 1700000000 +
+						      (n < 20 ? n * 5 : 100 + n)) == STORE_ADDED);
+		}
+
+		for (i = 0; i < sizeof(filters) / sizeof(filters[0]); i++) {
+			filters[i]->limit = -1;
+			CHECK(run_matches_scan(q, filters[i]) > 5);
+			filters[i]->limit = 5;
+			CHECK(run_matches_scan(q, filters[i]) == 5);
+			filters[i]->limit = 0;
+			CHECK(run_matches_scan(q, filters[i]) == 0);
+		}
+
+		for (i = 0; i < sizeof(none) / sizeof(none[0]); i++)
+			CHECK(run_matches_scan(q, &none[i]) == 0);
+
+		/* authors[1]'s kind 7 events match both filters, and are
+		 * reported once, in the order of the first filter to have them */
+		all.num = a.num = b.num = 0;
+		CHECK(query_run_all(q, overlap, 2, collect_loc, &all));
+		CHECK(query_scan(q, &overlap[0], collect_loc, &a));
+		CHECK(query_scan(q, &overlap[1], collect_loc, &b));
+		for (both = 0, i = 0; i < (size_t)b.num; i++) {
+			for (n = 0; n < a.num && a.locs[n] != b.locs[i]; n++)
+				;
+			both += n < a.num;
+		}
+		CHECK(both > 0);
+		CHECK(all.num == a.num + b.num - both);
+		CHECK(!memcmp(all.locs, a.locs, a.num * sizeof(a.locs[0])));
+		for (dups = 0, i = 0; i < (size_t)all.num; i++) {
+			for (n = i + 1; n < all.num; n++)
+				dups += all.locs[n] == all.locs[i];
+		}
+		CHECK(dups == 0);
+	}
+
+	query_close(q);
+close:
+	CHECK(store_close(s));
+out:
+	remove_store(dir);
+	arena_free(&arena);
+}
+
+/* a commitment long enough for a midstate, with the nonce digits at the
+ * end like a real event's nonce tag */
+static void make_commitment(unsigned char *buf, int len, int nonce_off)
+{
+	int i;
+
+	for (i = 0; i < len; i++)
+		buf[i] = 'a' + i % 26;
+	memset(buf + nonce_off, '0', NONCE_WIDTH);
+}
+
+static void test_mine_range_difficulty(int difficulty, int threads)
+{
+	unsigned char commitment[200], id[32], expect_id[32];
+	const int nonce_off = sizeof(commitment) - NONCE_WIDTH - 2;
+	struct mine_job job;
+	uint64_t nonce = UINT64_MAX, first;
+
+	make_commitment(commitment, sizeof(commitment), nonce_off);
+	CHECK(mine_job_init(&job, commitment, sizeof(commitment), nonce_off, difficulty));
+
+	for (first = 0; !mine_check(&job, first, expect_id); first++)
+		;
+
+	CHECK(mine_range(&job, 0, 1 << 20, threads, NULL, NULL, &nonce, id) == MINE_FOUND);
+	CHECK(mine_check(&job, nonce, expect_id));
+	CHECK(!memcmp(id, expect_id, 32));
+
+	/* one worker tries the nonces in order, so it finds the first */
+	if (threads == 1)
+		CHECK(nonce == first);
+	if (difficulty == 0)
+		CHECK(first == 0);
+}
+
+static void test_mine(void)
+{
+	test_mine_range_difficulty(0, 1);
+	test_mine_range_difficulty(1, 1);
+	test_mine_range_difficulty(0, 4);
+	test_mine_range_difficulty(1, 4);
+	test_mine_range_difficulty(8, 4);
+}
+
+/* bits of the pubkey a pattern fixes, p is 2^-bits */
+static int pattern_bits(const struct key_pattern *pat)
+{
+	double p = pat->p;
+	int bits = 0;
+
+	for (; p < 1; p *= 2)
+		bits++;
+	return p == 1 ? bits : -1;
+}
+
+/* patterns against a known pubkey and its npub, and patterns that must
+ * not compile */
+static void test_vanity(void)
+{
+	static const char *pubkey =
+		"3bf0c63fcb93463407af97a5e5ee64fa883d107ef9e558472c4eb9aaaefa459d";
+	static const char *npub =
+		"npub180cvv07tjdrrgpa0j7j7tmnyl2yr6yr7l8j4s3evf6u64th6gkwsyjh6w6";
+	static const struct {
+		const char *text;
+		int match, bits;
+	} patterns[] = {
+		{ "npub180cvv", 1, 25 },
+		{ "80cvv", 1, 25 },
+		{ "NPUB180CVV", 1, 25 },
+		{ "80CvV", 1, 25 },
+		{ "80cvw", 0, 25 },
+		{ "8?c.v", 1, 15 },
+		{ "[78]0", 1, 9 },
+		{ "[^8]", 0, -1 },
+		{ "[a-h]", 0, -1 },
+		{ "[0-9]0", 1, -1 },
+		{ "?0[c-e]", 1, -1 },
+		{ "[AC]", 0, 4 },
+		{ "80cvv07tjdrrgpa0j7j7tmnyl2yr6yr7l8j4s3evf6u64th6gkws", 1, 256 },
+		{ "80cvv07tjdrrgpa0j7j7tmnyl2yr6yr7l8j4s3evf6u64th6gkwq", 0, 256 },
+		{ "80cvv07tjdrrgpa0j7j7tmnyl2yr6yr7l8j4s3evf6u64th6gkw?", 1, 255 },
+		{ "hex:3bf0c6", 1, 24 },
+		{ "hex:3BF0C6", 1, 24 },
+		{ "hex:3bf0c7", 0, 24 },
+		{ "hex:3b?0.6", 1, 16 },
+		{ "hex:4", 0, 4 },
+		{ "hex:3bf0c63fcb93463407af97a5e5ee64fa883d107ef9e558472c4eb9aaaefa459d", 1, 256 },
+		{ "hex:3bf0c63fcb93463407af97a5e5ee64fa883d107ef9e558472c4eb9aaaefa459c", 0, 256 },
+	};
+	static const char *bad[] = {
+		"", "npub1", "hex:",
+		/* not in bech32 */
+		"1", "npub1b", "deb", "i", "O", "[ab]", "[^1]",
+		"d-v", "[c", "[h-a]",
+		/* the last character is q or s, and there are only 52 */
+		"80cvv07tjdrrgpa0j7j7tmnyl2yr6yr7l8j4s3evf6u64th6gkwp",
+		"80cvv07tjdrrgpa0j7j7tmnyl2yr6yr7l8j4s3evf6u64th6gkwsq",
+		"hex:g", "hex:12x4", "hex:0x12", "hex: 12",
+		"hex:3bf0c63fcb93463407af97a5e5ee64fa883d107ef9e558472c4eb9aaaefa459d0",
+	};
+	struct key_pattern pat;
+	unsigned char x[32];
+	char buf[128];
+	size_t i;
+
+	CHECK(hex_decode(pubkey, strlen(pubkey), x, sizeof(x)));
+	CHECK(bech32_encode(buf, sizeof(buf), "npub", x, 32) && !strcmp(buf, npub));
+
+	for (i = 0; i < sizeof(patterns) / sizeof(patterns[0]); i++) {
+		if (!key_pattern_compile(&pat, patterns[i].text)) {
+			fprintf(stderr, "vanity: '%s' did not compile\n", patterns[i].text);
+			failures++;
+			continue;
+		}
+		if (key_pattern_match(&pat, x) != patterns[i].match ||
+		    (patterns[i].bits >= 0 && pattern_bits(&pat) != patterns[i].bits)) {
+			fprintf(stderr, "vanity: '%s' matched %d with %d bits, expected %d with %d\n",
+				patterns[i].text, key_pattern_match(&pat, x), pattern_bits(&pat),
+				patterns[i].match, patterns[i].bits);
+			failures++;
+		}
+	}
+
+	for (i = 0; i < sizeof(bad) / sizeof(bad[0]); i++) {
+		if (key_pattern_compile(&pat, bad[i])) {
+			fprintf(stderr, "vanity: '%s' compiled\n", bad[i]);
+			failures++;
+		}
+	}
+}
+
+/* the nonce search of the pow tests: the first nonce that works is well
+ * past the leases the first run hands out */
+#define POW_TEST_DIFFICULTY 10
+#define POW_TEST_LEASE 64
+
+static void make_pow_event(struct nostr_event *ev, struct arena *arena)
+{
+	arena_reset(arena);
+	event_init(ev, arena);
+	memset(ev->pubkey, 0x33, 32);
+	ev->content = "leased";
+	ev->created_at = 1700000000;
+	ev->kind = 1;
+}
+
+static const char *nonce_tag(const struct nostr_event *ev)
+{
+	int i;
+
+	for (i = 0; i < ev->num_tags; i++) {
+		if (!strcmp(ev->tags[i].strs[0], "nonce"))
+			return ev->tags[i].strs[1];
+	}
+	return "";
+}
+
+struct pow_run {
+	pthread_t thread;
+	struct nostr_event *ev;
+	struct pow_opts opts;
+	int ok;
+};
+
+static void *pow_run_thread(void *data)
+{
+	struct pow_run *run = data;
+
+	run->ok = pow_mine_event(run->ev, POW_TEST_DIFFICULTY, &run->opts);
+	return NULL;
+}
+
+/* a worker driven by the test, which mines honestly but only as far as
+ * it is told to */
+struct fake_worker {
+	FILE *in;
+	int fd;
+	struct mine_job job;
+	unsigned char *commitment;
+	char line[4096];
+};
+
+static int fake_connect(struct fake_worker *w, const char *path)
+{
+	int difficulty, off, n, i;
+	size_t len;
+
+	memset(w, 0, sizeof(*w));
+	for (i = 0; i < 500 && access(path, F_OK); i++)
+		usleep(10 * 1000);
+	if ((w->fd = pow_connect(path)) < 0)
+		return 0;
+	if (!(w->in = fdopen(w->fd, "r")) || !fgets(w->line, sizeof(w->line), w->in) ||
+	    sscanf(w->line, "job %d %d %n", &difficulty, &off, &n) != 2)
+		return 0;
+	len = strcspn(w->line + n, "\n") / 2;
+	return (w->commitment = malloc(len)) &&
+	       hex_decode(w->line + n, len * 2, w->commitment, len) &&
+	       mine_job_init(&w->job, w->commitment, len, off, difficulty);
+}
+
+static int fake_lease(struct fake_worker *w, uint64_t *start, uint64_t *end)
+{
+	return fgets(w->line, sizeof(w->line), w->in) &&
+	       sscanf(w->line, "lease %" SCNu64 " %" SCNu64, start, end) == 2;
+}
+
+/* try [start, end), returns 1 with *nonce if one works */
+static int fake_mine(struct fake_worker *w, uint64_t start, uint64_t end, uint64_t *nonce)
+{
+	unsigned char id[32];
+
+	for (*nonce = start; *nonce < end; (*nonce)++) {
+		if (mine_check(&w->job, *nonce, id))
+			return 1;
+	}
+	return 0;
+}
+
+/* the coordinator hung up on us */
+static int fake_dropped(struct fake_worker *w)
+{
+	return !fgets(w->line, sizeof(w->line), w->in);
+}
+
+static void fake_close(struct fake_worker *w)
+{
+	if (w->in)
+		fclose(w->in);
+	else if (w->fd >= 0)
+		close(w->fd);
+	free(w->commitment);
+}
+
+struct range {
+	uint64_t start, end;
+};
+
+static int range_cmp(const void *a, const void *b)
+{
+	const struct range *x = a, *y = b;
+
+	return x->start < y->start ? -1 : x->start > y->start;
+}
+
+static int has_line(const char *path, const char *want)
+{
+	char line[128];
+	FILE *f;
+	int found = 0;
+
+	if (!(f = fopen(path, "r")))
+		return 0;
+	while (!found && fgets(line, sizeof(line), f))
+		found = !strcmp(line, want);
+	fclose(f);
+	return found;
+}
+
+/* A run over a socket is cut short and resumed from its checkpoint, and
+ * must find the nonce and id of a run that mines every nonce in order.
+ * Worker a stops checkpointing halfway through its lease, whose rest must
+ * go to worker b, which is interrupted halfway through its second lease.
+ * Worker c picks up from the checkpoint. The ranges each worker was the
+ * only one to try must cover the nonces up to the one found, once. */
+static void test_pow_resume(void)
+{
+	const uint64_t L = POW_TEST_LEASE;
+	char dir[] = "/tmp/test_nostril.XXXXXX", sock[64], ckpt[64], tmp[72], want[64];
+	struct nostr_event ref, ev;
+	struct arena ref_arena, arena;
+	struct fake_worker w;
+	struct pow_opts opts;
+	struct pow_run run;
+	struct range tried[64];
+	uint64_t start, end, nonce, expect;
+	int ntried = 0, found = 0, i;
+
+	if (!mkdtemp(dir)) {
+		CHECK(!"mkdtemp");
+		return;
+	}
+	snprintf(sock, sizeof(sock), "%s/pow.sock", dir);
+	snprintf(ckpt, sizeof(ckpt), "%s/pow.ckpt", dir);
+	snprintf(tmp, sizeof(tmp), "%s.tmp", ckpt);
+
+	arena_init(&ref_arena);
+	arena_init(&arena);
+
+	/* uninterrupted, one thread, the nonces in order */
+	make_pow_event(&ref, &ref_arena);
+	pow_defaults(&opts);
+	opts.threads = 1;
+	CHECK(pow_mine_event(&ref, POW_TEST_DIFFICULTY, &opts));
+	expect = strtoull(nonce_tag(&ref), NULL, 10);
+	CHECK(expect >= 3 * L);
+
+	pow_defaults(&opts);
+	opts.listen = sock;
+	opts.lease = L;
+	opts.timeout = 1;
+	opts.checkpoint = ckpt;
+
+	make_pow_event(&ev, &arena);
+	run.ev = &ev;
+	run.opts = opts;
+	CHECK(!pthread_create(&run.thread, NULL, pow_run_thread, &run));
+
+	CHECK(fake_connect(&w, sock));
+	CHECK(fake_lease(&w, &start, &end) && start == 0 && end == L);
+	CHECK(!fake_mine(&w, 0, L / 2, &nonce));
+	dprintf(w.fd, "progress %" PRIu64 " 0\n", L / 2);
+	tried[ntried++] = (struct range){ 0, L / 2 };
+	/* a goes quiet until its lease is taken back */
+	CHECK(fake_dropped(&w));
+	fake_close(&w);
+
+	CHECK(fake_connect(&w, sock));
+	CHECK(fake_lease(&w, &start, &end) && start == L / 2 && end == L);
+	CHECK(!fake_mine(&w, L / 2, L, &nonce));
+	dprintf(w.fd, "progress %" PRIu64 " 0\n", L);
+	tried[ntried++] = (struct range){ L / 2, L };
+	CHECK(fake_lease(&w, &start, &end) && start == L && end == 2 * L);
+	CHECK(!fake_mine(&w, L, L + L / 2, &nonce));
+	dprintf(w.fd, "progress %" PRIu64 " 0\n", L + L / 2);
+	tried[ntried++] = (struct range){ L, L + L / 2 };
+	/* give the coordinator time to take the checkpoint */
+	usleep(200 * 1000);
+	pthread_kill(run.thread, SIGINT);
+	pthread_join(run.thread, NULL);
+	CHECK(!run.ok);
+	CHECK(fake_dropped(&w));
+	fake_close(&w);
+
+	snprintf(want, sizeof(want), "next %" PRIu64 "\n", 2 * L);
+	CHECK(has_line(ckpt, want));
+	snprintf(want, sizeof(want), "range %" PRIu64 " %" PRIu64 "\n", L + L / 2, 2 * L);
+	CHECK(has_line(ckpt, want));
+
+	make_pow_event(&ev, &arena);
+	run.opts.resume = 1;
+	CHECK(!pthread_create(&run.thread, NULL, pow_run_thread, &run));
+
+	CHECK(fake_connect(&w, sock));
+	for (i = 0; !found && ntried < 64 && fake_lease(&w, &start, &end); i++) {
+		if (!i)
+			CHECK(start == L + L / 2 && end == 2 * L);
+		if ((found = fake_mine(&w, start, end, &nonce))) {
+			dprintf(w.fd, "found %" PRIu64 "\n", nonce);
+			tried[ntried++] = (struct range){ start, nonce + 1 };
+		} else {
+			dprintf(w.fd, "progress %" PRIu64 " 0\n", end);
+			tried[ntried++] = (struct range){ start, end };
+		}
+	}
+	pthread_join(run.thread, NULL);
+	CHECK(run.ok);
+	fake_close(&w);
+
+	CHECK(found && nonce == expect);
+	CHECK(!strcmp(nonce_tag(&ev), nonce_tag(&ref)));
+	CHECK(!memcmp(ev.id, ref.id, 32));
+	CHECK(access(ckpt, F_OK));
+
+	qsort(tried, ntried, sizeof(tried[0]), range_cmp);
+	CHECK(tried[0].start == 0);
+	for (i = 1; i < ntried; i++)
+		CHECK(tried[i].start == tried[i - 1].end);
+	CHECK(tried[ntried - 1].end == expect + 1);
+
+	unlink(ckpt);
+	unlink(tmp);
+	unlink(sock);
+	rmdir(dir);
+	arena_free(&ref_arena);
+	arena_free(&arena);
+}
+
+int main(void)
+{
+	test_sha256_vectors();
+	test_sha256_kernels();
+	test_aes_vectors();
+	test_parse_event();
+	test_store_checks();
+	test_query();
+	test_mine();
+	test_vanity();
+	test_pow_resume();
+
+	if (failures) {
+		fprintf(stderr, "%d checks failed\n", failures);
+		return 1;
+	}
+	printf("all checks passed\n");
+	return 0;
+}
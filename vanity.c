@@ -0,0 +1,213 @@
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+#include <ctype.h>
+
+#include "vanity.h"
+
+/* only the top bit of the last character is part of the key, the rest is
+ * padding and always zero, so it's either q or s */
+#define LAST_CHAR (BECH32_KEY_CHARS - 1)
+#define LAST_CHAR_VALUES (1u << 0 | 1u << 16)
+
+/* bit 0 is the most significant bit of the pubkey */
+static void set_bit(struct key_pattern *pat, int bit, int one)
+{
+	uint64_t b = 1ULL << (63 - bit % 64);
+
+	pat->mask[bit / 64] |= b;
+	if (one)
+		pat->value[bit / 64] |= b;
+	if (bit / 64 >= pat->words)
+		pat->words = bit / 64 + 1;
+}
+
+static void add_char(struct key_pattern *pat, int n, uint32_t set)
+{
+	uint32_t ones = 31, zeros = 31;
+	int v, b, count = 0, fixed = 0;
+	int bits = n == LAST_CHAR ? 1 : 5;
+
+	for (v = 0; v < 32; v++) {
+		if (!(set >> v & 1))
+			continue;
+		ones &= v;
+		zeros &= ~v;
+		count++;
+	}
+
+	/* bits that are the same in every allowed value go in the mask */
+	for (b = 0; b < bits; b++) {
+		if (!((ones | zeros) >> (4 - b) & 1))
+			continue;
+		set_bit(pat, 5 * n + b, ones >> (4 - b) & 1);
+		fixed++;
+	}
+
+	/* unless the values are every combination of the other bits, the
+	 * character needs checking on its own */
+	if (count != 1 << (bits - fixed)) {
+		pat->sets[pat->num_sets] = set;
+		pat->set_pos[pat->num_sets++] = n;
+	}
+
+	pat->p *= (double)count / (1 << bits);
+}
+
+static int bad_char(const char *text, char c)
+{
+	if (c == '1' || c == 'b' || c == 'B' || c == 'i' || c == 'I' ||
+	    c == 'o' || c == 'O')
+		fprintf(stderr, "vanity: there is no '%c' in bech32, in '%s'\n", c, text);
+	else
+		fprintf(stderr, "vanity: unexpected '%c' in '%s'\n", c, text);
+	return 0;
+}
+
+/* [abc], [a-h], [^q], after the [ */
+static const char *parse_class(const char *text, const char *s, uint32_t *set)
+{
+	int negate = 0, v;
+	char lo, hi, c;
+
+	if (*s == '^') {
+		negate = 1;
+		s++;
+	}
+
+	for (*set = 0; *s != ']'; s++) {
+		if (!*s) {
+			fprintf(stderr, "vanity: missing ']' in '%s'\n", text);
+			return NULL;
+		}
+
+		if (s[1] == '-' && s[2] && s[2] != ']') {
+			lo = tolower((unsigned char)s[0]);
+			hi = tolower((unsigned char)s[2]);
+			if (lo > hi) {
+				fprintf(stderr, "vanity: bad range '%.3s' in '%s'\n", s, text);
+				return NULL;
+			}
+			/* lo and hi are folded, and so are the letters */
+			for (c = lo; c <= hi; c++) {
+				if (!isupper((unsigned char)c) && (v = bech32_value(c)) >= 0)
+					*set |= 1u << v;
+			}
+			s += 2;
+			continue;
+		}
+
+		if ((v = bech32_value(*s)) < 0) {
+			bad_char(text, *s);
+			return NULL;
+		}
+		*set |= 1u << v;
+	}
+
+	if (negate)
+		*set = ~*set;
+
+	return s + 1;
+}
+
+/* hex:<digits>, four bits of the pubkey a digit */
+static int compile_hex(struct key_pattern *pat, const char *text, const char *s)
+{
+	int n, b, v;
+
+	for (n = 0; s[n]; n++) {
+		if (n == 64) {
+			fprintf(stderr, "vanity: '%s' is longer than a pubkey\n", text);
+			return 0;
+		}
+
+		if (s[n] == '?' || s[n] == '.')
+			continue;
+
+		if (!isxdigit((unsigned char)s[n])) {
+			fprintf(stderr, "vanity: '%c' is not a hex digit, in '%s'\n", s[n], text);
+			return 0;
+		}
+
+		v = isdigit((unsigned char)s[n]) ? s[n] - '0' : tolower((unsigned char)s[n]) - 'a' + 10;
+		for (b = 0; b < 4; b++)
+			set_bit(pat, 4 * n + b, v >> (3 - b) & 1);
+		pat->p /= 16;
+	}
+
+	if (!n) {
+		fprintf(stderr, "vanity: empty pattern\n");
+		return 0;
+	}
+
+	return 1;
+}
+
+int key_pattern_compile(struct key_pattern *pat, const char *text)
+{
+	const char *s = text;
+	uint32_t set;
+	int n, v;
+
+	memset(pat, 0, sizeof(*pat));
+	snprintf(pat->text, sizeof(pat->text), "%s", text);
+	pat->p = 1;
+
+	if (!strncasecmp(s, "hex:", 4))
+		return compile_hex(pat, text, s + 4);
+
+	if (!strncasecmp(s, "npub1", 5))
+		s += 5;
+
+	for (n = 0; *s; n++) {
+		if (n == BECH32_KEY_CHARS) {
+			fprintf(stderr, "vanity: '%s' is longer than an npub\n", text);
+			return 0;
+		}
+
+		if (*s == '?' || *s == '.') {
+			set = ~0u;
+			s++;
+		} else if (*s == '[') {
+			if (!(s = parse_class(text, s + 1, &set)))
+				return 0;
+		} else if ((v = bech32_value(*s)) >= 0) {
+			set = 1u << v;
+			s++;
+		} else {
+			return bad_char(text, *s);
+		}
+
+		if (n == LAST_CHAR)
+			set &= LAST_CHAR_VALUES;
+
+		if (!set) {
+			fprintf(stderr, "vanity: no npub matches '%s'\n", text);
+			return 0;
+		}
+
+		add_char(pat, n, set);
+	}
+
+	if (!n) {
+		fprintf(stderr, "vanity: empty pattern\n");
+		return 0;
+	}
+
+	return 1;
+}
+
+void key_pattern_zero_bits(struct key_pattern *pat, int bits)
+{
+	int i;
+
+	memset(pat, 0, sizeof(*pat));
+	bits = bits < 0 ? 0 : bits > 256 ? 256 : bits;
+	snprintf(pat->text, sizeof(pat->text), "%d leading zero bits", bits);
+
+	pat->p = 1;
+	for (i = 0; i < bits; i++) {
+		set_bit(pat, i, 0);
+		pat->p /= 2;
+	}
+}
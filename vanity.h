@@ -0,0 +1,82 @@
+#ifndef VANITY_H
+#define VANITY_H
+
+#include <stdint.h>
+
+#include "bech32.h"
+
+/* Vanity npubs.
+ *
+ * A pattern is a prefix of the data part of an npub, with or without the
+ * "npub1": bech32 characters in either case, ? or . for any character,
+ * and classes like [ac-h] or [^q]. Character n of an npub is bits
+ * 5n..5n+4 of the x-only pubkey, so a pattern compiles to a mask and value
+ * over those bits, and a candidate is checked with a few 64 bit compares
+ * instead of being bech32 encoded. Only classes whose characters don't
+ * share all their free bits, like [ac], need a per character check after
+ * the mask matched.
+ *
+ * A pattern starting with "hex:" is a prefix of the pubkey in hex
+ * instead, with ? or . for any digit. */
+
+#define VANITY_MAX_PATTERNS 16
+
+struct key_pattern {
+	/* what was asked for, for reports */
+	char text[64];
+
+	/* big endian 64 bit words of the pubkey */
+	uint64_t mask[4], value[4];
+	int words;
+
+	/* characters the mask can't express, with the 5 bit values allowed */
+	uint32_t sets[BECH32_KEY_CHARS];
+	unsigned char set_pos[BECH32_KEY_CHARS];
+	int num_sets;
+
+	/* the chance that a random pubkey matches */
+	double p;
+};
+
+/* compile an npub or hex: prefix pattern, errors are reported on stderr */
+int key_pattern_compile(struct key_pattern *pat, const char *text);
+
+/* `bits` leading zero bits, what --pow with --mine-pubkey asks for */
+void key_pattern_zero_bits(struct key_pattern *pat, int bits);
+
+/* character n of the npub data part as a 5 bit value */
+static inline int key_char(const unsigned char x[32], int n)
+{
+	int bit = 5 * n, i = bit >> 3;
+	unsigned v = x[i] << 8 | (i < 31 ? x[i + 1] : 0);
+
+	return (v >> (11 - (bit & 7))) & 31;
+}
+
+static inline uint64_t key_word(const unsigned char *p)
+{
+	return (uint64_t)p[0] << 56 | (uint64_t)p[1] << 48 |
+	       (uint64_t)p[2] << 40 | (uint64_t)p[3] << 32 |
+	       (uint64_t)p[4] << 24 | (uint64_t)p[5] << 16 |
+	       (uint64_t)p[6] << 8 | p[7];
+}
+
+static inline int key_pattern_match(const struct key_pattern *pat,
+				    const unsigned char x[32])
+{
+	int i;
+
+	for (i = 0; i < pat->words; i++) {
+		if ((key_word(x + 8 * i) & pat->mask[i]) != pat->value[i])
+			return 0;
+	}
+
+	for (i = 0; i < pat->num_sets; i++) {
+		if (!(pat->sets[i] >> key_char(x, pat->set_pos[i]) & 1))
+			return 0;
+	}
+
+	return 1;
+}
+
+#endif
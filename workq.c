@@ -0,0 +1,158 @@
+#include <stdlib.h>
+#include <pthread.h>
+
+#include "workq.h"
+
+struct workq_slot {
+	void *job;
+	int done;
+};
+
+struct workq {
+	pthread_mutex_t lock;
+	pthread_cond_t has_work;
+	pthread_cond_t has_done;
+	pthread_cond_t has_room;
+
+	workq_fn run;
+	void *data;
+
+	/* ring of jobs: [head, next) are queued or running, [head, tail)
+	 * were pushed but not popped */
+	struct workq_slot *slots;
+	int depth;
+	unsigned long head, next, tail;
+	int stop;
+
+	pthread_t *threads;
+	int nthreads;
+};
+
+static void *workq_worker(void *data)
+{
+	struct workq *q = data;
+	struct workq_slot *slot;
+
+	pthread_mutex_lock(&q->lock);
+	for (;;) {
+		while (!q->stop && q->next == q->tail)
+			pthread_cond_wait(&q->has_work, &q->lock);
+		if (q->stop)
+			break;
+
+		slot = &q->slots[q->next++ % q->depth];
+		pthread_mutex_unlock(&q->lock);
+
+		q->run(slot->job, q->data);
+
+		pthread_mutex_lock(&q->lock);
+		slot->done = 1;
+		pthread_cond_broadcast(&q->has_done);
+	}
+	pthread_mutex_unlock(&q->lock);
+
+	return NULL;
+}
+
+struct workq *workq_new(int threads, int depth, workq_fn run, void *data)
+{
+	struct workq *q;
+
+	if (!(q = calloc(1, sizeof(*q))))
+		return NULL;
+
+	q->run = run;
+	q->data = data;
+	q->depth = depth < 1 ? 1 : depth;
+
+	if (!(q->slots = calloc(q->depth, sizeof(*q->slots))) ||
+	    !(q->threads = calloc(threads, sizeof(*q->threads)))) {
+		free(q->slots);
+		free(q);
+		return NULL;
+	}
+
+	pthread_mutex_init(&q->lock, NULL);
+	pthread_cond_init(&q->has_work, NULL);
+	pthread_cond_init(&q->has_done, NULL);
+	pthread_cond_init(&q->has_room, NULL);
+
+	for (q->nthreads = 0; q->nthreads < threads; q->nthreads++) {
+		if (pthread_create(&q->threads[q->nthreads], NULL, workq_worker, q))
+			break;
+	}
+
+	if (q->nthreads == 0) {
+		workq_free(q);
+		return NULL;
+	}
+
+	return q;
+}
+
+int workq_full(struct workq *q)
+{
+	int full;
+
+	pthread_mutex_lock(&q->lock);
+	full = q->tail - q->head == (unsigned long)q->depth;
+	pthread_mutex_unlock(&q->lock);
+
+	return full;
+}
+
+void workq_push(struct workq *q, void *job)
+{
+	struct workq_slot *slot;
+
+	pthread_mutex_lock(&q->lock);
+	while (q->tail - q->head == (unsigned long)q->depth)
+		pthread_cond_wait(&q->has_room, &q->lock);
+
+	slot = &q->slots[q->tail++ % q->depth];
+	slot->job = job;
+	slot->done = 0;
+
+	pthread_cond_signal(&q->has_work);
+	pthread_mutex_unlock(&q->lock);
+}
+
+void *workq_pop(struct workq *q)
+{
+	struct workq_slot *slot;
+	void *job = NULL;
+
+	pthread_mutex_lock(&q->lock);
+	if (q->head != q->tail) {
+		slot = &q->slots[q->head % q->depth];
+		while (!slot->done)
+			pthread_cond_wait(&q->has_done, &q->lock);
+		job = slot->job;
+		q->head++;
+		pthread_cond_signal(&q->has_room);
+	}
+	pthread_mutex_unlock(&q->lock);
+
+	return job;
+}
+
+void workq_free(struct workq *q)
+{
+	int i;
+
+	pthread_mutex_lock(&q->lock);
+	q->stop = 1;
+	pthread_cond_broadcast(&q->has_work);
+	pthread_mutex_unlock(&q->lock);
+
+	for (i = 0; i < q->nthreads; i++)
+		pthread_join(q->threads[i], NULL);
+
+	pthread_mutex_destroy(&q->lock);
+	pthread_cond_destroy(&q->has_work);
+	pthread_cond_destroy(&q->has_done);
+	pthread_cond_destroy(&q->has_room);
+	free(q->threads);
+	free(q->slots);
+	free(q);
+}
@@ -0,0 +1,34 @@
+#ifndef WORKQ_H
+#define WORKQ_H
+
+/* An ordered work queue: jobs are run by a pool of threads, but are handed
+ * back by workq_pop in the order they were pushed. At most `depth` jobs are
+ * in flight, which bounds the memory used by a streaming pipeline:
+ *
+ *	while (read_job(&job)) {
+ *		if (workq_full(q))
+ *			write_job(workq_pop(q));
+ *		workq_push(q, job);
+ *	}
+ *	while ((job = workq_pop(q)))
+ *		write_job(job);
+ */
+
+struct workq;
+
+typedef void (*workq_fn)(void *job, void *data);
+
+struct workq *workq_new(int threads, int depth, workq_fn run, void *data);
+
+/* queue a job, blocks while the queue is full */
+void workq_push(struct workq *q, void *job);
+
+/* wait for the oldest job to finish and return it, NULL if none are queued */
+void *workq_pop(struct workq *q);
+
+int workq_full(struct workq *q);
+
+/* stop the workers, all jobs must have been popped */
+void workq_free(struct workq *q);
+
+#endif